@@ -0,0 +1,157 @@
+/*
+** File Name: bench.hpp
+** Author:    Aditya Ramesh
+** Date:      07/25/2014
+** Contact:   _@adityaramesh.com
+**
+** Utilities shared by the benchmarks. Each benchmark program prints its results
+** to standard output as a JSON object of the following form, so that the
+** results for different commits can be compared by a script:
+**
+**   {
+**     "benchmark": "io",
+**     "commit": "<commit passed as the first argument, if any>",
+**     "results": [{"name": "...", ...}, ...]
+**   }
+*/
+
+#ifndef ZE5A0C3B8_71D4_4F26_9B0E_C83F1A6D2E94
+#define ZE5A0C3B8_71D4_4F26_9B0E_C83F1A6D2E94
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace neo {
+namespace bench {
+
+/*
+** Returns the best of `trials` timings of `f`, in seconds.
+*/
+template <class Function>
+double best_time(unsigned trials, Function f)
+{
+	using clock = std::chrono::steady_clock;
+	using seconds = std::chrono::duration<double>;
+
+	auto best = std::numeric_limits<double>::max();
+	for (auto i = 0u; i != trials; ++i) {
+		auto t = clock::now();
+		f();
+		auto dt = std::chrono::duration_cast<seconds>(clock::now() - t);
+		best = std::min(best, dt.count());
+	}
+	return best;
+}
+
+/*
+** Returns `s` as a quoted JSON string.
+*/
+std::string quote(const std::string& s)
+{
+	static constexpr auto hex = "0123456789abcdef";
+	auto r = std::string{"\""};
+	for (auto c : s) {
+		switch (c) {
+		case '"':  r += "\\\""; break;
+		case '\\': r += "\\\\"; break;
+		case '\n': r += "\\n";  break;
+		case '\t': r += "\\t";  break;
+		default:
+			if ((unsigned char)c < 0x20) {
+				r += "\\u00";
+				r += hex[(unsigned char)c >> 4];
+				r += hex[c & 0xF];
+			}
+			else {
+				r += c;
+			}
+		}
+	}
+	return r + "\"";
+}
+
+template <class T>
+std::string to_string(const T& t)
+{
+	auto ss = std::ostringstream{};
+	ss << t;
+	return ss.str();
+}
+
+/*
+** A single result, stored as a list of key-value pairs. String values are
+** quoted and escaped when they are added; numeric values are not.
+*/
+class record
+{
+	std::vector<std::pair<std::string, std::string>> m_fields{};
+public:
+	explicit record(const std::string& name)
+	{ add("name", name); }
+
+	record& add(const std::string& key, const std::string& value)
+	{
+		m_fields.emplace_back(key, quote(value));
+		return *this;
+	}
+
+	record& add(const std::string& key, const char* value)
+	{ return add(key, std::string{value}); }
+
+	template <class T>
+	record& add(const std::string& key, const T& value)
+	{
+		m_fields.emplace_back(key, to_string(value));
+		return *this;
+	}
+
+	friend std::ostream& operator<<(std::ostream& os, const record& r)
+	{
+		os << "{";
+		for (auto i = size_t{0}; i != r.m_fields.size(); ++i) {
+			if (i != 0) { os << ", "; }
+			os << quote(r.m_fields[i].first) << ": "
+				<< r.m_fields[i].second;
+		}
+		return os << "}";
+	}
+};
+
+class report
+{
+	std::string m_name;
+	std::string m_commit;
+	std::vector<record> m_records{};
+public:
+	explicit report(const std::string& name, int argc, char** argv)
+	: m_name{name}, m_commit{argc > 1 ? argv[1] : ""} {}
+
+	report& add(const record& r)
+	{
+		m_records.push_back(r);
+		std::cerr << r << std::endl;
+		return *this;
+	}
+
+	void print(std::ostream& os = std::cout) const
+	{
+		os << "{\n  \"benchmark\": " << quote(m_name) << ",\n"
+			<< "  \"commit\": " << quote(m_commit) << ",\n"
+			<< "  \"results\": [\n";
+		for (auto i = size_t{0}; i != m_records.size(); ++i) {
+			os << "    " << m_records[i]
+				<< (i + 1 != m_records.size() ? ",\n" : "\n");
+		}
+		os << "  ]\n}" << std::endl;
+	}
+};
+
+}}
+
+#endif
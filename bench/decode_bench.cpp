@@ -0,0 +1,324 @@
+/*
+** File Name: decode_bench.cpp
+** Author:    Aditya Ramesh
+** Date:      07/25/2014
+** Contact:   _@adityaramesh.com
+**
+** Measures the throughput of `archive::scan`, `archive::scan_n`,
+** `archive::format`, `mnist::scan`, the byte order and storage order
+** conversion kernels, and the block codec on records that are already in
+** memory, so that the cost of decoding can be tracked separately from the cost
+** of IO.
+*/
+
+#include <algorithm>
+#include <tuple>
+#include <utility>
+#include <type_traits>
+#include <vector>
+#include <neo/io/archive.hpp>
+#include <neo/io/mnist.hpp>
+#include "bench.hpp"
+
+static constexpr auto records = 20000;
+static constexpr auto trials = 5;
+static constexpr auto batch_size = 512;
+
+template <size_t I = 0, class Tuple, class Function>
+typename std::enable_if<I == std::tuple_size<Tuple>::value>::type
+for_each(Tuple&, Function&) {}
+
+template <size_t I = 0, class Tuple, class Function>
+typename std::enable_if<(I < std::tuple_size<Tuple>::value)>::type
+for_each(Tuple& t, Function& f)
+{
+	f(std::get<I>(t));
+	for_each<I + 1>(t, f);
+}
+
+struct filler
+{
+	template <class T>
+	typename std::enable_if<std::is_arithmetic<T>::value>::type
+	operator()(T& t) { t = 1; }
+
+	template <class Derived>
+	void operator()(Eigen::DenseBase<Derived>& t) { t.setConstant(1); }
+};
+
+/*
+** Sums the components of each record, so that the compiler cannot discard the
+** work done by `scan`.
+*/
+struct summer
+{
+	double sum;
+
+	template <class T>
+	typename std::enable_if<std::is_arithmetic<T>::value>::type
+	operator()(T& t) { sum += t; }
+
+	template <class Derived>
+	void operator()(Eigen::DenseBase<Derived>& t)
+	{ sum += t.template cast<double>().sum(); }
+};
+
+template <class SerializedType>
+void bench_archive(neo::bench::report& rep, const char* name)
+{
+	namespace archive = neo::archive;
+	using neo::bench::record;
+	using value_type = archive::eigen_type<SerializedType>;
+
+	auto wis = archive::io_state<SerializedType>{};
+	auto es = archive::error_state{};
+	auto bs = archive::make_buffer_state<SerializedType>();
+	wis.element_count(records);
+
+	auto hdr = archive::header_size<SerializedType>::value;
+	auto elem = archive::element_size<SerializedType>::value;
+	auto buf = std::vector<uint8_t>(hdr + records * elem);
+	archive::write_header(buf.data(), buf.size(), wis, bs, es);
+
+	auto v = value_type{};
+	auto f = filler{};
+	for_each(v, f);
+
+	auto fmt = neo::bench::best_time(trials, [&] {
+		for (auto i = 0; i != records; ++i) {
+			archive::format(v, buf.data() + hdr + i * elem, elem,
+				wis, bs, es);
+		}
+	});
+	rep.add(record{"archive format"}.add("type", name)
+		.add("record_size", elem)
+		.add("records_per_second", records / fmt)
+		.add("mb_per_second", records * elem / fmt / 1e6));
+
+	auto ris = archive::io_state<SerializedType>{};
+	archive::read_header(buf.data(), buf.size(), ris, bs, es);
+
+	auto sum = summer{0};
+	auto scan = neo::bench::best_time(trials, [&] {
+		for (auto i = 0; i != records; ++i) {
+			archive::scan(buf.data() + hdr + i * elem, elem, ris,
+				bs, es);
+			for_each(ris.element(), sum);
+		}
+	});
+	rep.add(record{"archive scan"}.add("type", name)
+		.add("record_size", elem)
+		.add("records_per_second", records / scan)
+		.add("mb_per_second", records * elem / scan / 1e6)
+		.add("checksum", sum.sum));
+
+	auto bsum = summer{0};
+	auto batch = neo::bench::best_time(trials, [&] {
+		for (auto i = 0; i < records; i += batch_size) {
+			auto n = std::min(batch_size, records - i);
+			archive::scan_n(buf.data() + hdr + i * elem, n * elem, n,
+				ris, bs, es);
+			for_each(ris.batch(), bsum);
+		}
+	});
+	rep.add(record{"archive scan_n"}.add("type", name)
+		.add("record_size", elem)
+		.add("batch_size", batch_size)
+		.add("records_per_second", records / batch)
+		.add("mb_per_second", records * elem / batch / 1e6)
+		.add("checksum", bsum.sum));
+
+	/*
+	** The timings above include the cost of summing the components, since
+	** in the native byte order, `scan` and `scan_n` only construct views,
+	** and the compiler would otherwise discard the loops. The timings below
+	** exclude it, and reverse the byte order of the records, so that the
+	** decoders do real work. The records are flipped back and forth across
+	** trials, which does not affect the timings.
+	*/
+	ris.flip_integers(true).flip_floats(true);
+	auto t1 = neo::bench::best_time(trials, [&] {
+		for (auto i = 0; i != records; ++i) {
+			archive::scan(buf.data() + hdr + i * elem, elem, ris,
+				bs, es);
+		}
+	});
+	auto t2 = neo::bench::best_time(trials, [&] {
+		for (auto i = 0; i < records; i += batch_size) {
+			auto n = std::min(batch_size, records - i);
+			archive::scan_n(buf.data() + hdr + i * elem, n * elem, n,
+				ris, bs, es);
+		}
+	});
+	rep.add(record{"archive decode"}.add("type", name)
+		.add("byte_order", "foreign")
+		.add("record_size", elem)
+		.add("batch_size", batch_size)
+		.add("scan_records_per_second", records / t1)
+		.add("scan_n_records_per_second", records / t2));
+}
+
+void bench_mnist(neo::bench::report& rep)
+{
+	namespace mnist = neo::mnist;
+	using neo::bench::record;
+
+	auto is = mnist::image_io_state{};
+	auto es = mnist::error_state{};
+	auto bs = mnist::make_image_buffer_state();
+	auto elem = is.element_size();
+	auto buf = std::vector<uint8_t>(records * elem, 1);
+
+	auto sum = 0u;
+	auto t = neo::bench::best_time(trials, [&] {
+		for (auto i = 0; i != records; ++i) {
+			mnist::scan(buf.data() + i * elem, elem, is, bs, es);
+			sum += is.element()(0, 0);
+		}
+	});
+	rep.add(record{"mnist scan"}.add("record_size", elem)
+		.add("records_per_second", records / t)
+		.add("mb_per_second", records * elem / t / 1e6)
+		.add("checksum", sum));
+}
+
+/*
+** Measures the throughput of the kernels used to reverse the byte order of
+** archives written on machines with the opposite byte order.
+*/
+void bench_bswap(neo::bench::report& rep)
+{
+	using neo::bench::record;
+	static constexpr auto bytes = size_t{64 * 1024 * 1024};
+	auto buf = std::vector<uint8_t>(bytes, 1);
+
+	for (auto size : {2, 4, 8}) {
+		auto t = neo::bench::best_time(trials, [&] {
+			neo::archive::bswap_n(buf.data(), bytes / size, size);
+		});
+		rep.add(record{"bswap"}.add("scalar_size", size)
+			.add("gb_per_second", bytes / t / 1e9));
+	}
+}
+
+/*
+** Measures the throughput of the kernels used to convert matrices between
+** storage orders.
+*/
+void bench_transpose(neo::bench::report& rep)
+{
+	using neo::bench::record;
+	auto shapes = {std::make_pair(1024, 1024), std::make_pair(768, 1280)};
+
+	for (auto s : shapes) {
+		auto n = size_t(s.first * s.second);
+		auto a = std::vector<float>(n, 1);
+		auto b = std::vector<float>(n);
+
+		auto t1 = neo::bench::best_time(trials, [&] {
+			neo::archive::transpose(a.data(), b.data(), s.first,
+				s.second);
+		});
+		auto t2 = neo::bench::best_time(trials, [&] {
+			neo::archive::transpose_in_place(a.data(), s.first,
+				s.second);
+		});
+		rep.add(record{"transpose"}.add("rows", s.first)
+			.add("cols", s.second)
+			.add("gb_per_second", n * sizeof(float) / t1 / 1e9)
+			.add("in_place_gb_per_second",
+				n * sizeof(float) / t2 / 1e9));
+	}
+}
+
+/*
+** Measures the compression ratio and throughput of the block codec on sparse
+** float features, as well as the throughput of decompressing many blocks in
+** parallel.
+*/
+void bench_blocks(neo::bench::report& rep)
+{
+	namespace archive = neo::archive;
+	using neo::bench::record;
+	using input_type = std::tuple<float, archive::vector<float, 784>>;
+	static constexpr auto per_block = 256;
+	static constexpr auto blocks = records / per_block;
+
+	auto is = archive::io_state<input_type>{};
+	auto es = archive::error_state{};
+	auto bs = archive::make_buffer_state<input_type>();
+	is.flip_integers(false).flip_floats(false);
+	auto elem = is.element_size();
+	auto n = per_block * elem;
+
+	/*
+	** Mimics MNIST-like images: most pixels are zero, and the rest are
+	** random multiples of 1 / 255.
+	*/
+	auto raw = std::vector<uint8_t>(n);
+	auto v = archive::eigen_type<archive::vector<float, 784>>{};
+	auto x = uint32_t{1};
+	for (auto k = 0; k != per_block; ++k) {
+		for (auto i = 0; i != v.size(); ++i) {
+			x = x * 1664525 + 1013904223;
+			v(i) = (x >> 28) < 5 ? float(x >> 24) / 255 : 0;
+		}
+		archive::format(std::make_tuple(float(k % 10), v),
+			raw.data() + k * elem, elem, is, bs, es);
+	}
+
+	auto f = archive::default_block_format<input_type>(per_block);
+	auto z = std::vector<uint8_t>(archive::max_frame_size(n));
+	auto t1 = neo::bench::best_time(trials, [&] {
+		archive::compress_block(raw.data(), n, z.data(), z.size(), f,
+			is, bs, es);
+	});
+	auto stored = bs.consumed();
+
+	auto out = std::vector<uint8_t>(blocks * n);
+	auto t2 = neo::bench::best_time(trials, [&] {
+		archive::decompress_block(z.data(), stored, out.data(), n, f,
+			is, bs, es);
+	});
+
+	auto src = std::vector<const uint8_t*>(blocks, z.data());
+	auto dst = std::vector<uint8_t*>(blocks);
+	auto sizes = std::vector<size_t>(blocks, stored);
+	auto caps = std::vector<size_t>(blocks, n);
+	for (auto i = 0; i != blocks; ++i) {
+		dst[i] = out.data() + i * n;
+	}
+	auto t3 = neo::bench::best_time(trials, [&] {
+		archive::decompress_blocks(src.data(), sizes.data(), dst.data(),
+			caps.data(), blocks, f, is, es);
+	});
+
+	rep.add(record{"block codec"}.add("block_size", n)
+		.add("ratio", double(n) / stored)
+		.add("compress_gb_per_second", n / t1 / 1e9)
+		.add("decompress_gb_per_second", n / t2 / 1e9)
+		.add("parallel_decompress_gb_per_second",
+			blocks * n / t3 / 1e9));
+}
+
+int main(int argc, char** argv)
+{
+	namespace archive = neo::archive;
+	using archive::storage_order;
+
+	auto rep = neo::bench::report{"decode", argc, argv};
+
+	bench_archive<std::tuple<float, archive::vector<float, 784>>>(
+		rep, "float, vector<float, 784>");
+	bench_archive<std::tuple<archive::matrix<double, 32, 32,
+		storage_order::row_major>>>(rep, "matrix<double, 32, 32>");
+	bench_archive<std::tuple<archive::matrix<int16_t, 64, 48,
+		storage_order::column_major>, int32_t>>(
+		rep, "matrix<int16_t, 64, 48, column_major>, int32_t");
+	bench_mnist(rep);
+	bench_bswap(rep);
+	bench_transpose(rep);
+	bench_blocks(rep);
+
+	rep.print();
+}
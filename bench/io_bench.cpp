@@ -0,0 +1,119 @@
+/*
+** File Name: io_bench.cpp
+** Author:    Aditya Ramesh
+** Date:      07/25/2014
+** Contact:   _@adityaramesh.com
+**
+** Measures sequential and random reads and writes for each IO method and a
+** range of buffer sizes, using a scratch file in `out/bench`. The size of the
+** scratch file can be changed using the `NEO_BENCH_FILE_SIZE` environment
+** variable (in bytes).
+*/
+
+#include <cstdlib>
+#include <random>
+#include <neo/core/file.hpp>
+#include "bench.hpp"
+
+int main(int argc, char** argv)
+{
+	namespace file = neo::file;
+	using neo::access_mode;
+	using neo::io_method;
+	using neo::bench::record;
+
+	auto path = "out/bench/scratch.tmp";
+	auto rep = neo::bench::report{"io", argc, argv};
+
+	auto o = file::calibration_options{};
+	o.file_size = 256 * 1024 * 1024;
+	o.max_requests = 8192;
+	o.trials = 3;
+	if (auto fs = std::getenv("NEO_BENCH_FILE_SIZE")) {
+		o.file_size = std::atoll(fs);
+	}
+
+	auto methods = std::vector<io_method>{
+		io_method::buffer | io_method::paging,
+		io_method::buffer | io_method::direct,
+		io_method::mmap   | io_method::paging,
+	};
+	#ifdef NEO_HAS_IO_URING
+		methods.push_back(io_method::uring | io_method::paging);
+		methods.push_back(io_method::uring | io_method::direct);
+	#endif
+
+	auto sizes = std::vector<size_t>{};
+	for (auto n = size_t{4096}; n <= 16 * 1024 * 1024; n *= 4) {
+		sizes.push_back(n);
+	}
+
+	/*
+	** Create the scratch file once, so that its block size is known.
+	*/
+	{
+		auto g = std::mt19937{o.seed};
+		auto r = file::detail::time_writes(path,
+			io_method::buffer | io_method::paging, 1024 * 1024, 4096,
+			access_mode::sequential, o, g);
+		if (!r) {
+			std::cerr << "Failed to create the scratch file." << std::endl;
+			return EXIT_FAILURE;
+		}
+	}
+	auto blksize = (size_t)file::safe_stat(path).get().st_blksize;
+
+	for (auto m : {access_mode::sequential, access_mode::random}) {
+		auto access = m == access_mode::sequential ? "sequential" : "random";
+
+		for (auto mtd : methods) {
+			for (auto n : sizes) {
+				if (n < blksize) { continue; }
+				auto g = std::mt19937{o.seed};
+
+				for (auto op : {"write", "read"}) {
+					auto best = std::numeric_limits<double>::max();
+					auto error = std::string{};
+
+					for (auto i = 0u; i != o.trials; ++i) {
+						auto r = op[0] == 'w' ?
+							file::detail::time_writes(path,
+								mtd, n, blksize, m, o, g) :
+							file::detail::time_reads(path,
+								mtd, n, blksize, m, o, g);
+						if (!r) {
+							try { r.get(); }
+							catch (const std::exception& e) {
+								error = e.what();
+							}
+							break;
+						}
+						best = std::min(best, *r);
+					}
+
+					auto bytes = m == access_mode::sequential ?
+						(size_t)o.file_size :
+						std::min((size_t)o.file_size / n,
+							o.max_requests) * n;
+
+					auto rec = record{op};
+					rec.add("access", access)
+						.add("method", neo::bench::to_string(mtd))
+						.add("buffer_size", n);
+					if (!error.empty()) {
+						rec.add("error", error);
+					}
+					else {
+						rec.add("seconds", best)
+							.add("mb_per_second",
+								bytes / best / 1e6);
+					}
+					rep.add(rec);
+				}
+			}
+		}
+	}
+
+	::unlink(path);
+	rep.print();
+}
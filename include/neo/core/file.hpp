@@ -9,6 +9,11 @@
 #define Z1F24AE62_20B4_470B_880E_F37CA7FCCF7A
 
 #include <neo/core/file/allocate.hpp>
+#include <neo/core/file/batch.hpp>
+#include <neo/core/file/calibrate.hpp>
+#include <neo/core/file/copy.hpp>
 #include <neo/core/file/io.hpp>
+#include <neo/core/file/prefetching_reader.hpp>
+#include <neo/core/file/window_reader.hpp>
 
 #endif
@@ -14,6 +14,7 @@
 #include <limits>
 #include <type_traits>
 #include <neo/core/file/buffer.hpp>
+#include <neo/core/file/buffer_pool.hpp>
 #include <neo/core/file/handle.hpp>
 #include <neo/core/file/strategy.hpp>
 
@@ -35,6 +36,7 @@ allocate_ibuffer(
 	assert(bc.satisfies(s.required_constraints(io_mode::input)));
 
 	if (!!(*s.read_method() & io_method::mmap)) {
+		assert(!s.map_window() && "Use `window_reader` instead.");
 		return buffer<IOMode>{h.map(), (size_t)*s.current_file_size()};
 	}
 	else {
@@ -52,6 +54,34 @@ allocate_ibuffer(const handle<IOMode>& h, const strategy<IOMode>& s)
 	return allocate_ibuffer(h, s, s.preferred_constraints(io_mode::input));
 }
 
+/*
+** Like the above, except that the memory for the buffer is obtained from the
+** given pool rather than the system allocator.
+*/
+template <
+	io_mode IOMode,
+	typename std::enable_if<!!(IOMode & io_mode::input), int>::type = 0
+>
+buffer<IOMode>
+allocate_ibuffer(
+	const handle<IOMode>& h,
+	const strategy<IOMode>& s,
+	const buffer_constraints& bc,
+	buffer_pool& p
+)
+{
+	assert(s.read_method());
+	assert(bc.satisfies(s.required_constraints(io_mode::input)));
+
+	if (!!(*s.read_method() & io_method::mmap)) {
+		assert(!s.map_window() && "Use `window_reader` instead.");
+		return buffer<IOMode>{h.map(), (size_t)*s.current_file_size()};
+	}
+	else {
+		return p.allocate<IOMode>(bc);
+	}
+}
+
 template <
 	io_mode IOMode,
 	typename std::enable_if<!!(IOMode & io_mode::output), int>::type = 0
@@ -66,7 +96,7 @@ allocate_obuffer(
 	assert(s.write_method());
 	assert(bc.satisfies(s.required_constraints(io_mode::output)));
 
-	if (!!(*s.write_method() == io_method::mmap)) {
+	if (!!(*s.write_method() & io_method::mmap)) {
 		return buffer<IOMode>{h.map(), (size_t)*s.maximum_file_size()};
 	}
 	else {
@@ -84,6 +114,29 @@ allocate_obuffer(const handle<IOMode>& h, const strategy<IOMode>& s)
 	return allocate_obuffer(h, s, s.preferred_constraints(io_mode::output));
 }
 
+template <
+	io_mode IOMode,
+	typename std::enable_if<!!(IOMode & io_mode::output), int>::type = 0
+>
+buffer<IOMode>
+allocate_obuffer(
+	const handle<IOMode>& h,
+	const strategy<IOMode>& s,
+	const buffer_constraints& bc,
+	buffer_pool& p
+)
+{
+	assert(s.write_method());
+	assert(bc.satisfies(s.required_constraints(io_mode::output)));
+
+	if (!!(*s.write_method() & io_method::mmap)) {
+		return buffer<IOMode>{h.map(), (size_t)*s.maximum_file_size()};
+	}
+	else {
+		return p.allocate<IOMode>(bc);
+	}
+}
+
 buffer<io_mode::input | io_mode::output>
 allocate_iobuffer(
 	const handle<io_mode::input | io_mode::output>& h,
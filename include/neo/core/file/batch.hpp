@@ -0,0 +1,311 @@
+/*
+** File Name: batch.hpp
+** Author:    Aditya Ramesh
+** Date:      07/23/2014
+** Contact:   _@adityaramesh.com
+**
+** This file defines functions that read or write a batch of extents using as
+** few system calls as possible. The extents are sorted by offset, and runs of
+** extents that are adjacent (or, for reads, separated by gaps no larger than a
+** given threshold) are coalesced into a single `preadv` or `pwritev` call. The
+** bytes that lie in the gaps are read into a scratch buffer and discarded.
+**
+** This is intended for reading random minibatches of records from a large
+** file: a batch of a few hundred records that are close together costs only a
+** handful of system calls.
+**
+** When the read method uses direct IO, each run is instead widened to the
+** enclosing block-aligned extent and read into an aligned scratch buffer, from
+** which the extents are copied out. Runs are limited to `direct_chunk_size`
+** bytes in this case. Writes using direct IO are handled similarly: each run
+** of adjacent extents is gathered into a single buffer and written using a
+** read-modify-write of its partial edge blocks.
+*/
+
+#ifndef Z9A2C64E1_5B7D_4F38_8E0C_31D6B4A7F295
+#define Z9A2C64E1_5B7D_4F38_8E0C_31D6B4A7F295
+
+#include <algorithm>
+#include <climits>
+#include <numeric>
+#include <type_traits>
+#include <vector>
+#include <neo/core/file/buffer.hpp>
+#include <neo/core/file/handle.hpp>
+#include <neo/core/file/io.hpp>
+#include <neo/core/file/strategy.hpp>
+#include <neo/core/file/system.hpp>
+
+namespace neo {
+namespace file {
+
+struct extent
+{
+	off_t offset;
+	size_t size;
+};
+
+namespace detail {
+
+#ifdef IOV_MAX
+	static constexpr auto max_iovecs = IOV_MAX;
+#else
+	static constexpr auto max_iovecs = 1024;
+#endif
+
+/*
+** Returns the indices of the extents, sorted by offset.
+*/
+std::vector<size_t>& sorted_extents(const extent* e, size_t n)
+{
+	static thread_local std::vector<size_t> idx;
+	idx.resize(n);
+	std::iota(idx.begin(), idx.end(), size_t{0});
+	std::sort(idx.begin(), idx.end(), [&] (size_t i, size_t j) {
+		return e[i].offset < e[j].offset;
+	});
+	return idx;
+}
+
+/*
+** Walks the sorted extents, and calls `f(offset, iov, count)` once for each
+** run of extents that can be transferred using a single vectored call.
+** Extents in the same run may be separated by at most `max_gap` bytes, and
+** the gaps are mapped to `sink`.
+*/
+template <class Function>
+cc::expected<size_t>
+for_each_run(
+	const extent* e, uint8_t* const* p, size_t n,
+	size_t max_gap, uint8_t* sink,
+	Function f
+)
+{
+	static thread_local std::vector<iovec> iov;
+	auto& idx = sorted_extents(e, n);
+	auto calls = size_t{0};
+	auto i = size_t{0};
+
+	while (i != n) {
+		auto first = off_t{0};
+		auto end = off_t{0};
+		iov.clear();
+
+		for (; i != n; ++i) {
+			auto& x = e[idx[i]];
+			if (x.size == 0) { continue; }
+			if (iov.empty()) { first = end = x.offset; }
+
+			auto gap = x.offset - end;
+			if (x.offset < end || (size_t)gap > max_gap) { break; }
+			if (iov.size() + 2 > (size_t)max_iovecs) { break; }
+
+			if (gap > 0) {
+				iov.push_back(iovec{sink, (size_t)gap});
+			}
+			iov.push_back(iovec{p[idx[i]], x.size});
+			end = x.offset + x.size;
+		}
+
+		if (iov.empty()) { continue; }
+		auto r = f(first, iov.data(), (int)iov.size());
+		if (!r) { return r.exception(); }
+		++calls;
+	}
+	return calls;
+}
+
+/*
+** Reads the extents using block-aligned transfers through a scratch buffer,
+** for use with direct IO. Runs are formed as in `for_each_run`, except that
+** extents may overlap.
+*/
+template <io_mode IOMode>
+cc::expected<size_t>
+bounce_read_batch(
+	const handle<IOMode>& h, const extent* e, uint8_t* const* dst,
+	size_t n, size_t max_gap, size_t align
+)
+{
+	auto& idx = sorted_extents(e, n);
+	auto a = (off_t)align;
+	auto limit = (off_t)std::max(align, direct_chunk_size / align * align);
+	auto calls = size_t{0};
+	auto i = size_t{0};
+
+	while (i != n && e[idx[i]].size == 0) { ++i; }
+	while (i != n) {
+		auto j = i;
+		auto first = e[idx[i]].offset;
+		auto end = first;
+
+		for (; j != n; ++j) {
+			auto& x = e[idx[j]];
+			if (x.size == 0) { continue; }
+
+			auto stop = std::max(end, x.offset + (off_t)x.size);
+			if (j != i && (size_t)std::max(off_t{0}, x.offset - end) >
+				max_gap) { break; }
+			if (j != i && stop - (first - first % a) > limit) { break; }
+			end = stop;
+		}
+
+		auto base = first - first % a;
+		auto last = (end + a - 1) / a * a;
+		auto b = direct_scratch(last - base, align);
+		auto r = raw_read(h, b.data(), last - base, base);
+		if (!r) { return r.exception(); }
+		++calls;
+
+		for (; i != j; ++i) {
+			auto& x = e[idx[i]];
+			if (x.size == 0) { continue; }
+			std::copy_n(b.data() + (x.offset - base), x.size, dst[idx[i]]);
+		}
+		while (i != n && e[idx[i]].size == 0) { ++i; }
+	}
+	return calls;
+}
+
+/*
+** Writes the extents using block-aligned transfers, for use with direct IO.
+** Each run of adjacent extents is gathered into a contiguous buffer, and then
+** written using `bounce_write`.
+*/
+template <io_mode IOMode>
+cc::expected<size_t>
+bounce_write_batch(
+	const handle<IOMode>& h, const extent* e, const uint8_t* const* src,
+	size_t n, size_t align
+)
+{
+	static thread_local std::vector<uint8_t> run;
+
+	return for_each_run(e, (uint8_t* const*)src, n, 0, nullptr,
+		[&] (off_t off, iovec* iov, int cnt) -> cc::expected<void> {
+			run.clear();
+			for (auto k = 0; k != cnt; ++k) {
+				auto p = (const uint8_t*)iov[k].iov_base;
+				run.insert(run.end(), p, p + iov[k].iov_len);
+			}
+			return bounce_write(h, off, run.size(), run.data(), align);
+		});
+}
+
+}
+
+/*
+** Reads each extent `e[i]` of the file into the memory pointed to by `dst[i]`.
+** Extents separated by at most `max_gap` bytes are read using the same system
+** call. Returns the number of system calls that were made.
+*/
+template <
+	io_mode IOMode,
+	typename std::enable_if<!!(IOMode & io_mode::input), int>::type = 0
+>
+cc::expected<size_t>
+read_batch(
+	const handle<IOMode>& h,
+	const extent* e,
+	uint8_t* const* dst,
+	size_t n,
+	const strategy<IOMode>& s,
+	size_t max_gap = 64 * 1024
+) noexcept
+{
+	assert(s.read_method());
+
+	if (!!(*s.read_method() & io_method::mmap) && h.mapped()) {
+		for (auto i = size_t{0}; i != n; ++i) {
+			std::copy_n(h.map() + e[i].offset, e[i].size, dst[i]);
+		}
+		return size_t{0};
+	}
+
+	if (detail::needs_direct_alignment(s.read_method())) {
+		return detail::bounce_read_batch(h, e, dst, n, max_gap,
+			detail::direct_alignment(s));
+	}
+
+	static thread_local std::vector<uint8_t> sink;
+	sink.resize(std::max(sink.size(), max_gap));
+
+	return detail::for_each_run(e, dst, n, max_gap, sink.data(),
+		[&] (off_t off, iovec* iov, int cnt) {
+			return full_readv(h.descriptor(), iov, cnt, off);
+		});
+}
+
+/*
+** Reads a batch of extents into consecutive regions of the given buffer, in
+** the order in which the extents are listed.
+*/
+template <
+	io_mode IOMode,
+	typename std::enable_if<!!(IOMode & io_mode::input), int>::type = 0
+>
+cc::expected<size_t>
+read_batch(
+	const handle<IOMode>& h,
+	const extent* e,
+	size_t n,
+	buffer<IOMode>& b,
+	const strategy<IOMode>& s,
+	size_t max_gap = 64 * 1024
+) noexcept
+{
+	assert(b.writable());
+	static thread_local std::vector<uint8_t*> dst;
+	dst.resize(n);
+
+	auto p = b.data();
+	for (auto i = size_t{0}; i != n; ++i) {
+		dst[i] = p;
+		p += e[i].size;
+	}
+	assert(p <= b.data() + b.size());
+	return read_batch(h, e, dst.data(), n, s, max_gap);
+}
+
+/*
+** Writes the memory pointed to by `src[i]` to each extent `e[i]` of the file.
+** Only adjacent extents can be coalesced, since the contents of the file in
+** the gaps must not be overwritten. Returns the number of system calls that
+** were made; under direct IO, this is the number of coalesced runs.
+*/
+template <
+	io_mode IOMode,
+	typename std::enable_if<!!(IOMode & io_mode::output), int>::type = 0
+>
+cc::expected<size_t>
+write_batch(
+	const handle<IOMode>& h,
+	const extent* e,
+	const uint8_t* const* src,
+	size_t n,
+	const strategy<IOMode>& s
+) noexcept
+{
+	assert(s.write_method());
+
+	if (!!(*s.write_method() & io_method::mmap)) {
+		for (auto i = size_t{0}; i != n; ++i) {
+			std::copy_n(src[i], e[i].size, h.map() + e[i].offset);
+		}
+		return size_t{0};
+	}
+
+	if (detail::needs_direct_alignment(s.write_method())) {
+		return detail::bounce_write_batch(h, e, src, n,
+			detail::direct_alignment(s));
+	}
+
+	return detail::for_each_run(e, (uint8_t* const*)src, n, 0, nullptr,
+		[&] (off_t off, iovec* iov, int cnt) {
+			return full_writev(h.descriptor(), iov, cnt, off);
+		});
+}
+
+}}
+
+#endif
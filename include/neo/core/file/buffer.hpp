@@ -12,6 +12,7 @@
 #ifndef Z6BA46DF5_A643_4FA2_9445_FBBADE3471B9
 #define Z6BA46DF5_A643_4FA2_9445_FBBADE3471B9
 
+#include <algorithm>
 #include <cstdint>
 #include <cstdlib>
 #include <memory>
@@ -23,13 +24,31 @@
 namespace neo {
 namespace file {
 
+class buffer_pool;
+
+/*
+** The size of a transparent huge page on x86-64 and on ARM64 with 4KB pages.
+*/
+static constexpr auto huge_page_size = size_t{2 * 1024 * 1024};
+
+namespace detail {
+
+class pool_core;
+using pool_release =
+	void (*)(const std::shared_ptr<pool_core>&, uint8_t*, size_t);
+
+}
+
 template <io_mode IOMode>
 class buffer
 {
+	friend class buffer_pool;
+
 	enum source
 	{
 		memalign,
 		allocator,
+		pooled,
 		mmap_read_only,
 		mmap_write_only,
 		mmap_read_write
@@ -39,6 +58,20 @@ class buffer
 	size_t m_size{};
 	off_t m_off{};
 	source m_src;
+
+	/*
+	** Used to return the memory to the pool from which it was obtained,
+	** iff `m_src == pooled`.
+	*/
+	std::shared_ptr<detail::pool_core> m_pool{};
+	detail::pool_release m_release{};
+
+	explicit buffer(
+		std::shared_ptr<detail::pool_core> pool,
+		detail::pool_release release,
+		uint8_t* buf, size_t size
+	) noexcept : m_buf{buf}, m_size{size}, m_src{pooled},
+	m_pool{std::move(pool)}, m_release{release} {}
 public:
 	/*
 	** Creates a buffer whose contents are backed by a mapped file.
@@ -69,28 +102,26 @@ public:
 	buffer(const buffer&) = delete;
 
 	buffer(buffer&& rhs) noexcept :
-	m_buf{rhs.m_buf}, m_size{rhs.m_size}, m_off{rhs.m_off}, m_src{rhs.m_src}
+	m_buf{rhs.m_buf}, m_size{rhs.m_size}, m_off{rhs.m_off}, m_src{rhs.m_src},
+	m_pool{std::move(rhs.m_pool)}, m_release{rhs.m_release}
 	{ rhs.m_buf = nullptr; }
 
 	buffer& operator=(const buffer&) = delete;
 
 	buffer& operator=(buffer&& rhs) noexcept
 	{
-		this->~buffer();
+		release();
 		m_buf = rhs.m_buf;
 		m_size = rhs.m_size;
 		m_off = rhs.m_off;
 		m_src = rhs.m_src;
+		m_pool = std::move(rhs.m_pool);
+		m_release = rhs.m_release;
+		rhs.m_buf = nullptr;
 		return *this;
 	}
 
-	~buffer()
-	{
-		switch (m_src) {
-		case memalign:  std::free(m_buf); break;
-		case allocator: delete[] m_buf;   break;
-		}
-	}
+	~buffer() { release(); }
 
 	decltype(m_buf) data() const { return m_buf + m_off; }
 	bool readable() const { return m_src != mmap_write_only; }
@@ -108,6 +139,8 @@ public:
 		return m_buf;
 	}
 
+	bool pooled_memory() const { return m_src == pooled; }
+
 	bool mapped() const
 	{
 		return m_src == mmap_read_only ||
@@ -124,7 +157,7 @@ public:
 	buffer& resize(const buffer_constraints& bc)
 	{
 		assert(!mapped());
-		this->~buffer();
+		release();
 		resize_helper(bc);
 		return *this;
 	}
@@ -136,11 +169,48 @@ public:
 		return *this;
 	}
 private:
+	/*
+	** Frees the memory owned by the buffer, or returns it to its pool.
+	** The buffer may be reused afterwards.
+	*/
+	void release() noexcept
+	{
+		switch (m_src) {
+		case memalign:  std::free(m_buf); break;
+		case allocator: delete[] m_buf;   break;
+		case pooled:
+			if (m_buf != nullptr) {
+				m_release(m_pool, m_buf, m_size);
+			}
+			m_pool.reset();
+			break;
+		}
+		m_buf = nullptr;
+	}
+
 	void resize_helper(const buffer_constraints& bc)
 	{
 		auto s = min_size(bc);
 		m_size = s ? *s : ::getpagesize();
 
+		/*
+		** Large buffers are aligned to the huge page size, so that the
+		** kernel can back them with transparent huge pages.
+		*/
+		#ifdef MADV_HUGEPAGE
+			if (m_size >= huge_page_size) {
+				auto align = bc.align_to() ? std::max(*bc.align_to(),
+					huge_page_size) : huge_page_size;
+				m_src = memalign;
+				auto r = ::posix_memalign((void**)&m_buf, align, m_size);
+				if (r != 0) {
+					throw std::system_error{r, std::system_category()};
+				}
+				::madvise(m_buf, m_size, MADV_HUGEPAGE);
+				return;
+			}
+		#endif
+
 		if (bc.align_to()) {
 			m_src = memalign;
 			auto r = ::posix_memalign((void**)&m_buf, *bc.align_to(), m_size);
@@ -0,0 +1,314 @@
+/*
+** File Name: buffer_pool.hpp
+** Author:    Aditya Ramesh
+** Date:      07/24/2014
+** Contact:   _@adityaramesh.com
+**
+** The `buffer_pool` class recycles the memory used by `file::buffer` objects,
+** so that workloads that repeatedly create and destroy buffers (e.g. one per
+** file or per minibatch) do not pay for `posix_memalign`, `free`, and the
+** associated page faults in the steady state.
+**
+** Buffer sizes are rounded up to size classes, of which there are four per
+** power of two, so at most 25% of each block is wasted. Every block is aligned
+** to the alignment of the pool, and its pages are touched once when it is
+** first allocated. Blocks of at least `huge_page_size` bytes are also aligned
+** to the huge page size, and marked as candidates for transparent huge pages.
+** Released blocks are cached in a small free list that is local to the
+** releasing thread, and overflow to a shared free list protected by a mutex
+** per size class.
+**
+** Buffers obtained from a pool keep the pool's memory alive, so they may
+** safely outlive the `buffer_pool` object itself.
+*/
+
+#ifndef Z7C5F2E90_1A4B_4D63_9B8E_E04A6D3F17C2
+#define Z7C5F2E90_1A4B_4D63_9B8E_E04A6D3F17C2
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <system_error>
+#include <vector>
+#include <neo/core/buffer_constraints.hpp>
+#include <neo/core/file/buffer.hpp>
+
+namespace neo {
+namespace file {
+namespace detail {
+
+static constexpr auto min_class_shift = 12u;
+static constexpr auto max_class_shift = 40u;
+static constexpr auto classes_per_shift = 4u;
+static constexpr auto size_class_count =
+	(max_class_shift - min_class_shift) * classes_per_shift + 1;
+
+/*
+** The number of blocks of each size class that are cached by each thread before
+** blocks are returned to the shared free list.
+*/
+static constexpr auto thread_cache_blocks = 4u;
+
+/*
+** Returns the index of the smallest size class that is at least `n` bytes.
+*/
+unsigned size_class(size_t n)
+{
+	if (n <= (size_t{1} << min_class_shift)) { return 0; }
+
+	auto k = 63u - (unsigned)__builtin_clzll(n);
+	auto base = size_t{1} << k;
+	auto step = base / classes_per_shift;
+	auto i = (unsigned)((n - base + step - 1) / step);
+	if (i == classes_per_shift) {
+		++k;
+		i = 0;
+	}
+	assert(k < max_class_shift || (k == max_class_shift && i == 0));
+	return (k - min_class_shift) * classes_per_shift + i;
+}
+
+/*
+** Returns the number of bytes in a block of the given size class.
+*/
+size_t class_size(unsigned c)
+{
+	auto k = min_class_shift + c / classes_per_shift;
+	auto base = size_t{1} << k;
+	return base + (c % classes_per_shift) * (base / classes_per_shift);
+}
+
+class pool_core
+{
+	struct free_list
+	{
+		std::mutex mutex{};
+		std::vector<uint8_t*> blocks{};
+	};
+
+	size_t m_align;
+	std::array<free_list, size_class_count> m_lists{};
+	std::atomic<size_t> m_fresh{0};
+public:
+	explicit pool_core(size_t align) noexcept : m_align{align} {}
+
+	pool_core(const pool_core&) = delete;
+	pool_core& operator=(const pool_core&) = delete;
+
+	~pool_core()
+	{
+		for (auto& l : m_lists) {
+			for (auto p : l.blocks) { std::free(p); }
+		}
+	}
+
+	size_t alignment() const { return m_align; }
+	size_t fresh_allocations() const { return m_fresh.load(); }
+
+	uint8_t* take(unsigned c)
+	{
+		auto& l = m_lists[c];
+		std::lock_guard<std::mutex> g{l.mutex};
+		if (l.blocks.empty()) { return nullptr; }
+		auto p = l.blocks.back();
+		l.blocks.pop_back();
+		return p;
+	}
+
+	void give(unsigned c, uint8_t* p)
+	{
+		auto& l = m_lists[c];
+		std::lock_guard<std::mutex> g{l.mutex};
+		l.blocks.push_back(p);
+	}
+
+	uint8_t* make(unsigned c)
+	{
+		auto n = class_size(c);
+		auto p = (uint8_t*)nullptr;
+		auto align = n >= huge_page_size ?
+			std::max(m_align, huge_page_size) : m_align;
+		auto r = ::posix_memalign((void**)&p, align, n);
+		if (r != 0) {
+			throw std::system_error{r, std::system_category()};
+		}
+		#ifdef MADV_HUGEPAGE
+			if (n >= huge_page_size) {
+				::madvise(p, n, MADV_HUGEPAGE);
+			}
+		#endif
+
+		/*
+		** Touching each page now moves the cost of the page faults out
+		** of the first IO operation that uses the block.
+		*/
+		auto page = (size_t)::getpagesize();
+		for (auto i = size_t{0}; i < n; i += page) {
+			((volatile uint8_t*)p)[i] = 0;
+		}
+		++m_fresh;
+		return p;
+	}
+};
+
+/*
+** The per-thread cache of free blocks. A thread may use several pools, so the
+** cache holds one set of free lists for each of them. The cache only holds weak
+** references to the pools, and frees the blocks of the pools that are gone
+** whenever it is used, and when the thread exits.
+*/
+class thread_cache
+{
+	struct entry
+	{
+		pool_core* key;
+		std::weak_ptr<pool_core> core;
+		std::array<std::vector<uint8_t*>, size_class_count> blocks;
+	};
+
+	std::vector<std::unique_ptr<entry>> m_entries{};
+public:
+	~thread_cache()
+	{
+		for (auto& e : m_entries) { flush(*e); }
+	}
+
+	static thread_cache& instance()
+	{
+		static thread_local thread_cache c;
+		return c;
+	}
+
+	std::vector<uint8_t*>&
+	blocks(const std::shared_ptr<pool_core>& core, unsigned c)
+	{
+		/*
+		** This also ensures that a new pool allocated at the address of
+		** one that has been destroyed does not inherit its entry.
+		*/
+		prune();
+		for (auto& e : m_entries) {
+			if (e->key == core.get()) { return e->blocks[c]; }
+		}
+
+		m_entries.emplace_back(new entry{core.get(), core, {}});
+		return m_entries.back()->blocks[c];
+	}
+private:
+	/*
+	** Frees the blocks of the pools that have been destroyed, and removes
+	** their entries.
+	*/
+	void prune()
+	{
+		for (auto i = m_entries.size(); i-- != 0;) {
+			if (!m_entries[i]->core.expired()) { continue; }
+			flush(*m_entries[i]);
+			m_entries.erase(m_entries.begin() + i);
+		}
+	}
+
+	static void flush(entry& e)
+	{
+		auto core = e.core.lock();
+		for (auto c = 0u; c != size_class_count; ++c) {
+			for (auto p : e.blocks[c]) {
+				if (core) { core->give(c, p); }
+				else      { std::free(p);     }
+			}
+			e.blocks[c].clear();
+		}
+	}
+};
+
+}
+
+class buffer_pool
+{
+	std::shared_ptr<detail::pool_core> m_core;
+public:
+	/*
+	** Creates a pool whose blocks are aligned to `align` bytes. The
+	** default is the page size, which satisfies the alignment
+	** requirements of direct IO on all common file systems.
+	*/
+	explicit buffer_pool(size_t align = ::getpagesize()) :
+	m_core{std::make_shared<detail::pool_core>(align)}
+	{
+		assert(align != 0 && (align & (align - 1)) == 0 &&
+			"Alignment must be a power of two.");
+	}
+
+	size_t alignment() const { return m_core->alignment(); }
+
+	/*
+	** Returns the number of blocks that the pool has obtained from the
+	** system allocator. This stops increasing once the pool reaches a
+	** steady state.
+	*/
+	size_t fresh_allocations() const
+	{ return m_core->fresh_allocations(); }
+
+	/*
+	** Returns a buffer whose size is the minimum size permitted by `bc`.
+	** The alignment requirement of `bc`, if any, must divide the alignment
+	** of the pool.
+	*/
+	template <io_mode IOMode>
+	buffer<IOMode> allocate(const buffer_constraints& bc)
+	{
+		assert(!bc.align_to() || alignment() % *bc.align_to() == 0);
+
+		auto s = min_size(bc);
+		auto n = s ? *s : (size_t)::getpagesize();
+		auto c = detail::size_class(n);
+		auto& tc = detail::thread_cache::instance().blocks(m_core, c);
+
+		auto p = (uint8_t*)nullptr;
+		if (!tc.empty()) {
+			p = tc.back();
+			tc.pop_back();
+		}
+		else if ((p = m_core->take(c)) == nullptr) {
+			p = m_core->make(c);
+		}
+		return buffer<IOMode>{m_core, release, p, n};
+	}
+
+	/*
+	** Adds `count` blocks large enough for buffers satisfying `bc` to the
+	** shared free list, so that the first allocations do not incur the
+	** cost of the system allocator.
+	*/
+	void reserve(const buffer_constraints& bc, size_t count)
+	{
+		auto s = min_size(bc);
+		auto c = detail::size_class(s ? *s : (size_t)::getpagesize());
+		for (auto i = size_t{0}; i != count; ++i) {
+			m_core->give(c, m_core->make(c));
+		}
+	}
+private:
+	static void release(
+		const std::shared_ptr<detail::pool_core>& core,
+		uint8_t* p, size_t n
+	)
+	{
+		auto c = detail::size_class(n);
+		auto& tc = detail::thread_cache::instance().blocks(core, c);
+
+		if (tc.size() < detail::thread_cache_blocks) {
+			tc.push_back(p);
+		}
+		else {
+			core->give(c, p);
+		}
+	}
+};
+
+}}
+
+#endif
@@ -0,0 +1,302 @@
+/*
+** File Name: calibrate.hpp
+** Author:    Aditya Ramesh
+** Date:      07/24/2014
+** Contact:   _@adityaramesh.com
+**
+** The `calibrate` function measures the performance of the available read and
+** write methods on a particular file system, and returns a `profile_entry`
+** describing the fastest combination. Usage proceeds as follows:
+**
+**   auto p = file::profile::load(path);  // Or `file::profile{}`.
+**   auto e = file::calibrate("/mnt/scratch/neo.tmp", access_mode::sequential);
+**   p.insert(e.get()).save(path).get();
+**
+** Calibration creates a scratch file at the given path, which is removed
+** afterwards. The scratch file should be on the file system for which the
+** results are intended, and it should be large enough that the measurements
+** are not dominated by noise.
+**
+** For sequential access, both the methods and the buffer sizes are varied. For
+** random access, the buffer size is fixed to the expected record size (rounded
+** up to the block size), and only the methods are varied. On Linux, the page
+** cache for the scratch file is dropped before each read trial, so that reads
+** go to the device.
+*/
+
+#ifndef Z1B6E94A3_0F2D_4C87_A5D1_68E2F3B9C047
+#define Z1B6E94A3_0F2D_4C87_A5D1_68E2F3B9C047
+
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <random>
+#include <vector>
+#include <unistd.h>
+#include <neo/core/access_mode.hpp>
+#include <neo/core/file/buffer.hpp>
+#include <neo/core/file/handle.hpp>
+#include <neo/core/file/io.hpp>
+#include <neo/core/file/profile.hpp>
+#include <neo/core/file/strategy.hpp>
+
+namespace neo {
+namespace file {
+
+struct calibration_options
+{
+	// Size of the scratch file.
+	off_t file_size = 64_MB;
+	// Expected size of each record read or written using random access.
+	size_t record_size = 4_KB;
+	// Maximum number of requests to time for random access.
+	size_t max_requests = 4096;
+	// Number of times each configuration is timed. The best time is used.
+	unsigned trials = 3;
+	unsigned seed = 0;
+};
+
+namespace detail {
+
+using calibration_clock = std::chrono::steady_clock;
+
+double seconds_since(calibration_clock::time_point t)
+{
+	using seconds = std::chrono::duration<double>;
+	return std::chrono::duration_cast<seconds>(
+		calibration_clock::now() - t).count();
+}
+
+size_t align_up(size_t n, size_t align)
+{ return (n + align - 1) / align * align; }
+
+std::vector<off_t>
+calibration_offsets(
+	off_t fs, size_t n, access_mode m,
+	const calibration_options& o, std::mt19937& g
+)
+{
+	auto v = std::vector<off_t>{};
+	for (auto off = off_t{0}; off + (off_t)n <= fs; off += n) {
+		v.push_back(off);
+	}
+	if (m == access_mode::random) {
+		std::shuffle(v.begin(), v.end(), g);
+		v.resize(std::min(v.size(), o.max_requests));
+	}
+	return v;
+}
+
+cc::expected<double>
+time_writes(
+	const char* path, io_method mtd, size_t n, size_t blksize,
+	access_mode m, const calibration_options& o, std::mt19937& g
+)
+{
+	auto s = strategy<io_mode::output>(boost::none, o.file_size,
+		(blksize_t)blksize);
+	s.write_method(mtd);
+
+	auto bc = buffer_constraints{n};
+	bc.align_to(blksize);
+	auto b = buffer<io_mode::output>{bc};
+	std::fill_n(b.data(), n, 0x5A);
+	auto offs = calibration_offsets(o.file_size, n, m, o, g);
+
+	auto t = calibration_clock::now();
+	auto hr = open<open_mode::create_or_replace>(path, s);
+	if (!hr) { return hr.exception(); }
+	auto h = hr.move();
+
+	for (auto off : offs) {
+		auto r = write(h, off, n, b, s);
+		if (!r) { return r.exception(); }
+	}
+	auto r = safe_sync(h.descriptor());
+	if (!r) { return r.exception(); }
+	return seconds_since(t);
+}
+
+cc::expected<double>
+time_reads(
+	const char* path, io_method mtd, size_t n, size_t blksize,
+	access_mode m, const calibration_options& o, std::mt19937& g
+)
+{
+	#if PLATFORM_KERNEL == PLATFORM_KERNEL_LINUX
+	{
+		auto fd = safe_open(path, O_RDONLY);
+		if (!fd) { return fd.exception(); }
+		auto r1 = safe_drop_cache(*fd);
+		auto r2 = safe_close(*fd);
+		if (!r1) { return r1.exception(); }
+		if (!r2) { return r2.exception(); }
+	}
+	#endif
+
+	auto s = strategy<io_mode::input>{path};
+	s.read_method(mtd).read_ahead(
+		m == access_mode::sequential && !(mtd & io_method::direct));
+
+	auto bc = buffer_constraints{n};
+	bc.align_to(blksize);
+	auto b = buffer<io_mode::input>{bc};
+	auto offs = calibration_offsets(o.file_size, n, m, o, g);
+
+	auto t = calibration_clock::now();
+	auto hr = open<open_mode::read>(path, s);
+	if (!hr) { return hr.exception(); }
+	auto h = hr.move();
+
+	for (auto off : offs) {
+		auto r = read(h, off, n, b.data(), s);
+		if (!r) { return r.exception(); }
+	}
+	return seconds_since(t);
+}
+
+/*
+** Returns the best of `trials` timings of the given function, or an error if
+** the configuration is not supported (e.g. `O_DIRECT` on `tmpfs`).
+*/
+template <class Function>
+cc::expected<double> best_time(unsigned trials, Function f)
+{
+	auto best = std::numeric_limits<double>::max();
+	for (auto i = 0u; i != trials; ++i) {
+		auto r = f();
+		if (!r) { return r.exception(); }
+		best = std::min(best, *r);
+	}
+	return best;
+}
+
+}
+
+/*
+** Measures the read and write methods and buffer sizes on the file system that
+** contains `path`, and returns the best configuration for the given access
+** mode.
+*/
+cc::expected<profile_entry>
+calibrate(
+	const char* path,
+	access_mode m,
+	const calibration_options& o = calibration_options{}
+)
+{
+	using namespace detail;
+	const io_method write_methods[] = {
+		io_method::buffer | io_method::paging,
+		io_method::buffer | io_method::direct
+	};
+	const io_method read_methods[] = {
+		io_method::buffer | io_method::paging,
+		io_method::buffer | io_method::direct,
+		io_method::mmap   | io_method::paging
+	};
+	const size_t sequential_sizes[] =
+		{16_KB, 64_KB, 256_KB, 1024_KB, 4096_KB};
+
+	auto g = std::mt19937{o.seed};
+
+	/*
+	** We need the block size of the file system before we can choose the
+	** sizes to test, so we create the scratch file first.
+	*/
+	{
+		auto fd = safe_open(path, O_WRONLY | O_CREAT | O_TRUNC);
+		if (!fd) { return fd.exception(); }
+		auto r = safe_close(*fd);
+		if (!r) { return r.exception(); }
+	}
+	auto st = safe_stat(path);
+	if (!st) {
+		::unlink(path);
+		return st.exception();
+	}
+
+	auto blksize = (size_t)st->st_blksize;
+	auto sizes = std::vector<size_t>{};
+	if (m == access_mode::sequential) {
+		for (auto n : sequential_sizes) {
+			sizes.push_back(align_up(n, blksize));
+		}
+	}
+	else {
+		sizes.push_back(align_up(o.record_size, blksize));
+	}
+	sizes.erase(std::unique(sizes.begin(), sizes.end()), sizes.end());
+
+	auto e = profile_entry{};
+	e.device = st->st_dev;
+	e.mode = m;
+	auto best_write = std::numeric_limits<double>::max();
+	auto best_read = std::numeric_limits<double>::max();
+	auto error = cc::expected<double>{0.};
+
+	/*
+	** The write trials also leave behind a fully-written scratch file for
+	** the read trials.
+	*/
+	for (auto mtd : write_methods) {
+		for (auto n : sizes) {
+			auto r = best_time(o.trials, [&] {
+				return time_writes(path, mtd, n, blksize, m, o, g);
+			});
+			if (!r) { error = r; continue; }
+			if (*r < best_write) {
+				best_write = *r;
+				e.write_method = mtd;
+				e.write_size = n;
+			}
+		}
+	}
+
+	if (best_write == std::numeric_limits<double>::max()) {
+		::unlink(path);
+		return error.exception();
+	}
+
+	/*
+	** Random writes may leave holes at the end of the file, which would
+	** shorten the file seen by the read trials.
+	*/
+	{
+		auto fd = safe_open(path, O_WRONLY);
+		if (!fd) {
+			::unlink(path);
+			return fd.exception();
+		}
+		auto r1 = safe_truncate(*fd, o.file_size);
+		auto r2 = safe_close(*fd);
+		if (!r1 || !r2) {
+			::unlink(path);
+			return !r1 ? r1.exception() : r2.exception();
+		}
+	}
+
+	for (auto mtd : read_methods) {
+		for (auto n : sizes) {
+			auto r = best_time(o.trials, [&] {
+				return time_reads(path, mtd, n, blksize, m, o, g);
+			});
+			if (!r) { error = r; continue; }
+			if (*r < best_read) {
+				best_read = *r;
+				e.read_method = mtd;
+				e.read_size = n;
+			}
+		}
+	}
+
+	::unlink(path);
+	if (best_read == std::numeric_limits<double>::max()) {
+		return error.exception();
+	}
+	return e;
+}
+
+}}
+
+#endif
@@ -0,0 +1,404 @@
+/*
+** File Name: copy.hpp
+** Author:    Aditya Ramesh
+** Date:      07/25/2014
+** Contact:   _@adityaramesh.com
+**
+** This file defines the `copy` function, which copies a range of bytes from one
+** file to another without passing the data through user space whenever the
+** platform allows it. The following methods are attempted in order, and each
+** falls back to the next one if it is not supported for the given pair of
+** files:
+**
+**   1. `reflink`: Share the extents of the source file using `FICLONERANGE`
+**   (Btrfs, XFS, etc.). This is nearly free, but requires the offsets and
+**   length to be aligned to the file system block size.
+**   2. `copy_file_range`: Copy within the kernel. Some file systems (e.g. NFS)
+**   can also offload the copy to the server.
+**   3. `sendfile`: Copy within the kernel via the page cache.
+**   4. `bounce`: Read into and write from a user-space buffer.
+**
+** The ranges must not overlap if the source and destination refer to the same
+** file.
+*/
+
+#ifndef Z4F93A1C6_E27B_4D05_8A3F_B6D1E8720C59
+#define Z4F93A1C6_E27B_4D05_8A3F_B6D1E8720C59
+
+#include <algorithm>
+#include <chrono>
+#include <ostream>
+#include <ccbase/format.hpp>
+#include <neo/core/access_mode.hpp>
+#include <neo/core/buffer_constraints.hpp>
+#include <neo/core/file/buffer.hpp>
+#include <neo/core/file/handle.hpp>
+#include <neo/core/file/strategy.hpp>
+#include <neo/core/file/system.hpp>
+
+#if PLATFORM_KERNEL == PLATFORM_KERNEL_LINUX
+	#include <linux/fs.h>
+	#include <sys/ioctl.h>
+	#include <sys/sendfile.h>
+	#include <sys/syscall.h>
+#endif
+
+namespace neo {
+namespace file {
+
+/*
+** Controls what happens to existing data in the destination:
+**
+**   - `fail_if_exists`: Fail with `EEXIST` if the destination range overlaps
+**   the existing contents of the destination file. For the overload that
+**   accepts paths, fail if the destination file exists.
+**   - `overwrite`: Overwrite the destination range, leaving the rest of the
+**   destination file intact.
+**   - `truncate`: Overwrite the destination range, and truncate the
+**   destination file at the end of the range.
+*/
+enum class replace_policy : unsigned
+{
+	fail_if_exists,
+	overwrite,
+	truncate,
+};
+
+enum class copy_method : unsigned
+{
+	none,
+	reflink,
+	copy_file_range,
+	sendfile,
+	bounce,
+};
+
+std::ostream& operator<<(std::ostream& os, copy_method m)
+{
+	switch (m) {
+	case copy_method::none:            cc::write(os, "none");            break;
+	case copy_method::reflink:         cc::write(os, "reflink");         break;
+	case copy_method::copy_file_range: cc::write(os, "copy_file_range"); break;
+	case copy_method::sendfile:        cc::write(os, "sendfile");        break;
+	case copy_method::bounce:          cc::write(os, "bounce buffer");   break;
+	}
+	return os;
+}
+
+/*
+** Describes a completed copy. The number of bytes copied is less than the
+** requested length if the source file ends before the end of the range. The
+** method is the last one that was used.
+*/
+struct copy_stats
+{
+	size_t bytes;
+	copy_method method;
+	double seconds;
+
+	double throughput() const
+	{ return seconds > 0 ? bytes / seconds : 0; }
+};
+
+namespace detail {
+
+/*
+** Returns true if the error code indicates that a copy method is not supported
+** for the given pair of files, so that the next method should be tried. Other
+** errors (e.g. `EINVAL` for invalid arguments) are reported to the caller.
+*/
+bool copy_unsupported(int e)
+{ return e == ENOSYS || e == EOPNOTSUPP || e == ENOTSUP || e == EXDEV; }
+
+/*
+** `FICLONERANGE` also fails with `EINVAL` if the range is not aligned to the
+** block size or the file system does not support reflinks, and with `ENOTTY`
+** if the file does not support the ioctl at all.
+*/
+bool reflink_unsupported(int e)
+{ return copy_unsupported(e) || e == EINVAL || e == ENOTTY; }
+
+/*
+** Each of the following functions copies the bytes in `[done, len)` of the
+** range, and advances `done` as it makes progress. They return false if the
+** method is not supported, in which case the caller should continue with the
+** next method.
+*/
+
+template <class Function>
+cc::expected<bool>
+copy_reflink(
+	int in, off_t in_off, int out, off_t out_off,
+	size_t len, size_t& done, Function& progress
+)
+{
+	#ifdef FICLONERANGE
+		auto r = file_clone_range{};
+		r.src_fd = in;
+		r.src_offset = in_off + done;
+		r.src_length = len - done;
+		r.dest_offset = out_off + done;
+
+		if (::ioctl(out, FICLONERANGE, &r) == -1) {
+			if (reflink_unsupported(errno)) { return false; }
+			return current_system_error();
+		}
+		done = len;
+		progress(done, len);
+		return true;
+	#else
+		return false;
+	#endif
+}
+
+template <class Function>
+cc::expected<bool>
+copy_in_kernel(
+	int in, off_t in_off, int out, off_t out_off,
+	size_t len, size_t& done, Function& progress
+)
+{
+	#if defined(SYS_copy_file_range)
+		while (done != len) {
+			auto io = (loff_t)(in_off + done);
+			auto oo = (loff_t)(out_off + done);
+			auto r = ::syscall(SYS_copy_file_range, in, &io, out, &oo,
+				len - done, 0u);
+
+			if (r > 0) {
+				done += r;
+				progress(done, len);
+			}
+			else if (r == 0) {
+				return true;
+			}
+			else if (errno == EINTR) {
+				continue;
+			}
+			else if (copy_unsupported(errno)) {
+				return false;
+			}
+			else {
+				return current_system_error();
+			}
+		}
+		return true;
+	#else
+		return false;
+	#endif
+}
+
+template <class Function>
+cc::expected<bool>
+copy_sendfile(
+	int in, off_t in_off, int out, off_t out_off,
+	size_t len, size_t& done, Function& progress
+)
+{
+	#if PLATFORM_KERNEL == PLATFORM_KERNEL_LINUX
+		// `sendfile` writes at the current position of `out`.
+		if (::lseek(out, out_off + done, SEEK_SET) == -1) {
+			return current_system_error();
+		}
+
+		while (done != len) {
+			auto off = (off_t)(in_off + done);
+			auto n = std::min(len - done, size_t{0x7FFFF000});
+			auto r = ::sendfile(out, in, &off, n);
+
+			if (r > 0) {
+				done += r;
+				progress(done, len);
+			}
+			else if (r == 0) {
+				return true;
+			}
+			else if (errno == EINTR) {
+				continue;
+			}
+			else if (copy_unsupported(errno)) {
+				return false;
+			}
+			else {
+				return current_system_error();
+			}
+		}
+		return true;
+	#else
+		return false;
+	#endif
+}
+
+template <class Function>
+cc::expected<bool>
+copy_bounce(
+	int in, off_t in_off, int out, off_t out_off,
+	size_t len, size_t& done, const buffer_constraints& bc,
+	Function& progress
+)
+{
+	auto b = buffer<io_mode::input | io_mode::output>{bc};
+
+	while (done != len) {
+		auto n = std::min(len - done, b.size());
+		auto r = ::pread(in, b.data(), n, in_off + done);
+
+		if (r > 0) {
+			auto w = full_write(out, b.data(), r, out_off + done);
+			if (!w) { return w.exception(); }
+			done += r;
+			progress(done, len);
+		}
+		else if (r == 0) {
+			return true;
+		}
+		else if (errno != EINTR) {
+			return current_system_error();
+		}
+	}
+	return true;
+}
+
+}
+
+/*
+** Copies `len` bytes starting at offset `src_off` of `src` to offset `dst_off`
+** of `dst`. After each chunk, `progress(copied, len)` is invoked.
+*/
+template <io_mode SrcIOMode, io_mode DstIOMode, class Function>
+cc::expected<copy_stats>
+copy(
+	const handle<SrcIOMode>& src,
+	off_t src_off,
+	const handle<DstIOMode>& dst,
+	off_t dst_off,
+	size_t len,
+	replace_policy p,
+	const buffer_constraints& bc,
+	Function progress
+)
+{
+	static_assert(!!(SrcIOMode & io_mode::input), "Input IO mode required.");
+	static_assert(!!(DstIOMode & io_mode::output), "Output IO mode required.");
+
+	using clock = std::chrono::steady_clock;
+	using seconds = std::chrono::duration<double>;
+	auto t = clock::now();
+
+	auto in = src.descriptor();
+	auto out = dst.descriptor();
+
+	auto st = safe_stat(in);
+	if (!st) { return st.exception(); }
+	auto avail = st->st_size > src_off ? (size_t)(st->st_size - src_off) : 0;
+	len = std::min(len, avail);
+
+	if (p == replace_policy::fail_if_exists) {
+		auto ds = safe_stat(out);
+		if (!ds) { return ds.exception(); }
+		if (ds->st_size > dst_off) {
+			return std::system_error{EEXIST, std::system_category()};
+		}
+	}
+
+	auto done = size_t{0};
+	auto m = copy_method::none;
+	auto step = [&] (copy_method cm, const cc::expected<bool>& r, size_t prev)
+		-> cc::expected<void>
+	{
+		if (!r) { return r.exception(); }
+		if (done != prev) { m = cm; }
+		return true;
+	};
+
+	if (done != len) {
+		auto prev = done;
+		auto r = step(copy_method::reflink, detail::copy_reflink(
+			in, src_off, out, dst_off, len, done, progress), prev);
+		if (!r) { return r.exception(); }
+	}
+	if (done != len) {
+		auto prev = done;
+		auto r = step(copy_method::copy_file_range, detail::copy_in_kernel(
+			in, src_off, out, dst_off, len, done, progress), prev);
+		if (!r) { return r.exception(); }
+	}
+	if (done != len) {
+		auto prev = done;
+		auto r = step(copy_method::sendfile, detail::copy_sendfile(
+			in, src_off, out, dst_off, len, done, progress), prev);
+		if (!r) { return r.exception(); }
+	}
+	if (done != len) {
+		auto prev = done;
+		auto r = step(copy_method::bounce, detail::copy_bounce(
+			in, src_off, out, dst_off, len, done, bc, progress), prev);
+		if (!r) { return r.exception(); }
+	}
+
+	if (p == replace_policy::truncate) {
+		auto r = safe_truncate(out, dst_off + done);
+		if (!r) { return r.exception(); }
+	}
+
+	auto dt = std::chrono::duration_cast<seconds>(clock::now() - t);
+	return copy_stats{done, m, dt.count()};
+}
+
+/*
+** As above, but without progress reporting. The bounce buffer, if needed, is
+** sized using `bc`.
+*/
+template <io_mode SrcIOMode, io_mode DstIOMode>
+cc::expected<copy_stats>
+copy(
+	const handle<SrcIOMode>& src,
+	off_t src_off,
+	const handle<DstIOMode>& dst,
+	off_t dst_off,
+	size_t len,
+	replace_policy p = replace_policy::overwrite,
+	const buffer_constraints& bc = buffer_constraints{1024 * 1024}
+)
+{
+	return copy(src, src_off, dst, dst_off, len, p, bc,
+		[] (size_t, size_t) {});
+}
+
+/*
+** Copies the file at `src` to `dst`. If the copy cannot be done in the kernel,
+** then the bounce buffer is sized using the default `strategy` for reading
+** `src` sequentially.
+*/
+cc::expected<copy_stats>
+copy(
+	const char* src,
+	const char* dst,
+	replace_policy p = replace_policy::fail_if_exists
+)
+{
+	auto s = strategy<io_mode::input>{src};
+	s.infer_defaults(access_mode::sequential);
+
+	auto hr = open<open_mode::read>(src, s);
+	if (!hr) { return hr.exception(); }
+	auto h = hr.move();
+
+	// The `truncate` policy is applied by `copy` once the data is written.
+	auto flags = O_WRONLY | O_CREAT;
+	if (p == replace_policy::fail_if_exists) { flags |= O_EXCL; }
+
+	auto fd = safe_open(dst, flags);
+	if (!fd) { return fd.exception(); }
+	auto d = handle<io_mode::output>{*fd};
+
+	auto bc = s.preferred_constraints(io_mode::input);
+	if (!min_size(bc)) { bc.at_least(1024 * 1024); }
+
+	if (p == replace_policy::fail_if_exists) { p = replace_policy::overwrite; }
+	return copy(h, 0, d, 0, *s.current_file_size(), p, bc);
+}
+
+}}
+
+#endif
@@ -8,9 +8,12 @@
 #ifndef Z7C27BC1A_7DE8_46D3_8F94_9C61EE88C34C
 #define Z7C27BC1A_7DE8_46D3_8F94_9C61EE88C34C
 
+#include <memory>
+#include <neo/core/file/map_option.hpp>
 #include <neo/core/file/open_mode.hpp>
 #include <neo/core/file/strategy.hpp>
 #include <neo/core/file/system.hpp>
+#include <neo/core/file/uring.hpp>
 
 #if PLATFORM_KERNEL == PLATFORM_KERNEL_LINUX || \
     PLATFORM_KERNEL == PLATFORM_KERNEL_XNU
@@ -37,28 +40,56 @@ class handle
 	uint8_t* m_map{nullptr};
 	size_t m_map_size{};
 	int m_fd{-1};
+	fault_count m_faults{current_fault_count()};
+
+	#ifdef NEO_HAS_IO_URING
+		std::unique_ptr<uring> m_ring{};
+		int m_ring_index{-1};
+	#endif
 public:
 	explicit handle() noexcept {}
 	explicit handle(int fd) noexcept : m_fd{fd} {}
 
-	explicit handle(int fd, size_t size)
+	explicit handle(int fd, size_t size, map_option opts = map_option::none)
 	: m_map_size{size}, m_fd{fd}
 	{
+		auto flags = MAP_SHARED;
+		#if PLATFORM_KERNEL == PLATFORM_KERNEL_LINUX
+			if (!!(opts & map_option::populate)) {
+				flags |= MAP_POPULATE;
+			}
+		#endif
+
 		m_map = (uint8_t*)::mmap(nullptr, m_map_size, prot_flags,
-			MAP_SHARED, m_fd, 0);
+			flags, m_fd, 0);
 		if (m_map == (uint8_t*)-1) {
 			m_map = nullptr;
 			throw current_system_error();
 		}
+
+		/*
+		** The hints do not affect the correctness of the mapping, so
+		** failing to apply them is not an error here. Otherwise, the
+		** mapping would have to be undone before rethrowing.
+		*/
+		try {
+			advise(opts);
+		}
+		catch (...) {}
 	}
 
 	handle(const handle&) = delete;
 
 	handle(handle&& rhs) noexcept :
-	m_map{rhs.m_map}, m_fd{rhs.m_fd}
+	m_map{rhs.m_map}, m_map_size{rhs.m_map_size}, m_fd{rhs.m_fd},
+	m_faults{rhs.m_faults}
 	{
 		rhs.m_map = nullptr;
 		rhs.m_fd = -1;
+		#ifdef NEO_HAS_IO_URING
+			m_ring = std::move(rhs.m_ring);
+			m_ring_index = rhs.m_ring_index;
+		#endif
 	}
 
 	handle& operator=(const handle&) = delete;
@@ -66,9 +97,15 @@ public:
 	handle& operator=(handle&& rhs)
 	{
 		m_map = rhs.m_map;
+		m_map_size = rhs.m_map_size;
 		m_fd = rhs.m_fd;
+		m_faults = rhs.m_faults;
 		rhs.m_map = nullptr;
 		rhs.m_fd = -1;
+		#ifdef NEO_HAS_IO_URING
+			m_ring = std::move(rhs.m_ring);
+			m_ring_index = rhs.m_ring_index;
+		#endif
 		return *this;
 	}
 
@@ -98,8 +135,94 @@ public:
 		return m_fd;
 	}
 
+	/*
+	** Applies the access pattern and huge page hints in `opts` to the
+	** mapping. The `populate` option only has an effect when the mapping
+	** is created. Failure to enable huge pages is not an error, since
+	** support for them depends on the kernel configuration and the file
+	** system.
+	*/
+	handle& advise(map_option opts)
+	{
+		assert(mapped());
+		if (!!(opts & map_option::sequential)) {
+			*safe_madvise(m_map, m_map_size, MADV_SEQUENTIAL);
+		}
+		if (!!(opts & map_option::random)) {
+			*safe_madvise(m_map, m_map_size, MADV_RANDOM);
+		}
+		if (!!(opts & map_option::will_need)) {
+			*safe_madvise(m_map, m_map_size, MADV_WILLNEED);
+		}
+		#ifdef MADV_HUGEPAGE
+			if (!!(opts & map_option::huge_pages)) {
+				::madvise(m_map, m_map_size, MADV_HUGEPAGE);
+			}
+		#endif
+		return *this;
+	}
+
+	/*
+	** Returns the number of page faults taken by the whole process since
+	** the handle was created, or since `reset_faults` was last called.
+	** These are not counts for this handle: the kernel only keeps track of
+	** faults per process, so the counts include faults caused by other
+	** threads and other mappings. They are only meaningful when accesses
+	** to this handle's mapping are the main source of faults, e.g. when a
+	** single thread scans the mapping between `reset_faults` and `faults`.
+	*/
+	fault_count faults() const
+	{
+		auto c = current_fault_count();
+		return fault_count{c.minor - m_faults.minor, c.major - m_faults.major};
+	}
+
+	handle& reset_faults()
+	{
+		m_faults = current_fault_count();
+		return *this;
+	}
+
+	#ifdef NEO_HAS_IO_URING
+		/*
+		** Creates an io_uring instance with room for `entries` requests
+		** in flight, and registers the file descriptor with it.
+		*/
+		handle& attach_ring(unsigned entries)
+		{
+			assert(m_fd != -1);
+			m_ring.reset(new uring{entries});
+			m_ring_index = *m_ring->register_file(m_fd);
+			return *this;
+		}
+
+		bool has_ring() const { return m_ring != nullptr; }
+
+		uring& ring() const
+		{
+			assert(has_ring());
+			return *m_ring;
+		}
+
+		/*
+		** Returns the index of the file descriptor in the ring's table of
+		** registered files.
+		*/
+		int ring_index() const
+		{
+			assert(has_ring());
+			return m_ring_index;
+		}
+	#else
+		bool has_ring() const { return false; }
+	#endif
+
 	handle& close()
 	{
+		#ifdef NEO_HAS_IO_URING
+			// The ring holds a reference to the file descriptor.
+			m_ring.reset();
+		#endif
 		if (m_fd != -1) {
 			*safe_close(m_fd);
 		}
@@ -144,7 +267,7 @@ noexcept
 		if (
 			(s.read_method() && !!(*s.read_method() & io_method::direct) &&
 			!!(IOMode & io_mode::input)) ||
-			(s.write_method() && (*s.write_method() & io_method::direct) &&
+			(s.write_method() && !!(*s.write_method() & io_method::direct) &&
 			!!(IOMode & io_mode::output))
 		) {
 			auto r = safe_open(path, flags | O_DIRECT);
@@ -183,7 +306,7 @@ noexcept
 				if (!r1) {
 					auto r2 = safe_close(fd);
 					if (!r2) { return r2.exception(); }
-					return r1.exception(); }
+					return r1.exception();
 				}
 			#elif PLATFORM_KERNEL == PLATFORM_KERNEL_XNU
 				if ((uint64_t)*s.current_file_size() < 256_MB) {
@@ -218,14 +341,38 @@ noexcept
 	}
 
 	if (s.write_method() && !!(*s.write_method() & io_method::mmap)) {
-		return handle<IOMode>{fd, (size_t)*s.maximum_file_size()};
+		return handle<IOMode>{fd, (size_t)*s.maximum_file_size(),
+			s.map_options()};
 	}
-	else if (s.read_method() && !!(*s.read_method() & io_method::mmap)) {
-		return handle<IOMode>{fd, (size_t)*s.current_file_size()};
-	}
-	else {
-		return handle<IOMode>{fd};
+	else if (
+		s.read_method() && !!(*s.read_method() & io_method::mmap) &&
+		!s.map_window()
+	) {
+		return handle<IOMode>{fd, (size_t)*s.current_file_size(),
+			s.map_options()};
 	}
+
+	auto h = handle<IOMode>{fd};
+
+	/*
+	** If the `uring` method was requested, we attach a ring to the handle.
+	** The ring falls back to `pread` and `pwrite` by itself if the kernel
+	** does not support io_uring.
+	*/
+	#ifdef NEO_HAS_IO_URING
+		if (
+			(s.read_method() && !!(*s.read_method() & io_method::uring)) ||
+			(s.write_method() && !!(*s.write_method() & io_method::uring))
+		) {
+			try {
+				h.attach_ring(s.queue_depth() ? *s.queue_depth() : 32);
+			}
+			catch (const std::system_error& e) {
+				return e;
+			}
+		}
+	#endif
+	return h;
 }
 
 }}
@@ -3,14 +3,32 @@
 ** Author:    Aditya Ramesh
 ** Date:      07/12/2014
 ** Contact:   _@adityaramesh.com
+**
+** Direct IO (`O_DIRECT` on Linux) requires the offset, length, and memory
+** address of each transfer to be aligned to the logical block size of the
+** device. When all three are aligned, the `read` and `write` functions below
+** transfer the data directly to or from the caller's memory. Otherwise, the
+** request is widened to the enclosing block-aligned extent, which is
+** transferred through an aligned scratch buffer obtained from a shared
+** `buffer_pool`, and only the requested bytes are copied to or from the
+** caller's memory. Large requests are split into chunks of at most
+** `direct_chunk_size` bytes, so that the scratch buffer stays small.
+**
+** Unaligned writes are implemented as read-modify-write cycles on the first and
+** last blocks of the extent. This is not atomic: a concurrent write to other
+** bytes in the same blocks may be lost. If the widened extent extends past the
+** end of the file, then the file is truncated back to its new size afterwards.
 */
 
 #ifndef Z5A38F0F5_4A8B_46DE_8297_588006B2CCBF
 #define Z5A38F0F5_4A8B_46DE_8297_588006B2CCBF
 
 #include <algorithm>
+#include <limits>
+#include <mutex>
 #include <type_traits>
 #include <neo/core/file/buffer.hpp>
+#include <neo/core/file/buffer_pool.hpp>
 #include <neo/core/file/handle.hpp>
 #include <neo/core/file/strategy.hpp>
 #include <neo/core/file/system.hpp>
@@ -18,6 +36,266 @@
 namespace neo {
 namespace file {
 
+namespace detail {
+
+/*
+** Tag used for the requests issued by the synchronous `read` and `write`
+** functions when the handle has an attached ring. Tags passed to
+** `enqueue_read` and `enqueue_write` must not have this value.
+*/
+static constexpr auto sync_tag = std::numeric_limits<uint64_t>::max();
+
+#ifdef NEO_HAS_IO_URING
+
+/*
+** Performs a blocking transfer using the ring attached to the handle,
+** resubmitting the request in the event of a short transfer. The ring is locked
+** for the duration of the transfer, since several threads may use the handle.
+*/
+template <io_mode IOMode, bool Read>
+cc::expected<void>
+ring_transfer(const handle<IOMode>& h, uint8_t* p, size_t n, off_t off)
+{
+	auto& r = h.ring();
+	std::lock_guard<std::mutex> lock{r.sync_mutex()};
+	auto c = size_t{0};
+
+	do {
+		auto s = Read ?
+			r.prepare_read(h.ring_index(), p + c, n - c, off + c, sync_tag) :
+			r.prepare_write(h.ring_index(), p + c, n - c, off + c, sync_tag);
+		if (!s) { return s.exception(); }
+
+		auto res = r.wait_for(sync_tag);
+		if (!res) { return res.exception(); }
+
+		if (*res > 0) {
+			c += *res;
+		}
+		else if (*res == 0) {
+			return true;
+		}
+		else if (*res != -EINTR && *res != -EAGAIN) {
+			return std::system_error{-*res, std::system_category()};
+		}
+	}
+	while (c < n);
+	return true;
+}
+
+#endif
+
+/*
+** Transfers the given bytes using the ring attached to the handle, if any, and
+** `pread` or `pwrite` otherwise.
+*/
+
+template <io_mode IOMode>
+cc::expected<void>
+raw_read(const handle<IOMode>& h, uint8_t* p, size_t n, off_t off)
+{
+	#ifdef NEO_HAS_IO_URING
+		if (h.has_ring()) {
+			return ring_transfer<IOMode, true>(h, p, n, off);
+		}
+	#endif
+	return full_read(h.descriptor(), p, n, off);
+}
+
+template <io_mode IOMode>
+cc::expected<void>
+raw_write(const handle<IOMode>& h, uint8_t* p, size_t n, off_t off)
+{
+	#ifdef NEO_HAS_IO_URING
+		if (h.has_ring()) {
+			return ring_transfer<IOMode, false>(h, p, n, off);
+		}
+	#endif
+	return full_write(h.descriptor(), p, n, off);
+}
+
+static constexpr auto direct_chunk_size = size_t{4 * 1024 * 1024};
+
+/*
+** Returns true if requests using the given method must satisfy the alignment
+** requirements of direct IO. On OS X, `F_NOCACHE` imposes no such
+** requirements.
+*/
+bool needs_direct_alignment(const boost::optional<io_method>& m)
+{
+	#if PLATFORM_KERNEL == PLATFORM_KERNEL_LINUX
+		return m && !!(*m & io_method::direct);
+	#else
+		(void)m;
+		return false;
+	#endif
+}
+
+/*
+** Returns the alignment used for direct IO. The block size reported by `stat`
+** is a multiple of the logical block size of the device, so it is always safe
+** to use.
+*/
+template <io_mode IOMode>
+size_t direct_alignment(const strategy<IOMode>& s)
+{
+	return s.block_size() && *s.block_size() > 0 ?
+		(size_t)*s.block_size() : size_t{4096};
+}
+
+bool direct_aligned(off_t off, size_t n, const uint8_t* p, size_t align)
+{
+	return (size_t)off % align == 0 && n % align == 0 &&
+		(uintptr_t)p % align == 0;
+}
+
+/*
+** Returns an aligned scratch buffer of at least `n` bytes. The blocks are
+** recycled by a pool that is shared by all threads.
+*/
+buffer<io_mode::input | io_mode::output>
+direct_scratch(size_t n, size_t align)
+{
+	static buffer_pool pool{};
+	auto bc = buffer_constraints{n};
+	bc.align_to(align);
+
+	if (pool.alignment() % align == 0) {
+		return pool.allocate<io_mode::input | io_mode::output>(bc);
+	}
+	return buffer<io_mode::input | io_mode::output>{bc};
+}
+
+/*
+** Reads `n` bytes at offset `off` into `dst` through a scratch buffer, using
+** block-aligned transfers.
+*/
+template <io_mode IOMode>
+cc::expected<void>
+bounce_read(
+	const handle<IOMode>& h, off_t off, size_t n, uint8_t* dst,
+	size_t align
+)
+{
+	auto limit = std::max(align, direct_chunk_size / align * align);
+	auto end = off + (off_t)n;
+	auto last = (end + (off_t)align - 1) / (off_t)align * (off_t)align;
+	auto b = direct_scratch(std::min(limit, (size_t)(last - off +
+		off % (off_t)align)), align);
+
+	for (auto cur = off; cur != end;) {
+		auto first = cur - cur % (off_t)align;
+		auto stop = std::min(last, first + (off_t)limit);
+		auto r = raw_read(h, b.data(), stop - first, first);
+		if (!r) { return r; }
+
+		auto m = std::min(end, stop) - cur;
+		std::copy_n(b.data() + (cur - first), m, dst + (cur - off));
+		cur += m;
+	}
+	return true;
+}
+
+/*
+** Writes `n` bytes at offset `off` from `src` through a scratch buffer, using
+** block-aligned transfers. Partial blocks at either end of each chunk are read
+** first, so that the surrounding bytes are preserved.
+*/
+template <io_mode IOMode>
+cc::expected<void>
+bounce_write(
+	const handle<IOMode>& h, off_t off, size_t n, const uint8_t* src,
+	size_t align
+)
+{
+	auto st = safe_stat(h.descriptor());
+	if (!st) { return st.exception(); }
+	auto fs = st->st_size;
+
+	auto a = (off_t)align;
+	auto limit = std::max(align, direct_chunk_size / align * align);
+	auto end = off + (off_t)n;
+	auto last = (end + a - 1) / a * a;
+	auto b = direct_scratch(std::min(limit, (size_t)(last - off + off % a)),
+		align);
+
+	/*
+	** Bytes past the end of the file are zeroed, since a short read does
+	** not overwrite them.
+	*/
+	auto fill = [&] (off_t first, off_t block) -> cc::expected<void> {
+		auto p = b.data() + (block - first);
+		std::fill_n(p, align, 0);
+		if (block >= fs) { return true; }
+		return raw_read(h, p, align, block);
+	};
+
+	for (auto cur = off; cur != end;) {
+		auto first = cur - cur % a;
+		auto stop = std::min(last, first + (off_t)limit);
+		auto m = std::min(end, stop) - cur;
+
+		if (cur != first) {
+			auto r = fill(first, first);
+			if (!r) { return r; }
+		}
+		if (cur + m != stop && (cur == first || stop - a != first)) {
+			auto r = fill(first, stop - a);
+			if (!r) { return r; }
+		}
+
+		std::copy_n(src + (cur - off), m, b.data() + (cur - first));
+		auto r = raw_write(h, b.data(), stop - first, first);
+		if (!r) { return r; }
+		cur += m;
+	}
+
+	if (last > std::max(fs, end)) {
+		return safe_truncate(h.descriptor(), std::max(fs, end));
+	}
+	return true;
+}
+
+}
+
+/*
+** Reads `n` bytes at offset `off` into the memory pointed to by `dst`. Unlike
+** the overload that accepts a `buffer`, this always copies the data, even if
+** the read method is `mmap`.
+*/
+template <
+	io_mode IOMode,
+	typename std::enable_if<!!(IOMode & io_mode::input), int>::type = 0
+>
+cc::expected<void>
+read(
+	const handle<IOMode>& h,
+	off_t off,
+	size_t n,
+	uint8_t* dst,
+	const strategy<IOMode>& s
+) noexcept
+{
+	assert(n > 0);
+
+	/*
+	** The handle is not mapped if the strategy requests a windowed
+	** mapping, in which case we fall back to `pread`.
+	*/
+	if (!!(*s.read_method() & io_method::mmap) && h.mapped()) {
+		std::copy_n(h.map() + off, n, dst);
+		return true;
+	}
+
+	if (detail::needs_direct_alignment(s.read_method())) {
+		auto a = detail::direct_alignment(s);
+		if (!detail::direct_aligned(off, n, dst, a)) {
+			return detail::bounce_read(h, off, n, dst, a);
+		}
+	}
+	return detail::raw_read(h, dst, n, off);
+}
+
 template <
 	io_mode IOMode,
 	typename std::enable_if<!!(IOMode & io_mode::input), int>::type = 0
@@ -40,22 +318,16 @@ read(
 		assert((off_t)(off + n) <= s.maximum_file_size());
 	}
 
-	auto r = *s.read_method();
-	if (r == io_method::mmap) {
-		if (b.mapped() && b.map() == h.map()) {
-			b.offset(off);
-		}
-		else {
-			assert(b.writable());
-			std::copy_n(h.map() + off, n, b.data());
-		}
-	}
-	else if (r == io_method::paging || r == io_method::direct) {
-		assert(b.writable());
-		auto s = full_read(h.descriptor(), b.data(), n, off);
-		if (!s) { return s.exception(); }
+	if (
+		!!(*s.read_method() & io_method::mmap) &&
+		b.mapped() && b.map() == h.map()
+	) {
+		b.offset(off);
+		return true;
 	}
-	return true;
+
+	assert(b.writable());
+	return read(h, off, n, b.data(), s);
 }
 
 template <
@@ -77,8 +349,7 @@ write(
 		assert((off_t)(off + n) <= s.maximum_file_size());
 	}
 
-	switch (*s.write_method()) {
-	case io_method::mmap:
+	if (!!(*s.write_method() & io_method::mmap)) {
 		if (b.mapped() && b.map() == h.map()) {
 			// There is nothing to be done in this case, since the
 			// data buffer is a memory map.
@@ -87,17 +358,142 @@ write(
 			assert(b.readable());
 			std::copy_n(b.data(), n, h.map() + off);
 		}
-		break;
-	case io_method::paging:
-	case io_method::direct:
-		assert(b.readable());
-		auto r = full_write(h.descriptor(), b.data(), n, off);
-		if (!r) { return r.exception(); }
-		break;
+		return true;
+	}
+
+	assert(b.readable());
+	if (detail::needs_direct_alignment(s.write_method())) {
+		auto a = detail::direct_alignment(s);
+		if (!detail::direct_aligned(off, n, b.data(), a)) {
+			return detail::bounce_write(h, off, n, b.data(), a);
+		}
 	}
+	return detail::raw_write(h, b.data(), n, off);
+}
+
+#ifdef NEO_HAS_IO_URING
+
+/*
+** The functions below allow many requests to be kept in flight on a handle
+** opened with the `uring` IO method. A typical loop enqueues a batch of
+** requests, calls `submit` once, and then uses `reap` to consume the
+** completions, each of which is identified by the tag supplied when the
+** request was enqueued. Short transfers are reported as such; it is the
+** responsibility of the caller to deal with them.
+*/
+
+template <
+	io_mode IOMode,
+	typename std::enable_if<!!(IOMode & io_mode::input), int>::type = 0
+>
+cc::expected<void>
+enqueue_read(
+	const handle<IOMode>& h,
+	off_t off,
+	size_t n,
+	uint8_t* dst,
+	uint64_t tag
+) noexcept
+{
+	assert(n > 0);
+	assert(tag != detail::sync_tag);
+	return h.ring().prepare_read(h.ring_index(), dst, n, off, tag);
+}
+
+template <
+	io_mode IOMode,
+	typename std::enable_if<!!(IOMode & io_mode::input), int>::type = 0
+>
+cc::expected<void>
+enqueue_read(
+	const handle<IOMode>& h,
+	off_t off,
+	size_t n,
+	buffer<IOMode>& b,
+	uint64_t tag
+) noexcept
+{
+	assert(b.writable());
+	assert(n <= b.size());
+	return enqueue_read(h, off, n, b.data(), tag);
+}
+
+template <
+	io_mode IOMode,
+	typename std::enable_if<!!(IOMode & io_mode::output), int>::type = 0
+>
+cc::expected<void>
+enqueue_write(
+	const handle<IOMode>& h,
+	off_t off,
+	size_t n,
+	const uint8_t* src,
+	uint64_t tag
+) noexcept
+{
+	assert(n > 0);
+	assert(tag != detail::sync_tag);
+	return h.ring().prepare_write(h.ring_index(), src, n, off, tag);
+}
+
+template <
+	io_mode IOMode,
+	typename std::enable_if<!!(IOMode & io_mode::output), int>::type = 0
+>
+cc::expected<void>
+enqueue_write(
+	const handle<IOMode>& h,
+	off_t off,
+	size_t n,
+	const buffer<IOMode>& b,
+	uint64_t tag
+) noexcept
+{
+	assert(b.readable());
+	assert(n <= b.size());
+	return enqueue_write(h, off, n, b.data(), tag);
+}
+
+/*
+** Submits all enqueued requests using a single system call.
+*/
+template <io_mode IOMode>
+cc::expected<unsigned>
+submit(const handle<IOMode>& h) noexcept
+{ return h.ring().submit(); }
+
+/*
+** Waits until at least `min` requests have completed, and copies up to `max`
+** completions to `out`.
+*/
+template <io_mode IOMode>
+cc::expected<size_t>
+reap(const handle<IOMode>& h, completion* out, size_t max, size_t min = 1)
+noexcept
+{ return h.ring().reap(out, max, min); }
+
+/*
+** Registers the buffer with the ring attached to the handle, so that requests
+** that target it avoid the cost of pinning its pages. The buffer must outlive
+** the registration; see `uring.hpp`.
+*/
+template <io_mode IOMode>
+cc::expected<void>
+register_buffer(const handle<IOMode>& h, buffer<IOMode>& b) noexcept
+{
+	assert(!b.mapped());
+	auto r = h.ring().register_buffer(b.data(), b.size());
+	if (!r) { return r.exception(); }
 	return true;
 }
 
+template <io_mode IOMode>
+cc::expected<void>
+unregister_buffers(const handle<IOMode>& h) noexcept
+{ return h.ring().unregister_buffers(); }
+
+#endif
+
 }}
 
 #endif
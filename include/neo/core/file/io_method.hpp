@@ -17,16 +17,31 @@ namespace neo {
 
 enum class io_method : unsigned
 {
-	// Valid states are either `paging` or `direct` OR'd with either
-	// `buffer` or `mmap`.
-	buffer,
-	mmap,
-	paging,
-	direct,
+	// Valid states are either `paging` or `direct` OR'd with one of
+	// `buffer`, `mmap`, or `uring`. The `uring` method uses io_uring on
+	// Linux, and falls back to `buffer` on kernels that do not support it.
+	buffer = 0x01,
+	mmap   = 0x02,
+	uring  = 0x04,
+	paging = 0x08,
+	direct = 0x10,
 };
 
 DEFINE_ENUM_BITWISE_OPERATORS(io_method)
 
+/*
+** Determines whether `m` is one of the valid states described above.
+*/
+bool is_valid(io_method m)
+{
+	auto x = (unsigned)m;
+	auto t = x & (unsigned)(io_method::buffer | io_method::mmap |
+		io_method::uring);
+	auto a = x & (unsigned)(io_method::paging | io_method::direct);
+	auto single = [] (unsigned y) { return y != 0 && (y & (y - 1)) == 0; };
+	return single(t) && single(a) && (t | a) == x;
+}
+
 std::ostream& operator<<(std::ostream& os, io_method m)
 {
 	if (!!(m & io_method::buffer)) {
@@ -51,6 +66,17 @@ std::ostream& operator<<(std::ostream& os, io_method m)
 			assert(false && "Invalid io_method value.");
 		}
 	}
+	else if (!!(m & io_method::uring)) {
+		if (!!(m & io_method::paging)) {
+			cc::write(os, "paged io_uring IO");
+		}
+		else if (!!(m & io_method::direct)) {
+			cc::write(os, "direct io_uring IO");
+		}
+		else {
+			assert(false && "Invalid io_method value.");
+		}
+	}
 	else {
 		assert(false && "Invalid io_method value.");
 	}
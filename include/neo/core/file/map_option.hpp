@@ -0,0 +1,70 @@
+/*
+** File Name: map_option.hpp
+** Author:    Aditya Ramesh
+** Date:      07/25/2014
+** Contact:   _@adityaramesh.com
+**
+** This file defines the `map_option` enum, which describes the hints applied to
+** a file when it is memory-mapped.
+**
+**   - `populate`: Prefault the entire mapping when it is created (Linux's
+**   `MAP_POPULATE`). This avoids one minor fault per page at the cost of
+**   reading the whole file up front, so it is only appropriate for files that
+**   will be read in their entirety.
+**   - `sequential`, `random`: Advise the kernel of the access pattern, which
+**   controls how aggressively it reads ahead.
+**   - `will_need`: Advise the kernel to start reading the file into the page
+**   cache asynchronously.
+**   - `huge_pages`: Ask for the mapping to be backed by transparent huge pages
+**   where possible, to reduce TLB misses. On most kernels, this only has an
+**   effect for file systems that support huge pages in the page cache (e.g.
+**   `tmpfs` with `huge=` set).
+**
+** Options that are not supported by the platform are silently ignored.
+*/
+
+#ifndef Z8E41B2D7_93AF_4C50_B6E8_2A07F5D9C3E1
+#define Z8E41B2D7_93AF_4C50_B6E8_2A07F5D9C3E1
+
+#include <ostream>
+#include <ccbase/format.hpp>
+#include <neo/utility/enum_bitmask.hpp>
+
+namespace neo {
+
+enum class map_option : unsigned
+{
+	none       = 0x00,
+	populate   = 0x01,
+	sequential = 0x02,
+	random     = 0x04,
+	will_need  = 0x08,
+	huge_pages = 0x10,
+};
+
+DEFINE_ENUM_BITWISE_OPERATORS(map_option)
+
+std::ostream& operator<<(std::ostream& os, map_option m)
+{
+	if (m == map_option::none) {
+		cc::write(os, "none");
+		return os;
+	}
+
+	auto first = true;
+	auto put = [&] (map_option x, const char* s) {
+		if (!(m & x)) { return; }
+		cc::write(os, first ? "$" : ", $", s);
+		first = false;
+	};
+	put(map_option::populate, "populate");
+	put(map_option::sequential, "sequential");
+	put(map_option::random, "random");
+	put(map_option::will_need, "will need");
+	put(map_option::huge_pages, "huge pages");
+	return os;
+}
+
+}
+
+#endif
@@ -0,0 +1,261 @@
+/*
+** File Name: prefetching_reader.hpp
+** Author:    Aditya Ramesh
+** Date:      07/22/2014
+** Contact:   _@adityaramesh.com
+**
+** The `prefetching_reader` class overlaps reading a file with processing its
+** contents. It owns a ring of buffers that a background thread fills with
+** consecutive windows of the file, while the consumer scans the window that was
+** filled before. Usage proceeds as follows:
+**
+**   1. Construct the reader from a handle, a strategy, and the `buffer_state`
+**   of the deserializer. The buffers are sized using both the strategy's and
+**   the deserializer's preferred constraints.
+**   2. Call `next(0)` to obtain the first window, and deserialize as many
+**   records from `data()` as possible.
+**   3. Call `next(n)`, where `n` is the number of bytes of the current window
+**   that were consumed. The remaining bytes, which belong to a record that
+**   straddles the boundary between two windows, are copied to the front of the
+**   next window, so that the record is contiguous and need not be read again.
+**   4. Repeat until `next` returns zero.
+**
+** To make room for the carried-over bytes, each buffer reserves headroom in
+** front of the region into which the file is read. The size of the headroom is
+** determined by the deserializer's required constraints, which is why no
+** record may be larger than the minimum size that they permit.
+**
+** The handle must not be used by other threads while the reader is alive.
+*/
+
+#ifndef Z3E8D51A4_92C7_4F0B_B6E2_5D1A09C37F84
+#define Z3E8D51A4_92C7_4F0B_B6E2_5D1A09C37F84
+
+#include <algorithm>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <neo/core/buffer_state.hpp>
+#include <neo/core/file/buffer.hpp>
+#include <neo/core/file/handle.hpp>
+#include <neo/core/file/io.hpp>
+#include <neo/core/file/strategy.hpp>
+
+namespace neo {
+namespace file {
+
+template <io_mode IOMode>
+class prefetching_reader
+{
+	static_assert(!!(IOMode & io_mode::input), "Input IO mode required.");
+
+	struct slot
+	{
+		buffer<IOMode> buf;
+		off_t off;
+		size_t size;
+		bool full;
+
+		explicit slot(const buffer_constraints& bc)
+		: buf{bc}, off{}, size{}, full{} {}
+	};
+
+	const handle<IOMode>& m_handle;
+	const strategy<IOMode>& m_strat;
+	std::vector<slot> m_slots{};
+	size_t m_headroom{};
+	size_t m_payload{};
+
+	off_t m_next_off;
+	off_t m_end;
+	// Index of the next slot to be filled by the producer.
+	size_t m_tail{};
+	// Number of slots that have been filled and not yet released.
+	size_t m_filled{};
+	bool m_eof{};
+	bool m_stop{};
+	std::exception_ptr m_error{};
+
+	std::mutex m_mutex{};
+	std::condition_variable m_producer_cv{};
+	std::condition_variable m_consumer_cv{};
+	std::thread m_thread{};
+
+	// Index of the slot currently held by the consumer.
+	size_t m_head{};
+	bool m_holding{};
+	uint8_t* m_data{};
+	size_t m_size{};
+	off_t m_off{};
+public:
+	/*
+	** Creates a reader for the range `[off, end)` of the file, using
+	** `depth` buffers. The offset must satisfy the alignment requirements
+	** of the read method.
+	*/
+	explicit prefetching_reader(
+		const handle<IOMode>& h,
+		const strategy<IOMode>& s,
+		const buffer_state& bs,
+		off_t off,
+		off_t end,
+		size_t depth = 2
+	) : m_handle(h), m_strat(s), m_next_off{off}, m_end{end}
+	{
+		assert(depth >= 2 && "At least two buffers are required.");
+		assert(off <= end);
+		assert(s.read_method() && !(*s.read_method() & io_method::mmap) &&
+			"Prefetching is meaningless for memory-mapped files.");
+
+		auto bc = merge_strong(
+			s.preferred_constraints(io_mode::input),
+			bs.preferred_constraints()
+		);
+		assert(bc && "Preferred constraints are incompatible.");
+
+		auto align = bc->align_to() ? *bc->align_to() : size_t{1};
+		auto round_up = [&] (size_t n) {
+			return n % align == 0 ? n : n + align - n % align;
+		};
+
+		auto carry = min_size(bs.required_constraints());
+		m_headroom = round_up(carry ? *carry : 0);
+
+		auto payload = min_size(*bc);
+		m_payload = round_up(payload ? *payload : ::getpagesize());
+
+		auto slot_bc = buffer_constraints{m_headroom + m_payload};
+		slot_bc.align_to(bc->align_to());
+
+		m_slots.reserve(depth);
+		for (auto i = size_t{0}; i != depth; ++i) {
+			m_slots.emplace_back(slot_bc);
+		}
+		m_thread = std::thread{[this] { produce(); }};
+	}
+
+	prefetching_reader(const prefetching_reader&) = delete;
+	prefetching_reader& operator=(const prefetching_reader&) = delete;
+
+	~prefetching_reader()
+	{
+		{
+			std::lock_guard<std::mutex> l{m_mutex};
+			m_stop = true;
+		}
+		m_producer_cv.notify_one();
+		m_thread.join();
+	}
+
+	/*
+	** Returns the pointer to, size of, and offset of the current window.
+	*/
+	uint8_t* data() const { return m_data; }
+	size_t size() const { return m_size; }
+	off_t offset() const { return m_off; }
+
+	size_t headroom() const { return m_headroom; }
+	size_t payload_size() const { return m_payload; }
+	size_t depth() const { return m_slots.size(); }
+
+	/*
+	** Releases the current window, of which the first `consumed` bytes were
+	** processed, and makes the next window available. Returns the size of
+	** the new window, which is zero once the end of the range has been
+	** reached. Any bytes left over in the final window are discarded; it is
+	** the responsibility of the caller to deal with premature EOF.
+	*/
+	cc::expected<size_t> next(size_t consumed)
+	{
+		auto carry = size_t{0};
+		auto carry_src = (const uint8_t*)nullptr;
+
+		if (m_holding) {
+			assert(consumed <= m_size);
+			carry = m_size - consumed;
+			carry_src = m_data + consumed;
+			assert(carry <= m_headroom &&
+				"Record is larger than the required buffer size.");
+		}
+
+		/*
+		** The headroom of the next slot is never touched by the
+		** producer, so the leftover bytes can be copied there while
+		** it is still being filled.
+		*/
+		auto next = m_holding ? (m_head + 1) % m_slots.size() : m_head;
+		auto dst = m_slots[next].buf.data() + m_headroom - carry;
+		if (carry != 0) {
+			std::copy_n(carry_src, carry, dst);
+		}
+
+		std::unique_lock<std::mutex> l{m_mutex};
+		if (m_holding) {
+			m_slots[m_head].full = false;
+			--m_filled;
+			m_head = next;
+			m_holding = false;
+			m_producer_cv.notify_one();
+		}
+
+		m_consumer_cv.wait(l, [&] {
+			return m_slots[m_head].full || m_error || (m_eof && m_filled == 0);
+		});
+
+		if (m_error) { return m_error; }
+		if (!m_slots[m_head].full) {
+			m_data = nullptr;
+			m_size = 0;
+			return size_t{0};
+		}
+
+		auto& sl = m_slots[m_head];
+		m_holding = true;
+		m_data = dst;
+		m_size = carry + sl.size;
+		m_off = sl.off - carry;
+		return m_size;
+	}
+private:
+	void produce()
+	{
+		for (;;) {
+			std::unique_lock<std::mutex> l{m_mutex};
+			m_producer_cv.wait(l, [&] {
+				return m_stop || m_filled != m_slots.size();
+			});
+			if (m_stop) { return; }
+			if (m_next_off >= m_end) {
+				m_eof = true;
+				m_consumer_cv.notify_one();
+				return;
+			}
+
+			auto& sl = m_slots[m_tail];
+			sl.off = m_next_off;
+			sl.size = std::min((size_t)(m_end - m_next_off), m_payload);
+			m_next_off += sl.size;
+			l.unlock();
+
+			auto r = read(m_handle, sl.off, sl.size,
+				sl.buf.data() + m_headroom, m_strat);
+
+			l.lock();
+			if (!r) {
+				m_error = r.exception();
+				m_consumer_cv.notify_one();
+				return;
+			}
+			sl.full = true;
+			++m_filled;
+			m_tail = (m_tail + 1) % m_slots.size();
+			m_consumer_cv.notify_one();
+		}
+	}
+};
+
+}}
+
+#endif
@@ -0,0 +1,176 @@
+/*
+** File Name: profile.hpp
+** Author:    Aditya Ramesh
+** Date:      07/24/2014
+** Contact:   _@adityaramesh.com
+**
+** A `profile` records the best IO methods and buffer sizes for the file systems
+** on a particular machine, as measured by the `calibrate` function. Each entry
+** is keyed by the device ID (`st_dev`) of the file system and the access mode.
+** The `strategy::infer_defaults` function consults the global profile before it
+** falls back to its built-in table.
+**
+** The global profile is loaded from the path given by the `NEO_IO_PROFILE`
+** environment variable, the first time that it is used. Profiles are stored in
+** a simple text format with one entry per line:
+**
+**   <st_dev> <sequential|random> <read method> <read size> <write method> <write size>
+**
+** where the methods are the numeric values of the corresponding `io_method`
+** bitmasks, and lines starting with `#` are ignored. Entries whose methods are
+** not valid `io_method` states, or that use `mmap` for writing (which requires
+** the maximum file size to be known in advance), are rejected. Note that device IDs of
+** some file systems (e.g. `tmpfs`) are not stable across reboots, so the
+** profile may need to be regenerated.
+*/
+
+#ifndef Z5D0B8E27_6C41_4A9F_93E2_B7F1C40A58D6
+#define Z5D0B8E27_6C41_4A9F_93E2_B7F1C40A58D6
+
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <system_error>
+#include <vector>
+#include <boost/optional.hpp>
+#include <ccbase/error.hpp>
+#include <ccbase/format.hpp>
+#include <neo/core/access_mode.hpp>
+#include <neo/core/file/io_method.hpp>
+#include <neo/core/file/system.hpp>
+
+namespace neo {
+namespace file {
+
+struct profile_entry
+{
+	dev_t device;
+	access_mode mode;
+	io_method read_method;
+	size_t read_size;
+	io_method write_method;
+	size_t write_size;
+};
+
+class profile
+{
+	std::vector<profile_entry> m_entries{};
+public:
+	static cc::expected<profile> load(const char* path)
+	{
+		auto is = std::ifstream{path};
+		if (!is) { return current_system_error(); }
+
+		auto p = profile{};
+		auto line = std::string{};
+		auto n = size_t{0};
+
+		while (std::getline(is, line)) {
+			++n;
+			if (line.empty() || line[0] == '#') { continue; }
+
+			auto ss = std::istringstream{line};
+			auto dev = 0ull;
+			auto mode = std::string{};
+			auto rm = unsigned{};
+			auto wm = unsigned{};
+			auto e = profile_entry{};
+
+			ss >> dev >> mode >> rm >> e.read_size >> wm >> e.write_size;
+			if (!ss || (mode != "sequential" && mode != "random")) {
+				return std::runtime_error{cc::format(
+					"Malformed entry on line $ of IO profile "
+					"\"$\".", n, path)};
+			}
+
+			e.device = (dev_t)dev;
+			e.mode = mode == "sequential" ? access_mode::sequential :
+				access_mode::random;
+			e.read_method = (io_method)rm;
+			e.write_method = (io_method)wm;
+			if (
+				!is_valid(e.read_method) ||
+				!is_valid(e.write_method) ||
+				!!(e.write_method & io_method::mmap)
+			) {
+				return std::runtime_error{cc::format(
+					"Invalid IO method on line $ of IO profile "
+					"\"$\".", n, path)};
+			}
+			p.insert(e);
+		}
+		return p;
+	}
+
+	cc::expected<void> save(const char* path) const
+	{
+		auto os = std::ofstream{path};
+		if (!os) { return current_system_error(); }
+
+		os << "# device access read_method read_size write_method "
+			"write_size\n";
+		for (const auto& e : m_entries) {
+			os << (unsigned long long)e.device << ' '
+				<< (e.mode == access_mode::sequential ?
+					"sequential" : "random") << ' '
+				<< (unsigned)e.read_method << ' '
+				<< e.read_size << ' '
+				<< (unsigned)e.write_method << ' '
+				<< e.write_size << '\n';
+		}
+
+		os.flush();
+		if (!os) { return current_system_error(); }
+		return true;
+	}
+
+	/*
+	** Returns the profile loaded from the path in the `NEO_IO_PROFILE`
+	** environment variable, or an empty profile if the variable is not set
+	** or the file cannot be read.
+	*/
+	static const profile& global()
+	{
+		static const profile p = [] {
+			auto path = std::getenv("NEO_IO_PROFILE");
+			if (path == nullptr) { return profile{}; }
+
+			auto r = load(path);
+			return r ? r.move() : profile{};
+		}();
+		return p;
+	}
+
+	const std::vector<profile_entry>& entries() const
+	{ return m_entries; }
+
+	boost::optional<profile_entry>
+	lookup(dev_t dev, access_mode m) const
+	{
+		for (const auto& e : m_entries) {
+			if (e.device == dev && e.mode == m) { return e; }
+		}
+		return boost::none;
+	}
+
+	/*
+	** Adds the given entry, replacing any existing entry for the same
+	** device and access mode.
+	*/
+	profile& insert(const profile_entry& e)
+	{
+		for (auto& x : m_entries) {
+			if (x.device == e.device && x.mode == e.mode) {
+				x = e;
+				return *this;
+			}
+		}
+		m_entries.push_back(e);
+		return *this;
+	}
+};
+
+}}
+
+#endif
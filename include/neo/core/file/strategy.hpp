@@ -15,7 +15,9 @@
 **   2. If you are writing to the file and know the maximum file size, supply
 **   this information using the corresponding setter function.
 **   3. Invoke the `infer_defaults` member function to set parameters to default
-**   values based on the information about the file that you provided. These
+**   values based on the information about the file that you provided. If the
+**   global `profile` (see `profile.hpp`) has an entry for the file system
+**   containing the file, then the calibrated values are used. Otherwise, the
 **   values are chosen based on [this benchmark][io_benchmark].
 **   4. Obtain a handle a file using the `open` function.
 **
@@ -25,7 +27,10 @@
 ** file system, kernel version, and so on.
 **
 ** If you are interested in optimizing the IO performance on your platform, then
-** I suggest running the benchmark on your platform. The results of the
+** I suggest running the `calibrate` function (see `calibrate.hpp`) on each file
+** system that you use, and saving the results to the file referred to by the
+** `NEO_IO_PROFILE` environment variable. Alternatively, you can run the
+** benchmark on your platform. The results of the
 ** benchmark can then be used to manually tune the `strategy` parameters. If you
 ** are able to, please send the benchmark results to me, so that the library can
 ** work better on more platforms like yours, without any manual tuning.
@@ -59,6 +64,8 @@
 #include <neo/core/io_mode.hpp>
 #include <neo/core/buffer_constraints.hpp>
 #include <neo/core/file/io_method.hpp>
+#include <neo/core/file/map_option.hpp>
+#include <neo/core/file/profile.hpp>
 #include <neo/core/file/system.hpp>
 
 namespace neo {
@@ -76,8 +83,12 @@ class strategy
 	boost::optional<off_t> m_cur_fs{};
 	boost::optional<off_t> m_max_fs{};
 	boost::optional<blksize_t> m_blksize{};
+	boost::optional<dev_t> m_dev{};
 	boost::optional<io_method> m_read_mtd{};
 	boost::optional<io_method> m_write_mtd{};
+	boost::optional<unsigned> m_queue_depth{};
+	map_option m_map_opts{map_option::none};
+	boost::optional<size_t> m_map_window{};
 	bool m_rdahead{};
 	bool m_preallocate{};
 public:
@@ -113,10 +124,19 @@ public:
 		}
 	} 
 
-	strategy& infer_defaults(access_mode);
+	/*
+	** Sets the parameters to default values, using the entry of the given
+	** profile for the device containing the file if there is one. The
+	** first overload uses the global profile.
+	*/
+	strategy& infer_defaults(access_mode m)
+	{ return infer_defaults(m, profile::global()); }
+
+	strategy& infer_defaults(access_mode, const profile&);
 
 	/*
-	** Updates the file size and block size by invoking `stat` on `path`.
+	** Updates the file size, block size, and device ID by invoking `stat`
+	** on `path`.
 	** The `infer_defaults` function must be called explicitly in order to
 	** recalibrate the other parameters based on the new information. If the
 	** file size and block size have not changed much, calling
@@ -132,6 +152,7 @@ public:
 		else {
 			m_blksize = st.st_blksize;
 		}
+		m_dev = st.st_dev;
 
 		if (m_cur_fs && m_max_fs) {
 			assert(m_max_fs > m_cur_fs);
@@ -298,6 +319,42 @@ public:
 		return *this;
 	}
 
+	/*
+	** Sets the number of requests that can be in flight at once when the
+	** `uring` IO method is used. This determines the size of the
+	** submission queue created by `open`.
+	*/
+	strategy& queue_depth(unsigned n)
+	{
+		assert(n > 0);
+		m_queue_depth = n;
+		return *this;
+	}
+
+	/*
+	** Sets the hints that are applied to the file when it is
+	** memory-mapped. These have no effect unless one of the IO methods is
+	** `mmap`.
+	*/
+	strategy& map_options(map_option m)
+	{
+		m_map_opts = m;
+		return *this;
+	}
+
+	/*
+	** Requests that files read using `mmap` be mapped one window of `n`
+	** bytes at a time, rather than in their entirety. The handle returned
+	** by `open` is then left unmapped, and the file should be read using
+	** `window_reader`.
+	*/
+	strategy& map_window(size_t n)
+	{
+		assert(n > 0);
+		m_map_window = n;
+		return *this;
+	}
+
 	strategy& read_ahead(bool b)
 	{
 		assert(!!(IOMode & io_mode::input));
@@ -314,14 +371,86 @@ public:
 	}
 
 	DEFINE_COPY_GETTER_SETTER(strategy, block_size, m_blksize)
+	DEFINE_COPY_GETTER_SETTER(strategy, device, m_dev)
 	DEFINE_COPY_GETTER(current_file_size, m_cur_fs)
 	DEFINE_COPY_GETTER(maximum_file_size, m_max_fs)
 	DEFINE_COPY_GETTER(read_method, m_read_mtd)
 	DEFINE_COPY_GETTER(write_method, m_write_mtd)
+	DEFINE_COPY_GETTER(queue_depth, m_queue_depth)
+	DEFINE_COPY_GETTER(map_options, m_map_opts)
+	DEFINE_COPY_GETTER(map_window, m_map_window)
 	DEFINE_COPY_GETTER(read_ahead, m_rdahead)
 	DEFINE_COPY_GETTER(preallocate, m_preallocate)
+private:
+	void apply(const profile_entry&);
+	void apply_builtin(access_mode);
 };
 
+/*
+** Sets the parameters using the calibrated values in the given profile
+** entry.
+*/
+template <io_mode IOMode>
+void strategy<IOMode>::apply(const profile_entry& e)
+{
+	auto align = m_blksize ? *m_blksize : ::getpagesize();
+	auto seq = e.mode == access_mode::sequential;
+
+	if (!!(IOMode & io_mode::input)) {
+		assert(m_cur_fs && "Current file size required.");
+		m_read_mtd = e.read_method;
+		m_rdahead = seq && !(e.read_method & io_method::direct);
+		if (!!(e.read_method & io_method::mmap)) {
+			m_map_opts = seq ? map_option::sequential :
+				map_option::random;
+		}
+		m_ipref.at_least(e.read_size).align_to(align);
+		if (!!(e.read_method & io_method::direct)) {
+			m_ireq.align_to(align);
+		}
+	}
+	if (!!(IOMode & io_mode::output)) {
+		if (m_max_fs && (!m_cur_fs || *m_max_fs > *m_cur_fs)) {
+			m_preallocate = true;
+		}
+		m_write_mtd = e.write_method;
+		m_opref.at_least(e.write_size).align_to(align);
+		if (!!(e.write_method & io_method::direct)) {
+			m_oreq.align_to(align);
+		}
+	}
+	if (IOMode == (io_mode::input | io_mode::output)) {
+		/*
+		** The calibration never selects `mmap` for writing, so we
+		** cannot use it for reading either if the buffers are to be
+		** shared.
+		*/
+		if (!!(*m_read_mtd & io_method::mmap)) {
+			m_read_mtd = io_method::buffer | io_method::paging;
+		}
+		if (!!(*m_read_mtd & io_method::direct) ||
+			!!(*m_write_mtd & io_method::direct))
+		{
+			m_ioreq.align_to(align);
+		}
+		m_iopref.align_to(align);
+	}
+}
+
+template <io_mode IOMode>
+strategy<IOMode>&
+strategy<IOMode>::infer_defaults(access_mode m, const profile& p)
+{
+	if (m_dev) {
+		if (auto e = p.lookup(*m_dev, m)) {
+			apply(*e);
+			return *this;
+		}
+	}
+	apply_builtin(m);
+	return *this;
+}
+
 /*
 ** Sets the parameters to default values based on the results of [this
 ** benchmark][io_benchmark].
@@ -329,7 +458,7 @@ public:
 ** [io_benchmark]: http://adityaramesh.com/io_benchmark/
 */
 template <io_mode IOMode>
-strategy<IOMode>& strategy<IOMode>::infer_defaults(access_mode m)
+void strategy<IOMode>::apply_builtin(access_mode m)
 {
 	if (IOMode == io_mode::input) {
 		assert(m_cur_fs && "Current file size required.");
@@ -417,7 +546,6 @@ strategy<IOMode>& strategy<IOMode>::infer_defaults(access_mode m)
 			m_iopref.align_to(*m_blksize);
 		}
 	}
-	return *this;
 }
 
 template <io_mode IOMode>
@@ -460,6 +588,22 @@ std::ostream& operator<<(std::ostream& os, const strategy<IOMode>& s)
 		cc::writeln(os, " * Block size: not provided.");
 	}
 
+	if (s.queue_depth()) {
+		cc::writeln(os, " * Queue depth: $.", *s.queue_depth());
+	}
+	else {
+		cc::writeln(os, " * Queue depth: not provided.");
+	}
+
+	cc::writeln(os, " * Map options: $.", s.map_options());
+
+	if (s.map_window()) {
+		cc::writeln(os, " * Map window: $.", *s.map_window());
+	}
+	else {
+		cc::writeln(os, " * Map window: entire file.");
+	}
+
 	cc::writeln(os, " * Read ahead: $.", s.read_ahead());
 	cc::writeln(os, " * Preallocate: $.", s.preallocate());
 	return os;
@@ -20,6 +20,8 @@
 	#include <sys/types.h>
 	#include <sys/stat.h>
 	#include <sys/mman.h>
+	#include <sys/resource.h>
+	#include <sys/uio.h>
 	#include <unistd.h>
 	#include <fcntl.h>
 #else
@@ -127,6 +129,74 @@ full_write(int fd, uint8_t* buf, size_t count, off_t offset)
 	return true;
 }
 
+namespace detail {
+
+/*
+** Advances the array of `iovec`s past the first `n` bytes, modifying the
+** partially-consumed entry in place.
+*/
+void advance_iovecs(iovec*& iov, int& cnt, size_t n)
+{
+	while (cnt > 0 && n >= iov->iov_len) {
+		n -= iov->iov_len;
+		++iov;
+		--cnt;
+	}
+	if (cnt > 0) {
+		iov->iov_base = (uint8_t*)iov->iov_base + n;
+		iov->iov_len -= n;
+	}
+}
+
+}
+
+/*
+** Vectored analogs of `full_read` and `full_write`. Note that the contents of
+** the `iovec` array are modified in the event of a short transfer.
+*/
+
+cc::expected<void>
+full_readv(int fd, iovec* iov, int cnt, off_t offset)
+{
+	auto c = size_t{0};
+	while (cnt > 0) {
+		auto r = ::preadv(fd, iov, cnt, offset + c);
+		if (r > 0) {
+			c += r;
+			detail::advance_iovecs(iov, cnt, r);
+		}
+		else if (r == 0) {
+			return true;
+		}
+		else {
+			if (errno == EINTR) { continue; }
+			return current_system_error();
+		}
+	}
+	return true;
+}
+
+cc::expected<void>
+full_writev(int fd, iovec* iov, int cnt, off_t offset)
+{
+	auto c = size_t{0};
+	while (cnt > 0) {
+		auto r = ::pwritev(fd, iov, cnt, offset + c);
+		if (r > 0) {
+			c += r;
+			detail::advance_iovecs(iov, cnt, r);
+		}
+		else if (r == 0) {
+			return true;
+		}
+		else {
+			if (errno == EINTR) { continue; }
+			return current_system_error();
+		}
+	}
+	return true;
+}
+
 cc::expected<void>
 safe_truncate(int fd, off_t fs)
 {
@@ -139,8 +209,60 @@ safe_truncate(int fd, off_t fs)
 	return true;
 }
 
+/*
+** The number of page faults taken by the process, as reported by `getrusage`.
+** Minor faults are serviced from the page cache, and major faults require IO.
+*/
+struct fault_count
+{
+	long minor;
+	long major;
+};
+
+fault_count current_fault_count() noexcept
+{
+	auto ru = rusage{};
+	::getrusage(RUSAGE_SELF, &ru);
+	return fault_count{ru.ru_minflt, ru.ru_majflt};
+}
+
+cc::expected<void>
+safe_madvise(void* p, size_t n, int advice)
+{
+	if (::madvise(p, n, advice) == -1) {
+		return current_system_error();
+	}
+	return true;
+}
+
+cc::expected<void>
+safe_sync(int fd)
+{
+	auto r = int{};
+	do {
+		r = ::fsync(fd);
+	}
+	while (r == -1 && errno == EINTR);
+	if (r == -1) { return current_system_error(); }
+	return true;
+}
+
 #if PLATFORM_KERNEL == PLATFORM_KERNEL_LINUX
 
+/*
+** Evicts the clean pages of the file in the range `[off, off + len)` from the
+** page cache, so that subsequent reads go to the device. A length of zero
+** extends the range to the end of the file. Pages that are still mapped are not
+** evicted.
+*/
+cc::expected<void>
+safe_drop_cache(int fd, off_t off = 0, off_t len = 0)
+{
+	auto r = ::posix_fadvise(fd, off, len, POSIX_FADV_DONTNEED);
+	if (r != 0) { return std::system_error{r, std::system_category()}; }
+	return true;
+}
+
 cc::expected<void>
 safe_fadvise_sequential(int fd, off_t fs)
 {
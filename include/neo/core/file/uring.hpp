@@ -0,0 +1,512 @@
+/*
+** File Name: uring.hpp
+** Author:    Aditya Ramesh
+** Date:      07/21/2014
+** Contact:   _@adityaramesh.com
+**
+** This file defines the `uring` class, a thin wrapper over Linux's io_uring
+** interface that is used to keep many read and write requests in flight on a
+** single file handle. Requests are batched: `prepare_read` and `prepare_write`
+** only fill submission queue entries, and the kernel is not entered until
+** `submit` is called (or the submission queue is full).
+**
+** Buffers and file descriptors can be registered with the ring, so that the
+** kernel does not need to pin the pages or look up the file for every request.
+** Registration is explicit, because the pages of a registered buffer remain
+** pinned until the ring is destroyed or the buffers are unregistered. The
+** caller must not free a registered buffer before calling
+** `unregister_buffers`.
+**
+** If the kernel does not support io_uring (or it has been disabled), the ring
+** is constructed in emulated mode: each prepared request is immediately
+** performed using `pread` or `pwrite`, and its completion is queued so that
+** it can be reaped in the usual way. This allows callers to use the same code
+** path regardless of kernel support.
+**
+** A single request transfers at most `max_uring_request` bytes, which is the
+** limit that Linux imposes on each read or write. Longer requests are truncated
+** to this size, and complete as short transfers.
+**
+** A ring is not thread-safe. The synchronous `file::read` and `file::write`
+** functions lock `sync_mutex()` while they use the ring, so that they can be
+** called concurrently on the same handle; requests queued using `enqueue_read`
+** and `enqueue_write` must not be mixed with concurrent synchronous calls.
+*/
+
+#ifndef Z4B1E7C2A_3F6D_4E8B_9A51_27C0D84E6F13
+#define Z4B1E7C2A_3F6D_4E8B_9A51_27C0D84E6F13
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <mutex>
+#include <vector>
+#include <neo/core/file/system.hpp>
+
+#if PLATFORM_KERNEL == PLATFORM_KERNEL_LINUX && !defined(NEO_NO_IO_URING)
+	#include <linux/io_uring.h>
+	#include <sys/syscall.h>
+	#include <sys/uio.h>
+	#define NEO_HAS_IO_URING
+#endif
+
+namespace neo {
+namespace file {
+
+/*
+** Describes the result of a request submitted to a `uring`. As with the raw
+** io_uring interface, `result` is the number of bytes transferred on success,
+** and the negated error code on failure.
+*/
+struct completion
+{
+	uint64_t tag;
+	int32_t result;
+};
+
+#ifdef NEO_HAS_IO_URING
+
+// The largest number of bytes that Linux transfers using a single request.
+static constexpr auto max_uring_request = size_t{0x7FFFF000};
+
+namespace detail {
+
+int uring_setup(unsigned entries, io_uring_params* p)
+{ return (int)::syscall(__NR_io_uring_setup, entries, p); }
+
+int uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags)
+{
+	return (int)::syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+		flags, nullptr, 0);
+}
+
+int uring_register(int fd, unsigned opcode, const void* arg, unsigned n)
+{ return (int)::syscall(__NR_io_uring_register, fd, opcode, arg, n); }
+
+}
+
+class uring
+{
+	int m_fd{-1};
+	unsigned m_entries{};
+
+	uint8_t* m_sq_ring{nullptr};
+	size_t m_sq_ring_size{};
+	uint8_t* m_cq_ring{nullptr};
+	size_t m_cq_ring_size{};
+	io_uring_sqe* m_sqes{nullptr};
+	size_t m_sqes_size{};
+
+	unsigned* m_sq_head{};
+	unsigned* m_sq_tail{};
+	unsigned* m_sq_mask{};
+	unsigned* m_sq_array{};
+	unsigned* m_cq_head{};
+	unsigned* m_cq_tail{};
+	unsigned* m_cq_mask{};
+	io_uring_cqe* m_cqes{};
+
+	// Number of prepared entries that have not yet been submitted.
+	unsigned m_pending{};
+	// Number of submitted entries whose completions have not been reaped.
+	unsigned m_inflight{};
+
+	std::vector<iovec> m_bufs{};
+	std::vector<int> m_files{};
+
+	/*
+	** Completions that were reaped while waiting for a specific request,
+	** and completions produced in emulated mode.
+	*/
+	std::vector<completion> m_stash{};
+	// Serializes the synchronous transfers that use this ring.
+	std::mutex m_sync_mutex{};
+public:
+	/*
+	** Creates a ring with room for `entries` requests in flight. If the
+	** kernel does not support io_uring, the ring is created in emulated
+	** mode; check `emulated()` to find out which one happened.
+	*/
+	explicit uring(unsigned entries) : m_entries{entries}
+	{
+		assert(entries > 0);
+
+		auto p = io_uring_params{};
+		std::memset(&p, 0, sizeof(p));
+
+		auto fd = detail::uring_setup(entries, &p);
+		if (fd == -1) {
+			if (errno == ENOSYS || errno == EPERM || errno == EINVAL) {
+				return;
+			}
+			throw current_system_error();
+		}
+		m_fd = fd;
+		m_entries = p.sq_entries;
+
+		m_sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+		m_cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+		m_sqes_size = p.sq_entries * sizeof(io_uring_sqe);
+
+		/*
+		** Newer kernels allow both rings to be mapped using a single
+		** call to `mmap`.
+		*/
+		auto single_mmap = !!(p.features & IORING_FEAT_SINGLE_MMAP);
+		if (single_mmap) {
+			m_sq_ring_size = m_cq_ring_size =
+				std::max(m_sq_ring_size, m_cq_ring_size);
+		}
+
+		// The destructor does not run if the constructor throws.
+		try {
+			m_sq_ring = map_region(m_sq_ring_size, IORING_OFF_SQ_RING);
+			if (single_mmap) {
+				m_cq_ring = m_sq_ring;
+			}
+			else {
+				m_cq_ring = map_region(m_cq_ring_size,
+					IORING_OFF_CQ_RING);
+			}
+			m_sqes = (io_uring_sqe*)map_region(m_sqes_size,
+				IORING_OFF_SQES);
+		}
+		catch (...) {
+			release();
+			throw;
+		}
+
+		m_sq_head  = (unsigned*)(m_sq_ring + p.sq_off.head);
+		m_sq_tail  = (unsigned*)(m_sq_ring + p.sq_off.tail);
+		m_sq_mask  = (unsigned*)(m_sq_ring + p.sq_off.ring_mask);
+		m_sq_array = (unsigned*)(m_sq_ring + p.sq_off.array);
+		m_cq_head  = (unsigned*)(m_cq_ring + p.cq_off.head);
+		m_cq_tail  = (unsigned*)(m_cq_ring + p.cq_off.tail);
+		m_cq_mask  = (unsigned*)(m_cq_ring + p.cq_off.ring_mask);
+		m_cqes     = (io_uring_cqe*)(m_cq_ring + p.cq_off.cqes);
+	}
+
+	uring(const uring&) = delete;
+	uring& operator=(const uring&) = delete;
+
+	~uring() { release(); }
+
+	bool emulated() const { return m_fd == -1; }
+	unsigned entries() const { return m_entries; }
+	unsigned pending() const { return m_pending; }
+	unsigned in_flight() const { return m_inflight + m_pending; }
+
+	/*
+	** Returns the mutex that must be held while the ring is used by a
+	** synchronous transfer.
+	*/
+	std::mutex& sync_mutex() { return m_sync_mutex; }
+
+	/*
+	** Registers the file descriptor with the ring, and returns its index
+	** in the table of registered files. Requests for registered files
+	** should use this index instead of the file descriptor.
+	*/
+	cc::expected<int> register_file(int fd)
+	{
+		m_files.push_back(fd);
+		if (emulated()) { return (int)m_files.size() - 1; }
+
+		if (m_files.size() > 1) {
+			detail::uring_register(m_fd, IORING_UNREGISTER_FILES,
+				nullptr, 0);
+		}
+		auto r = detail::uring_register(m_fd, IORING_REGISTER_FILES,
+			m_files.data(), m_files.size());
+		if (r == -1) {
+			m_files.pop_back();
+			return current_system_error();
+		}
+		return (int)m_files.size() - 1;
+	}
+
+	/*
+	** Registers the given memory region with the ring, and returns its
+	** index in the table of registered buffers.
+	*/
+	cc::expected<int> register_buffer(uint8_t* p, size_t n)
+	{
+		m_bufs.push_back(iovec{p, n});
+		if (emulated()) { return (int)m_bufs.size() - 1; }
+
+		if (m_bufs.size() > 1) {
+			detail::uring_register(m_fd, IORING_UNREGISTER_BUFFERS,
+				nullptr, 0);
+		}
+		auto r = detail::uring_register(m_fd, IORING_REGISTER_BUFFERS,
+			m_bufs.data(), m_bufs.size());
+		if (r == -1) {
+			m_bufs.pop_back();
+			return current_system_error();
+		}
+		return (int)m_bufs.size() - 1;
+	}
+
+	cc::expected<void> unregister_buffers()
+	{
+		if (m_bufs.empty()) { return true; }
+		m_bufs.clear();
+		if (emulated()) { return true; }
+
+		auto r = detail::uring_register(m_fd, IORING_UNREGISTER_BUFFERS,
+			nullptr, 0);
+		if (r == -1) { return current_system_error(); }
+		return true;
+	}
+
+	/*
+	** Returns the index of the registered buffer that contains the range
+	** `[p, p + n)`, or -1 if no such buffer exists.
+	*/
+	int buffer_index(const uint8_t* p, size_t n) const
+	{
+		for (auto i = size_t{0}; i != m_bufs.size(); ++i) {
+			auto b = (const uint8_t*)m_bufs[i].iov_base;
+			if (p >= b && p + n <= b + m_bufs[i].iov_len) {
+				return (int)i;
+			}
+		}
+		return -1;
+	}
+
+	/*
+	** Queues a read of `n` bytes at offset `off` of the file with the
+	** given index in the table of registered files.
+	*/
+	cc::expected<void>
+	prepare_read(int file, uint8_t* p, size_t n, off_t off, uint64_t tag)
+	{
+		if (n > max_uring_request) { n = max_uring_request; }
+		if (emulated()) {
+			auto r = emulated_transfer<true>(m_files[file], p, n, off);
+			m_stash.push_back(completion{tag, r});
+			return true;
+		}
+
+		auto buf = buffer_index(p, n);
+		auto op = buf == -1 ? IORING_OP_READ : IORING_OP_READ_FIXED;
+		return prepare(op, file, p, n, off, tag, buf);
+	}
+
+	cc::expected<void>
+	prepare_write(int file, const uint8_t* p, size_t n, off_t off, uint64_t tag)
+	{
+		if (n > max_uring_request) { n = max_uring_request; }
+		if (emulated()) {
+			auto r = emulated_transfer<false>(m_files[file],
+				(uint8_t*)p, n, off);
+			m_stash.push_back(completion{tag, r});
+			return true;
+		}
+
+		auto buf = buffer_index(p, n);
+		auto op = buf == -1 ? IORING_OP_WRITE : IORING_OP_WRITE_FIXED;
+		return prepare(op, file, (uint8_t*)p, n, off, tag, buf);
+	}
+
+	/*
+	** Submits all prepared requests to the kernel using a single system
+	** call, and returns the number of requests submitted.
+	*/
+	cc::expected<unsigned> submit()
+	{
+		if (emulated() || m_pending == 0) { return 0u; }
+
+		auto r = int{};
+		do {
+			r = detail::uring_enter(m_fd, m_pending, 0, 0);
+		}
+		while (r == -1 && errno == EINTR);
+
+		if (r == -1) { return current_system_error(); }
+		m_pending -= r;
+		m_inflight += r;
+		return (unsigned)r;
+	}
+
+	/*
+	** Copies up to `max` completions to `out`, blocking until at least
+	** `min` completions are available. Returns the number of completions
+	** copied.
+	*/
+	cc::expected<size_t> reap(completion* out, size_t max, size_t min = 1)
+	{
+		assert(min <= max);
+		auto c = std::min(m_stash.size(), max);
+		std::copy_n(m_stash.begin(), c, out);
+		m_stash.erase(m_stash.begin(), m_stash.begin() + c);
+		if (emulated() || c >= max) { return c; }
+
+		auto r = reap_kernel(out + c, max - c, min > c ? min - c : 0);
+		if (!r) { return r.exception(); }
+		return c + *r;
+	}
+
+	/*
+	** Blocks until the request with the given tag has completed, and
+	** returns its result. Completions for other requests that are reaped
+	** in the meantime are retained for subsequent calls to `reap`.
+	*/
+	cc::expected<int32_t> wait_for(uint64_t tag)
+	{
+		for (;;) {
+			auto it = std::find_if(m_stash.begin(), m_stash.end(),
+				[&] (const completion& c) { return c.tag == tag; });
+			if (it != m_stash.end()) {
+				auto r = it->result;
+				m_stash.erase(it);
+				return r;
+			}
+			assert(m_inflight + m_pending > 0 && "Request not found.");
+
+			auto c = completion{};
+			auto r = reap_one(c);
+			if (!r) { return r.exception(); }
+			if (c.tag == tag) { return c.result; }
+			m_stash.push_back(c);
+		}
+	}
+private:
+	void release()
+	{
+		if (m_sqes != nullptr) {
+			::munmap(m_sqes, m_sqes_size);
+			m_sqes = nullptr;
+		}
+		if (m_cq_ring != nullptr && m_cq_ring != m_sq_ring) {
+			::munmap(m_cq_ring, m_cq_ring_size);
+		}
+		m_cq_ring = nullptr;
+		if (m_sq_ring != nullptr) {
+			::munmap(m_sq_ring, m_sq_ring_size);
+			m_sq_ring = nullptr;
+		}
+		if (m_fd != -1) {
+			safe_close(m_fd);
+			m_fd = -1;
+		}
+	}
+
+	uint8_t* map_region(size_t n, off_t off)
+	{
+		auto p = (uint8_t*)::mmap(nullptr, n, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, m_fd, off);
+		if (p == (uint8_t*)-1) { throw current_system_error(); }
+		return p;
+	}
+
+	/*
+	** Performs the transfer using `pread` or `pwrite`, and returns the
+	** number of bytes transferred, as the kernel would. An error is only
+	** reported if no bytes were transferred.
+	*/
+	template <bool Read>
+	static int32_t
+	emulated_transfer(int fd, uint8_t* p, size_t n, off_t off)
+	{
+		auto c = size_t{0};
+		while (c < n) {
+			auto r = Read ?
+				::pread(fd, p + c, n - c, off + c) :
+				::pwrite(fd, p + c, n - c, off + c);
+			if (r > 0) {
+				c += r;
+			}
+			else if (r == 0) {
+				break;
+			}
+			else if (errno != EINTR) {
+				if (c == 0) { return -errno; }
+				break;
+			}
+		}
+		return (int32_t)c;
+	}
+
+	cc::expected<void>
+	prepare(uint8_t op, int file, uint8_t* p, size_t n, off_t off,
+		uint64_t tag, int buf)
+	{
+		if (m_pending == m_entries) {
+			auto r = submit();
+			if (!r) { return r.exception(); }
+		}
+
+		auto tail = *m_sq_tail;
+		auto i = tail & *m_sq_mask;
+		auto& e = m_sqes[i];
+		std::memset(&e, 0, sizeof(e));
+
+		e.opcode    = op;
+		e.flags     = IOSQE_FIXED_FILE;
+		e.fd        = file;
+		e.off       = off;
+		e.addr      = (uint64_t)p;
+		e.len       = (uint32_t)n;
+		e.user_data = tag;
+		if (buf != -1) { e.buf_index = buf; }
+
+		m_sq_array[i] = i;
+		__atomic_store_n(m_sq_tail, tail + 1, __ATOMIC_RELEASE);
+		++m_pending;
+		return true;
+	}
+
+	size_t reap_available(completion* out, size_t max)
+	{
+		auto head = *m_cq_head;
+		auto tail = __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE);
+		auto c = size_t{0};
+
+		for (; head != tail && c != max; ++head, ++c) {
+			auto& e = m_cqes[head & *m_cq_mask];
+			out[c] = completion{e.user_data, e.res};
+		}
+		__atomic_store_n(m_cq_head, head, __ATOMIC_RELEASE);
+		m_inflight -= c;
+		return c;
+	}
+
+	/*
+	** Like `reap`, but only considers completions posted by the kernel.
+	*/
+	cc::expected<size_t>
+	reap_kernel(completion* out, size_t max, size_t min)
+	{
+		if (m_pending != 0) {
+			auto r = submit();
+			if (!r) { return r.exception(); }
+		}
+
+		auto c = size_t{0};
+		for (;;) {
+			c += reap_available(out + c, max - c);
+			if (c >= min || m_inflight == 0) { return c; }
+
+			auto r = detail::uring_enter(m_fd, 0, 1,
+				IORING_ENTER_GETEVENTS);
+			if (r == -1 && errno != EINTR) {
+				return current_system_error();
+			}
+		}
+	}
+
+	cc::expected<void> reap_one(completion& c)
+	{
+		auto r = reap_kernel(&c, 1, 1);
+		if (!r) { return r.exception(); }
+		assert(*r == 1);
+		return true;
+	}
+};
+
+#endif
+
+}}
+
+#endif
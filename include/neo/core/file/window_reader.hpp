@@ -0,0 +1,200 @@
+/*
+** File Name: window_reader.hpp
+** Author:    Aditya Ramesh
+** Date:      07/25/2014
+** Contact:   _@adityaramesh.com
+**
+** The `window_reader` class reads a file through a memory mapping that covers
+** only a fixed-size window of the file at a time. This makes it possible to use
+** `mmap` for files that are too large to map in their entirety, e.g. on
+** machines with constrained virtual memory or a low `vm.max_map_count`. Only
+** one mapping exists at any time.
+**
+** The interface is the same as that of `prefetching_reader`: call `next(n)`,
+** where `n` is the number of bytes of the current window that were consumed,
+** to obtain the next window. The next window is mapped starting at the page
+** containing the first unconsumed byte, so consecutive windows overlap, and a
+** record that straddles the end of one window is contiguous at the start of the
+** next. Once the old window is unmapped, the pages of the file behind the new
+** window are evicted from the page cache using `POSIX_FADV_DONTNEED`, so that
+** scanning a large file does not displace the rest of the page cache.
+**
+** Windows are mapped privately and are writable, so that deserializers may
+** modify the data in place (e.g. to change the byte order) without affecting
+** the file.
+**
+** The window size is taken from `strategy::map_window`, and must be larger
+** than the minimum size permitted by the deserializer's required constraints
+** by at least one page; otherwise, a straddling record could never fit in a
+** window.
+*/
+
+#ifndef ZC2A7F0E5_4D18_4B93_8E6A_1F9B3D57A024
+#define ZC2A7F0E5_4D18_4B93_8E6A_1F9B3D57A024
+
+#include <algorithm>
+#include <neo/core/buffer_state.hpp>
+#include <neo/core/file/handle.hpp>
+#include <neo/core/file/strategy.hpp>
+#include <neo/core/file/system.hpp>
+
+namespace neo {
+namespace file {
+
+template <io_mode IOMode>
+class window_reader
+{
+	static_assert(!!(IOMode & io_mode::input), "Input IO mode required.");
+
+	int m_fd;
+	map_option m_opts;
+	size_t m_window;
+	size_t m_overlap;
+	off_t m_end;
+
+	uint8_t* m_map{};
+	off_t m_map_off{};
+	size_t m_map_size{};
+
+	uint8_t* m_data{};
+	size_t m_size{};
+	off_t m_off;
+public:
+	/*
+	** Creates a reader for the range `[off, end)` of the file.
+	*/
+	explicit window_reader(
+		const handle<IOMode>& h,
+		const strategy<IOMode>& s,
+		const buffer_state& bs,
+		off_t off,
+		off_t end
+	) : m_fd{h.descriptor()}, m_opts{s.map_options()}, m_end{end},
+	m_off{off}
+	{
+		assert(off <= end);
+		assert(s.map_window() && "Window size required.");
+
+		auto page = (size_t)::getpagesize();
+		auto carry = min_size(bs.required_constraints());
+		m_overlap = carry ? *carry : 0;
+
+		m_window = (*s.map_window() + page - 1) / page * page;
+		assert(m_window >= m_overlap + page &&
+			"Window is too small for the largest record.");
+	}
+
+	window_reader(const window_reader&) = delete;
+	window_reader& operator=(const window_reader&) = delete;
+
+	~window_reader() { unmap(); }
+
+	/*
+	** Returns the pointer to, size of, and offset of the current window.
+	*/
+	uint8_t* data() const { return m_data; }
+	size_t size() const { return m_size; }
+	off_t offset() const { return m_off; }
+	size_t window_size() const { return m_window; }
+
+	/*
+	** Releases the current window, of which the first `consumed` bytes were
+	** processed, and maps the next window. Returns the size of the new
+	** window, which is zero once the end of the range has been reached. Any
+	** bytes left over in the final window are discarded.
+	*/
+	cc::expected<size_t> next(size_t consumed)
+	{
+		assert(consumed <= m_size);
+		assert(m_size - consumed <= m_overlap &&
+			"Record is larger than the required buffer size.");
+		auto pos = m_off + (off_t)consumed;
+		auto page = (off_t)::getpagesize();
+		auto start = pos - pos % page;
+		auto stop = std::min(m_end, start + (off_t)m_window);
+
+		/*
+		** If the current window already extends to the end of the
+		** range, then the leftover bytes can never form a complete
+		** record.
+		*/
+		if (pos >= m_end || (m_data != nullptr &&
+			m_off + (off_t)m_size >= m_end))
+		{
+			unmap();
+			m_data = nullptr;
+			m_size = 0;
+			m_off = pos;
+			return size_t{0};
+		}
+
+		auto old_off = m_map_off;
+		auto old_size = m_map != nullptr ? m_map_size : 0;
+		unmap();
+
+		#if PLATFORM_KERNEL == PLATFORM_KERNEL_LINUX
+			if (old_size != 0 && start > old_off) {
+				auto r = safe_drop_cache(m_fd, old_off, std::min(
+					start - old_off, (off_t)old_size));
+				if (!r) { return r.exception(); }
+			}
+		#endif
+
+		auto flags = MAP_PRIVATE;
+		#if PLATFORM_KERNEL == PLATFORM_KERNEL_LINUX
+			if (!!(m_opts & map_option::populate)) {
+				flags |= MAP_POPULATE;
+			}
+		#endif
+
+		auto p = ::mmap(nullptr, stop - start, PROT_READ | PROT_WRITE,
+			flags, m_fd, start);
+		if (p == MAP_FAILED) { return current_system_error(); }
+
+		m_map = (uint8_t*)p;
+		m_map_off = start;
+		m_map_size = stop - start;
+
+		auto r = advise();
+		if (!r) { return r.exception(); }
+
+		m_data = m_map + (pos - start);
+		m_size = stop - pos;
+		m_off = pos;
+		return m_size;
+	}
+private:
+	cc::expected<void> advise()
+	{
+		if (!!(m_opts & map_option::sequential)) {
+			auto r = safe_madvise(m_map, m_map_size, MADV_SEQUENTIAL);
+			if (!r) { return r; }
+		}
+		if (!!(m_opts & map_option::random)) {
+			auto r = safe_madvise(m_map, m_map_size, MADV_RANDOM);
+			if (!r) { return r; }
+		}
+		if (!!(m_opts & map_option::will_need)) {
+			auto r = safe_madvise(m_map, m_map_size, MADV_WILLNEED);
+			if (!r) { return r; }
+		}
+		#ifdef MADV_HUGEPAGE
+			if (!!(m_opts & map_option::huge_pages)) {
+				::madvise(m_map, m_map_size, MADV_HUGEPAGE);
+			}
+		#endif
+		return true;
+	}
+
+	void unmap()
+	{
+		if (m_map != nullptr) {
+			::munmap(m_map, m_map_size);
+			m_map = nullptr;
+		}
+	}
+};
+
+}}
+
+#endif
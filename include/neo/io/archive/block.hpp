@@ -0,0 +1,423 @@
+/*
+** File Name: block.hpp
+** Author:    Aditya Ramesh
+** Date:      07/27/2014
+** Contact:   _@adityaramesh.com
+**
+** This file defines the functions used to read and write block-compressed
+** archives. In such an archive, consecutive records are grouped into blocks of
+** `records_per_block` records each (the last block may have fewer), and each
+** block is compressed independently using the codec in `lz.hpp`. The header of
+** the archive has version `compressed_version`, and is followed by a block
+** format section that records the codec, shuffle width, and block size; refer
+** to `notes/archive_format.md` for the layout.
+**
+** To write an archive, set `io_state::compressed`, call `write_header` and
+** `write_block_format`, and then use `format` to write the records of each
+** block into a staging buffer, which is passed to `compress_block`. The offsets
+** of the compressed blocks can be saved in a `record_index`, so that blocks can
+** later be located in constant time.
+**
+** To read an archive, set `io_state::compressed` (otherwise, `read_header`
+** rejects the archive, since its blocks cannot be scanned directly), call
+** `read_header` and `read_block_format`, and then use
+** `decompress_block` (or `decompress_blocks`, which decompresses many blocks in
+** parallel) to recover the records of each block. The decompressed buffers can
+** be passed to `scan` and `scan_n` as usual.
+*/
+
+#ifndef Z2F6A9C07_E3B1_4D28_95C4_7B0E1D83A6F2
+#define Z2F6A9C07_E3B1_4D28_95C4_7B0E1D83A6F2
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstring>
+#include <exception>
+#include <new>
+#include <thread>
+#include <vector>
+#include <ccbase/format.hpp>
+#include <neo/core/operation_status.hpp>
+#include <neo/io/archive/definitions.hpp>
+#include <neo/io/archive/lz.hpp>
+#include <neo/io/archive/scan.hpp>
+
+namespace neo {
+namespace archive {
+
+enum class codec : uint8_t
+{
+	none = 0,
+	lz   = 1,
+};
+
+struct block_format
+{
+	codec method;
+	// The width by which blocks are shuffled before compression.
+	uint8_t shuffle_width;
+	uint32_t records_per_block;
+};
+
+// codec + shuffle width + reserved + records per block
+static constexpr auto block_format_size = size_t{1 + 1 + 2 + 4};
+// decompressed size + stored size
+static constexpr auto frame_header_size = size_t{4 + 4};
+
+/*
+** Returns the block format used by default for the given element type. The
+** shuffle width is the size of the scalars of the element, if they all have
+** the same size.
+*/
+template <class SerializedType>
+block_format default_block_format(uint32_t records_per_block)
+{
+	static constexpr auto width =
+	detail::scalar_info<SerializedType>::uniform_size;
+	return block_format{codec::lz, uint8_t{width == 0 ? 1 : width},
+		records_per_block};
+}
+
+/*
+** Returns the largest possible size of a compressed block whose decompressed
+** size is `n` bytes. Blocks that do not compress are stored as they are.
+*/
+constexpr size_t max_frame_size(size_t n)
+{ return frame_header_size + n; }
+
+template <class SerializedType>
+operation_status
+write_block_format(
+	uint8_t* buf, size_t n,
+	const block_format& f,
+	io_state<SerializedType>& is,
+	buffer_state& bs, error_state&
+) noexcept
+{
+	(void)n;
+	(void)is;
+	assert(n >= block_format_size);
+	assert(is.compressed());
+	assert(f.records_per_block > 0);
+
+	buf[0] = static_cast<uint8_t>(f.method);
+	buf[1] = f.shuffle_width;
+	buf[2] = buf[3] = 0;
+	std::memcpy(buf + 4, &f.records_per_block, 4);
+	bs.consumed(block_format_size);
+	return operation_status::success;
+}
+
+template <class SerializedType>
+operation_status
+read_block_format(
+	const uint8_t* buf, size_t n,
+	block_format& f,
+	io_state<SerializedType>& is,
+	buffer_state& bs, error_state& es
+) noexcept
+{
+	(void)n;
+	assert(n >= block_format_size);
+	bs.consumed(block_format_size);
+
+	if (!is.compressed()) {
+		es.push_record(
+			severity::critical,
+			context{offset_type{0}, uint8_t{0}},
+			"Archive is not block-compressed."
+		);
+		return operation_status::failure |
+			operation_status::fatal_error;
+	}
+
+	f.method = static_cast<codec>(buf[0]);
+	f.shuffle_width = buf[1];
+	std::memcpy(&f.records_per_block, buf + 4, 4);
+	if (is.flip_integers()) {
+		f.records_per_block = cc::bswap(f.records_per_block);
+	}
+
+	if (f.method != codec::none && f.method != codec::lz) {
+		es.push_record(
+			severity::critical,
+			context{offset_type{0}, uint8_t{0}},
+			"Unsupported codec."
+		);
+		return operation_status::failure |
+			operation_status::fatal_error;
+	}
+	if (f.records_per_block == 0) {
+		es.push_record(
+			severity::critical,
+			context{offset_type{0}, uint8_t{0}},
+			"Blocks must contain at least one record."
+		);
+		return operation_status::failure |
+			operation_status::fatal_error;
+	}
+	return operation_status::success;
+}
+
+namespace detail {
+
+/*
+** Returns a per-thread scratch buffer of at least `n` bytes.
+*/
+uint8_t* block_scratch(size_t n)
+{
+	static thread_local std::vector<uint8_t> buf;
+	if (buf.size() < n) { buf.resize(n); }
+	return buf.data();
+}
+
+void read_frame_header(
+	const uint8_t* buf, bool flip,
+	uint32_t& size, uint32_t& stored
+)
+{
+	std::memcpy(&size, buf, 4);
+	std::memcpy(&stored, buf + 4, 4);
+	if (flip) {
+		size = cc::bswap(size);
+		stored = cc::bswap(stored);
+	}
+}
+
+}
+
+/*
+** Compresses the block of `n` bytes at `src` into `dst`, which must have room
+** for `max_frame_size(n)` bytes.
+*/
+template <class SerializedType>
+operation_status
+compress_block(
+	const uint8_t* src, size_t n,
+	uint8_t* dst, size_t cap,
+	const block_format& f,
+	const io_state<SerializedType>&,
+	buffer_state& bs, error_state& es
+) noexcept
+{
+	(void)cap;
+	assert(cap >= max_frame_size(n));
+	assert(n <= UINT32_MAX);
+
+	auto stored = size_t{0};
+	if (f.method == codec::lz) {
+		auto p = src;
+		if (f.shuffle_width > 1) {
+			auto q = (uint8_t*)nullptr;
+			try {
+				q = detail::block_scratch(n);
+			}
+			catch (const std::bad_alloc&) {
+				bs.consumed(0);
+				es.push_record(
+					severity::critical,
+					context{offset_type{0}, uint8_t{0}},
+					"Failed to allocate scratch space."
+				);
+				return operation_status::failure |
+					operation_status::fatal_error;
+			}
+			shuffle(src, n, f.shuffle_width, q);
+			p = q;
+		}
+		// Only keep the result if it is smaller than the input.
+		stored = lz_compress(p, n, dst + frame_header_size,
+			n == 0 ? 0 : n - 1);
+	}
+	if (stored == 0) {
+		std::copy_n(src, n, dst + frame_header_size);
+		stored = n;
+	}
+
+	auto size = (uint32_t)n;
+	auto s = (uint32_t)stored;
+	std::memcpy(dst, &size, 4);
+	std::memcpy(dst + 4, &s, 4);
+	bs.consumed(frame_header_size + stored);
+	return operation_status::success;
+}
+
+/*
+** Returns the decompressed size of the block at `buf`, which must contain at
+** least `frame_header_size` bytes.
+*/
+template <class SerializedType>
+size_t block_size(const uint8_t* buf, const io_state<SerializedType>& is)
+{
+	uint32_t size, stored;
+	detail::read_frame_header(buf, is.flip_integers(), size, stored);
+	return size;
+}
+
+/*
+** Decompresses the block at the start of `src` into `dst`, which must have
+** room for `block_size(src, is)` bytes. If the compressed block does not fit
+** in the `n` bytes at `src`, then nothing is consumed, the required buffer size
+** is raised to the size of the block, and the result has the `incomplete` and
+** `req_constr_update` flags set.
+*/
+template <class SerializedType>
+operation_status
+decompress_block(
+	const uint8_t* src, size_t n,
+	uint8_t* dst, size_t cap,
+	const block_format& f,
+	const io_state<SerializedType>& is,
+	buffer_state& bs, error_state& es
+) noexcept
+{
+	assert(n >= frame_header_size);
+
+	uint32_t size, stored;
+	detail::read_frame_header(src, is.flip_integers(), size, stored);
+	if (n < frame_header_size + stored) {
+		bs.consumed(0);
+		bs.required_constraints().at_least(frame_header_size + stored);
+		return operation_status::incomplete |
+			operation_status::req_constr_update;
+	}
+
+	/*
+	** The frame header is untrusted, so a block that claims to be larger
+	** than the destination, or that was stored using more bytes than it
+	** takes uncompressed, is skipped.
+	*/
+	bs.consumed(frame_header_size + stored);
+	if (size > cap || stored > size) {
+		es.push_record(
+			severity::error,
+			context{offset_type{0}, uint8_t{0}},
+			"Corrupt block."
+		);
+		return operation_status::failure |
+			operation_status::recoverable_error;
+	}
+	src += frame_header_size;
+
+	if (stored == size) {
+		std::copy_n(src, size, dst);
+		return operation_status::success;
+	}
+
+	auto r = ~size_t{0};
+	if (f.method == codec::lz) {
+		if (f.shuffle_width > 1) {
+			auto q = (uint8_t*)nullptr;
+			try {
+				q = detail::block_scratch(size);
+			}
+			catch (const std::bad_alloc&) {
+				es.push_record(
+					severity::critical,
+					context{offset_type{0}, uint8_t{0}},
+					"Failed to allocate scratch space."
+				);
+				return operation_status::failure |
+					operation_status::fatal_error;
+			}
+			r = lz_decompress(src, stored, q, size);
+			if (r == size) {
+				unshuffle(q, size, f.shuffle_width, dst);
+			}
+		}
+		else {
+			r = lz_decompress(src, stored, dst, size);
+		}
+	}
+
+	if (r != size) {
+		es.push_record(
+			severity::error,
+			context{offset_type{0}, uint8_t{0}},
+			"Corrupt block."
+		);
+		return operation_status::failure |
+			operation_status::recoverable_error;
+	}
+	return operation_status::success;
+}
+
+/*
+** Decompresses the `count` blocks at `src[i]`, each of which has `n[i]` bytes,
+** into `dst[i]` using up to `threads` threads (by default, one per core). A
+** record is added to `es` for each block that could not be decompressed, whose
+** context holds the index of the block. If some of the threads cannot be
+** created, then a warning is added to `es`, and the blocks are decompressed
+** using the threads that were created.
+*/
+template <class SerializedType>
+operation_status
+decompress_blocks(
+	const uint8_t* const* src, const size_t* n,
+	uint8_t* const* dst, const size_t* cap,
+	size_t count,
+	const block_format& f,
+	const io_state<SerializedType>& is,
+	error_state& es,
+	unsigned threads = 0
+)
+{
+	if (threads == 0) {
+		threads = std::max(1u, std::thread::hardware_concurrency());
+	}
+	threads = (unsigned)std::min<size_t>(threads, count);
+
+	auto status = std::vector<operation_status>(count);
+	std::atomic<size_t> next{0};
+	auto work = [&] {
+		auto bs = buffer_state{};
+		auto les = error_state{};
+		for (;;) {
+			auto i = next.fetch_add(1, std::memory_order_relaxed);
+			if (i >= count) { return; }
+			status[i] = decompress_block(src[i], n[i], dst[i],
+				cap[i], f, is, bs, les);
+		}
+	};
+
+	if (threads <= 1) {
+		work();
+	}
+	else {
+		auto pool = std::vector<std::thread>{};
+		try {
+			pool.reserve(threads - 1);
+			for (auto i = 1u; i != threads; ++i) {
+				pool.emplace_back(work);
+			}
+		}
+		catch (const std::exception&) {
+			es.push_record(
+				severity::warning,
+				context{offset_type{0}, uint8_t{0}},
+				cc::format("Only $ of $ threads could be created.",
+					pool.size() + 1, threads)
+			);
+		}
+		work();
+		for (auto& t : pool) { t.join(); }
+	}
+
+	auto r = operation_status::success;
+	for (auto i = size_t{0}; i != count; ++i) {
+		if (!!(status[i] & operation_status::success)) { continue; }
+		es.push_record(
+			severity::error,
+			context{offset_type{i}, uint8_t{0}},
+			"Corrupt or truncated block."
+		);
+		r = operation_status::failure |
+			operation_status::recoverable_error;
+	}
+	return r;
+}
+
+}}
+
+#endif
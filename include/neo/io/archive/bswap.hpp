@@ -0,0 +1,188 @@
+/*
+** File Name: bswap.hpp
+** Author:    Aditya Ramesh
+** Date:      07/26/2014
+** Contact:   _@adityaramesh.com
+**
+** This file defines kernels that reverse the byte order of a contiguous array
+** of 2-, 4-, or 8-byte scalars in place. The kernels use `pshufb` with 32-byte
+** (AVX2) or 16-byte (SSSE3) vectors when the target supports them, and fall
+** back to the compiler's byte swap builtins for the remaining scalars. The
+** scalars need not be aligned.
+*/
+
+#ifndef Z3E8A51C4_92D7_4B0F_A6E3_5C1D7F24B908
+#define Z3E8A51C4_92D7_4B0F_A6E3_5C1D7F24B908
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <ccbase/platform.hpp>
+
+#if defined(__AVX2__) || defined(__SSSE3__)
+	#include <immintrin.h>
+#endif
+
+namespace neo {
+namespace archive {
+namespace detail {
+
+template <size_t Size>
+struct bswap_scalar;
+
+template <>
+struct bswap_scalar<2>
+{
+	static CC_ALWAYS_INLINE void apply(uint8_t* p)
+	{
+		uint16_t x;
+		std::memcpy(&x, p, 2);
+		x = __builtin_bswap16(x);
+		std::memcpy(p, &x, 2);
+	}
+};
+
+template <>
+struct bswap_scalar<4>
+{
+	static CC_ALWAYS_INLINE void apply(uint8_t* p)
+	{
+		uint32_t x;
+		std::memcpy(&x, p, 4);
+		x = __builtin_bswap32(x);
+		std::memcpy(p, &x, 4);
+	}
+};
+
+template <>
+struct bswap_scalar<8>
+{
+	static CC_ALWAYS_INLINE void apply(uint8_t* p)
+	{
+		uint64_t x;
+		std::memcpy(&x, p, 8);
+		x = __builtin_bswap64(x);
+		std::memcpy(p, &x, 8);
+	}
+};
+
+/*
+** Returns the `pshufb` control byte that moves byte `i` of a 16-byte lane to
+** its position after reversing the bytes of each `Size`-byte scalar.
+*/
+template <size_t Size>
+constexpr char bswap_mask_byte(size_t i)
+{ return (char)(i / Size * Size + (Size - 1 - i % Size)); }
+
+template <size_t Size>
+struct bswap_kernel
+{
+	/*
+	** Reverses the byte order of the `n` scalars starting at `p`, and
+	** returns the number of scalars that were processed. Each iteration
+	** processes a whole vector, so some scalars may be left over.
+	*/
+	static CC_ALWAYS_INLINE size_t vectorized(uint8_t* p, size_t n)
+	{
+		auto i = size_t{0};
+		auto bytes = n * Size;
+
+		#if defined(__AVX2__)
+			const auto m32 = _mm256_setr_epi8(
+				bswap_mask_byte<Size>(0),  bswap_mask_byte<Size>(1),
+				bswap_mask_byte<Size>(2),  bswap_mask_byte<Size>(3),
+				bswap_mask_byte<Size>(4),  bswap_mask_byte<Size>(5),
+				bswap_mask_byte<Size>(6),  bswap_mask_byte<Size>(7),
+				bswap_mask_byte<Size>(8),  bswap_mask_byte<Size>(9),
+				bswap_mask_byte<Size>(10), bswap_mask_byte<Size>(11),
+				bswap_mask_byte<Size>(12), bswap_mask_byte<Size>(13),
+				bswap_mask_byte<Size>(14), bswap_mask_byte<Size>(15),
+				bswap_mask_byte<Size>(0),  bswap_mask_byte<Size>(1),
+				bswap_mask_byte<Size>(2),  bswap_mask_byte<Size>(3),
+				bswap_mask_byte<Size>(4),  bswap_mask_byte<Size>(5),
+				bswap_mask_byte<Size>(6),  bswap_mask_byte<Size>(7),
+				bswap_mask_byte<Size>(8),  bswap_mask_byte<Size>(9),
+				bswap_mask_byte<Size>(10), bswap_mask_byte<Size>(11),
+				bswap_mask_byte<Size>(12), bswap_mask_byte<Size>(13),
+				bswap_mask_byte<Size>(14), bswap_mask_byte<Size>(15)
+			);
+
+			// Unrolled twice to hide the latency of the loads.
+			for (; i + 64 <= bytes; i += 64) {
+				auto a = _mm256_loadu_si256((__m256i*)(p + i));
+				auto b = _mm256_loadu_si256((__m256i*)(p + i + 32));
+				a = _mm256_shuffle_epi8(a, m32);
+				b = _mm256_shuffle_epi8(b, m32);
+				_mm256_storeu_si256((__m256i*)(p + i), a);
+				_mm256_storeu_si256((__m256i*)(p + i + 32), b);
+			}
+			for (; i + 32 <= bytes; i += 32) {
+				auto a = _mm256_loadu_si256((__m256i*)(p + i));
+				a = _mm256_shuffle_epi8(a, m32);
+				_mm256_storeu_si256((__m256i*)(p + i), a);
+			}
+		#endif
+
+		#if defined(__SSSE3__)
+			const auto m16 = _mm_setr_epi8(
+				bswap_mask_byte<Size>(0),  bswap_mask_byte<Size>(1),
+				bswap_mask_byte<Size>(2),  bswap_mask_byte<Size>(3),
+				bswap_mask_byte<Size>(4),  bswap_mask_byte<Size>(5),
+				bswap_mask_byte<Size>(6),  bswap_mask_byte<Size>(7),
+				bswap_mask_byte<Size>(8),  bswap_mask_byte<Size>(9),
+				bswap_mask_byte<Size>(10), bswap_mask_byte<Size>(11),
+				bswap_mask_byte<Size>(12), bswap_mask_byte<Size>(13),
+				bswap_mask_byte<Size>(14), bswap_mask_byte<Size>(15)
+			);
+
+			for (; i + 16 <= bytes; i += 16) {
+				auto a = _mm_loadu_si128((__m128i*)(p + i));
+				a = _mm_shuffle_epi8(a, m16);
+				_mm_storeu_si128((__m128i*)(p + i), a);
+			}
+		#endif
+
+		(void)p;
+		return i / Size;
+	}
+
+	static void apply(uint8_t* p, size_t n)
+	{
+		auto i = vectorized(p, n);
+		for (; i != n; ++i) {
+			bswap_scalar<Size>::apply(p + i * Size);
+		}
+	}
+};
+
+template <>
+struct bswap_kernel<1>
+{
+	static CC_ALWAYS_INLINE void apply(uint8_t*, size_t) {}
+};
+
+}
+
+/*
+** Reverses the byte order of each of the `n` scalars starting at `p`, in place.
+*/
+template <class Scalar>
+CC_ALWAYS_INLINE void bswap_n(Scalar* p, size_t n)
+{ detail::bswap_kernel<sizeof(Scalar)>::apply((uint8_t*)p, n); }
+
+/*
+** As above, but for `n` scalars of `size` bytes each, where `size` is only
+** known at runtime.
+*/
+CC_ALWAYS_INLINE void bswap_n(uint8_t* p, size_t n, size_t size)
+{
+	switch (size) {
+	case 2: detail::bswap_kernel<2>::apply(p, n); break;
+	case 4: detail::bswap_kernel<4>::apply(p, n); break;
+	case 8: detail::bswap_kernel<8>::apply(p, n); break;
+	}
+}
+
+}}
+
+#endif
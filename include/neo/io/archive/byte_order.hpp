@@ -21,18 +21,18 @@ enum class byte_order : unsigned
 	float_little   = 0x0,
 	float_big      = 0x2,
 	integer_mask   = 0x01,
-	float_mask     = 0x10,
+	float_mask     = 0x02,
 };
 
 DEFINE_ENUM_BITWISE_OPERATORS(byte_order)
 
 #if PLATFORM_INTEGER_BYTE_ORDER == PLATFORM_BYTE_ORDER_LITTLE
 	static constexpr auto platform_integer_byte_order = byte_order::integer_little;
-	static constexpr auto platform_float_byte_order   = byte_order::integer_little;
+	static constexpr auto platform_float_byte_order   = byte_order::float_little;
 	static constexpr auto platform_byte_order         = byte_order::integer_little | byte_order::float_little;
 #elif PLATFORM_INTEGER_BYTE_ORDER == PLATFORM_BYTE_ORDER_BIG
 	static constexpr auto platform_integer_byte_order = byte_order::integer_big;
-	static constexpr auto platform_float_byte_order   = byte_order::integer_big;
+	static constexpr auto platform_float_byte_order   = byte_order::float_big;
 	static constexpr auto platform_byte_order         = byte_order::integer_big | byte_order::float_big;
 #else
 	#error "Unsupported platform integer byte order."
@@ -0,0 +1,462 @@
+/*
+** File Name: checksum.hpp
+** Author:    Aditya Ramesh
+** Date:      07/27/2014
+** Contact:   _@adityaramesh.com
+**
+** This file defines the optional checksum section of an archive, which holds
+** the CRC-32C of each consecutive block of `block_size` bytes of the file (the
+** last block may be shorter), so that silent corruption can be detected. The
+** checksums cover everything that precedes the section, including the header
+** and the index, if any. The section is written at the end of the file, and is
+** located using a trailer of fixed size; refer to `notes/archive_format.md` for
+** the layout.
+**
+** The writer passes everything that it writes to `checksum_table::update`, and
+** calls `write_checksums` once the rest of the archive has been written. Data
+** that is overwritten afterwards (e.g. the record count in the header) must be
+** reported to `checksum_table::patch`. `stream_writer` does all of this when it
+** is given a block size.
+**
+** The reader calls `read_checksums`, and then either checks the data in its
+** read path using `verify_checksums`, or verifies the entire archive using
+** `verify_archive`, which can use several threads. Mismatches are reported as
+** error records whose context holds the index and offset of the bad block.
+*/
+
+#ifndef Z2F6B8D15_9A4C_4E37_81D0_C5E93B7A2F46
+#define Z2F6B8D15_9A4C_4E37_81D0_C5E93B7A2F46
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstring>
+#include <exception>
+#include <new>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include <ccbase/format.hpp>
+#include <neo/core/operation_status.hpp>
+#include <neo/core/file/handle.hpp>
+#include <neo/core/file/io.hpp>
+#include <neo/core/file/strategy.hpp>
+#include <neo/core/file/system.hpp>
+#include <neo/io/archive/bswap.hpp>
+#include <neo/io/archive/crc32c.hpp>
+#include <neo/io/archive/definitions.hpp>
+
+namespace neo {
+namespace archive {
+
+static constexpr char checksum_magic[] = "DSACRC32";
+static constexpr auto checksum_magic_size = size_t{8};
+
+// section offset + block size + reserved + magic
+static constexpr auto checksum_trailer_size = size_t{8 + 4 + 4 + 8};
+
+/*
+** The context of a checksum mismatch holds the index of the block, and its
+** offset in the file.
+*/
+using checksum_context = basic_context<
+	with_element<offset_type>, with_offset
+>;
+
+using checksum_log_record = basic_log_record<
+	with_severity, with_context<checksum_context>, with_message
+>;
+
+using checksum_error_state = basic_error_state<checksum_log_record>;
+
+class checksum_table
+{
+	std::vector<uint32_t> m_crcs{};
+	// The checksum and size of the last block, if it is incomplete.
+	uint32_t m_tail{};
+	size_t m_tail_size{};
+	uint32_t m_block{};
+public:
+	explicit checksum_table() noexcept {}
+
+	explicit checksum_table(uint32_t block_size) noexcept
+	: m_block{block_size} { assert(block_size > 0); }
+
+	/*
+	** Creates a table with the given checksums, which cover the first
+	** `size` bytes of the file.
+	*/
+	explicit checksum_table(
+		uint32_t block_size,
+		std::vector<uint32_t>&& crcs,
+		size_t size
+	) noexcept : m_crcs(std::move(crcs)), m_block{block_size}
+	{
+		assert(m_crcs.size() == (size + block_size - 1) / block_size);
+		m_tail_size = size % block_size;
+		if (m_tail_size != 0) {
+			m_tail = m_crcs.back();
+			m_crcs.pop_back();
+		}
+	}
+
+	uint32_t block_size() const noexcept { return m_block; }
+
+	size_t block_count() const noexcept
+	{ return m_crcs.size() + (m_tail_size != 0); }
+
+	/*
+	** Returns the number of bytes covered by the checksums, which is also
+	** the offset of the checksum section.
+	*/
+	size_t size() const noexcept
+	{ return m_crcs.size() * m_block + m_tail_size; }
+
+	uint32_t checksum(size_t i) const noexcept
+	{
+		assert(i < block_count());
+		return i < m_crcs.size() ? m_crcs[i] : m_tail;
+	}
+
+	/*
+	** Appends the `n` bytes at `p` to the data covered by the checksums.
+	*/
+	void update(const uint8_t* p, size_t n) noexcept
+	{
+		assert(m_block > 0);
+		while (n != 0) {
+			auto k = std::min(n, m_block - m_tail_size);
+			m_tail = crc32c(p, k, m_tail);
+			m_tail_size += k;
+			p += k;
+			n -= k;
+
+			if (m_tail_size == m_block) {
+				m_crcs.push_back(m_tail);
+				m_tail = 0;
+				m_tail_size = 0;
+			}
+		}
+	}
+
+	/*
+	** Updates the checksums after the `n` covered bytes at offset `off`
+	** were changed from `old` to `cur`. Since the checksum is linear, this
+	** does not require the rest of the block.
+	*/
+	void patch(
+		size_t off, const uint8_t* old, const uint8_t* cur, size_t n
+	) noexcept
+	{
+		assert(off + n <= size());
+		while (n != 0) {
+			auto i = off / m_block;
+			auto q = off % m_block;
+			auto k = std::min<size_t>(n, m_block - q);
+			auto len = i < m_crcs.size() ? m_block : m_tail_size;
+
+			// The checksum of the difference, without conditioning.
+			auto d = uint32_t{0};
+			for (auto j = size_t{0}; j != k; ++j) {
+				auto x = uint8_t(old[j] ^ cur[j]);
+				d = detail::crc32c_update(d, &x, 1);
+			}
+			d = detail::crc32c_multiply(
+				detail::crc32c_shift(len - q - k), d);
+			(i < m_crcs.size() ? m_crcs[i] : m_tail) ^= d;
+
+			off += k;
+			old += k;
+			cur += k;
+			n -= k;
+		}
+	}
+};
+
+/*
+** Returns the size of the checksum section, including the trailer.
+*/
+size_t checksum_size(const checksum_table& t) noexcept
+{ return 4 * t.block_count() + checksum_trailer_size; }
+
+/*
+** Writes the checksum section, followed by the trailer, to the buffer. The
+** section must be written at `t.size()`, immediately after the data that it
+** covers.
+*/
+template <class SerializedType>
+operation_status
+write_checksums(
+	uint8_t* buf, size_t n,
+	const checksum_table& t,
+	io_state<SerializedType>&,
+	buffer_state& bs, error_state&
+) noexcept
+{
+	(void)n;
+	assert(n >= checksum_size(t));
+	assert(t.block_size() > 0);
+
+	auto p = buf;
+	for (auto i = size_t{0}; i != t.block_count(); ++i) {
+		auto x = t.checksum(i);
+		std::memcpy(p, &x, 4);
+		p += 4;
+	}
+
+	auto pos = uint64_t{t.size()};
+	auto block = t.block_size();
+	std::memcpy(p, &pos, 8);
+	std::memcpy(p + 8, &block, 4);
+	std::memset(p + 12, 0, 4);
+	std::memcpy(p + 16, checksum_magic, checksum_magic_size);
+
+	bs.consumed(checksum_size(t));
+	return operation_status::success;
+}
+
+namespace detail {
+
+/*
+** Reads the trailer of the checksum section, if the archive has one. Returns
+** false if it does not.
+*/
+template <class SerializedType, io_mode IOMode>
+cc::expected<bool>
+read_checksum_trailer(
+	const file::handle<IOMode>& h,
+	const file::strategy<IOMode>& s,
+	const io_state<SerializedType>& is,
+	size_t fs,
+	uint64_t& pos,
+	uint32_t& block
+) noexcept
+{
+	if (fs < is.header_size() + checksum_trailer_size) { return false; }
+
+	uint8_t t[checksum_trailer_size];
+	auto r = file::read(h, (off_t)(fs - checksum_trailer_size),
+		checksum_trailer_size, t, s);
+	if (!r) { return r.exception(); }
+
+	if (std::memcmp(t + 16, checksum_magic, checksum_magic_size) != 0) {
+		return false;
+	}
+
+	std::memcpy(&pos, t, 8);
+	std::memcpy(&block, t + 8, 4);
+	if (is.flip_integers()) {
+		pos = cc::bswap(pos);
+		block = cc::bswap(block);
+	}
+
+	if (
+		block == 0 || pos < is.header_size() ||
+		pos + 4 * ((pos + block - 1) / block) +
+		checksum_trailer_size != fs
+	) {
+		return std::runtime_error{cc::format(
+			"Malformed checksum trailer: offset $, block size $, "
+			"file size $.", pos, block, fs)};
+	}
+	return true;
+}
+
+/*
+** Returns the size of the archive, excluding the checksum section. Other
+** sections that are located using trailers (such as the index) end here.
+*/
+template <class SerializedType, io_mode IOMode>
+cc::expected<size_t>
+unchecked_size(
+	const file::handle<IOMode>& h,
+	const file::strategy<IOMode>& s,
+	const io_state<SerializedType>& is
+) noexcept
+{
+	auto st = file::safe_stat(h.descriptor());
+	if (!st) { return st.exception(); }
+	auto fs = (size_t)st->st_size;
+
+	auto pos = uint64_t{};
+	auto block = uint32_t{};
+	auto r = read_checksum_trailer(h, s, is, fs, pos, block);
+	if (!r) { return r.exception(); }
+	return *r ? (size_t)pos : fs;
+}
+
+}
+
+/*
+** Reads the checksums of the archive, which must have been opened using `h`.
+** The byte order of the archive is taken from `is`, so `read_header` must be
+** called first.
+*/
+template <class SerializedType, io_mode IOMode>
+cc::expected<checksum_table>
+read_checksums(
+	const file::handle<IOMode>& h,
+	const file::strategy<IOMode>& s,
+	const io_state<SerializedType>& is
+) noexcept
+{
+	auto st = file::safe_stat(h.descriptor());
+	if (!st) { return st.exception(); }
+	auto fs = (size_t)st->st_size;
+
+	auto pos = uint64_t{};
+	auto block = uint32_t{};
+	auto r = detail::read_checksum_trailer(h, s, is, fs, pos, block);
+	if (!r) { return r.exception(); }
+	if (!*r) {
+		return std::runtime_error{"Archive does not have checksums."};
+	}
+
+	auto crcs = std::vector<uint32_t>((pos + block - 1) / block);
+	auto q = file::read(h, (off_t)pos, 4 * crcs.size(),
+		(uint8_t*)crcs.data(), s);
+	if (!q) { return q.exception(); }
+	if (is.flip_integers()) {
+		bswap_n(crcs.data(), crcs.size());
+	}
+	return checksum_table{block, std::move(crcs), (size_t)pos};
+}
+
+/*
+** Verifies the blocks that lie entirely within the `n` bytes at `p`, which were
+** read from offset `off` of the archive. Blocks that are only partially
+** contained in the buffer are skipped. A record is added to `es` for each block
+** whose checksum does not match.
+*/
+operation_status
+verify_checksums(
+	const uint8_t* p, size_t n, size_t off,
+	const checksum_table& t,
+	checksum_error_state& es
+) noexcept
+{
+	auto b = t.block_size();
+	auto end = std::min(off + n, t.size());
+	auto i = (off + b - 1) / b;
+	auto bad = false;
+
+	for (; i * b < end; ++i) {
+		auto first = i * b;
+		auto last = std::min(first + b, t.size());
+		if (last > end) { break; }
+
+		if (crc32c(p + (first - off), last - first) != t.checksum(i)) {
+			es.push_record(
+				severity::error,
+				checksum_context{offset_type{i}, (off_t)first},
+				cc::format("Checksum mismatch in bytes [$, $).",
+					first, last)
+			);
+			bad = true;
+		}
+	}
+
+	if (bad) {
+		return operation_status::failure |
+			operation_status::recoverable_error;
+	}
+	return operation_status::success;
+}
+
+/*
+** Verifies every block of the archive using up to `threads` threads, each of
+** which reads chunks of at least `chunk_size` bytes. Returns the number of bad
+** blocks, each of which is reported in `es` in order of offset. If some of the
+** threads cannot be created, then a warning is added to `es` first, and the
+** archive is verified using the threads that were created.
+*/
+template <
+	io_mode IOMode,
+	typename std::enable_if<!!(IOMode & io_mode::input), int>::type = 0
+>
+cc::expected<size_t>
+verify_archive(
+	const file::handle<IOMode>& h,
+	const file::strategy<IOMode>& s,
+	const checksum_table& t,
+	checksum_error_state& es,
+	unsigned threads = 1,
+	size_t chunk_size = 4 * 1024 * 1024
+)
+{
+	auto b = size_t{t.block_size()};
+	auto chunk = std::max(b, chunk_size / b * b);
+	auto chunks = (t.size() + chunk - 1) / chunk;
+	threads = (unsigned)std::max<size_t>(1,
+		std::min<size_t>(threads, chunks));
+
+	std::atomic<size_t> next{0};
+	auto states = std::vector<checksum_error_state>(threads);
+	auto errors = std::vector<std::exception_ptr>(threads);
+
+	auto work = [&] (unsigned k) {
+		auto buf = std::vector<uint8_t>{};
+		try {
+			buf.resize(chunk);
+		}
+		catch (const std::bad_alloc&) {
+			errors[k] = std::current_exception();
+			return;
+		}
+
+		for (;;) {
+			auto c = next.fetch_add(1, std::memory_order_relaxed);
+			if (c >= chunks) { return; }
+
+			auto off = c * chunk;
+			auto n = std::min(chunk, t.size() - off);
+			auto r = file::read(h, (off_t)off, n, buf.data(), s);
+			if (!r) {
+				errors[k] = r.exception();
+				return;
+			}
+			verify_checksums(buf.data(), n, off, t, states[k]);
+		}
+	};
+
+	auto pool = std::vector<std::thread>{};
+	try {
+		pool.reserve(threads - 1);
+		for (auto k = 1u; k < threads; ++k) {
+			pool.emplace_back(work, k);
+		}
+	}
+	catch (const std::exception&) {
+		es.push_record(
+			severity::warning,
+			checksum_context{offset_type{0}, off_t{0}},
+			cc::format("Only $ of $ threads could be created.",
+				pool.size() + 1, threads)
+		);
+	}
+	work(0);
+	for (auto& th : pool) { th.join(); }
+
+	for (auto& e : errors) {
+		if (e) { return e; }
+	}
+
+	// Merge the records of the threads in order of offset.
+	auto recs = std::vector<const checksum_log_record*>{};
+	for (auto& st : states) {
+		for (auto i = size_t{0}; i != st.record_count(); ++i) {
+			recs.push_back(&st.record(i));
+		}
+	}
+	std::sort(recs.begin(), recs.end(), [] (
+		const checksum_log_record* a, const checksum_log_record* b
+	) { return a->context().offset() < b->context().offset(); });
+	for (auto r : recs) {
+		es.push_record(r->severity(), r->context(), r->message());
+	}
+	return recs.size();
+}
+
+}}
+
+#endif
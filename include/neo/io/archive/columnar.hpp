@@ -0,0 +1,355 @@
+/*
+** File Name: columnar.hpp
+** Author:    Aditya Ramesh
+** Date:      07/27/2014
+** Contact:   _@adityaramesh.com
+**
+** This file defines the functions used to read and write columnar archives. In
+** such an archive, consecutive records are grouped into row groups of
+** `rows_per_group` records each (the last group may have fewer), and within
+** each group, the values of each component are stored contiguously as a column.
+** A reader that only needs some of the components can therefore skip the
+** columns of the others entirely. The header of the archive has version
+** `columnar_version`, and is followed by a column format section; refer to
+** `notes/archive_format.md` for the layout. Only element types of fixed size
+** are supported.
+**
+** To write an archive, set `io_state::columnar`, call `write_header` and
+** `write_column_format`, and then use `format` to write the records of each
+** row group into a staging buffer, which is passed to `write_row_group`.
+**
+** To read an archive, set `io_state::columnar` (otherwise, `read_header`
+** rejects the archive), call `read_header` and `read_column_format`, and then
+** use `read_columns` to read the selected columns of a row group into a buffer.
+** Afterwards, `scan_columns` processes the columns and constructs views of
+** them in `is.batch()`, in the same way as `scan_n`; the views of the other
+** components are left uninitialized.
+*/
+
+#ifndef ZB3E58A17_0F4D_4C62_8D19_6A2F07C4E93B
+#define ZB3E58A17_0F4D_4C62_8D19_6A2F07C4E93B
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <stdexcept>
+#include <tuple>
+#include <neo/core/operation_status.hpp>
+#include <neo/core/file/batch.hpp>
+#include <neo/core/file/buffer.hpp>
+#include <neo/core/file/handle.hpp>
+#include <neo/core/file/strategy.hpp>
+#include <neo/io/archive/definitions.hpp>
+#include <neo/io/archive/scan.hpp>
+
+namespace neo {
+namespace archive {
+
+struct column_format
+{
+	uint32_t rows_per_group;
+};
+
+// rows per group + reserved
+static constexpr auto column_format_size = size_t{4 + 4};
+
+namespace detail {
+
+/*
+** Describes the component with the given index of a tuple: its type, its
+** offset within a record, and the number of matrices that precede it.
+*/
+template <size_t Index, class SerializedType>
+struct column_info;
+
+template <class T, class... Ts>
+struct column_info<0, std::tuple<T, Ts...>>
+{
+	using type = T;
+	static constexpr auto offset = size_t{0};
+	static constexpr auto matrix_index = size_t{0};
+	static constexpr auto size = element_size<T>::value;
+};
+
+template <size_t Index, class T, class... Ts>
+struct column_info<Index, std::tuple<T, Ts...>>
+{
+	using next = column_info<Index - 1, std::tuple<Ts...>>;
+	using type = typename next::type;
+	static constexpr auto offset = element_size<T>::value + next::offset;
+	static constexpr auto matrix_index =
+		is_matrix<T>::value + next::matrix_index;
+	static constexpr auto size = next::size;
+};
+
+template <class SerializedType, size_t... Indices>
+struct columns;
+
+template <class SerializedType>
+struct columns<SerializedType>
+{
+	static constexpr auto size = size_t{0};
+
+	static void extents(file::extent*, off_t, size_t) {}
+
+	static void apply(
+		uint8_t*, size_t, io_state<SerializedType>&, error_state&
+	) {}
+};
+
+template <class SerializedType, size_t Index, size_t... Indices>
+struct columns<SerializedType, Index, Indices...>
+{
+	using info = column_info<Index, SerializedType>;
+	using helper = process_batch_impl<
+		Index, info::matrix_index, typename info::type
+	>;
+	using next = columns<SerializedType, Indices...>;
+
+	// The size of each selected component.
+	static constexpr auto size = info::size + next::size;
+
+	/*
+	** Computes the extents of the columns of the row group at `off` that
+	** contains `rows` records.
+	*/
+	static void extents(file::extent* e, off_t off, size_t rows)
+	{
+		*e = file::extent{(off_t)(off + rows * info::offset),
+			rows * info::size};
+		next::extents(e + 1, off, rows);
+	}
+
+	static void apply(
+		uint8_t* buf, size_t rows,
+		io_state<SerializedType>& is, error_state& es
+	)
+	{
+		helper::apply(buf, rows, info::size, false, is, es);
+		next::apply(buf + rows * info::size, rows, is, es);
+	}
+};
+
+/*
+** Scatters the components of `rows` consecutive records into columns.
+*/
+template <class SerializedType, size_t Index, size_t Count>
+struct scatter_columns
+{
+	using info = column_info<Index, SerializedType>;
+	using next = scatter_columns<SerializedType, Index + 1, Count>;
+
+	static void apply(const uint8_t* src, size_t rows, uint8_t* dst)
+	{
+		static constexpr auto elem_size =
+			element_size<SerializedType>::value;
+
+		auto q = dst + rows * info::offset;
+		for (auto i = size_t{0}; i != rows; ++i) {
+			std::memcpy(q + i * info::size,
+				src + i * elem_size + info::offset, info::size);
+		}
+		next::apply(src, rows, dst);
+	}
+};
+
+template <class SerializedType, size_t Count>
+struct scatter_columns<SerializedType, Count, Count>
+{
+	static void apply(const uint8_t*, size_t, uint8_t*) {}
+};
+
+}
+
+template <class SerializedType>
+operation_status
+write_column_format(
+	uint8_t* buf, size_t n,
+	const column_format& f,
+	io_state<SerializedType>& is,
+	buffer_state& bs, error_state&
+) noexcept
+{
+	(void)n;
+	(void)is;
+	assert(n >= column_format_size);
+	assert(is.columnar());
+	assert(f.rows_per_group > 0);
+
+	std::memcpy(buf, &f.rows_per_group, 4);
+	std::memset(buf + 4, 0, 4);
+	bs.consumed(column_format_size);
+	return operation_status::success;
+}
+
+template <class SerializedType>
+operation_status
+read_column_format(
+	const uint8_t* buf, size_t n,
+	column_format& f,
+	io_state<SerializedType>& is,
+	buffer_state& bs, error_state& es
+) noexcept
+{
+	(void)n;
+	assert(n >= column_format_size);
+	bs.consumed(column_format_size);
+
+	if (!is.columnar()) {
+		es.push_record(
+			severity::critical,
+			context{offset_type{0}, uint8_t{0}},
+			"Archive is not columnar."
+		);
+		return operation_status::failure |
+			operation_status::fatal_error;
+	}
+
+	std::memcpy(&f.rows_per_group, buf, 4);
+	if (is.flip_integers()) {
+		f.rows_per_group = cc::bswap(f.rows_per_group);
+	}
+	if (f.rows_per_group == 0) {
+		es.push_record(
+			severity::critical,
+			context{offset_type{0}, uint8_t{0}},
+			"Row groups must contain at least one record."
+		);
+		return operation_status::failure |
+			operation_status::fatal_error;
+	}
+	return operation_status::success;
+}
+
+/*
+** Returns the number of row groups in the archive, and the number of records
+** in the given row group.
+*/
+template <class SerializedType>
+size_t row_group_count(
+	const column_format& f,
+	const io_state<SerializedType>& is
+) noexcept
+{
+	return (is.element_count() + f.rows_per_group - 1) /
+		f.rows_per_group;
+}
+
+template <class SerializedType>
+size_t row_group_size(
+	const column_format& f,
+	const io_state<SerializedType>& is,
+	size_t group
+) noexcept
+{
+	assert(group < row_group_count(f, is));
+	return (size_t)std::min<offset_type>(f.rows_per_group,
+		is.element_count() - group * f.rows_per_group);
+}
+
+/*
+** Rearranges the `rows` consecutive records at `src`, which were written using
+** `format`, into the columns of a row group. The row group is the same size
+** as the records.
+*/
+template <class SerializedType>
+operation_status
+write_row_group(
+	const uint8_t* src, size_t rows,
+	uint8_t* dst, size_t cap,
+	const io_state<SerializedType>& is,
+	buffer_state& bs, error_state&
+) noexcept
+{
+	static_assert(detail::is_tuple<SerializedType>::value,
+		"Columnar archives require tuple elements.");
+	static_assert(!is_dynamic<SerializedType>::value,
+		"Columnar archives require elements of fixed size.");
+
+	(void)cap;
+	assert(cap >= rows * is.element_size());
+
+	using helper = detail::scatter_columns<SerializedType, 0,
+		std::tuple_size<SerializedType>::value>;
+	helper::apply(src, rows, dst);
+	bs.consumed(rows * is.element_size());
+	return operation_status::success;
+}
+
+/*
+** Reads the columns with the given indices of a row group into consecutive
+** regions of the buffer, in the order in which the indices are listed, and
+** returns the total number of bytes read. The selected columns are read using
+** as few system calls as possible, as described in `file/batch.hpp`.
+*/
+template <
+	size_t... Indices,
+	class SerializedType,
+	io_mode IOMode,
+	typename std::enable_if<!!(IOMode & io_mode::input), int>::type = 0
+>
+cc::expected<size_t>
+read_columns(
+	const file::handle<IOMode>& h,
+	const file::strategy<IOMode>& s,
+	const column_format& f,
+	const io_state<SerializedType>& is,
+	size_t group,
+	file::buffer<IOMode>& b
+) noexcept
+{
+	static_assert(sizeof...(Indices) > 0, "No columns selected.");
+	using helper = detail::columns<SerializedType, Indices...>;
+
+	if (is.converted()) {
+		return std::runtime_error{"The columns of converted archives "
+			"cannot be read."};
+	}
+	auto rows = row_group_size(f, is, group);
+	auto off = is.header_size() + column_format_size +
+		group * f.rows_per_group * is.element_size();
+
+	file::extent e[sizeof...(Indices)];
+	helper::extents(e, (off_t)off, rows);
+	assert(rows * helper::size <= b.size());
+
+	auto r = file::read_batch(h, e, sizeof...(Indices), b, s);
+	if (!r) { return r.exception(); }
+	return rows * helper::size;
+}
+
+/*
+** Processes the columns with the given indices of a row group with `rows`
+** records, which are stored consecutively at the start of the buffer in the
+** order in which the indices are listed (as done by `read_columns`), and
+** constructs the corresponding views in `is.batch()`.
+*/
+template <size_t... Indices, class SerializedType>
+operation_status
+scan_columns(
+	uint8_t* buf, size_t n, size_t rows,
+	io_state<SerializedType>& is,
+	buffer_state& bs, error_state& es
+) noexcept
+{
+	using helper = detail::columns<SerializedType, Indices...>;
+
+	if (is.converted()) {
+		return detail::conversion_failure(bs, es);
+	}
+	(void)n;
+	assert(rows > 0);
+	assert(n >= rows * helper::size);
+	bs.consumed(rows * helper::size);
+
+	is.batch_size(rows);
+	if (!is.reset_widened(rows * widened_size<SerializedType>::value)) {
+		return detail::scratch_failure(bs, es);
+	}
+	helper::apply(buf, rows, is, es);
+	return operation_status::success;
+}
+
+}}
+
+#endif
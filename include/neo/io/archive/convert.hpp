@@ -0,0 +1,781 @@
+/*
+** File Name: convert.hpp
+** Author:    Aditya Ramesh
+** Date:      07/27/2014
+** Contact:   _@adityaramesh.com
+**
+** This file defines the kernels that convert between `float` and the narrow
+** scalar types declared in `tensor.hpp`. Half precision floats are converted
+** using the F16C instructions, and bfloat16 and scaled 8-bit integers using
+** AVX2, when the target supports them; the remaining scalars are converted one
+** at a time. Narrowing always rounds to nearest, with ties to even. Input of any
+** other arithmetic type is first converted to `float`, so `double` input is
+** rounded twice.
+**
+** A scaled component is narrowed using the scale `max |x| / 127`, so that the
+** coefficient with the largest magnitude is mapped to +/-127.
+**
+** This file also defines `convert_n`, which converts the coefficients of a
+** component from the scalar type used by the file (given by its scalar code) to
+** the one requested by the reader, as permitted by a `conversion_policy`.
+** Integers of up to 32 bits and floats are converted to `float` and `double`
+** using AVX2.
+*/
+
+#ifndef Z4C17E9B2_8D35_4A6F_B0E4_29F6A1C85D73
+#define Z4C17E9B2_8D35_4A6F_B0E4_29F6A1C85D73
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <ccbase/platform.hpp>
+#include <neo/io/archive/bswap.hpp>
+#include <neo/io/archive/tensor.hpp>
+
+#if defined(__AVX2__) || defined(__F16C__)
+	#include <immintrin.h>
+#endif
+
+namespace neo {
+namespace archive {
+namespace detail {
+
+CC_ALWAYS_INLINE uint32_t float_bits(float f)
+{
+	uint32_t x;
+	std::memcpy(&x, &f, 4);
+	return x;
+}
+
+CC_ALWAYS_INLINE float bits_float(uint32_t x)
+{
+	float f;
+	std::memcpy(&f, &x, 4);
+	return f;
+}
+
+float half_to_float(uint16_t h) noexcept
+{
+	auto sign = uint32_t(h & 0x8000) << 16;
+	auto exp = uint32_t(h >> 10) & 0x1F;
+	auto man = uint32_t(h) & 0x3FF;
+
+	if (exp == 0x1F) {
+		return bits_float(sign | 0x7F800000 | (man << 13));
+	}
+	if (exp != 0) {
+		return bits_float(sign | ((exp + 112) << 23) | (man << 13));
+	}
+	if (man == 0) {
+		return bits_float(sign);
+	}
+
+	// Subnormal halves are normal floats.
+	exp = 113;
+	while (!(man & 0x400)) {
+		man <<= 1;
+		--exp;
+	}
+	return bits_float(sign | (exp << 23) | ((man & 0x3FF) << 13));
+}
+
+uint16_t float_to_half(float f) noexcept
+{
+	auto x = float_bits(f);
+	auto sign = uint16_t((x >> 16) & 0x8000);
+	x &= 0x7FFFFFFF;
+
+	if (x >= 0x7F800000) {
+		// Infinities are preserved, and NaNs are made quiet.
+		return sign | 0x7C00 | (x > 0x7F800000 ?
+			0x200 | ((x >> 13) & 0x3FF) : 0);
+	}
+	// Halfway between the largest half and 2^16.
+	if (x >= 0x477FF000) {
+		return sign | 0x7C00;
+	}
+	if (x >= 0x38800000) {
+		// Rebias the exponent, and round the mantissa.
+		x -= 0x38000000;
+		return sign | uint16_t((x + 0xFFF + ((x >> 13) & 1)) >> 13);
+	}
+	// Half of the smallest subnormal half rounds to zero.
+	if (x <= 0x33000000) {
+		return sign;
+	}
+
+	// The result is subnormal, in units of 2^-24.
+	auto e = x >> 23;
+	auto m = (x & 0x7FFFFF) | 0x800000;
+	auto shift = 126 - e;
+	auto r = m >> shift;
+	auto rem = m & ((uint32_t{1} << shift) - 1);
+	auto half = uint32_t{1} << (shift - 1);
+	if (rem > half || (rem == half && (r & 1))) { ++r; }
+	return sign | uint16_t(r);
+}
+
+CC_ALWAYS_INLINE float bfloat_to_float(uint16_t b)
+{ return bits_float(uint32_t(b) << 16); }
+
+CC_ALWAYS_INLINE uint16_t float_to_bfloat(float f)
+{
+	auto x = float_bits(f);
+	if ((x & 0x7FFFFFFF) > 0x7F800000) {
+		return uint16_t((x >> 16) | 0x40);
+	}
+	return uint16_t((x + 0x7FFF + ((x >> 16) & 1)) >> 16);
+}
+
+/*
+** NaNs are quantized to zero, here and in `narrow_vectorized`, and are ignored
+** by `max_abs`.
+*/
+CC_ALWAYS_INLINE int8_t quantize(float f, float inv)
+{
+	auto q = std::nearbyint(f * inv);
+	if (std::isnan(q)) { return 0; }
+	return (int8_t)std::max(-127.f, std::min(127.f, q));
+}
+
+/*
+** Each of the following functions processes as many scalars as it can using
+** SIMD instructions, and returns the number of scalars processed.
+*/
+
+CC_ALWAYS_INLINE size_t
+widen_vectorized(const float16* src, size_t n, float* dst)
+{
+	auto i = size_t{0};
+	#if defined(__F16C__)
+		for (; i + 8 <= n; i += 8) {
+			auto h = _mm_loadu_si128((const __m128i*)(src + i));
+			_mm256_storeu_ps(dst + i, _mm256_cvtph_ps(h));
+		}
+	#endif
+	(void)src;
+	(void)n;
+	(void)dst;
+	return i;
+}
+
+CC_ALWAYS_INLINE size_t
+narrow_vectorized(const float* src, size_t n, float16* dst)
+{
+	auto i = size_t{0};
+	#if defined(__F16C__)
+		for (; i + 8 <= n; i += 8) {
+			auto h = _mm256_cvtps_ph(_mm256_loadu_ps(src + i),
+				_MM_FROUND_TO_NEAREST_INT);
+			_mm_storeu_si128((__m128i*)(dst + i), h);
+		}
+	#endif
+	(void)src;
+	(void)n;
+	(void)dst;
+	return i;
+}
+
+CC_ALWAYS_INLINE size_t
+widen_vectorized(const bfloat16* src, size_t n, float* dst)
+{
+	auto i = size_t{0};
+	#if defined(__AVX2__)
+		for (; i + 8 <= n; i += 8) {
+			auto b = _mm_loadu_si128((const __m128i*)(src + i));
+			auto x = _mm256_slli_epi32(_mm256_cvtepu16_epi32(b), 16);
+			_mm256_storeu_si256((__m256i*)(dst + i), x);
+		}
+	#endif
+	(void)src;
+	(void)n;
+	(void)dst;
+	return i;
+}
+
+CC_ALWAYS_INLINE size_t
+narrow_vectorized(const float* src, size_t n, bfloat16* dst)
+{
+	auto i = size_t{0};
+	#if defined(__AVX2__)
+		auto one = _mm256_set1_epi32(1);
+		auto bias = _mm256_set1_epi32(0x7FFF);
+		auto quiet = _mm256_set1_epi32(0x40);
+
+		for (; i + 8 <= n; i += 8) {
+			auto f = _mm256_loadu_ps(src + i);
+			auto x = _mm256_castps_si256(f);
+			auto lsb = _mm256_and_si256(_mm256_srli_epi32(x, 16), one);
+			auto r = _mm256_add_epi32(x, _mm256_add_epi32(bias, lsb));
+			r = _mm256_srli_epi32(r, 16);
+
+			auto q = _mm256_or_si256(_mm256_srli_epi32(x, 16), quiet);
+			auto nan = _mm256_castps_si256(
+				_mm256_cmp_ps(f, f, _CMP_UNORD_Q));
+			r = _mm256_blendv_epi8(r, q, nan);
+
+			// Each lane is packed separately, so the halves of the
+			// result are gathered afterwards.
+			r = _mm256_packus_epi32(r, r);
+			r = _mm256_permute4x64_epi64(r, 0x08);
+			_mm_storeu_si128((__m128i*)(dst + i),
+				_mm256_castsi256_si128(r));
+		}
+	#endif
+	(void)src;
+	(void)n;
+	(void)dst;
+	return i;
+}
+
+CC_ALWAYS_INLINE size_t
+widen_vectorized(const scaled_int8* src, size_t n, float scale, float* dst)
+{
+	auto i = size_t{0};
+	#if defined(__AVX2__)
+		auto s = _mm256_set1_ps(scale);
+		for (; i + 8 <= n; i += 8) {
+			auto b = _mm_loadl_epi64((const __m128i*)(src + i));
+			auto x = _mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(b));
+			_mm256_storeu_ps(dst + i, _mm256_mul_ps(x, s));
+		}
+	#endif
+	(void)src;
+	(void)n;
+	(void)scale;
+	(void)dst;
+	return i;
+}
+
+CC_ALWAYS_INLINE size_t
+narrow_vectorized(const float* src, size_t n, float inv, scaled_int8* dst)
+{
+	auto i = size_t{0};
+	#if defined(__AVX2__)
+		auto s = _mm256_set1_ps(inv);
+		auto hi = _mm256_set1_epi32(127);
+		auto lo = _mm256_set1_epi32(-127);
+
+		for (; i + 8 <= n; i += 8) {
+			// The conversion uses the current rounding mode, which
+			// is round-to-nearest by default.
+			auto x = _mm256_mul_ps(_mm256_loadu_ps(src + i), s);
+			auto q = _mm256_cvtps_epi32(x);
+			q = _mm256_max_epi32(_mm256_min_epi32(q, hi), lo);
+			// NaNs convert to INT_MIN, so they are cleared here.
+			auto ord = _mm256_cmp_ps(x, x, _CMP_ORD_Q);
+			q = _mm256_and_si256(q, _mm256_castps_si256(ord));
+
+			auto w = _mm_packs_epi32(_mm256_castsi256_si128(q),
+				_mm256_extracti128_si256(q, 1));
+			_mm_storel_epi64((__m128i*)(dst + i),
+				_mm_packs_epi16(w, w));
+		}
+	#endif
+	(void)src;
+	(void)n;
+	(void)inv;
+	(void)dst;
+	return i;
+}
+
+CC_ALWAYS_INLINE float max_abs(const float* src, size_t n)
+{
+	auto i = size_t{0};
+	auto m = 0.f;
+	#if defined(__AVX2__)
+		auto mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF));
+		auto v = _mm256_setzero_ps();
+		for (; i + 8 <= n; i += 8) {
+			auto x = _mm256_and_ps(_mm256_loadu_ps(src + i), mask);
+			// Returns `v` if `x` is NaN, like `std::max` below.
+			v = _mm256_max_ps(x, v);
+		}
+
+		float t[8];
+		_mm256_storeu_ps(t, v);
+		m = *std::max_element(t, t + 8);
+	#endif
+	for (; i != n; ++i) {
+		m = std::max(m, std::abs(src[i]));
+	}
+	return m;
+}
+
+}
+
+/*
+** Widens the `n` scalars at `src` to `dst`.
+*/
+
+void widen_n(const float16* src, size_t n, float* dst) noexcept
+{
+	auto i = detail::widen_vectorized(src, n, dst);
+	for (; i != n; ++i) {
+		dst[i] = detail::half_to_float(src[i].bits);
+	}
+}
+
+void widen_n(const bfloat16* src, size_t n, float* dst) noexcept
+{
+	auto i = detail::widen_vectorized(src, n, dst);
+	for (; i != n; ++i) {
+		dst[i] = detail::bfloat_to_float(src[i].bits);
+	}
+}
+
+void widen_n(const scaled_int8* src, size_t n, float scale, float* dst) noexcept
+{
+	auto i = detail::widen_vectorized(src, n, scale, dst);
+	for (; i != n; ++i) {
+		dst[i] = scale * src[i].bits;
+	}
+}
+
+/*
+** Narrows the `n` scalars at `src` to `dst`, rounding to nearest. The overload
+** for scaled integers returns the scale that was used.
+*/
+
+void narrow_n(const float* src, size_t n, float16* dst) noexcept
+{
+	auto i = detail::narrow_vectorized(src, n, dst);
+	for (; i != n; ++i) {
+		dst[i].bits = detail::float_to_half(src[i]);
+	}
+}
+
+void narrow_n(const float* src, size_t n, bfloat16* dst) noexcept
+{
+	auto i = detail::narrow_vectorized(src, n, dst);
+	for (; i != n; ++i) {
+		dst[i].bits = detail::float_to_bfloat(src[i]);
+	}
+}
+
+float narrow_n(const float* src, size_t n, scaled_int8* dst) noexcept
+{
+	auto m = detail::max_abs(src, n);
+	auto scale = m / 127;
+	auto inv = m == 0 ? 0.f : 127 / m;
+
+	auto i = detail::narrow_vectorized(src, n, inv, dst);
+	for (; i != n; ++i) {
+		dst[i].bits = detail::quantize(src[i], inv);
+	}
+	return scale;
+}
+
+/*
+** As above, but for input of any other arithmetic type, which is converted to
+** `float` in chunks that fit on the stack.
+*/
+template <class T, class Scalar>
+void narrow_n(const T* src, size_t n, Scalar* dst) noexcept
+{
+	static constexpr auto chunk_size = size_t{256};
+	float buf[chunk_size];
+
+	for (auto i = size_t{0}; i < n; i += chunk_size) {
+		auto k = std::min(chunk_size, n - i);
+		std::copy(src + i, src + i + k, buf);
+		narrow_n(buf, k, dst + i);
+	}
+}
+
+template <class T>
+float narrow_n(const T* src, size_t n, scaled_int8* dst) noexcept
+{
+	static constexpr auto chunk_size = size_t{256};
+	float buf[chunk_size];
+
+	auto m = 0.f;
+	for (auto i = size_t{0}; i != n; ++i) {
+		m = std::max(m, std::abs((float)src[i]));
+	}
+	auto inv = m == 0 ? 0.f : 127 / m;
+
+	for (auto i = size_t{0}; i < n; i += chunk_size) {
+		auto k = std::min(chunk_size, n - i);
+		std::copy(src + i, src + i + k, buf);
+		auto j = detail::narrow_vectorized(buf, k, inv, dst + i);
+		for (; j != k; ++j) {
+			dst[i + j].bits = detail::quantize(buf[j], inv);
+		}
+	}
+	return m / 127;
+}
+
+namespace detail {
+
+/*
+** Reads and writes components with narrow scalar types. The `flip` argument of
+** `widen` indicates whether the byte order of the floats in the file must be
+** reversed first, which is done in place.
+*/
+template <class Scalar>
+struct narrow_codec
+{
+	static CC_ALWAYS_INLINE size_t size(size_t n)
+	{ return sizeof(Scalar) * n; }
+
+	static CC_ALWAYS_INLINE void
+	widen(uint8_t* p, size_t n, bool flip, float* dst)
+	{
+		if (flip) { bswap_n((uint16_t*)p, n); }
+		widen_n((const Scalar*)p, n, dst);
+	}
+
+	template <class T>
+	static CC_ALWAYS_INLINE uint8_t*
+	narrow(const T* src, size_t n, uint8_t* p)
+	{
+		narrow_n(src, n, (Scalar*)p);
+		return p + size(n);
+	}
+};
+
+template <>
+struct narrow_codec<scaled_int8>
+{
+	static constexpr auto scale = scale_size<scaled_int8>::value;
+
+	static CC_ALWAYS_INLINE size_t size(size_t n)
+	{ return scale + n; }
+
+	static CC_ALWAYS_INLINE void
+	widen(uint8_t* p, size_t n, bool flip, float* dst)
+	{
+		if (flip) { bswap_n((uint32_t*)p, 1); }
+		float s;
+		std::memcpy(&s, p, scale);
+		widen_n((const scaled_int8*)(p + scale), n, s, dst);
+	}
+
+	template <class T>
+	static CC_ALWAYS_INLINE uint8_t*
+	narrow(const T* src, size_t n, uint8_t* p)
+	{
+		auto s = narrow_n(src, n, (scaled_int8*)(p + scale));
+		std::memcpy(p, &s, scale);
+		return p + size(n);
+	}
+};
+
+}
+
+/*
+** Determines which conversions between the scalar type of a component in the
+** file and the one requested by the reader are allowed:
+**   - `none`: the scalar types must match.
+**   - `lossless`: only conversions that preserve every value are allowed, such
+**   as `int16_t` or `float16` to `float`, and `uint8_t` to `int32_t`.
+**   - `lossy`: conversions of any scalar type to `float` or `double` are also
+**   allowed, and round to nearest.
+** Conversions from floating-point types to integers are never allowed.
+*/
+enum class conversion_policy : uint8_t
+{
+	none,
+	lossless,
+	lossy
+};
+
+namespace detail {
+
+/*
+** Returns the number of bits needed to represent the magnitude of the integers
+** with the given scalar code, or zero if the code is not that of an integer.
+*/
+int magnitude_bits(uint8_t code) noexcept
+{
+	switch (code) {
+	case scalar_code<int8_t>::value:   return 7;
+	case scalar_code<int16_t>::value:  return 15;
+	case scalar_code<int32_t>::value:  return 31;
+	case scalar_code<int64_t>::value:  return 63;
+	case scalar_code<uint8_t>::value:  return 8;
+	case scalar_code<uint16_t>::value: return 16;
+	case scalar_code<uint32_t>::value: return 32;
+	case scalar_code<uint64_t>::value: return 64;
+	default:                           return 0;
+	}
+}
+
+bool is_signed_integer(uint8_t code) noexcept
+{ return code <= scalar_code<int64_t>::value; }
+
+/*
+** Returns the number of significant bits of the floats with the given scalar
+** code, or zero if the code is not that of a floating-point type. The values of
+** scaled integers are computed using `float`.
+*/
+int significand_bits(uint8_t code) noexcept
+{
+	switch (code) {
+	case scalar_code<float>::value:       return 24;
+	case scalar_code<double>::value:      return 53;
+	case scalar_code<float16>::value:     return 11;
+	case scalar_code<bfloat16>::value:    return 8;
+	case scalar_code<scaled_int8>::value: return 24;
+	default:                              return 0;
+	}
+}
+
+/*
+** Returns the number of exponent bits of the floats with the given scalar code,
+** or zero if the code is not that of a floating-point type.
+*/
+int exponent_bits(uint8_t code) noexcept
+{
+	switch (code) {
+	case scalar_code<float>::value:       return 8;
+	case scalar_code<double>::value:      return 11;
+	case scalar_code<float16>::value:     return 5;
+	case scalar_code<bfloat16>::value:    return 8;
+	case scalar_code<scaled_int8>::value: return 8;
+	default:                              return 0;
+	}
+}
+
+}
+
+/*
+** Determines whether every value of the scalar type with code `from` can be
+** represented by the scalar type with code `to`. Between floating-point types,
+** both the precision and the exponent range must be preserved, so that neither
+** `float16` nor `bfloat16` can be converted losslessly to the other.
+*/
+bool is_lossless_conversion(uint8_t from, uint8_t to) noexcept
+{
+	using namespace detail;
+
+	if (from == to) { return true; }
+	if (scalar_size(from) == 0 || scalar_size(to) == 0) { return false; }
+
+	auto p = significand_bits(to);
+	if (p != 0) {
+		auto m = magnitude_bits(from);
+		if (m != 0) { return m <= p; }
+		return significand_bits(from) <= p &&
+			exponent_bits(from) <= exponent_bits(to);
+	}
+
+	auto m = magnitude_bits(from);
+	if (m == 0 || (is_signed_integer(from) && !is_signed_integer(to))) {
+		return false;
+	}
+	return m <= magnitude_bits(to);
+}
+
+bool is_conversion_allowed(uint8_t from, uint8_t to, conversion_policy p)
+noexcept
+{
+	switch (p) {
+	case conversion_policy::none:
+		return from == to;
+	case conversion_policy::lossless:
+		return is_lossless_conversion(from, to);
+	case conversion_policy::lossy:
+		return is_lossless_conversion(from, to) || (
+			scalar_size(from) != 0 &&
+			detail::significand_bits(to) != 0
+		);
+	}
+	return false;
+}
+
+namespace detail {
+
+/*
+** Converts as many scalars as possible using SIMD instructions, and returns the
+** number converted. Integers of up to 32 bits are first widened to 32-bit
+** integers, and then converted to the floating-point type.
+*/
+
+template <class Src, class Dst>
+CC_ALWAYS_INLINE size_t
+convert_vectorized(const Src*, size_t, Dst*) { return 0; }
+
+#if defined(__AVX2__)
+
+template <class Src>
+struct is_epi32_source
+{
+	static constexpr auto value =
+		std::is_integral<Src>::value && sizeof(Src) <= 4 &&
+		!(std::is_unsigned<Src>::value && sizeof(Src) == 4);
+};
+
+// Loads eight integers, and widens them to 32 bits.
+CC_ALWAYS_INLINE __m256i load_epi32(const int8_t* p)
+{ return _mm256_cvtepi8_epi32(_mm_loadl_epi64((const __m128i*)p)); }
+
+CC_ALWAYS_INLINE __m256i load_epi32(const uint8_t* p)
+{ return _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)p)); }
+
+CC_ALWAYS_INLINE __m256i load_epi32(const int16_t* p)
+{ return _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)p)); }
+
+CC_ALWAYS_INLINE __m256i load_epi32(const uint16_t* p)
+{ return _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)p)); }
+
+CC_ALWAYS_INLINE __m256i load_epi32(const int32_t* p)
+{ return _mm256_loadu_si256((const __m256i*)p); }
+
+template <
+	class Src,
+	typename std::enable_if<is_epi32_source<Src>::value, int>::type = 0
+>
+CC_ALWAYS_INLINE size_t
+convert_vectorized(const Src* src, size_t n, float* dst)
+{
+	auto i = size_t{0};
+	for (; i + 8 <= n; i += 8) {
+		auto x = load_epi32(src + i);
+		_mm256_storeu_ps(dst + i, _mm256_cvtepi32_ps(x));
+	}
+	return i;
+}
+
+template <
+	class Src,
+	typename std::enable_if<is_epi32_source<Src>::value, int>::type = 0
+>
+CC_ALWAYS_INLINE size_t
+convert_vectorized(const Src* src, size_t n, double* dst)
+{
+	auto i = size_t{0};
+	for (; i + 8 <= n; i += 8) {
+		auto x = load_epi32(src + i);
+		_mm256_storeu_pd(dst + i,
+			_mm256_cvtepi32_pd(_mm256_castsi256_si128(x)));
+		_mm256_storeu_pd(dst + i + 4,
+			_mm256_cvtepi32_pd(_mm256_extracti128_si256(x, 1)));
+	}
+	return i;
+}
+
+CC_ALWAYS_INLINE size_t
+convert_vectorized(const float* src, size_t n, double* dst)
+{
+	auto i = size_t{0};
+	for (; i + 4 <= n; i += 4) {
+		_mm256_storeu_pd(dst + i, _mm256_cvtps_pd(_mm_loadu_ps(src + i)));
+	}
+	return i;
+}
+
+CC_ALWAYS_INLINE size_t
+convert_vectorized(const double* src, size_t n, float* dst)
+{
+	auto i = size_t{0};
+	for (; i + 4 <= n; i += 4) {
+		_mm_storeu_ps(dst + i, _mm256_cvtpd_ps(_mm256_loadu_pd(src + i)));
+	}
+	return i;
+}
+
+#endif
+
+template <class Src, class Dst>
+CC_ALWAYS_INLINE void convert_typed(const Src* src, size_t n, Dst* dst)
+{
+	auto i = convert_vectorized(src, n, dst);
+	for (; i != n; ++i) {
+		// The components of a record need not be aligned.
+		Src x;
+		std::memcpy(&x, src + i, sizeof(Src));
+		dst[i] = static_cast<Dst>(x);
+	}
+}
+
+/*
+** Components with narrow scalar types are widened to `float` first, in chunks
+** that fit on the stack.
+*/
+template <class Dst, class Widen>
+CC_ALWAYS_INLINE void convert_widened(size_t n, Dst* dst, Widen widen)
+{
+	static constexpr auto chunk_size = size_t{256};
+	float buf[chunk_size];
+
+	for (auto i = size_t{0}; i < n; i += chunk_size) {
+		auto k = std::min(chunk_size, n - i);
+		widen(i, k, buf);
+		convert_typed(buf, k, dst + i);
+	}
+}
+
+template <class Widen>
+CC_ALWAYS_INLINE void convert_widened(size_t n, float* dst, Widen widen)
+{ widen(0, n, dst); }
+
+}
+
+/*
+** Converts the `n` coefficients of the component at `src`, whose scalar type
+** has the given code, to `dst`. The component must already be in the byte
+** order of the platform. If the scalar type is scaled, then `src` refers to the
+** scale that precedes the coefficients.
+*/
+template <class Dst>
+void convert_n(const uint8_t* src, uint8_t code, size_t n, Dst* dst) noexcept
+{
+	using detail::convert_typed;
+	using detail::convert_widened;
+
+	switch (code) {
+	case scalar_code<int8_t>::value:
+		convert_typed((const int8_t*)src, n, dst); break;
+	case scalar_code<int16_t>::value:
+		convert_typed((const int16_t*)src, n, dst); break;
+	case scalar_code<int32_t>::value:
+		convert_typed((const int32_t*)src, n, dst); break;
+	case scalar_code<int64_t>::value:
+		convert_typed((const int64_t*)src, n, dst); break;
+	case scalar_code<uint8_t>::value:
+		convert_typed((const uint8_t*)src, n, dst); break;
+	case scalar_code<uint16_t>::value:
+		convert_typed((const uint16_t*)src, n, dst); break;
+	case scalar_code<uint32_t>::value:
+		convert_typed((const uint32_t*)src, n, dst); break;
+	case scalar_code<uint64_t>::value:
+		convert_typed((const uint64_t*)src, n, dst); break;
+	case scalar_code<float>::value:
+		convert_typed((const float*)src, n, dst); break;
+	case scalar_code<double>::value:
+		convert_typed((const double*)src, n, dst); break;
+	case scalar_code<float16>::value: {
+		auto p = (const float16*)src;
+		convert_widened(n, dst, [&] (size_t i, size_t k, float* q) {
+			widen_n(p + i, k, q); });
+		break;
+	}
+	case scalar_code<bfloat16>::value: {
+		auto p = (const bfloat16*)src;
+		convert_widened(n, dst, [&] (size_t i, size_t k, float* q) {
+			widen_n(p + i, k, q); });
+		break;
+	}
+	case scalar_code<scaled_int8>::value: {
+		static constexpr auto scale = scale_size<scaled_int8>::value;
+		float s;
+		std::memcpy(&s, src, scale);
+		auto p = (const scaled_int8*)(src + scale);
+		convert_widened(n, dst, [&] (size_t i, size_t k, float* q) {
+			widen_n(p + i, k, s, q); });
+		break;
+	}
+	default:
+		assert(false && "Invalid scalar code.");
+	}
+}
+
+}}
+
+#endif
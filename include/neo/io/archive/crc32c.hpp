@@ -0,0 +1,190 @@
+/*
+** File Name: crc32c.hpp
+** Author:    Aditya Ramesh
+** Date:      07/27/2014
+** Contact:   _@adityaramesh.com
+**
+** This file defines the CRC-32C (Castagnoli) checksum used to detect corruption
+** in archives. When the target supports SSE 4.2, the checksum is computed using
+** the `crc32` instruction. Since each instruction depends on the result of the
+** previous one, long buffers are split into three lanes that are processed in
+** an interleaved fashion, which hides the latency of the instruction; the
+** checksums of the lanes are then combined by multiplication in GF(2), as done
+** by `crc32c_combine`. Otherwise, a table-driven implementation that consumes
+** eight bytes at a time is used.
+*/
+
+#ifndef Z9B2E6F41_3C7A_4D08_B5E1_A64D2C0F7E93
+#define Z9B2E6F41_3C7A_4D08_B5E1_A64D2C0F7E93
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <ccbase/platform.hpp>
+
+#if defined(__SSE4_2__) && defined(__x86_64__)
+	#include <nmmintrin.h>
+#endif
+
+namespace neo {
+namespace archive {
+namespace detail {
+
+// The reflected CRC-32C polynomial.
+static constexpr auto crc32c_poly = uint32_t{0x82F63B78};
+
+/*
+** Returns the product of `a` and `b` modulo the polynomial. In the reflected
+** representation, the most significant bit holds the coefficient of x^0.
+*/
+uint32_t crc32c_multiply(uint32_t a, uint32_t b) noexcept
+{
+	auto m = uint32_t{1} << 31;
+	auto p = uint32_t{0};
+	for (;;) {
+		if (a & m) {
+			p ^= b;
+			if ((a & (m - 1)) == 0) { break; }
+		}
+		m >>= 1;
+		b = b & 1 ? (b >> 1) ^ crc32c_poly : b >> 1;
+	}
+	return p;
+}
+
+/*
+** Returns x^(8n) modulo the polynomial, which is the operator that appends `n`
+** zero bytes to a message.
+*/
+uint32_t crc32c_shift(size_t n) noexcept
+{
+	// x^0 and x^8.
+	auto p = uint32_t{1} << 31;
+	auto x = uint32_t{1} << 23;
+	for (; n != 0; n >>= 1) {
+		if (n & 1) { p = crc32c_multiply(p, x); }
+		x = crc32c_multiply(x, x);
+	}
+	return p;
+}
+
+struct crc32c_tables
+{
+	uint32_t t[8][256];
+
+	crc32c_tables() noexcept
+	{
+		for (auto i = uint32_t{0}; i != 256; ++i) {
+			auto c = i;
+			for (auto j = 0; j != 8; ++j) {
+				c = c & 1 ? (c >> 1) ^ crc32c_poly : c >> 1;
+			}
+			t[0][i] = c;
+		}
+		for (auto i = 0; i != 256; ++i) {
+			for (auto k = 1; k != 8; ++k) {
+				t[k][i] = (t[k - 1][i] >> 8) ^
+					t[0][t[k - 1][i] & 0xFF];
+			}
+		}
+	}
+};
+
+/*
+** Updates the CRC register `c`, which is not complemented, using the `n` bytes
+** at `p`.
+*/
+uint32_t crc32c_update_generic(uint32_t c, const uint8_t* p, size_t n) noexcept
+{
+	static const crc32c_tables tables{};
+	auto& t = tables.t;
+
+	for (; n >= 8; n -= 8, p += 8) {
+		uint32_t lo, hi;
+		std::memcpy(&lo, p, 4);
+		std::memcpy(&hi, p + 4, 4);
+		#if PLATFORM_INTEGER_BYTE_ORDER == PLATFORM_BYTE_ORDER_BIG
+			lo = __builtin_bswap32(lo);
+			hi = __builtin_bswap32(hi);
+		#endif
+		lo ^= c;
+		c = t[7][lo & 0xFF] ^ t[6][(lo >> 8) & 0xFF] ^
+			t[5][(lo >> 16) & 0xFF] ^ t[4][lo >> 24] ^
+			t[3][hi & 0xFF] ^ t[2][(hi >> 8) & 0xFF] ^
+			t[1][(hi >> 16) & 0xFF] ^ t[0][hi >> 24];
+	}
+	for (; n != 0; --n, ++p) {
+		c = (c >> 8) ^ t[0][(c ^ *p) & 0xFF];
+	}
+	return c;
+}
+
+#if defined(__SSE4_2__) && defined(__x86_64__)
+
+uint32_t crc32c_update_sse42(uint32_t c, const uint8_t* p, size_t n) noexcept
+{
+	// The number of bytes processed by each lane per iteration.
+	static constexpr auto lane_size = size_t{4096};
+	static const auto shift = crc32c_shift(lane_size);
+
+	for (; n >= 3 * lane_size; n -= 3 * lane_size, p += 3 * lane_size) {
+		auto c0 = uint64_t{c};
+		auto c1 = uint64_t{0};
+		auto c2 = uint64_t{0};
+		for (auto i = size_t{0}; i != lane_size; i += 8) {
+			uint64_t x0, x1, x2;
+			std::memcpy(&x0, p + i, 8);
+			std::memcpy(&x1, p + lane_size + i, 8);
+			std::memcpy(&x2, p + 2 * lane_size + i, 8);
+			c0 = _mm_crc32_u64(c0, x0);
+			c1 = _mm_crc32_u64(c1, x1);
+			c2 = _mm_crc32_u64(c2, x2);
+		}
+		c = crc32c_multiply(shift, (uint32_t)c0) ^ (uint32_t)c1;
+		c = crc32c_multiply(shift, c) ^ (uint32_t)c2;
+	}
+
+	auto c0 = uint64_t{c};
+	for (; n >= 8; n -= 8, p += 8) {
+		uint64_t x;
+		std::memcpy(&x, p, 8);
+		c0 = _mm_crc32_u64(c0, x);
+	}
+	c = (uint32_t)c0;
+	for (; n != 0; --n, ++p) {
+		c = _mm_crc32_u8(c, *p);
+	}
+	return c;
+}
+
+#endif
+
+CC_ALWAYS_INLINE
+uint32_t crc32c_update(uint32_t c, const uint8_t* p, size_t n) noexcept
+{
+	#if defined(__SSE4_2__) && defined(__x86_64__)
+		return crc32c_update_sse42(c, p, n);
+	#else
+		return crc32c_update_generic(c, p, n);
+	#endif
+}
+
+}
+
+/*
+** Returns the checksum of the `n` bytes at `p`. To compute the checksum of a
+** message incrementally, pass the checksum of the preceding bytes as `crc`.
+*/
+uint32_t crc32c(const uint8_t* p, size_t n, uint32_t crc = 0) noexcept
+{ return ~detail::crc32c_update(~crc, p, n); }
+
+/*
+** Given the checksums of two messages, the second of which has `n` bytes,
+** returns the checksum of their concatenation.
+*/
+uint32_t crc32c_combine(uint32_t crc1, uint32_t crc2, size_t n) noexcept
+{ return detail::crc32c_multiply(detail::crc32c_shift(n), crc1) ^ crc2; }
+
+}}
+
+#endif
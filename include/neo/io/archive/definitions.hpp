@@ -8,12 +8,18 @@
 #ifndef Z1FFDB7DB_502A_4714_A127_B431A08D7837
 #define Z1FFDB7DB_502A_4714_A127_B431A08D7837
 
+#include <algorithm>
 #include <cstdint>
+#include <new>
+#include <tuple>
+#include <type_traits>
+#include <vector>
 #include <neo/core/basic_context.hpp>
 #include <neo/core/basic_log_record.hpp>
 #include <neo/core/basic_error_state.hpp>
 #include <neo/core/buffer_state.hpp>
 #include <neo/io/archive/byte_order.hpp>
+#include <neo/io/archive/convert.hpp>
 #include <neo/io/archive/eigen_traits.hpp>
 #include <neo/io/archive/size_traits.hpp>
 #include <ccbase/utility.hpp>
@@ -22,6 +28,16 @@ namespace neo {
 namespace archive {
 
 static constexpr auto version = 1;
+// The version used for block-compressed archives; refer to `block.hpp`.
+static constexpr auto compressed_version = 2;
+// The version used for columnar archives; refer to `columnar.hpp`.
+static constexpr auto columnar_version = 3;
+/*
+** The high bit of the record count is set until the archive is finalized, and
+** the remaining bits hold the number of records written so far; refer to
+** `stream_writer.hpp`.
+*/
+static constexpr auto unfinalized_count_flag = uint64_t{1} << 63;
 
 using offset_type = uint_fast64_t;
 
@@ -35,35 +51,83 @@ using log_record = basic_log_record<
 
 using error_state = basic_error_state<log_record>;
 
+/*
+** The size of an element with dynamic extents is only known once its extents
+** have been read, so initially, only the size of the smallest possible element
+** is required. `scan` and `format` raise the required size when they encounter
+** an element that does not fit in the buffer.
+*/
 template <class SerializedType>
 buffer_state make_buffer_state() noexcept
 {
-	static constexpr auto hdr_size = element_size<SerializedType>::value;
+	static constexpr auto hdr_size = header_size<SerializedType>::value;
 	static constexpr auto elem_size = element_size<SerializedType>::value;
 	static constexpr auto min_size = (hdr_size % elem_size == 0) ?
 	hdr_size : hdr_size + elem_size - hdr_size % elem_size;
 
 	auto b = buffer_state{};
 	b.required_constraints().at_least(min_size);
-	b.preferred_constraints().at_least(min_size).multiple_of(elem_size);
+	b.preferred_constraints().at_least(min_size);
+	if (!is_dynamic<SerializedType>::value) {
+		b.preferred_constraints().multiple_of(elem_size);
+	}
 	return b;
 }
 
+namespace detail {
+
+template <class T>
+struct is_tuple : std::false_type {};
+
+template <class... Ts>
+struct is_tuple<std::tuple<Ts...>> : std::true_type {};
+
+}
+
+/*
+** The default upper bound on the size of an element with dynamic extents. The
+** extents are read from the file, so they are checked against this bound
+** before the caller is asked to grow its buffer. Component sizes are computed
+** using coefficient counts that are clamped to this bound, so that corrupt
+** extents cannot cause the sizes to overflow.
+*/
+static constexpr auto max_dynamic_element_size = size_t{1} << 48;
+
 template <class SerializedType>
 class io_state
 {
 public:
 	using value_type = mapped_eigen_type<SerializedType>;
+	using batch_type = mapped_batch_type<SerializedType>;
 private:
 	static constexpr auto hdr_size  = header_size<SerializedType>::value;
 	static constexpr auto elem_size = element_size<SerializedType>::value;
 	static constexpr auto matrices  = count_matrices<SerializedType>::value;
+	static constexpr auto dyn_size  = is_dynamic<SerializedType>::value;
+	static constexpr auto components = element_extents<SerializedType>::value;
+
+	static_assert(!dyn_size || detail::is_tuple<SerializedType>::value,
+		"Components with dynamic extents must belong to a tuple.");
 
 	/*
 	** Part of a nasty hack to get around the fact that `Eigen::Map`s are
 	** not default constructible.
 	*/
 	std::array<uint8_t, sizeof(value_type)> m_buf;
+	// Holds the views constructed by `scan_n`, for the same reason.
+	typename std::aligned_storage<
+		sizeof(batch_type), alignof(batch_type)
+	>::type m_batch;
+	size_t m_batch_size{};
+	// Holds the components with narrow scalar types once they are widened.
+	std::vector<float> m_wide{};
+	size_t m_wide_pos{};
+	// Scratch space used to transpose rectangular matrices in place.
+	std::vector<uint8_t> m_trans_buf{};
+	// The size of the current element, if its extents are dynamic.
+	size_t m_elem_size{elem_size};
+	// The largest element with dynamic extents that `scan` accepts.
+	size_t m_max_elem_size{max_dynamic_element_size};
 	boost::optional<offset_type> m_elem_count{};
 
 	/*
@@ -76,10 +140,53 @@ private:
 	bool m_flip_ints;
 	// Do we need to flip the byte order of floats?
 	bool m_flip_floats;
+	// Are the records grouped into compressed blocks?
+	bool m_compressed{};
+	// Are the components of the records stored in columns?
+	bool m_columnar{};
+	// Was the record count patched once the archive was written?
+	bool m_finalized{true};
+
+	/*
+	** The scalar code of each component in the file. If any of these
+	** differ from those of the element type, then the archive is
+	** `converted`, and its elements must be read into a destination
+	** provided by the caller; refer to `scan`.
+	*/
+	std::array<uint8_t, components> m_file_scalars;
+	conversion_policy m_conversion{conversion_policy::none};
+	bool m_converted{};
 public:
 	explicit io_state() noexcept {}
 	size_t header_size() const { return hdr_size; }
-	size_t element_size() const { return elem_size; }
+
+	/*
+	** Returns the size of the current element. If the element type has
+	** dynamic extents, then this is the size of the element that was last
+	** processed by `scan` or `format`.
+	*/
+	size_t element_size() const
+	{ return dyn_size || m_converted ? m_elem_size : elem_size; }
+
+	io_state& element_size(size_t n) noexcept
+	{
+		m_elem_size = n;
+		return *this;
+	}
+
+	/*
+	** Readers that know the size of the file should set this to the
+	** number of bytes that follow the header, so that elements whose
+	** extents are corrupt are rejected rather than read.
+	*/
+	size_t max_element_size() const noexcept { return m_max_elem_size; }
+
+	io_state& max_element_size(size_t n) noexcept
+	{
+		assert(n <= max_dynamic_element_size);
+		m_max_elem_size = n;
+		return *this;
+	}
 
 	bool transpose_matrix(size_t n)
 	const noexcept { return m_trans[n]; }
@@ -101,8 +208,105 @@ public:
 	const value_type& element() const noexcept
 	{ return *reinterpret_cast<const value_type*>(m_buf.data()); }
 
+	/*
+	** Returns the views of the batch of elements decoded by the last call
+	** to `scan_n`. These are only valid after the first such call.
+	*/
+	batch_type& batch() noexcept
+	{
+		assert(m_batch_size != 0 && "Batch uninitialized.");
+		return *reinterpret_cast<batch_type*>(&m_batch);
+	}
+
+	const batch_type& batch() const noexcept
+	{
+		assert(m_batch_size != 0 && "Batch uninitialized.");
+		return *reinterpret_cast<const batch_type*>(&m_batch);
+	}
+
+	size_t batch_size() const noexcept { return m_batch_size; }
+
+	io_state& batch_size(size_t n) noexcept
+	{
+		m_batch_size = n;
+		return *this;
+	}
+
+	/*
+	** Discards the coefficients that were widened by the last call to
+	** `scan` or `scan_n`, and ensures that there is space for `n` more.
+	** This invalidates the views of the components with narrow scalar
+	** types. Returns false if the space could not be allocated.
+	*/
+	bool reset_widened(size_t n) noexcept
+	{
+		m_wide_pos = 0;
+		if (m_wide.size() >= n) { return true; }
+		try {
+			m_wide.resize(n);
+		}
+		catch (const std::bad_alloc&) {
+			return false;
+		}
+		return true;
+	}
+
+	/*
+	** Returns space for the next `n` widened coefficients.
+	*/
+	float* widened(size_t n) noexcept
+	{
+		assert(m_wide_pos + n <= m_wide.size());
+		auto p = m_wide.data() + m_wide_pos;
+		m_wide_pos += n;
+		return p;
+	}
+
+	/*
+	** Ensures that there is space to transpose matrices of up to `n`
+	** bytes in place, if any of the matrices need to be transposed.
+	** Returns false if the space could not be allocated.
+	*/
+	bool reserve_transposed(size_t n) noexcept
+	{
+		if (m_trans_buf.size() >= n) { return true; }
+		if (std::find(m_trans.begin(), m_trans.end(), true) ==
+			m_trans.end()) { return true; }
+		try {
+			m_trans_buf.resize(n);
+		}
+		catch (const std::bad_alloc&) {
+			return false;
+		}
+		return true;
+	}
+
+	/*
+	** Returns the scratch space reserved by `reserve_transposed`.
+	*/
+	template <class Scalar>
+	Scalar* transposed() noexcept
+	{ return reinterpret_cast<Scalar*>(m_trans_buf.data()); }
+
 	DEFINE_COPY_GETTER_SETTER(io_state, flip_integers, m_flip_ints)
 	DEFINE_COPY_GETTER_SETTER(io_state, flip_floats, m_flip_floats)
+	DEFINE_COPY_GETTER_SETTER(io_state, compressed, m_compressed)
+	DEFINE_COPY_GETTER_SETTER(io_state, columnar, m_columnar)
+	DEFINE_COPY_GETTER_SETTER(io_state, finalized, m_finalized)
+	DEFINE_COPY_GETTER_SETTER(io_state, conversion, m_conversion)
+	DEFINE_COPY_GETTER_SETTER(io_state, converted, m_converted)
+
+	uint8_t file_scalar(size_t n) const noexcept
+	{ return m_file_scalars[n]; }
+
+	io_state& file_scalar(size_t n, uint8_t code) noexcept
+	{
+		m_file_scalars[n] = code;
+		return *this;
+	}
+
+	bool has_element_count() const noexcept
+	{ return !!m_elem_count; }
 
 	offset_type element_count() const
 	{
@@ -0,0 +1,472 @@
+/*
+** File Name: dynamic_io.hpp
+** Author:    Aditya Ramesh
+** Date:      07/27/2014
+** Contact:   _@adityaramesh.com
+**
+** This file defines the `dynamic_io_state` class, which allows archives to be
+** read when the element type is only known at runtime (e.g. by inspectors and
+** converters). The overload of `read_header` for this class parses the header
+** into a `component_schema` for each component, instead of verifying it against
+** a compile-time type.
+**
+** While the header is parsed, a decode table is built with one entry per
+** component, holding the offset of the component within the element (if the
+** element has fixed size) and a pointer to the byte swap kernel for the width
+** of its scalar, if the byte order of the scalar must be reversed. Scanning an
+** element then amounts to a single pass over this table, so that throughput
+** stays close to that of the templated `scan`. Matrices are not transposed;
+** instead, the `component_view` of each component records the storage order,
+** which is accounted for by the strides of the map returned by `map()`.
+*/
+
+#ifndef Z6C0F9E25_B3A8_4D71_8E46_D5172B9AC0F3
+#define Z6C0F9E25_B3A8_4D71_8E46_D5172B9AC0F3
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <vector>
+#include <boost/optional.hpp>
+#include <neo/core/operation_status.hpp>
+#include <neo/io/archive/bswap.hpp>
+#include <neo/io/archive/definitions.hpp>
+
+namespace neo {
+namespace archive {
+
+/*
+** Describes a component of the element type, as given in the header. The
+** extents of a scalar are both one, and those of a vector are its size and one.
+** An extent that is `dynamic_extent_code` is stored with each element.
+*/
+struct component_schema
+{
+	uint8_t scalar;
+	// Zero for scalars, one for vectors, and two for matrices.
+	uint8_t dims;
+	storage_order order;
+	uint32_t rows;
+	uint32_t cols;
+
+	size_t scalar_size() const noexcept
+	{ return archive::scalar_size(scalar); }
+
+	size_t scale_size() const noexcept
+	{ return scale_prefix_size(scalar); }
+
+	bool is_dynamic() const noexcept
+	{
+		return rows == dynamic_extent_code ||
+			cols == dynamic_extent_code;
+	}
+};
+
+/*
+** Refers to a component of the element that was last scanned.
+*/
+struct component_view
+{
+	template <class Scalar>
+	using map_type = Eigen::Map<
+		const Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic>,
+		Eigen::Unaligned,
+		Eigen::Stride<Eigen::Dynamic, Eigen::Dynamic>
+	>;
+
+	uint8_t scalar;
+	storage_order order;
+	// Refers to the coefficients, which follow the scale, if any.
+	const uint8_t* data;
+	size_t rows;
+	size_t cols;
+	// The scale of a component whose scalar type is `scaled_int8`.
+	float scale;
+
+	size_t size() const noexcept
+	{ return rows * cols * scalar_size(scalar); }
+
+	/*
+	** Returns the value of a scalar component.
+	*/
+	template <class Scalar>
+	Scalar value() const noexcept
+	{
+		assert(scalar_code<Scalar>::value == scalar);
+		assert(rows == 1 && cols == 1);
+		Scalar s;
+		std::memcpy(&s, data, sizeof(Scalar));
+		return s;
+	}
+
+	/*
+	** Returns a map of the component as a `rows` by `cols` matrix. Vectors
+	** are mapped as column vectors.
+	*/
+	template <class Scalar>
+	map_type<Scalar> map() const noexcept
+	{
+		using stride = Eigen::Stride<Eigen::Dynamic, Eigen::Dynamic>;
+		assert(scalar_code<Scalar>::value == scalar);
+
+		auto p = (const Scalar*)data;
+		if (order == storage_order::row_major) {
+			return map_type<Scalar>{p, (long)rows, (long)cols,
+				stride{1, (long)cols}};
+		}
+		return map_type<Scalar>{p, (long)rows, (long)cols,
+			stride{(long)rows, 1}};
+	}
+};
+
+namespace detail {
+
+using decode_fn = void (*)(uint8_t*, size_t);
+
+struct decode_entry
+{
+	// Reverses the byte order of the scalars, or null if this is not needed.
+	decode_fn flip;
+	// The offset of the component within an element of fixed size.
+	size_t offset;
+	size_t count;
+	// The size of the scale that precedes the coefficients.
+	size_t scale;
+};
+
+/*
+** Reads the scale at `p` into `v`, and returns a pointer to the coefficients
+** that follow it.
+*/
+CC_ALWAYS_INLINE uint8_t*
+read_scale(uint8_t* p, bool flip, component_view& v)
+{
+	if (flip) { bswap_n((uint32_t*)p, 1); }
+	std::memcpy(&v.scale, p, 4);
+	return p + 4;
+}
+
+decode_fn flip_kernel(size_t width) noexcept
+{
+	switch (width) {
+	case 2: return &bswap_kernel<2>::apply;
+	case 4: return &bswap_kernel<4>::apply;
+	case 8: return &bswap_kernel<8>::apply;
+	default: return nullptr;
+	}
+}
+
+}
+
+class dynamic_io_state
+{
+	friend operation_status read_header(const uint8_t*, size_t,
+		dynamic_io_state&, buffer_state&, error_state&) noexcept;
+	friend operation_status scan(uint8_t*, size_t, dynamic_io_state&,
+		buffer_state&, error_state&) noexcept;
+
+	std::vector<component_schema> m_schema{};
+	std::vector<detail::decode_entry> m_decode{};
+	std::vector<component_view> m_views{};
+	size_t m_hdr_size{};
+	// The size of the smallest element, which includes the dynamic extents.
+	size_t m_min_elem_size{};
+	size_t m_elem_size{};
+	size_t m_max_elem_size{max_dynamic_element_size};
+	size_t m_dyn_extents{};
+	boost::optional<offset_type> m_elem_count{};
+	bool m_flip_ints{};
+	bool m_flip_floats{};
+	bool m_compressed{};
+	bool m_columnar{};
+	bool m_finalized{true};
+public:
+	explicit dynamic_io_state() noexcept {}
+
+	size_t header_size() const noexcept { return m_hdr_size; }
+	size_t component_count() const noexcept { return m_schema.size(); }
+	bool is_dynamic() const noexcept { return m_dyn_extents != 0; }
+	size_t dynamic_extents() const noexcept { return m_dyn_extents; }
+
+	const component_schema& schema(size_t i) const noexcept
+	{ return m_schema[i]; }
+
+	/*
+	** Returns the size of the current element. If the element type has
+	** dynamic extents, then this is the size of the element that was last
+	** scanned.
+	*/
+	size_t element_size() const noexcept { return m_elem_size; }
+	size_t min_element_size() const noexcept { return m_min_elem_size; }
+
+	// See `io_state::max_element_size`.
+	size_t max_element_size() const noexcept { return m_max_elem_size; }
+
+	dynamic_io_state& max_element_size(size_t n) noexcept
+	{
+		assert(n <= max_dynamic_element_size);
+		m_max_elem_size = n;
+		return *this;
+	}
+
+	/*
+	** Returns the view of the given component of the element that was last
+	** scanned.
+	*/
+	const component_view& component(size_t i) const noexcept
+	{ return m_views[i]; }
+
+	bool flip_integers() const noexcept { return m_flip_ints; }
+	bool flip_floats() const noexcept { return m_flip_floats; }
+	bool compressed() const noexcept { return m_compressed; }
+	bool columnar() const noexcept { return m_columnar; }
+	bool finalized() const noexcept { return m_finalized; }
+
+	offset_type element_count() const
+	{
+		assert(m_elem_count && "Element count uninitialized.");
+		return *m_elem_count;
+	}
+};
+
+/*
+** Parses the header at the start of the buffer into `is`. The size of the
+** header depends on the components that it describes, so if the header does
+** not fit in the buffer, then nothing is consumed, the required buffer size is
+** raised to the size of the header (or of the part that is known so far), and
+** the result has the `incomplete` and `req_constr_update` flags set.
+*/
+operation_status
+read_header(
+	const uint8_t* buf, size_t n,
+	dynamic_io_state& is,
+	buffer_state& bs, error_state& es
+) noexcept
+{
+	static constexpr auto elem_count_size = size_t{8};
+
+	auto need = [&] (size_t size) {
+		bs.consumed(0);
+		bs.required_constraints().at_least(size);
+		return operation_status::incomplete |
+			operation_status::req_constr_update;
+	};
+	auto fail = [&] (uint8_t index, const char* msg) {
+		es.push_record(
+			severity::critical,
+			context{offset_type{0}, index},
+			msg
+		);
+		return operation_status::failure |
+			operation_status::fatal_error;
+	};
+
+	if (n < 3) { return need(3); }
+	if (buf[0] > columnar_version) {
+		return fail(0, "Unsupported archive version.");
+	}
+
+	auto o = static_cast<byte_order>(buf[1]);
+	is.m_flip_ints = (o & byte_order::integer_mask) !=
+		platform_integer_byte_order;
+	is.m_flip_floats = (o & byte_order::float_mask) !=
+		platform_float_byte_order;
+	is.m_compressed = buf[0] == compressed_version;
+	is.m_columnar = buf[0] == columnar_version;
+
+	auto count = size_t{buf[2]};
+	auto read_u32 = [&] (const uint8_t* p) {
+		uint32_t x;
+		std::memcpy(&x, p, 4);
+		return is.m_flip_ints ? cc::bswap(x) : x;
+	};
+
+	is.m_schema.clear();
+	is.m_decode.clear();
+	is.m_dyn_extents = 0;
+
+	auto off = size_t{3};
+	auto elem = size_t{0};
+	for (auto i = size_t{0}; i != count; ++i) {
+		if (n < off + 2) { return need(off + 2); }
+		auto c = component_schema{buf[off], buf[off + 1],
+			storage_order::column_major, 1, 1};
+		auto index = (uint8_t)i;
+
+		if (c.scalar_size() == 0) {
+			return fail(index, "Invalid scalar type.");
+		}
+
+		switch (c.dims) {
+		case 0:
+			off += 2;
+			break;
+		case 1:
+			if (n < off + 6) { return need(off + 6); }
+			c.rows = read_u32(buf + off + 2);
+			off += 6;
+			break;
+		case 2:
+			if (n < off + 11) { return need(off + 11); }
+			c.order = static_cast<storage_order>(buf[off + 2]);
+			if (
+				c.order != storage_order::row_major &&
+				c.order != storage_order::column_major
+			) { return fail(index, "Invalid storage order."); }
+			c.rows = read_u32(buf + off + 3);
+			c.cols = read_u32(buf + off + 7);
+			off += 11;
+			break;
+		default:
+			return fail(index, "Invalid component dimension.");
+		}
+
+		if (c.rows == 0 || c.cols == 0) {
+			return fail(index, "Components must not be empty.");
+		}
+		is.m_dyn_extents += (c.rows == dynamic_extent_code) +
+			(c.cols == dynamic_extent_code);
+
+		auto flip = c.scalar_size() > 1 && (is_floating_point(c.scalar) ?
+			is.m_flip_floats : is.m_flip_ints);
+		auto k = c.is_dynamic() ? size_t{0} : size_t{c.rows} * c.cols;
+		is.m_decode.push_back(detail::decode_entry{
+			flip ? detail::flip_kernel(c.scalar_size()) : nullptr,
+			elem, k, c.scale_size()
+		});
+		elem += c.scale_size() + k * c.scalar_size();
+		is.m_schema.push_back(c);
+	}
+
+	if (n < off + elem_count_size) { return need(off + elem_count_size); }
+	auto ec = uint64_t{};
+	std::memcpy(&ec, buf + off, elem_count_size);
+	if (is.m_flip_ints) { ec = cc::bswap(ec); }
+	is.m_finalized = !(ec & unfinalized_count_flag);
+	if (!is.m_finalized) {
+		es.push_record(
+			severity::warning,
+			context{offset_type{0}, uint8_t{0}},
+			"Archive was not finalized."
+		);
+		ec &= ~unfinalized_count_flag;
+	}
+
+	// For fixed sizes, the offsets are relative to the start of the element.
+	auto prefix = 4 * is.m_dyn_extents;
+	for (auto& d : is.m_decode) { d.offset += prefix; }
+
+	is.m_hdr_size = off + elem_count_size;
+	is.m_min_elem_size = prefix + elem;
+	is.m_elem_size = is.m_min_elem_size;
+	is.m_elem_count = ec;
+
+	is.m_views.resize(count);
+	for (auto i = size_t{0}; i != count; ++i) {
+		auto& c = is.m_schema[i];
+		is.m_views[i] = component_view{c.scalar, c.order, nullptr,
+			c.rows, c.cols, 1};
+	}
+
+	bs.consumed(is.m_hdr_size);
+	return operation_status::success;
+}
+
+/*
+** Processes the element at the start of the buffer, and updates the views
+** returned by `is.component()`. As with the templated `scan`, if the element
+** has dynamic extents and does not fit in the buffer, then the result has the
+** `incomplete` and `req_constr_update` flags set, and nothing is consumed.
+** Elements larger than `is.max_element_size()` are rejected, as are the
+** records of block-compressed and columnar archives, which cannot be scanned in
+** place.
+*/
+operation_status
+scan(
+	uint8_t* buf, size_t n,
+	dynamic_io_state& is,
+	buffer_state& bs, error_state& es
+) noexcept
+{
+	auto& d = is.m_decode;
+	auto& v = is.m_views;
+
+	if (is.m_compressed || is.m_columnar) {
+		bs.consumed(0);
+		es.push_record(
+			severity::critical,
+			context{offset_type{0}, uint8_t{0}},
+			is.m_compressed ? "Archive is block-compressed." :
+				"Archive is columnar."
+		);
+		return operation_status::failure |
+			operation_status::fatal_error;
+	}
+
+	if (!is.is_dynamic()) {
+		(void)n;
+		assert(n >= is.m_elem_size);
+		for (auto i = size_t{0}; i != d.size(); ++i) {
+			auto p = buf + d[i].offset;
+			if (d[i].scale != 0) {
+				p = detail::read_scale(p, is.m_flip_floats, v[i]);
+			}
+			if (d[i].flip != nullptr) { d[i].flip(p, d[i].count); }
+			v[i].data = p;
+		}
+		bs.consumed(is.m_elem_size);
+		return operation_status::success;
+	}
+
+	assert(n >= is.m_min_elem_size);
+	auto ext = (const uint8_t*)buf;
+	auto read_ext = [&] {
+		uint32_t x;
+		std::memcpy(&x, ext, 4);
+		ext += 4;
+		return is.m_flip_ints ? cc::bswap(x) : x;
+	};
+
+	auto size = 4 * is.m_dyn_extents;
+	for (auto i = size_t{0}; i != d.size(); ++i) {
+		auto& c = is.m_schema[i];
+		v[i].rows = c.rows == dynamic_extent_code ? read_ext() : c.rows;
+		v[i].cols = c.cols == dynamic_extent_code ? read_ext() : c.cols;
+		size += c.scale_size() + c.scalar_size() * std::min(
+			v[i].rows * v[i].cols, max_dynamic_element_size);
+	}
+	if (size > is.m_max_elem_size) {
+		bs.consumed(0);
+		es.push_record(
+			severity::critical,
+			context{offset_type{0}, uint8_t{0}},
+			"Element is larger than the maximum element size."
+		);
+		return operation_status::failure |
+			operation_status::fatal_error;
+	}
+	if (n < size) {
+		bs.consumed(0);
+		bs.required_constraints().at_least(size);
+		return operation_status::incomplete |
+			operation_status::req_constr_update;
+	}
+
+	auto p = buf + 4 * is.m_dyn_extents;
+	for (auto i = size_t{0}; i != d.size(); ++i) {
+		auto k = v[i].rows * v[i].cols;
+		if (d[i].scale != 0) {
+			p = detail::read_scale(p, is.m_flip_floats, v[i]);
+		}
+		if (d[i].flip != nullptr) { d[i].flip(p, k); }
+		v[i].data = p;
+		p += k * is.m_schema[i].scalar_size();
+	}
+	is.m_elem_size = size;
+	bs.consumed(size);
+	return operation_status::success;
+}
+
+}}
+
+#endif
@@ -38,11 +38,27 @@ struct eigen_storage_order<storage_order::column_major>
 	static constexpr type value = Eigen::ColMajor;
 };
 
+/*
+** Converts between `neo` extents and Eigen extents.
+*/
+
+template <size_t Extent>
+struct eigen_extent
+{
+	static constexpr int value =
+	Extent == dynamic ? (int)Eigen::Dynamic : (int)Extent;
+};
+
+constexpr size_t archive_extent(int n)
+{ return n == Eigen::Dynamic ? dynamic : (size_t)n; }
+
 /*
 ** Returns the Eigen type corresponding to one of the following `neo` types:
 **   - scalar<class>
 **   - vector<class, std::size_t>
 **   - matrix<class, std::size_t, std::size_t, storage_order>
+**
+** Narrow scalar types are mapped to `float`.
 */
 
 template <class InputType>
@@ -52,7 +68,9 @@ template <class Scalar, size_t Rows, size_t Cols, storage_order Order>
 struct eigen_type_impl<matrix<Scalar, Rows, Cols, Order>>
 {
 	using type = Eigen::Matrix<
-		Scalar, Rows, Cols,
+		typename value_scalar<Scalar>::type,
+		eigen_extent<Rows>::value,
+		eigen_extent<Cols>::value,
 		eigen_storage_order<Order>::value
 	>;
 };
@@ -60,13 +78,16 @@ struct eigen_type_impl<matrix<Scalar, Rows, Cols, Order>>
 template <class Scalar, size_t Size>
 struct eigen_type_impl<vector<Scalar, Size>>
 {
-	using type = Eigen::Matrix<Scalar, Size, 1>;
+	using type = Eigen::Matrix<
+		typename value_scalar<Scalar>::type,
+		eigen_extent<Size>::value, 1
+	>;
 };
 
 template <class Scalar>
 struct eigen_type_impl
 {
-	using type = Scalar;
+	using type = typename value_scalar<Scalar>::type;
 };
 
 template <class... Ts>
@@ -106,7 +127,7 @@ struct mapped_eigen_type_impl<vector<Scalar, Size>>
 template <class Scalar>
 struct mapped_eigen_type_impl
 {
-	using type = Scalar;
+	using type = typename value_scalar<Scalar>::type;
 };
 
 template <class... Ts>
@@ -118,6 +139,111 @@ struct mapped_eigen_type_impl<std::tuple<Ts...>>
 template <class T>
 using mapped_eigen_type = typename mapped_eigen_type_impl<T>::type;
 
+/*
+** As above, but the maps refer to read-only data.
+*/
+
+template <class InputType>
+struct const_mapped_eigen_type_impl
+{
+	using type = InputType;
+};
+
+template <class Scalar, size_t Rows, size_t Cols, storage_order Order>
+struct const_mapped_eigen_type_impl<matrix<Scalar, Rows, Cols, Order>>
+{
+	using input_type = matrix<Scalar, Rows, Cols, Order>;
+	using type = Eigen::Map<const eigen_type<input_type>>;
+};
+
+template <class Scalar, size_t Size>
+struct const_mapped_eigen_type_impl<vector<Scalar, Size>>
+{
+	using input_type = vector<Scalar, Size>;
+	using type = Eigen::Map<const eigen_type<input_type>>;
+};
+
+template <class... Ts>
+struct const_mapped_eigen_type_impl<std::tuple<Ts...>>
+{
+	using type = std::tuple<
+		typename const_mapped_eigen_type_impl<Ts>::type...
+	>;
+};
+
+template <class T>
+using const_mapped_eigen_type = typename const_mapped_eigen_type_impl<T>::type;
+
+/*
+** Returns the type of the view used by `scan_n` to expose one component of a
+** batch of consecutive elements. The view is a matrix with one column per
+** element, whose rows are the coefficients of the component in the order in
+** which they are stored (so a matrix component is flattened). Each column is
+** `stride` scalars apart, where `stride` is the size of the element in units of
+** the scalar type. Components with narrow scalar types are widened into
+** contiguous columns of floats.
+*/
+
+template <class Scalar, size_t Size>
+struct batch_view
+{
+	// Eigen requires matrices with one row to be row-major.
+	static constexpr auto is_row = Size == 1;
+
+	using type = Eigen::Map<
+		Eigen::Matrix<
+			Scalar, eigen_extent<Size>::value, Eigen::Dynamic,
+			is_row ? Eigen::RowMajor : Eigen::ColMajor
+		>,
+		Eigen::Unaligned,
+		Eigen::Stride<Eigen::Dynamic, Eigen::Dynamic>
+	>;
+
+	static type make(Scalar* p, size_t count, size_t stride)
+	{
+		using stride_type = Eigen::Stride<Eigen::Dynamic, Eigen::Dynamic>;
+		return is_row ?
+			type{p, 1, (long)count, stride_type{(long)stride, (long)stride}} :
+			type{p, (long)Size, (long)count, stride_type{(long)stride, 1}};
+	}
+};
+
+template <class InputType>
+struct mapped_batch_type_impl;
+
+template <class Scalar, size_t Rows, size_t Cols, storage_order Order>
+struct mapped_batch_type_impl<matrix<Scalar, Rows, Cols, Order>>
+{
+	static constexpr auto size =
+	Rows == dynamic || Cols == dynamic ? dynamic : Rows * Cols;
+
+	using view = batch_view<typename value_scalar<Scalar>::type, size>;
+	using type = typename view::type;
+};
+
+template <class Scalar, size_t Size>
+struct mapped_batch_type_impl<vector<Scalar, Size>>
+{
+	using view = batch_view<typename value_scalar<Scalar>::type, Size>;
+	using type = typename view::type;
+};
+
+template <class Scalar>
+struct mapped_batch_type_impl
+{
+	using view = batch_view<typename value_scalar<Scalar>::type, 1>;
+	using type = typename view::type;
+};
+
+template <class... Ts>
+struct mapped_batch_type_impl<std::tuple<Ts...>>
+{
+	using type = std::tuple<typename mapped_batch_type_impl<Ts>::type...>;
+};
+
+template <class T>
+using mapped_batch_type = typename mapped_batch_type_impl<T>::type;
+
 /*
 ** Various useful Eigen traits.
 */
@@ -152,10 +278,9 @@ struct eigen_matrix_traits
 	static constexpr auto rows = T::RowsAtCompileTime;
 	static constexpr auto cols = T::ColsAtCompileTime;
 
-	static_assert(rows != Eigen::Dynamic, "Row count must be fixed.");
-	static_assert(cols != Eigen::Dynamic, "Column count must be fixed.");
-
-	static constexpr auto size = rows * cols;
+	static constexpr auto size =
+	rows == Eigen::Dynamic || cols == Eigen::Dynamic ?
+	(int)Eigen::Dynamic : rows * cols;
 	static constexpr auto is_row_major = T::IsRowMajor;
 	static constexpr auto is_col_major = !is_row_major;
 	static constexpr auto is_vector = T::IsVectorAtCompileTime;
@@ -165,8 +290,11 @@ struct eigen_matrix_traits
 
 	using archive_type = typename std::conditional<
 		is_vector,
-		vector<scalar, size>,
-		matrix<scalar, rows, cols, storage_order>
+		vector<scalar, archive_extent(size)>,
+		matrix<
+			scalar, archive_extent(rows), archive_extent(cols),
+			storage_order
+		>
 	>::type;
 };
 
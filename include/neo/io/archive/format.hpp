@@ -13,6 +13,7 @@
 #include <tuple>
 #include <type_traits>
 #include <neo/core/operation_status.hpp>
+#include <neo/io/archive/convert.hpp>
 #include <neo/io/archive/definitions.hpp>
 
 namespace neo {
@@ -20,12 +21,17 @@ namespace archive {
 namespace detail {
 
 /*
-** Helper class that writes a single component of an element.
+** Helper class that writes a single component of an element. Components with
+** narrow scalar types are handled by the specializations for which `Narrow` is
+** true.
 */
-template <class InputType, class OutputType>
+template <
+	class InputType, class OutputType,
+	bool Narrow = is_narrow<typename scalar_type<OutputType>::type>::value
+>
 struct write_component;
 
-template <class Scalar1, class Scalar2>
+template <class Scalar1, class Scalar2, bool Narrow>
 struct write_component
 {
 	static_assert(std::is_arithmetic<Scalar1>::value, "Input type must be scalar.");
@@ -40,7 +46,7 @@ struct write_component
 };
 
 template <class InputType, class Scalar, size_t Size>
-struct write_component<InputType, vector<Scalar, Size>>
+struct write_component<InputType, vector<Scalar, Size>, false>
 {
 	static_assert(InputType::IsVectorAtCompileTime, "Input type must be a vector.");
 
@@ -60,7 +66,7 @@ struct write_component<InputType, vector<Scalar, Size>>
 	{
 		auto q = (Scalar*)p;
 		if (can_use_copy) {
-			std::copy(v.data(), v.data() + Size, q);
+			std::copy(v.data(), v.data() + v.size(), q);
 		}
 		else {
 			for (auto i = index{0}; i != v.rows() * v.cols(); ++i) {
@@ -78,7 +84,7 @@ template <
 	size_t Cols,
 	storage_order Order
 >
-struct write_component<InputType, matrix<Scalar, Rows, Cols, Order>>
+struct write_component<InputType, matrix<Scalar, Rows, Cols, Order>, false>
 {
 	using output_type = matrix<Scalar, Rows, Cols, Order>;
 	using index = typename InputType::Index;
@@ -102,7 +108,7 @@ struct write_component<InputType, matrix<Scalar, Rows, Cols, Order>>
 			(Order == storage_order::column_major && !m.IsRowMajor))
 		)
 		{
-			std::copy(m.data(), m.data() + Rows * Cols, q);
+			std::copy(m.data(), m.data() + m.size(), q);
 		}
 		else if (m.IsRowMajor) {
 			if (Order == storage_order::row_major) {
@@ -147,6 +153,178 @@ struct write_component<InputType, matrix<Scalar, Rows, Cols, Order>>
 	}
 };
 
+/*
+** Components with narrow scalar types are narrowed from coefficients that are
+** contiguous in memory and have the storage order used by the file, so other
+** input is evaluated into a temporary first.
+*/
+
+template <class Scalar1, class Scalar2>
+struct write_component<Scalar1, Scalar2, true>
+{
+	static_assert(std::is_arithmetic<Scalar1>::value, "Input type must be scalar.");
+
+	static CC_ALWAYS_INLINE uint8_t*
+	apply(const Scalar1& s, uint8_t* p)
+	{ return narrow_codec<Scalar2>::narrow(&s, 1, p); }
+};
+
+template <class InputType, class Scalar, size_t Size>
+struct write_component<InputType, vector<Scalar, Size>, true>
+{
+	static_assert(InputType::IsVectorAtCompileTime, "Input type must be a vector.");
+
+	using plain_type = typename InputType::PlainObject;
+	using codec = narrow_codec<Scalar>;
+	static constexpr auto can_use_data = is_plain_object<InputType>::value;
+
+	static CC_ALWAYS_INLINE uint8_t*
+	apply(const InputType& v, uint8_t* p)
+	{
+		if (can_use_data) {
+			return codec::narrow(v.data(), v.size(), p);
+		}
+		auto t = plain_type{v};
+		return codec::narrow(t.data(), t.size(), p);
+	}
+};
+
+template <
+	class InputType,
+	class Scalar,
+	size_t Rows,
+	size_t Cols,
+	storage_order Order
+>
+struct write_component<InputType, matrix<Scalar, Rows, Cols, Order>, true>
+{
+	using plain_type = Eigen::Matrix<
+		typename InputType::Scalar, Eigen::Dynamic, Eigen::Dynamic,
+		eigen_storage_order<Order>::value
+	>;
+	using codec = narrow_codec<Scalar>;
+
+	static constexpr auto can_use_data =
+	is_plain_object<InputType>::value &&
+	(Order == storage_order::row_major) == bool(InputType::IsRowMajor);
+
+	static CC_ALWAYS_INLINE uint8_t*
+	apply(const InputType& m, uint8_t* p)
+	{
+		if (can_use_data) {
+			return codec::narrow(m.data(), m.size(), p);
+		}
+		auto t = plain_type{m};
+		return codec::narrow(t.data(), t.size(), p);
+	}
+};
+
+/*
+** Helper class that measures a single component of an element, and writes its
+** dynamic extents (if any) to the start of the record.
+*/
+template <class InputType, class OutputType>
+struct component_extents;
+
+template <class Scalar1, class Scalar2>
+struct component_extents
+{
+	static CC_ALWAYS_INLINE size_t size(const Scalar1&)
+	{ return element_size<Scalar2>::value; }
+
+	static CC_ALWAYS_INLINE uint8_t*
+	apply(const Scalar1&, uint8_t* p) { return p; }
+};
+
+template <class InputType, class Scalar, size_t Size>
+struct component_extents<InputType, vector<Scalar, Size>>
+{
+	static CC_ALWAYS_INLINE size_t size(const InputType& v)
+	{ return scale_size<Scalar>::value + sizeof(Scalar) * v.size(); }
+
+	static CC_ALWAYS_INLINE uint8_t*
+	apply(const InputType& v, uint8_t* p)
+	{
+		assert(Size == dynamic || (size_t)v.size() == Size);
+		if (Size != dynamic) { return p; }
+		*(uint32_t*)p = v.size();
+		return p + 4;
+	}
+};
+
+template <
+	class InputType,
+	class Scalar,
+	size_t Rows,
+	size_t Cols,
+	storage_order Order
+>
+struct component_extents<InputType, matrix<Scalar, Rows, Cols, Order>>
+{
+	static CC_ALWAYS_INLINE size_t size(const InputType& m)
+	{ return scale_size<Scalar>::value + sizeof(Scalar) * m.size(); }
+
+	static CC_ALWAYS_INLINE uint8_t*
+	apply(const InputType& m, uint8_t* p)
+	{
+		assert(Rows == dynamic || (size_t)m.rows() == Rows);
+		assert(Cols == dynamic || (size_t)m.cols() == Cols);
+		if (Rows == dynamic) {
+			*(uint32_t*)p = m.rows();
+			p += 4;
+		}
+		if (Cols == dynamic) {
+			*(uint32_t*)p = m.cols();
+			p += 4;
+		}
+		return p;
+	}
+};
+
+/*
+** Helper class that measures an entire element, and writes the extents that
+** prefix the record.
+*/
+template <
+	size_t Current,
+	size_t Max,
+	class InputType,
+	class OutputType
+>
+struct element_extents_helper
+{
+	using input_component =
+	typename std::tuple_element<Current, InputType>::type;
+
+	using output_component =
+	typename std::tuple_element<Current, OutputType>::type;
+
+	using helper =
+	component_extents<input_component, output_component>;
+
+	using next =
+	element_extents_helper<Current + 1, Max, InputType, OutputType>;
+
+	static CC_ALWAYS_INLINE size_t size(const InputType& v)
+	{ return helper::size(std::get<Current>(v)) + next::size(v); }
+
+	static CC_ALWAYS_INLINE uint8_t*
+	apply(const InputType& v, uint8_t* p)
+	{
+		auto q = helper::apply(std::get<Current>(v), p);
+		return next::apply(v, q);
+	}
+};
+
+template <size_t Max, class InputType, class OutputType>
+struct element_extents_helper<Max, Max, InputType, OutputType>
+{
+	static CC_ALWAYS_INLINE size_t size(const InputType&) { return 0; }
+
+	static CC_ALWAYS_INLINE uint8_t*
+	apply(const InputType&, uint8_t* p) { return p; }
+};
+
 /*
 ** Helper class that writes an entire element.
 */
@@ -195,6 +373,9 @@ struct write_element;
 template <class T, class OutputType>
 struct write_element
 {
+	static CC_ALWAYS_INLINE size_t size(const T& v)
+	{ return component_extents<T, OutputType>::size(v); }
+
 	static CC_ALWAYS_INLINE void
 	apply(const T& v, uint8_t* p)
 	{
@@ -207,17 +388,30 @@ struct write_element<std::tuple<Ts...>, OutputType>
 {
 	using input_type = std::tuple<Ts...>;
 
+	using extents = element_extents_helper<
+		0, sizeof...(Ts), input_type, OutputType
+	>;
+
+	static CC_ALWAYS_INLINE size_t size(const input_type& v)
+	{ return extents_size<OutputType>::value + extents::size(v); }
+
 	static CC_ALWAYS_INLINE void
 	apply(const input_type& v, uint8_t* p)
 	{
 		write_element_helper<
 			0, sizeof...(Ts), input_type, OutputType
-		>::apply(v, p);
+		>::apply(v, extents::apply(v, p));
 	}
 };
 
 }
 
+/*
+** Writes the element `t` to the buffer. If the element type has dynamic
+** extents and the element does not fit in the buffer, then nothing is written;
+** instead, the required buffer size is raised to the size of the element, and
+** the `req_constr_update` flag is set in the result.
+*/
 template <class T, class SerializedType>
 operation_status
 format(
@@ -226,10 +420,23 @@ format(
 	buffer_state& bs, error_state&
 ) noexcept
 {
+	using helper = detail::write_element<T, SerializedType>;
+
+	if (is_dynamic<SerializedType>::value) {
+		auto size = helper::size(t);
+		if (n < size) {
+			bs.consumed(0);
+			bs.required_constraints().at_least(size);
+			return operation_status::incomplete |
+				operation_status::req_constr_update;
+		}
+		is.element_size(size);
+	}
+
 	(void)n;
 	assert(n >= is.element_size());
 	bs.consumed(is.element_size());
-	detail::write_element<T, SerializedType>::apply(t, buf);
+	helper::apply(t, buf);
 	return operation_status::success;
 }
 
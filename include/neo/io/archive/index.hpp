@@ -0,0 +1,309 @@
+/*
+** File Name: index.hpp
+** Author:    Aditya Ramesh
+** Date:      07/27/2014
+** Contact:   _@adityaramesh.com
+**
+** This file defines the optional index section of an archive, which holds the
+** offset of each record, so that records can be located without reading the
+** records that precede them. The index is written after the last record, and is
+** located using a trailer of fixed size at the end of the file; refer to
+** `notes/archive_format.md` for the layout.
+**
+** The writer records the offset of each record in a `record_index` as it goes,
+** and calls `write_index` once all of the records have been written.
+** `stream_writer` does this when it is constructed with `index` set. The reader
+** calls `read_index` after `read_header`, and then uses `seek` to obtain the
+** extent of a given record, or `read_records` to read a batch of records using
+** as few system calls as possible. If the read method is `mmap`, then the index
+** is used in place, so that opening an archive with billions of records does
+** not require reading the entire index up front.
+*/
+
+#ifndef Z4B7E19A2_6C3D_4F85_9A0E_D23F8C61B574
+#define Z4B7E19A2_6C3D_4F85_9A0E_D23F8C61B574
+
+#include <cassert>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <vector>
+#include <ccbase/format.hpp>
+#include <neo/core/operation_status.hpp>
+#include <neo/core/file/batch.hpp>
+#include <neo/core/file/handle.hpp>
+#include <neo/core/file/io.hpp>
+#include <neo/core/file/strategy.hpp>
+#include <neo/core/file/system.hpp>
+#include <neo/io/archive/bswap.hpp>
+#include <neo/io/archive/checksum.hpp>
+#include <neo/io/archive/definitions.hpp>
+
+namespace neo {
+namespace archive {
+
+static constexpr char index_magic[] = "DSAINDEX";
+static constexpr auto index_magic_size = size_t{8};
+
+// index offset + entry count + magic
+static constexpr auto trailer_size = size_t{8 + 8 + 8};
+
+/*
+** Holds the offsets of the records of an archive. There is one more entry than
+** there are records: the last entry is the offset of the end of the last
+** record, which is also the offset of the index section.
+**
+** An index that is being built, or that was read into memory, owns its
+** entries. An index that refers to a memory mapping of the archive does not;
+** its entries are then in the byte order of the archive, and are converted when
+** they are accessed.
+*/
+class record_index
+{
+	std::vector<offset_type> m_offs{};
+	const uint8_t* m_map{};
+	size_t m_entries{};
+	bool m_flip{};
+public:
+	explicit record_index() noexcept {}
+
+	explicit record_index(const uint8_t* p, size_t entries, bool flip)
+	noexcept : m_map{p}, m_entries{entries}, m_flip{flip} {}
+
+	explicit record_index(std::vector<offset_type> offs) noexcept :
+	m_offs(std::move(offs)), m_entries{m_offs.size()} {}
+
+	/*
+	** Appends the offset of the next record. After the last record, the
+	** offset of the end of the data should also be appended.
+	*/
+	record_index& push_back(offset_type off)
+	{
+		assert(m_map == nullptr && "Mapped indices are read-only.");
+		assert((m_offs.empty() || off >= m_offs.back()) &&
+			"Offsets must be nondecreasing.");
+		m_offs.push_back(off);
+		m_entries = m_offs.size();
+		return *this;
+	}
+
+	bool mapped() const noexcept { return m_map != nullptr; }
+	size_t entry_count() const noexcept { return m_entries; }
+
+	size_t record_count() const noexcept
+	{ return m_entries == 0 ? 0 : m_entries - 1; }
+
+	offset_type offset(size_t i) const noexcept
+	{
+		assert(i < m_entries);
+		if (m_map == nullptr) { return m_offs[i]; }
+
+		auto off = uint64_t{};
+		std::memcpy(&off, m_map + 8 * i, 8);
+		return m_flip ? cc::bswap(off) : off;
+	}
+
+	/*
+	** Returns the owned entries. Only valid if the index is not mapped.
+	*/
+	const std::vector<offset_type>& entries() const noexcept
+	{
+		assert(m_map == nullptr);
+		return m_offs;
+	}
+};
+
+/*
+** Returns the size of the index section, including the trailer.
+*/
+size_t index_size(const record_index& idx) noexcept
+{ return 8 * idx.entry_count() + trailer_size; }
+
+/*
+** Writes the index section, followed by the trailer, to the buffer. The index
+** section must be written at `idx.offset(idx.record_count())`, immediately
+** after the last record.
+*/
+template <class SerializedType>
+operation_status
+write_index(
+	uint8_t* buf, size_t n,
+	const record_index& idx,
+	io_state<SerializedType>&,
+	buffer_state& bs, error_state& es
+) noexcept
+{
+	(void)n;
+	assert(n >= index_size(idx));
+	assert(!idx.mapped());
+
+	if (idx.entry_count() == 0) {
+		es.push_record(
+			severity::critical,
+			context{offset_type{0}, uint8_t{0}},
+			"The index must contain the offset of the end of the data."
+		);
+		return operation_status::failure |
+			operation_status::fatal_error;
+	}
+
+	auto& offs = idx.entries();
+	auto p = buf;
+	for (auto off : offs) {
+		auto x = uint64_t{off};
+		std::memcpy(p, &x, 8);
+		p += 8;
+	}
+
+	auto pos = uint64_t{offs.back()};
+	auto count = uint64_t{offs.size()};
+	std::memcpy(p, &pos, 8);
+	std::memcpy(p + 8, &count, 8);
+	std::memcpy(p + 16, index_magic, index_magic_size);
+
+	bs.consumed(index_size(idx));
+	return operation_status::success;
+}
+
+/*
+** Reads the index of the archive, which must have been opened using `h`. The
+** byte order of the archive is taken from `is`, so `read_header` must be
+** called first. If the read method of `s` is `mmap` and the archive is mapped,
+** then the index refers to the mapping, which must outlive it.
+*/
+template <class SerializedType, io_mode IOMode>
+cc::expected<record_index>
+read_index(
+	const file::handle<IOMode>& h,
+	const file::strategy<IOMode>& s,
+	const io_state<SerializedType>& is
+) noexcept
+{
+	// The index precedes the checksum section, if there is one.
+	auto e = detail::unchecked_size(h, s, is);
+	if (!e) { return e.exception(); }
+	auto fs = *e;
+
+	if (fs < is.header_size() + trailer_size) {
+		return std::runtime_error{cc::format(
+			"Archive of size $ is too small to contain an index.",
+			fs)};
+	}
+
+	uint8_t t[trailer_size];
+	auto r = file::read(h, (off_t)(fs - trailer_size), trailer_size, t, s);
+	if (!r) { return r.exception(); }
+
+	if (std::memcmp(t + 16, index_magic, index_magic_size) != 0) {
+		return std::runtime_error{"Archive does not have an index."};
+	}
+
+	auto pos = uint64_t{};
+	auto count = uint64_t{};
+	std::memcpy(&pos, t, 8);
+	std::memcpy(&count, t + 8, 8);
+	if (is.flip_integers()) {
+		pos = cc::bswap(pos);
+		count = cc::bswap(count);
+	}
+
+	// The count is checked against the space before the trailer first, so
+	// that a corrupt count cannot overflow the size computation below.
+	if (
+		count == 0 || pos < is.header_size() ||
+		pos > fs - trailer_size ||
+		count > (fs - trailer_size - pos) / 8 ||
+		pos + 8 * count + trailer_size != fs
+	) {
+		return std::runtime_error{cc::format(
+			"Malformed index trailer: offset $, $ entries, file "
+			"size $.", pos, count, fs)};
+	}
+
+	if (!!(*s.read_method() & io_method::mmap) && h.mapped()) {
+		return record_index{h.map() + pos, (size_t)count,
+			is.flip_integers()};
+	}
+
+	auto offs = std::vector<offset_type>{};
+	try {
+		offs.resize(count);
+	}
+	catch (const std::bad_alloc&) {
+		return std::runtime_error{cc::format(
+			"Failed to allocate an index of $ entries.", count)};
+	}
+	static_assert(sizeof(offset_type) == 8, "");
+	r = file::read(h, (off_t)pos, 8 * count, (uint8_t*)offs.data(), s);
+	if (!r) { return r.exception(); }
+	if (is.flip_integers()) {
+		bswap_n(offs.data(), offs.size());
+	}
+	return record_index{std::move(offs)};
+}
+
+/*
+** Returns the extent of the record with the given index.
+*/
+file::extent seek(const record_index& idx, offset_type id) noexcept
+{
+	assert(id < idx.record_count());
+	auto off = idx.offset(id);
+	return file::extent{(off_t)off, (size_t)(idx.offset(id + 1) - off)};
+}
+
+/*
+** As above, but for archives whose elements have fixed size, which do not need
+** an index.
+*/
+template <class SerializedType>
+file::extent seek(const io_state<SerializedType>& is, offset_type id) noexcept
+{
+	static_assert(!is_dynamic<SerializedType>::value,
+		"Archives with dynamic extents require an index.");
+	assert(id < is.element_count());
+	return file::extent{
+		(off_t)(is.header_size() + id * is.element_size()),
+		is.element_size()
+	};
+}
+
+/*
+** Reads the records with the given indices into consecutive regions of the
+** buffer, in the order in which the indices are listed, and returns the total
+** number of bytes read. Records that are close together in the file are
+** coalesced into a single read, as described in `file/batch.hpp`.
+*/
+template <
+	io_mode IOMode,
+	typename std::enable_if<!!(IOMode & io_mode::input), int>::type = 0
+>
+cc::expected<size_t>
+read_records(
+	const file::handle<IOMode>& h,
+	const record_index& idx,
+	const offset_type* ids,
+	size_t n,
+	file::buffer<IOMode>& b,
+	const file::strategy<IOMode>& s,
+	size_t max_gap = 64 * 1024
+) noexcept
+{
+	static thread_local std::vector<file::extent> e;
+	e.resize(n);
+
+	auto total = size_t{0};
+	for (auto i = size_t{0}; i != n; ++i) {
+		e[i] = seek(idx, ids[i]);
+		total += e[i].size;
+	}
+	assert(total <= b.size());
+
+	auto r = file::read_batch(h, e.data(), n, b, s, max_gap);
+	if (!r) { return r.exception(); }
+	return total;
+}
+
+}}
+
+#endif
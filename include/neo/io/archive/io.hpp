@@ -12,5 +12,15 @@
 #include <neo/io/archive/scan.hpp>
 #include <neo/io/archive/write_header.hpp>
 #include <neo/io/archive/format.hpp>
+#include <neo/io/archive/convert.hpp>
+#include <neo/io/archive/index.hpp>
+#include <neo/io/archive/checksum.hpp>
+#include <neo/io/archive/block.hpp>
+#include <neo/io/archive/parallel_writer.hpp>
+#include <neo/io/archive/stream_writer.hpp>
+#include <neo/io/archive/mapped_view.hpp>
+#include <neo/io/archive/shuffled_reader.hpp>
+#include <neo/io/archive/columnar.hpp>
+#include <neo/io/archive/dynamic_io.hpp>
 
 #endif
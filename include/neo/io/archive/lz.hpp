@@ -0,0 +1,343 @@
+/*
+** File Name: lz.hpp
+** Author:    Aditya Ramesh
+** Date:      07/27/2014
+** Contact:   _@adityaramesh.com
+**
+** This file defines the codec used to compress the blocks of an archive. Each
+** block is first shuffled by scalar width, so that byte `j` of every scalar is
+** stored contiguously; for floating-point data, this groups the sign and
+** exponent bytes, which are highly repetitive. The result is then compressed
+** using a byte-oriented LZ77 codec in the style of LZ4, which favors decoding
+** speed over compression ratio.
+**
+** A compressed stream consists of sequences, each of which is made up of:
+**
+**   - A token byte, whose high and low nibbles hold the literal length and the
+**   match length minus four. A nibble value of 15 means that the length
+**   continues in the following bytes, each of which adds up to 255 to it; the
+**   first byte less than 255 ends the length.
+**   - The literals.
+**   - The offset of the match, as a 16-bit little-endian integer.
+**   - The remainder of the match length, if any.
+**
+** The last sequence consists of only a token and literals. The last
+** `lz_last_literals` bytes of the input are always encoded as literals, so
+** that no match extends to the end of the output. This lets the decoder copy
+** most matches eight bytes at a time.
+*/
+
+#ifndef Z8D41C7E3_A25F_4E96_B07D_3F1E6A94C285
+#define Z8D41C7E3_A25F_4E96_B07D_3F1E6A94C285
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <ccbase/platform.hpp>
+
+namespace neo {
+namespace archive {
+
+/*
+** Reorders the `n` bytes at `src`, which consist of scalars of `width` bytes
+** each, so that byte `j` of scalar `i` is stored at `dst[j * (n / width) +
+** i]`. Any trailing bytes that do not form a whole scalar are copied as they
+** are.
+*/
+void shuffle(const uint8_t* src, size_t n, size_t width, uint8_t* dst)
+{
+	if (width <= 1) {
+		std::copy_n(src, n, dst);
+		return;
+	}
+
+	auto count = n / width;
+	for (auto j = size_t{0}; j != width; ++j) {
+		auto q = dst + j * count;
+		for (auto i = size_t{0}; i != count; ++i) {
+			q[i] = src[i * width + j];
+		}
+	}
+	std::copy(src + count * width, src + n, dst + count * width);
+}
+
+/*
+** Reverses the effect of `shuffle`.
+*/
+void unshuffle(const uint8_t* src, size_t n, size_t width, uint8_t* dst)
+{
+	if (width <= 1) {
+		std::copy_n(src, n, dst);
+		return;
+	}
+
+	auto count = n / width;
+	for (auto j = size_t{0}; j != width; ++j) {
+		auto p = src + j * count;
+		for (auto i = size_t{0}; i != count; ++i) {
+			dst[i * width + j] = p[i];
+		}
+	}
+	std::copy(src + count * width, src + n, dst + count * width);
+}
+
+static constexpr auto lz_min_match = size_t{4};
+static constexpr auto lz_last_literals = size_t{8};
+static constexpr auto lz_max_offset = size_t{65535};
+
+namespace detail {
+
+static constexpr auto lz_hash_bits = 12;
+
+CC_ALWAYS_INLINE uint32_t lz_read32(const uint8_t* p)
+{
+	uint32_t x;
+	std::memcpy(&x, p, 4);
+	return x;
+}
+
+CC_ALWAYS_INLINE uint64_t lz_read64(const uint8_t* p)
+{
+	uint64_t x;
+	std::memcpy(&x, p, 8);
+	return x;
+}
+
+CC_ALWAYS_INLINE uint32_t lz_hash(uint32_t x)
+{ return (x * 2654435761u) >> (32 - lz_hash_bits); }
+
+/*
+** Writes the remainder of a length whose nibble is 15. Returns nullptr if the
+** output would overflow.
+*/
+CC_ALWAYS_INLINE uint8_t*
+lz_write_length(uint8_t* op, const uint8_t* oend, size_t n)
+{
+	for (; n >= 255; n -= 255) {
+		if (op == oend) { return nullptr; }
+		*op++ = 255;
+	}
+	if (op == oend) { return nullptr; }
+	*op++ = (uint8_t)n;
+	return op;
+}
+
+/*
+** Reads the remainder of a length whose nibble is 15. Returns false if the
+** input ends first.
+*/
+CC_ALWAYS_INLINE bool
+lz_read_length(const uint8_t*& ip, const uint8_t* iend, size_t& n)
+{
+	for (;;) {
+		if (ip == iend) { return false; }
+		auto b = *ip++;
+		n += b;
+		if (b != 255) { return true; }
+	}
+}
+
+/*
+** Writes a sequence consisting of `lits` literals starting at `anchor`,
+** followed by a match of length `len` at distance `off`, or no match if `len`
+** is zero. Returns nullptr if the output would overflow.
+*/
+CC_ALWAYS_INLINE uint8_t*
+lz_write_sequence(
+	uint8_t* op, const uint8_t* oend,
+	const uint8_t* anchor, size_t lits,
+	size_t off, size_t len
+)
+{
+	if (op == oend) { return nullptr; }
+	auto token = op++;
+	auto ml = len == 0 ? size_t{0} : len - lz_min_match;
+
+	*token = (uint8_t)((std::min(lits, size_t{15}) << 4) |
+		std::min(ml, size_t{15}));
+
+	if (lits >= 15) {
+		op = lz_write_length(op, oend, lits - 15);
+		if (op == nullptr) { return nullptr; }
+	}
+	if ((size_t)(oend - op) < lits) { return nullptr; }
+	std::copy_n(anchor, lits, op);
+	op += lits;
+
+	if (len == 0) { return op; }
+	if (oend - op < 2) { return nullptr; }
+	*op++ = (uint8_t)(off & 0xFF);
+	*op++ = (uint8_t)(off >> 8);
+
+	if (ml >= 15) {
+		op = lz_write_length(op, oend, ml - 15);
+	}
+	return op;
+}
+
+}
+
+/*
+** Compresses the `n` bytes at `src` into the `cap` bytes at `dst`. Returns the
+** size of the compressed stream, or zero if it would not fit in `cap` bytes.
+*/
+size_t lz_compress(const uint8_t* src, size_t n, uint8_t* dst, size_t cap)
+{
+	using namespace detail;
+
+	uint32_t table[1 << lz_hash_bits] = {};
+	auto ip = src;
+	auto anchor = src;
+	auto iend = src + n;
+	auto op = dst;
+	auto oend = dst + cap;
+
+	if (n > lz_last_literals + lz_min_match) {
+		// Matches must end before the last literals.
+		auto mlimit = iend - lz_last_literals;
+		auto ilimit = mlimit - lz_min_match;
+		auto misses = size_t{0};
+
+		while (ip <= ilimit) {
+			auto seq = lz_read32(ip);
+			auto h = lz_hash(seq);
+			auto ref = src + table[h];
+			table[h] = (uint32_t)(ip - src);
+
+			if (
+				ref >= ip || (size_t)(ip - ref) > lz_max_offset ||
+				lz_read32(ref) != seq
+			) {
+				// Skip faster through incompressible data.
+				ip += 1 + (misses++ >> 6);
+				continue;
+			}
+			misses = 0;
+
+			// Extend the match backwards over the pending literals.
+			while (ip > anchor && ref > src && ip[-1] == ref[-1]) {
+				--ip;
+				--ref;
+			}
+
+			auto len = lz_min_match;
+			while (ip + len + 8 <= mlimit) {
+				auto x = lz_read64(ip + len) ^ lz_read64(ref + len);
+				if (x != 0) {
+					len += __builtin_ctzll(x) / 8;
+					goto found;
+				}
+				len += 8;
+			}
+			while (ip + len < mlimit && ip[len] == ref[len]) {
+				++len;
+			}
+		found:
+			op = lz_write_sequence(op, oend, anchor, ip - anchor,
+				ip - ref, len);
+			if (op == nullptr) { return 0; }
+
+			ip += len;
+			anchor = ip;
+		}
+	}
+
+	op = lz_write_sequence(op, oend, anchor, iend - anchor, 0, 0);
+	return op == nullptr ? 0 : op - dst;
+}
+
+/*
+** Decompresses the `n` bytes at `src` into the `cap` bytes at `dst`. Returns
+** the size of the decompressed data, or `(size_t)-1` if the stream is
+** malformed or would overflow the output.
+*/
+size_t lz_decompress(const uint8_t* src, size_t n, uint8_t* dst, size_t cap)
+{
+	using namespace detail;
+	static constexpr auto error = ~size_t{0};
+
+	auto ip = src;
+	auto iend = src + n;
+	auto op = dst;
+	auto oend = dst + cap;
+
+	while (ip != iend) {
+		auto token = *ip++;
+
+		auto lits = static_cast<size_t>(token >> 4);
+		if (lits == 15 && !lz_read_length(ip, iend, lits)) {
+			return error;
+		}
+		if (
+			(size_t)(iend - ip) < lits ||
+			(size_t)(oend - op) < lits
+		) { return error; }
+
+		// Short literal runs are copied sixteen bytes at a time.
+		if (lits <= 16 && iend - ip >= 16 && oend - op >= 16) {
+			std::memcpy(op, ip, 16);
+		}
+		else {
+			std::copy_n(ip, lits, op);
+		}
+		ip += lits;
+		op += lits;
+		if (ip == iend) { break; }
+
+		if (iend - ip < 2) { return error; }
+		auto off = size_t{ip[0]} | (size_t{ip[1]} << 8);
+		ip += 2;
+		if (off == 0 || off > (size_t)(op - dst)) { return error; }
+
+		auto len = size_t{token & 15u};
+		if (len == 15 && !lz_read_length(ip, iend, len)) {
+			return error;
+		}
+		len += lz_min_match;
+		if ((size_t)(oend - op) < len) { return error; }
+
+		auto ref = op - off;
+		if ((size_t)(oend - op) < len + 8) {
+			for (auto i = size_t{0}; i != len; ++i) {
+				op[i] = ref[i];
+			}
+			op += len;
+			continue;
+		}
+
+		/*
+		** Copy eight bytes at a time. The last chunk may write past the
+		** end of the match, but not past the end of the output. If the
+		** match overlaps itself by less than eight bytes, then the first
+		** eight bytes are copied one at a time. The match repeats with
+		** period `off`, so the rest can then be copied from `step`
+		** bytes back, where `step` is the smallest multiple of `off`
+		** that is at least eight.
+		*/
+		auto step = off;
+		auto i = size_t{0};
+		if (off < 8) {
+			for (; i != 8; ++i) {
+				op[i] = ref[i];
+			}
+			step = off * ((8 + off - 1) / off);
+		}
+		for (; i < len; i += 8) {
+			std::memcpy(op + i, op + i - step, 8);
+		}
+		op += len;
+	}
+	return op - dst;
+}
+
+/*
+** Returns the largest possible size of the compressed stream for an input of
+** `n` bytes.
+*/
+constexpr size_t lz_bound(size_t n)
+{ return n + n / 255 + 16; }
+
+}}
+
+#endif
@@ -0,0 +1,307 @@
+/*
+** File Name: mapped_view.hpp
+** Author:    Aditya Ramesh
+** Date:      07/27/2014
+** Contact:   _@adityaramesh.com
+**
+** The `mapped_view` class provides random access to the records of an archive
+** by mapping the entire file into memory. The header is verified once when the
+** view is opened; after that, each record is exposed as a tuple of read-only
+** `Eigen::Map`s that point directly into the mapping, so accessing a record
+** neither copies its data nor modifies any state. Since all of the member
+** functions are `const`, a view can be shared by any number of threads.
+**
+** The records must be usable in place: the archive must not be compressed or
+** columnar, its byte order must match that of the platform (unless all of its
+** scalars are single bytes), and each matrix must be stored in the order
+** requested by the element type. Archives that do not satisfy these conditions
+** must be read using `scan` instead. Only element types of fixed size whose
+** scalar types are not narrow (refer to `convert.hpp`) are supported.
+*/
+
+#ifndef Z7E0A3D51_C84B_4F29_A6D2_1B95E7F34C08
+#define Z7E0A3D51_C84B_4F29_A6D2_1B95E7F34C08
+
+#include <cassert>
+#include <cstring>
+#include <iterator>
+#include <stdexcept>
+#include <tuple>
+#include <ccbase/format.hpp>
+#include <neo/core/operation_status.hpp>
+#include <neo/core/file/handle.hpp>
+#include <neo/core/file/strategy.hpp>
+#include <neo/io/archive/definitions.hpp>
+#include <neo/io/archive/read_header.hpp>
+#include <neo/io/archive/scan.hpp>
+
+namespace neo {
+namespace archive {
+namespace detail {
+
+/*
+** Constructs the view of a component whose data begin at `p`.
+*/
+template <class Scalar>
+struct view_component
+{
+	using type = Scalar;
+
+	static CC_ALWAYS_INLINE type apply(const uint8_t* p)
+	{
+		Scalar s;
+		std::memcpy(&s, p, sizeof(Scalar));
+		return s;
+	}
+};
+
+template <class Scalar, size_t Size>
+struct view_component<vector<Scalar, Size>>
+{
+	using type = const_mapped_eigen_type<vector<Scalar, Size>>;
+
+	static CC_ALWAYS_INLINE type apply(const uint8_t* p)
+	{ return type{(const Scalar*)p}; }
+};
+
+template <class Scalar, size_t Rows, size_t Cols, storage_order Order>
+struct view_component<matrix<Scalar, Rows, Cols, Order>>
+{
+	using type = const_mapped_eigen_type<matrix<Scalar, Rows, Cols, Order>>;
+
+	static CC_ALWAYS_INLINE type apply(const uint8_t* p)
+	{ return type{(const Scalar*)p}; }
+};
+
+/*
+** Constructs the views of the components of a tuple, the first of which begins
+** `Offset` bytes after `p`.
+*/
+template <size_t Offset, class... Ts>
+struct view_tuple;
+
+template <size_t Offset>
+struct view_tuple<Offset>
+{
+	static CC_ALWAYS_INLINE std::tuple<> apply(const uint8_t*)
+	{ return std::tuple<>{}; }
+};
+
+template <size_t Offset, class T, class... Ts>
+struct view_tuple<Offset, T, Ts...>
+{
+	using type = std::tuple<
+		typename view_component<T>::type,
+		typename view_component<Ts>::type...
+	>;
+	using next = view_tuple<Offset + element_size<T>::value, Ts...>;
+
+	static CC_ALWAYS_INLINE type apply(const uint8_t* p)
+	{
+		return std::tuple_cat(
+			std::make_tuple(view_component<T>::apply(p + Offset)),
+			next::apply(p)
+		);
+	}
+};
+
+template <class SerializedType>
+struct view_element : view_component<SerializedType> {};
+
+template <class... Ts>
+struct view_element<std::tuple<Ts...>> : view_tuple<0, Ts...> {};
+
+}
+
+template <class SerializedType>
+class mapped_view
+{
+	static_assert(!is_dynamic<SerializedType>::value,
+		"Mapped views require elements of fixed size.");
+	static_assert(!has_narrow<SerializedType>::value,
+		"Narrow scalar types must be widened using `scan`.");
+
+	using helper = detail::view_element<SerializedType>;
+	static constexpr auto elem_size = element_size<SerializedType>::value;
+public:
+	using value_type = const_mapped_eigen_type<SerializedType>;
+	using size_type = offset_type;
+
+	class iterator
+	{
+		const uint8_t* m_pos{};
+	public:
+		using iterator_category = std::random_access_iterator_tag;
+		using value_type        = mapped_view::value_type;
+		using difference_type   = std::ptrdiff_t;
+		using pointer           = void;
+		// The views are constructed on demand, and returned by value.
+		using reference         = value_type;
+
+		explicit iterator() noexcept {}
+		explicit iterator(const uint8_t* p) noexcept : m_pos{p} {}
+
+		value_type operator*() const { return helper::apply(m_pos); }
+
+		value_type operator[](difference_type n) const
+		{ return helper::apply(m_pos + n * (difference_type)elem_size); }
+
+		iterator& operator++() noexcept { m_pos += elem_size; return *this; }
+		iterator& operator--() noexcept { m_pos -= elem_size; return *this; }
+
+		iterator operator++(int) noexcept
+		{ auto t = *this; ++*this; return t; }
+
+		iterator operator--(int) noexcept
+		{ auto t = *this; --*this; return t; }
+
+		iterator& operator+=(difference_type n) noexcept
+		{
+			m_pos += n * (difference_type)elem_size;
+			return *this;
+		}
+
+		iterator& operator-=(difference_type n) noexcept
+		{ return *this += -n; }
+
+		iterator operator+(difference_type n) const noexcept
+		{ return iterator{*this} += n; }
+
+		iterator operator-(difference_type n) const noexcept
+		{ return iterator{*this} -= n; }
+
+		difference_type operator-(const iterator& rhs) const noexcept
+		{ return (m_pos - rhs.m_pos) / (difference_type)elem_size; }
+
+		bool operator==(const iterator& rhs) const noexcept
+		{ return m_pos == rhs.m_pos; }
+
+		bool operator!=(const iterator& rhs) const noexcept
+		{ return m_pos != rhs.m_pos; }
+
+		bool operator<(const iterator& rhs) const noexcept
+		{ return m_pos < rhs.m_pos; }
+
+		bool operator>(const iterator& rhs) const noexcept
+		{ return m_pos > rhs.m_pos; }
+
+		bool operator<=(const iterator& rhs) const noexcept
+		{ return m_pos <= rhs.m_pos; }
+
+		bool operator>=(const iterator& rhs) const noexcept
+		{ return m_pos >= rhs.m_pos; }
+	};
+
+	using const_iterator = iterator;
+private:
+	file::handle<io_mode::input> m_handle{};
+	const uint8_t* m_data{};
+	size_type m_count{};
+public:
+	explicit mapped_view() noexcept {}
+
+	explicit mapped_view(
+		file::handle<io_mode::input>&& h,
+		size_t hdr_size,
+		size_type count
+	) noexcept : m_handle(std::move(h)),
+	m_data{m_handle.map() + hdr_size}, m_count{count} {}
+
+	size_type size() const noexcept { return m_count; }
+	bool empty() const noexcept { return m_count == 0; }
+	size_t element_size() const noexcept { return elem_size; }
+
+	/*
+	** Returns a pointer to the serialized data of the first record.
+	*/
+	const uint8_t* data() const noexcept { return m_data; }
+
+	value_type operator[](size_type i) const
+	{
+		assert(i < m_count);
+		return helper::apply(m_data + i * elem_size);
+	}
+
+	iterator begin() const noexcept { return iterator{m_data}; }
+	iterator end() const noexcept
+	{ return iterator{m_data + m_count * elem_size}; }
+
+	iterator cbegin() const noexcept { return begin(); }
+	iterator cend() const noexcept { return end(); }
+};
+
+/*
+** Maps the archive at the given path, and verifies that its records can be used
+** in place.
+*/
+template <class SerializedType>
+cc::expected<mapped_view<SerializedType>>
+open_mapped_view(const char* path) noexcept
+{
+	using namespace file;
+	using info = detail::scalar_info<SerializedType>;
+
+	auto s = strategy<io_mode::input>{path};
+	s.infer_defaults(access_mode::random).read_method(io_method::mmap);
+
+	auto r = open<open_mode::read>(path, s);
+	if (!r) { return r.exception(); }
+	auto h = r.move();
+	if (!h.mapped()) {
+		return std::runtime_error{cc::format(
+			"Failed to map archive \"$\".", path)};
+	}
+
+	auto is = io_state<SerializedType>{};
+	auto bs = make_buffer_state<SerializedType>();
+	auto es = error_state{};
+	auto fs = (size_t)*s.current_file_size();
+
+	if (fs < is.header_size()) {
+		return std::runtime_error{cc::format(
+			"Archive \"$\" is too small to contain a header.", path)};
+	}
+
+	auto st = read_header(h.map(), fs, is, bs, es);
+	if (!(st & operation_status::success)) {
+		return std::runtime_error{cc::format(
+			"Invalid archive header in \"$\": $", path,
+			es.record(es.record_count() - 1).message())};
+	}
+
+	if (is.compressed()) {
+		return std::runtime_error{cc::format(
+			"Archive \"$\" is block-compressed.", path)};
+	}
+	if (is.columnar()) {
+		return std::runtime_error{cc::format(
+			"Archive \"$\" is columnar.", path)};
+	}
+	if (
+		(info::has_int && is.flip_integers() && info::uniform_size != 1) ||
+		(info::has_float && is.flip_floats())
+	) {
+		return std::runtime_error{cc::format(
+			"Archive \"$\" has foreign byte order.", path)};
+	}
+	for (auto i = size_t{0}; i != count_matrices<SerializedType>::value; ++i) {
+		if (is.transpose_matrix(i)) {
+			return std::runtime_error{cc::format(
+				"Matrix $ of archive \"$\" has the wrong storage "
+				"order.", i, path)};
+		}
+	}
+
+	auto count = is.element_count();
+	if (fs < is.header_size() + count * is.element_size()) {
+		return std::runtime_error{cc::format(
+			"Archive \"$\" of size $ is too small to contain $ "
+			"records.", path, fs, count)};
+	}
+	return mapped_view<SerializedType>{std::move(h), is.header_size(),
+		count};
+}
+
+}}
+
+#endif
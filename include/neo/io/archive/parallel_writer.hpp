@@ -0,0 +1,273 @@
+/*
+** File Name: parallel_writer.hpp
+** Author:    Aditya Ramesh
+** Date:      07/27/2014
+** Contact:   _@adityaramesh.com
+**
+** The `parallel_writer` class allows many threads to write records of fixed
+** size to the same archive. Each producer thread obtains a `reservation`,
+** which is a block of consecutive record slots, formats its records into the
+** slots, and then flushes the reservation, after which the reservation can be
+** reused for the next block. The record count in the header is patched when
+** the writer is finalized.
+**
+** Reservations obtained using `reserve()` are handed out in the order in which
+** they are requested, so the position of each record in the archive depends on
+** how the threads are scheduled. For deterministic output, reserve explicit
+** ranges of indices using `reserve(first, n)` instead.
+**
+** If the write method is `mmap`, then records are formatted directly into the
+** mapping, and flushing does not copy anything. Otherwise, each reservation
+** formats its records into a private staging buffer, which is flushed using a
+** single positional write. Positional writes to disjoint ranges may proceed in
+** parallel, except in two cases, in which flushes are serialized:
+**
+**   - Under direct IO, unaligned writes are implemented as read-modify-write
+**   cycles on the edge blocks (see `file/io.hpp`), so flushes of neighboring
+**   reservations could overwrite each other's records.
+**   - If the write method is `uring`, then each write is submitted through
+**   the ring of the handle, which is shared by all of the threads.
+*/
+
+#ifndef Z5C19E8B4_07D3_4A62_B8F1_92A6E4C3D05B
+#define Z5C19E8B4_07D3_4A62_B8F1_92A6E4C3D05B
+
+#include <atomic>
+#include <cassert>
+#include <mutex>
+#include <boost/optional.hpp>
+#include <neo/core/operation_status.hpp>
+#include <neo/core/file/buffer.hpp>
+#include <neo/core/file/handle.hpp>
+#include <neo/core/file/io.hpp>
+#include <neo/core/file/strategy.hpp>
+#include <neo/core/file/system.hpp>
+#include <neo/io/archive/definitions.hpp>
+#include <neo/io/archive/format.hpp>
+#include <neo/io/archive/write_header.hpp>
+
+namespace neo {
+namespace archive {
+
+template <class SerializedType, io_mode IOMode>
+class parallel_writer
+{
+	static_assert(!!(IOMode & io_mode::output), "Output IO mode required.");
+	static_assert(!is_dynamic<SerializedType>::value,
+		"Parallel writing requires elements of fixed size.");
+
+	static constexpr auto hdr_size = header_size<SerializedType>::value;
+	static constexpr auto elem_size = element_size<SerializedType>::value;
+
+	const file::handle<IOMode>& m_handle;
+	const file::strategy<IOMode>& m_strat;
+	size_t m_block;
+	bool m_mapped;
+	// Must flushes be serialized? Refer to the comment at the top.
+	bool m_serial;
+
+	std::atomic<offset_type> m_next{0};
+	// One past the largest index of a record that has been flushed.
+	std::atomic<offset_type> m_end{0};
+	std::mutex m_mutex{};
+public:
+	class reservation
+	{
+		friend class parallel_writer;
+
+		parallel_writer* m_writer{};
+		offset_type m_first{};
+		size_t m_size{};
+		size_t m_filled{};
+		boost::optional<file::buffer<IOMode>> m_buf{};
+
+		io_state<SerializedType> m_is{};
+		buffer_state m_bs{make_buffer_state<SerializedType>()};
+		error_state m_es{};
+	public:
+		explicit reservation() noexcept {}
+
+		offset_type first() const noexcept { return m_first; }
+		size_t size() const noexcept { return m_size; }
+		error_state& errors() noexcept { return m_es; }
+
+		/*
+		** Returns a pointer to the slot for the record with index
+		** `first() + k`.
+		*/
+		uint8_t* slot(size_t k) noexcept
+		{
+			assert(k < m_size);
+			if (m_writer->m_mapped) {
+				return m_writer->m_handle.map() + hdr_size +
+					(m_first + k) * elem_size;
+			}
+			return m_buf->data() + k * elem_size;
+		}
+
+		/*
+		** Formats `t` into the slot for the record with index `i`.
+		** Every slot before the last one that is used must be filled
+		** before the reservation is flushed.
+		*/
+		template <class T>
+		operation_status format(offset_type i, const T& t) noexcept
+		{
+			assert(i >= m_first && i < m_first + m_size);
+			auto k = (size_t)(i - m_first);
+			m_filled = std::max(m_filled, k + 1);
+			return archive::format(t, slot(k), elem_size, m_is,
+				m_bs, m_es);
+		}
+
+		/*
+		** Formats `t` into the slot after the last one that was used.
+		*/
+		template <class T>
+		operation_status push_back(const T& t) noexcept
+		{ return format(m_first + m_filled, t); }
+
+		bool full() const noexcept { return m_filled == m_size; }
+
+		/*
+		** Writes the filled slots to the archive. The reservation
+		** must then be reused (or discarded) by calling `reserve`.
+		*/
+		cc::expected<void> flush() noexcept
+		{
+			assert(m_writer != nullptr);
+			if (m_filled == 0) { return true; }
+			auto r = m_writer->flush(*this);
+			if (!r) { return r; }
+
+			m_writer->extend(m_first + m_filled);
+			m_filled = 0;
+			m_size = 0;
+			return true;
+		}
+	};
+
+	/*
+	** Creates a writer that hands out blocks of `block` records. The
+	** handle and strategy must outlive the writer. If the write method is
+	** `mmap`, then the file must have been preallocated to the maximum file
+	** size, since the records are stored to the mapping directly.
+	*/
+	explicit parallel_writer(
+		const file::handle<IOMode>& h,
+		const file::strategy<IOMode>& s,
+		size_t block = 4096
+	) noexcept : m_handle{h}, m_strat{s}, m_block{block}
+	{
+		assert(s.write_method());
+		assert(block > 0);
+		m_mapped = !!(*s.write_method() & io_method::mmap);
+		m_serial = !m_mapped && (
+			!!(*s.write_method() & io_method::uring) ||
+			file::detail::needs_direct_alignment(s.write_method()));
+	}
+
+	parallel_writer(const parallel_writer&) = delete;
+	parallel_writer& operator=(const parallel_writer&) = delete;
+
+	bool mapped() const noexcept { return m_mapped; }
+	size_t block_size() const noexcept { return m_block; }
+
+	/*
+	** Returns the number of records in the archive so far, which is one
+	** more than the largest index of a record that has been flushed.
+	*/
+	offset_type record_count() const noexcept
+	{ return m_end.load(std::memory_order_acquire); }
+
+	/*
+	** Reserves the next block of records. This is safe to call from any
+	** thread.
+	*/
+	reservation reserve()
+	{
+		auto r = reservation{};
+		reserve(r);
+		return r;
+	}
+
+	reservation reserve(offset_type first, size_t n)
+	{
+		auto r = reservation{};
+		reserve(r, first, n);
+		return r;
+	}
+
+	/*
+	** As above, but reuses the staging buffer of an existing reservation,
+	** which must have been flushed.
+	*/
+	void reserve(reservation& r)
+	{
+		auto first = m_next.fetch_add(m_block, std::memory_order_relaxed);
+		reserve(r, first, m_block);
+	}
+
+	void reserve(reservation& r, offset_type first, size_t n)
+	{
+		assert(r.m_filled == 0 && "Reservation has not been flushed.");
+		assert(n > 0);
+
+		if (m_mapped) {
+			assert(hdr_size + (first + n) * elem_size <=
+				m_handle.map_size() && "Mapping is too small.");
+		}
+		else if (!r.m_buf || r.m_buf->size() < n * elem_size) {
+			r.m_buf.emplace(buffer_constraints{n * elem_size});
+		}
+
+		r.m_writer = this;
+		r.m_first = first;
+		r.m_size = n;
+	}
+
+	/*
+	** Writes the header with the final record count, and truncates the
+	** file to the end of the last record. This must only be called once
+	** every reservation has been flushed.
+	*/
+	cc::expected<void> finalize() noexcept
+	{
+		auto count = record_count();
+		auto is = io_state<SerializedType>{};
+		auto bs = make_buffer_state<SerializedType>();
+		auto es = error_state{};
+		is.element_count(count);
+
+		auto b = file::buffer<IOMode>{buffer_constraints{
+			std::max(size_t{hdr_size}, size_t{elem_size})}};
+		write_header(b.data(), b.size(), is, bs, es);
+
+		auto r = file::write(m_handle, 0, bs.consumed(), b, m_strat);
+		if (!r) { return r; }
+		return file::safe_truncate(m_handle.descriptor(),
+			(off_t)(hdr_size + count * elem_size));
+	}
+private:
+	cc::expected<void> flush(reservation& r) noexcept
+	{
+		if (m_mapped) { return true; }
+
+		auto off = (off_t)(hdr_size + r.m_first * elem_size);
+		auto n = r.m_filled * elem_size;
+		std::unique_lock<std::mutex> l{m_mutex, std::defer_lock};
+		if (m_serial) { l.lock(); }
+		return file::write(m_handle, off, n, *r.m_buf, m_strat);
+	}
+
+	void extend(offset_type end) noexcept
+	{
+		auto cur = m_end.load(std::memory_order_relaxed);
+		while (cur < end && !m_end.compare_exchange_weak(cur, end,
+			std::memory_order_release, std::memory_order_relaxed)) {}
+	}
+};
+
+}}
+
+#endif
@@ -17,6 +17,73 @@ namespace neo {
 namespace archive {
 namespace detail {
 
+/*
+** Records the scalar code of a component in the file. If it differs from that
+** of `Scalar`, then the component is converted when it is read, provided that
+** this is allowed by the conversion policy of `is` and that the element has a
+** fixed size.
+*/
+template <uint8_t Index, class Scalar, class SerializedType>
+void verify_scalar(uint8_t code, io_state<SerializedType>& is, error_state& es)
+{
+	is.file_scalar(Index, code);
+	if (code == scalar_code<Scalar>::value) { return; }
+
+	using value_type = typename value_scalar<Scalar>::type;
+	if (
+		is_dynamic<SerializedType>::value ||
+		!is_conversion_allowed(code, scalar_code<value_type>::value,
+			is.conversion())
+	) {
+		es.push_record(
+			severity::critical,
+			context{offset_type{0}, Index},
+			"Mismatching scalar types."
+		);
+		return;
+	}
+	is.converted(true);
+}
+
+/*
+** Measures the size of an element in the file, using the scalar codes recorded
+** by `verify_scalar`.
+*/
+template <size_t Index, class... Ts>
+struct file_element_size;
+
+template <size_t Index, class T, class... Ts>
+struct file_element_size<Index, T, Ts...>
+{
+	template <class SerializedType>
+	static size_t apply(const io_state<SerializedType>& is)
+	{
+		auto code = is.file_scalar(Index);
+		auto size = scale_prefix_size(code) +
+			coefficient_count<T>::value * scalar_size(code);
+		return size + file_element_size<Index + 1, Ts...>::apply(is);
+	}
+};
+
+template <size_t Index>
+struct file_element_size<Index>
+{
+	template <class SerializedType>
+	static size_t apply(const io_state<SerializedType>&) { return 0; }
+};
+
+template <class T>
+struct file_element
+{
+	using helper = file_element_size<0, T>;
+};
+
+template <class... Ts>
+struct file_element<std::tuple<Ts...>>
+{
+	using helper = file_element_size<0, Ts...>;
+};
+
 /*
 ** Verifies that a given component of the element type described in the header
 ** matches the corresponding component of the input type.
@@ -27,14 +94,15 @@ struct verify_component;
 template <uint8_t Index, uint8_t MatrixIndex, class Scalar>
 struct verify_component
 {
-	static_assert(std::is_arithmetic<Scalar>::value, "Type must be arithmetic.");
+	static_assert(std::is_arithmetic<Scalar>::value || is_narrow<Scalar>::value,
+		"Type must be arithmetic.");
 	static constexpr auto component_size = 2;
 
 	template <class SerializedType>
 	static bool apply(
 		const uint8_t*& cur_buf,
 		size_t& rem_buf_size,
-		io_state<SerializedType>&,
+		io_state<SerializedType>& is,
 		error_state& es
 	)
 	{
@@ -46,13 +114,7 @@ struct verify_component
 			);
 			return false;
 		}
-		if (scalar_code<Scalar>::value != cur_buf[0]) {
-			es.push_record(
-				severity::critical,
-				context{offset_type{0}, Index},
-				"Mismatching scalar types."
-			);
-		}
+		verify_scalar<Index, Scalar>(cur_buf[0], is, es);
 		if (cur_buf[1] != 0) {
 			es.push_record(
 				severity::critical,
@@ -88,13 +150,7 @@ struct verify_component<Index, MatrixIndex, vector<Scalar, Size>>
 			);
 			return false;
 		}
-		if (scalar_code<Scalar>::value != cur_buf[0]) {
-			es.push_record(
-				severity::critical,
-				context{offset_type{0}, Index},
-				"Mismatching scalar types."
-			);
-		}
+		verify_scalar<Index, Scalar>(cur_buf[0], is, es);
 		if (cur_buf[1] != 1) {
 			es.push_record(
 				severity::critical,
@@ -107,7 +163,7 @@ struct verify_component<Index, MatrixIndex, vector<Scalar, Size>>
 		if (is.flip_integers()) {
 			size = cc::bswap(size);
 		}
-		if (size != Size) {
+		if (size != extent_code(Size)) {
 			es.push_record(
 				severity::critical,
 				context{offset_type{0}, Index},
@@ -149,13 +205,7 @@ struct verify_component<Index, MatrixIndex, matrix<Scalar, Rows, Cols, Order>>
 			);
 			return false;
 		}
-		if (scalar_code<Scalar>::value != cur_buf[0]) {
-			es.push_record(
-				severity::critical,
-				context{offset_type{0}, Index},
-				"Mismatching scalar types."
-			);
-		}
+		verify_scalar<Index, Scalar>(cur_buf[0], is, es);
 		if (cur_buf[1] != 2) {
 			es.push_record(
 				severity::critical,
@@ -175,14 +225,14 @@ struct verify_component<Index, MatrixIndex, matrix<Scalar, Rows, Cols, Order>>
 			cols = cc::bswap(cols);
 		}
 
-		if (rows != Rows) {
+		if (rows != extent_code(Rows)) {
 			es.push_record(
 				severity::critical,
 				context{offset_type{0}, Index},
 				"Mismatching row counts."
 			);
 		}
-		if (cols != Cols) {
+		if (cols != extent_code(Cols)) {
 			es.push_record(
 				severity::critical,
 				context{offset_type{0}, Index},
@@ -328,7 +378,7 @@ read_header(
 	assert(n >= is.header_size());
 	bs.consumed(is.header_size());
 
-	if (buf[0] > version) {
+	if (buf[0] > columnar_version) {
 		es.push_record(
 			severity::critical,
 			context{offset_type{0}, uint8_t{0}},
@@ -338,6 +388,36 @@ read_header(
 			operation_status::fatal_error;
 	}
 
+	/*
+	** The records of block-compressed and columnar archives cannot be
+	** processed using `scan`. These archives are only accepted if the
+	** caller indicated that it reads them using `block.hpp` or
+	** `columnar.hpp`, by setting the corresponding flag of `is` before
+	** reading the header, as is done when they are written.
+	*/
+	if (buf[0] == compressed_version && !is.compressed()) {
+		es.push_record(
+			severity::critical,
+			context{offset_type{0}, uint8_t{0}},
+			"Archive is block-compressed."
+		);
+		return operation_status::failure |
+			operation_status::fatal_error;
+	}
+	if (buf[0] == columnar_version && !is.columnar()) {
+		es.push_record(
+			severity::critical,
+			context{offset_type{0}, uint8_t{0}},
+			"Archive is columnar."
+		);
+		return operation_status::failure |
+			operation_status::fatal_error;
+	}
+
+	is.compressed(buf[0] == compressed_version);
+	is.columnar(buf[0] == columnar_version);
+	is.converted(false);
+
 	auto o = static_cast<byte_order>(buf[1]);
 	auto io = o & byte_order::integer_mask;
 	auto fo = o & byte_order::float_mask;
@@ -369,8 +449,32 @@ read_header(
 		is, es
 	);
 
-	is.element_count(*(uint64_t*)(buf + is.header_size() -
-		elem_count_size));
+	if (is.converted()) {
+		using file_helper = typename detail::file_element<
+			SerializedType
+		>::helper;
+		is.element_size(file_helper::apply(is));
+	}
+
+	auto count = *(uint64_t*)(buf + is.header_size() - elem_count_size);
+	if (is.flip_integers()) {
+		count = cc::bswap(count);
+	}
+
+	/*
+	** If the archive was not finalized, then the count is that of the
+	** records known to have been written; refer to `stream_writer.hpp`.
+	*/
+	is.finalized(!(count & unfinalized_count_flag));
+	if (!is.finalized()) {
+		es.push_record(
+			severity::warning,
+			context{offset_type{0}, uint8_t{0}},
+			"Archive was not finalized."
+		);
+		count &= ~unfinalized_count_flag;
+	}
+	is.element_count(count);
 
 	if (es.record_count(severity::critical) == 0) {
 		return operation_status::success;
@@ -8,21 +8,64 @@
 #ifndef Z806F248F_0CBC_4050_AACB_86268BAB6909
 #define Z806F248F_0CBC_4050_AACB_86268BAB6909
 
+#include <algorithm>
+#include <array>
 #include <cassert>
+#include <cstring>
 #include <tuple>
 #include <type_traits>
 #include <neo/core/operation_status.hpp>
+#include <neo/io/archive/bswap.hpp>
+#include <neo/io/archive/convert.hpp>
 #include <neo/io/archive/definitions.hpp>
+#include <neo/io/archive/transpose.hpp>
 
 namespace neo {
 namespace archive {
 namespace detail {
 
+/*
+** Reports that there was not enough space to widen the narrow components, or
+** to transpose the matrices, of the elements being scanned.
+*/
+operation_status scratch_failure(buffer_state& bs, error_state& es)
+{
+	bs.consumed(0);
+	es.push_record(
+		severity::critical,
+		context{offset_type{0}, uint8_t{0}},
+		"Failed to allocate scratch space for the elements being scanned."
+	);
+	return operation_status::failure | operation_status::fatal_error;
+}
+
+/*
+** Reports that the elements of a converted archive were scanned in place. This
+** is only possible using the overload of `scan` that takes a destination, since
+** the sizes of the components in the file differ from those of the element
+** type.
+*/
+operation_status conversion_failure(buffer_state& bs, error_state& es)
+{
+	bs.consumed(0);
+	es.push_record(
+		severity::critical,
+		context{offset_type{0}, uint8_t{0}},
+		"Converted elements require a destination."
+	);
+	return operation_status::failure | operation_status::fatal_error;
+}
+
 /*
 ** Performs the actual work to process a component to ensure that it has the
-** correct byte order and storage order, in the case of a matrix.
+** correct byte order and storage order, in the case of a matrix. Components
+** with narrow scalar types are handled by the specializations for which
+** `Narrow` is true.
 */
-template <uint8_t Index, uint8_t MatrixIndex, class Scalar>
+template <
+	uint8_t Index, uint8_t MatrixIndex, class Scalar,
+	bool Narrow = is_narrow<typename scalar_type<Scalar>::type>::value
+>
 struct process_component
 {
 	static_assert(std::is_arithmetic<Scalar>::value,
@@ -48,7 +91,7 @@ struct process_component
 };
 
 template <uint8_t Index, uint8_t MatrixIndex, class Scalar, size_t Size>
-struct process_component<Index, MatrixIndex, vector<Scalar, Size>>
+struct process_component<Index, MatrixIndex, vector<Scalar, Size>, false>
 {
 	using input_type = vector<Scalar, Size>;
 	using output_type = mapped_eigen_type<input_type>;
@@ -63,10 +106,7 @@ struct process_component<Index, MatrixIndex, vector<Scalar, Size>>
 			(is_int && is.flip_integers() && sizeof(Scalar) > 1) ||
 			(is_float && is.flip_floats() && sizeof(Scalar) > 1)
 		) {
-			auto p = (Scalar*)buf;
-			for (auto i = size_t{0}; i != Size; ++i) {
-				*p = cc::bswap(*p);
-			}
+			bswap_n((Scalar*)buf, Size);
 		}
 		::new (&std::get<Index>(is.element())) output_type{(Scalar*)buf};
 	}
@@ -80,14 +120,12 @@ template <
 	size_t Cols,
 	storage_order Order
 >
-struct process_component<Index, MatrixIndex, matrix<Scalar, Rows, Cols, Order>>
+struct process_component<
+	Index, MatrixIndex, matrix<Scalar, Rows, Cols, Order>, false
+>
 {
 	using input_type = matrix<Scalar, Rows, Cols, Order>;
 	using output_type = mapped_eigen_type<input_type>;
-	using transposed_type = Eigen::Map<Eigen::Matrix<
-		Scalar, Cols, Rows,
-		eigen_storage_order<Order>::value
-	>>;
 
 	static constexpr auto is_int = std::is_integral<Scalar>::value;
 	static constexpr auto is_float = std::is_floating_point<Scalar>::value;
@@ -100,23 +138,104 @@ struct process_component<Index, MatrixIndex, matrix<Scalar, Rows, Cols, Order>>
 			(is_int && is.flip_integers() && sizeof(Scalar) > 1) ||
 			(is_float && is.flip_floats() && sizeof(Scalar) > 1)
 		) {
-			auto p = (Scalar*)buf;
-			for (auto i = size_t{0}; i != Rows * Cols; ++i) {
-				*p = cc::bswap(*p);
-			}
+			bswap_n((Scalar*)buf, Rows * Cols);
 		}
 
-		// TODO: The code to perform the transpose could be optimized so
-		// that no temporary buffer needs to be allocated.
 		if (is.transpose_matrix(MatrixIndex)) {
-			auto t = transposed_type{(Scalar*)buf};
-			t.transpose().eval();
-			::new (&std::get<Index>(is.element())) output_type{t.data()};
+			transpose_matrix((Scalar*)buf, is);
 		}
-		else {
-			::new (&std::get<Index>(is.element())) output_type{(Scalar*)buf};
+		::new (&std::get<Index>(is.element())) output_type{(Scalar*)buf};
+	}
+
+	/*
+	** Converts the matrix at `p` from the storage order used by the file
+	** to `Order`, in place, using the scratch space of `is`.
+	*/
+	template <class SerializedType>
+	static CC_ALWAYS_INLINE void
+	transpose_matrix(Scalar* p, io_state<SerializedType>& is)
+	{
+		// The dimensions of the matrix as it is stored in the file,
+		// viewed as a row-major matrix.
+		static constexpr auto col_major = Order == storage_order::column_major;
+		static constexpr auto rows = col_major ? Rows : Cols;
+		static constexpr auto cols = col_major ? Cols : Rows;
+		transpose_in_place(p, rows, cols, is.template transposed<Scalar>());
+	}
+};
+
+/*
+** Components with narrow scalar types are widened into the scratch space of
+** `is`, since the floats do not fit in the buffer. The views refer to the
+** scratch space instead of the buffer.
+*/
+
+template <uint8_t Index, uint8_t MatrixIndex, class Scalar>
+struct process_component<Index, MatrixIndex, Scalar, true>
+{
+	template <class SerializedType>
+	static CC_ALWAYS_INLINE void
+	apply(uint8_t* buf, io_state<SerializedType>& is, error_state&)
+	{
+		narrow_codec<Scalar>::widen(buf, 1, is.flip_floats(),
+			&std::get<Index>(is.element()));
+	}
+};
+
+template <uint8_t Index, uint8_t MatrixIndex, class Scalar, size_t Size>
+struct process_component<Index, MatrixIndex, vector<Scalar, Size>, true>
+{
+	using input_type = vector<Scalar, Size>;
+	using output_type = mapped_eigen_type<input_type>;
+
+	template <class SerializedType>
+	static CC_ALWAYS_INLINE void
+	apply(uint8_t* buf, io_state<SerializedType>& is, error_state&)
+	{
+		auto p = is.widened(Size);
+		narrow_codec<Scalar>::widen(buf, Size, is.flip_floats(), p);
+		::new (&std::get<Index>(is.element())) output_type{p};
+	}
+};
+
+template <
+	uint8_t Index,
+	uint8_t MatrixIndex,
+	class Scalar,
+	size_t Rows,
+	size_t Cols,
+	storage_order Order
+>
+struct process_component<
+	Index, MatrixIndex, matrix<Scalar, Rows, Cols, Order>, true
+>
+{
+	using input_type = matrix<Scalar, Rows, Cols, Order>;
+	using output_type = mapped_eigen_type<input_type>;
+
+	template <class SerializedType>
+	static CC_ALWAYS_INLINE void
+	apply(uint8_t* buf, io_state<SerializedType>& is, error_state&)
+	{
+		auto p = is.widened(Rows * Cols);
+		narrow_codec<Scalar>::widen(buf, Rows * Cols,
+			is.flip_floats(), p);
+
+		if (is.transpose_matrix(MatrixIndex)) {
+			transpose_matrix(p, is);
 		}
+		::new (&std::get<Index>(is.element())) output_type{p};
+	}
 
+	// See the specialization for other scalar types.
+	template <class SerializedType>
+	static CC_ALWAYS_INLINE void
+	transpose_matrix(float* p, io_state<SerializedType>& is)
+	{
+		static constexpr auto col_major = Order == storage_order::column_major;
+		static constexpr auto rows = col_major ? Rows : Cols;
+		static constexpr auto cols = col_major ? Cols : Rows;
+		transpose_in_place(p, rows, cols, is.template transposed<float>());
 	}
 };
 
@@ -228,30 +347,933 @@ struct process_element<std::tuple<Ts...>, Matrices>
 	{ helper::apply(buf, is, es); }
 };
 
-}
+/*
+** Processes a component of an element whose type has dynamic extents. The
+** dynamic extents of the component, if any, are taken from `ext`, which is
+** advanced past them. The `size` function measures the component in the same
+** way, without processing it.
+*/
+template <
+	uint8_t Index, uint8_t MatrixIndex, class Scalar,
+	bool Narrow = is_narrow<typename scalar_type<Scalar>::type>::value
+>
+struct process_dynamic_component
+{
+	static CC_ALWAYS_INLINE size_t size(const uint32_t*&)
+	{ return element_size<Scalar>::value; }
+
+	template <class SerializedType>
+	static CC_ALWAYS_INLINE uint8_t*
+	apply(
+		uint8_t* buf, const uint32_t*&,
+		io_state<SerializedType>& is, error_state& es
+	)
+	{
+		process_component<Index, MatrixIndex, Scalar>::apply(buf, is, es);
+		return buf + element_size<Scalar>::value;
+	}
+};
+
+template <uint8_t Index, uint8_t MatrixIndex, class Scalar, size_t Size>
+struct process_dynamic_component<
+	Index, MatrixIndex, vector<Scalar, Size>, false
+>
+{
+	using input_type = vector<Scalar, Size>;
+	using output_type = mapped_eigen_type<input_type>;
+	static constexpr auto is_int = std::is_integral<Scalar>::value;
+	static constexpr auto is_float = std::is_floating_point<Scalar>::value;
+
+	static CC_ALWAYS_INLINE size_t extent(const uint32_t*& ext)
+	{ return Size == dynamic ? *ext++ : Size; }
+
+	static CC_ALWAYS_INLINE size_t size(const uint32_t*& ext)
+	{ return sizeof(Scalar) * extent(ext); }
+
+	template <class SerializedType>
+	static CC_ALWAYS_INLINE uint8_t*
+	apply(
+		uint8_t* buf, const uint32_t*& ext,
+		io_state<SerializedType>& is, error_state&
+	)
+	{
+		auto n = extent(ext);
+		if (
+			(is_int && is.flip_integers() && sizeof(Scalar) > 1) ||
+			(is_float && is.flip_floats() && sizeof(Scalar) > 1)
+		) {
+			bswap_n((Scalar*)buf, n);
+		}
+		::new (&std::get<Index>(is.element()))
+		output_type{(Scalar*)buf, (long)n};
+		return buf + sizeof(Scalar) * n;
+	}
+};
+
+template <
+	uint8_t Index,
+	uint8_t MatrixIndex,
+	class Scalar,
+	size_t Rows,
+	size_t Cols,
+	storage_order Order
+>
+struct process_dynamic_component<
+	Index, MatrixIndex, matrix<Scalar, Rows, Cols, Order>, false
+>
+{
+	using input_type = matrix<Scalar, Rows, Cols, Order>;
+	using output_type = mapped_eigen_type<input_type>;
+	static constexpr auto is_int = std::is_integral<Scalar>::value;
+	static constexpr auto is_float = std::is_floating_point<Scalar>::value;
+
+	static CC_ALWAYS_INLINE size_t size(const uint32_t*& ext)
+	{
+		auto rows = size_t{Rows == dynamic ? *ext++ : Rows};
+		auto cols = size_t{Cols == dynamic ? *ext++ : Cols};
+		return sizeof(Scalar) *
+			std::min(rows * cols, max_dynamic_element_size);
+	}
+
+	template <class SerializedType>
+	static CC_ALWAYS_INLINE uint8_t*
+	apply(
+		uint8_t* buf, const uint32_t*& ext,
+		io_state<SerializedType>& is, error_state&
+	)
+	{
+		auto rows = Rows == dynamic ? *ext++ : Rows;
+		auto cols = Cols == dynamic ? *ext++ : Cols;
+		if (
+			(is_int && is.flip_integers() && sizeof(Scalar) > 1) ||
+			(is_float && is.flip_floats() && sizeof(Scalar) > 1)
+		) {
+			bswap_n((Scalar*)buf, rows * cols);
+		}
+
+		if (is.transpose_matrix(MatrixIndex)) {
+			// See `process_component::transpose_matrix`.
+			auto tmp = is.template transposed<Scalar>();
+			if (Order == storage_order::column_major) {
+				transpose_in_place((Scalar*)buf, rows, cols, tmp);
+			}
+			else {
+				transpose_in_place((Scalar*)buf, cols, rows, tmp);
+			}
+		}
+		::new (&std::get<Index>(is.element()))
+		output_type{(Scalar*)buf, (long)rows, (long)cols};
+		return buf + sizeof(Scalar) * rows * cols;
+	}
+};
+
+template <uint8_t Index, uint8_t MatrixIndex, class Scalar, size_t Size>
+struct process_dynamic_component<
+	Index, MatrixIndex, vector<Scalar, Size>, true
+>
+{
+	using input_type = vector<Scalar, Size>;
+	using output_type = mapped_eigen_type<input_type>;
+	using codec = narrow_codec<Scalar>;
+
+	static CC_ALWAYS_INLINE size_t extent(const uint32_t*& ext)
+	{ return Size == dynamic ? *ext++ : Size; }
+
+	static CC_ALWAYS_INLINE size_t size(const uint32_t*& ext)
+	{ return codec::size(extent(ext)); }
+
+	template <class SerializedType>
+	static CC_ALWAYS_INLINE uint8_t*
+	apply(
+		uint8_t* buf, const uint32_t*& ext,
+		io_state<SerializedType>& is, error_state&
+	)
+	{
+		auto n = extent(ext);
+		auto p = is.widened(n);
+		codec::widen(buf, n, is.flip_floats(), p);
+		::new (&std::get<Index>(is.element())) output_type{p, (long)n};
+		return buf + codec::size(n);
+	}
+};
+
+template <
+	uint8_t Index,
+	uint8_t MatrixIndex,
+	class Scalar,
+	size_t Rows,
+	size_t Cols,
+	storage_order Order
+>
+struct process_dynamic_component<
+	Index, MatrixIndex, matrix<Scalar, Rows, Cols, Order>, true
+>
+{
+	using input_type = matrix<Scalar, Rows, Cols, Order>;
+	using output_type = mapped_eigen_type<input_type>;
+	using codec = narrow_codec<Scalar>;
+
+	static CC_ALWAYS_INLINE size_t size(const uint32_t*& ext)
+	{
+		auto rows = size_t{Rows == dynamic ? *ext++ : Rows};
+		auto cols = size_t{Cols == dynamic ? *ext++ : Cols};
+		return codec::size(std::min(rows * cols,
+			max_dynamic_element_size));
+	}
+
+	template <class SerializedType>
+	static CC_ALWAYS_INLINE uint8_t*
+	apply(
+		uint8_t* buf, const uint32_t*& ext,
+		io_state<SerializedType>& is, error_state&
+	)
+	{
+		auto rows = Rows == dynamic ? *ext++ : Rows;
+		auto cols = Cols == dynamic ? *ext++ : Cols;
+		auto p = is.widened(rows * cols);
+		codec::widen(buf, rows * cols, is.flip_floats(), p);
+
+		if (is.transpose_matrix(MatrixIndex)) {
+			// See `process_component::transpose_matrix`.
+			auto tmp = is.template transposed<float>();
+			if (Order == storage_order::column_major) {
+				transpose_in_place(p, rows, cols, tmp);
+			}
+			else {
+				transpose_in_place(p, cols, rows, tmp);
+			}
+		}
+		::new (&std::get<Index>(is.element()))
+		output_type{p, (long)rows, (long)cols};
+		return buf + codec::size(rows * cols);
+	}
+};
+
+/*
+** Iterates over the components of an element type with dynamic extents.
+*/
+template <size_t Index, size_t MatrixIndex, class... Ts>
+struct process_dynamic_element;
+
+template <size_t Index, size_t MatrixIndex, class T, class... Ts>
+struct process_dynamic_element<Index, MatrixIndex, T, Ts...>
+{
+	using helper = process_dynamic_component<Index, MatrixIndex, T>;
+	using next = process_dynamic_element<
+		Index + 1, MatrixIndex + is_matrix<T>::value, Ts...
+	>;
+
+	static CC_ALWAYS_INLINE size_t size(const uint32_t*& ext)
+	{
+		auto n = helper::size(ext);
+		return n + next::size(ext);
+	}
+
+	template <class SerializedType>
+	static CC_ALWAYS_INLINE void
+	apply(
+		uint8_t* buf, const uint32_t*& ext,
+		io_state<SerializedType>& is, error_state& es
+	)
+	{
+		auto p = helper::apply(buf, ext, is, es);
+		next::apply(p, ext, is, es);
+	}
+};
+
+template <size_t Index, size_t MatrixIndex>
+struct process_dynamic_element<Index, MatrixIndex>
+{
+	static CC_ALWAYS_INLINE size_t size(const uint32_t*&) { return 0; }
+
+	template <class SerializedType>
+	static CC_ALWAYS_INLINE void
+	apply(
+		uint8_t*, const uint32_t*&,
+		io_state<SerializedType>&, error_state&
+	) {}
+};
+
+template <class InputType>
+struct process_dynamic;
+
+template <class... Ts>
+struct process_dynamic<std::tuple<Ts...>>
+{
+	using helper = process_dynamic_element<0, 0, Ts...>;
+};
 
+/*
+** Scans an element whose type has fixed extents.
+*/
 template <class SerializedType>
 operation_status
-scan(
+scan_element(
 	uint8_t* buf, size_t n,
 	io_state<SerializedType>& is,
-	buffer_state& bs, error_state& es
+	buffer_state& bs, error_state& es,
+	std::false_type
 ) noexcept
 {
 	(void)n;
 	assert(n >= is.element_size());
 	bs.consumed(is.element_size());
+	if (
+		!is.reset_widened(widened_size<SerializedType>::value) ||
+		!is.reserve_transposed(transpose_size<SerializedType>::value)
+	) {
+		return scratch_failure(bs, es);
+	}
 
 	static constexpr auto matrices =
 	count_matrices<SerializedType>::value;
 
 	using helper =
-	detail::process_element<SerializedType, matrices>;
+	process_element<SerializedType, matrices>;
 
 	helper::apply(buf, is, es);
 	return operation_status::success;
 }
 
+/*
+** Scans an element whose type has dynamic extents. If the element does not
+** fit in the buffer, then the required buffer size is raised to the size of
+** the element, and the buffer is left unmodified. Elements larger than
+** `is.max_element_size()` are rejected.
+*/
+template <class SerializedType>
+operation_status
+scan_element(
+	uint8_t* buf, size_t n,
+	io_state<SerializedType>& is,
+	buffer_state& bs, error_state& es,
+	std::true_type
+) noexcept
+{
+	using helper = typename process_dynamic<SerializedType>::helper;
+	static constexpr auto extents = dynamic_extents<SerializedType>::value;
+	static constexpr auto prefix = extents_size<SerializedType>::value;
+
+	(void)n;
+	assert(n >= element_size<SerializedType>::value);
+
+	auto ext = std::array<uint32_t, extents>{};
+	std::memcpy(ext.data(), buf, prefix);
+	if (is.flip_integers()) {
+		bswap_n(ext.data(), extents);
+	}
+
+	auto p = (const uint32_t*)ext.data();
+	auto size = prefix + helper::size(p);
+	if (size > is.max_element_size()) {
+		bs.consumed(0);
+		es.push_record(
+			severity::critical,
+			context{offset_type{0}, uint8_t{0}},
+			"Element is larger than the maximum element size."
+		);
+		return operation_status::failure |
+			operation_status::fatal_error;
+	}
+	if (n < size) {
+		bs.consumed(0);
+		bs.required_constraints().at_least(size);
+		return operation_status::incomplete |
+			operation_status::req_constr_update;
+	}
+
+	is.element_size(size);
+	bs.consumed(size);
+	// Each narrow coefficient occupies at least one byte.
+	if (has_narrow<SerializedType>::value && !is.reset_widened(size)) {
+		return scratch_failure(bs, es);
+	}
+	// No matrix occupies more space than the element once it is widened.
+	if (!is.reserve_transposed(has_narrow<SerializedType>::value ?
+		sizeof(float) * size : size)) {
+		return scratch_failure(bs, es);
+	}
+	p = ext.data();
+	helper::apply(buf + prefix, p, is, es);
+	return operation_status::success;
+}
+
+/*
+** Returns the component with the given index of a tuple, or the object itself
+** if the serialized type is not a tuple.
+*/
+
+template <size_t Index, class... Ts>
+CC_ALWAYS_INLINE auto
+get_component(std::tuple<Ts...>& t) -> decltype(std::get<Index>(t))
+{ return std::get<Index>(t); }
+
+template <size_t Index, class T>
+CC_ALWAYS_INLINE T& get_component(T& t) { return t; }
+
+/*
+** Describes the scalar types of the components of an element. If all of the
+** scalars have the same size, then `uniform_size` is that size, and the byte
+** order of a whole batch can be reversed at once; otherwise, it is zero.
+*/
+
+template <class T>
+struct scalar_info
+{
+	static constexpr auto uniform_size = sizeof(T);
+	static constexpr auto has_int = std::is_integral<T>::value;
+	static constexpr auto has_float = std::is_floating_point<T>::value;
+};
+
+template <>
+struct scalar_info<float16>
+{
+	static constexpr auto uniform_size = size_t{2};
+	static constexpr auto has_int = false;
+	static constexpr auto has_float = true;
+};
+
+template <>
+struct scalar_info<bfloat16> : scalar_info<float16> {};
+
+// The coefficients are preceded by a `float` scale.
+template <>
+struct scalar_info<scaled_int8>
+{
+	static constexpr auto uniform_size = size_t{0};
+	static constexpr auto has_int = false;
+	static constexpr auto has_float = true;
+};
+
+template <class Scalar, size_t Size>
+struct scalar_info<vector<Scalar, Size>> : scalar_info<Scalar> {};
+
+template <class Scalar, size_t Rows, size_t Cols, storage_order Order>
+struct scalar_info<matrix<Scalar, Rows, Cols, Order>> :
+scalar_info<Scalar> {};
+
+template <class T>
+struct scalar_info<std::tuple<T>> : scalar_info<T> {};
+
+template <class T, class... Ts>
+struct scalar_info<std::tuple<T, Ts...>>
+{
+	using first = scalar_info<T>;
+	using rest = scalar_info<std::tuple<Ts...>>;
+
+	static constexpr auto uniform_size =
+		first::uniform_size == rest::uniform_size ?
+		first::uniform_size : 0;
+	static constexpr auto has_int = first::has_int || rest::has_int;
+	static constexpr auto has_float = first::has_float || rest::has_float;
+};
+
+/*
+** Processes one component of each element in a batch of `count` consecutive
+** elements, and constructs the corresponding view in `is.batch()`. The
+** decisions regarding the byte order and storage order are made once for the
+** whole batch, rather than once per element.
+*/
+template <size_t Index, size_t MatrixIndex, class Scalar, size_t Size>
+struct process_batch_component
+{
+	using view = batch_view<Scalar, Size>;
+	static constexpr auto is_int = std::is_integral<Scalar>::value;
+	static constexpr auto is_float = std::is_floating_point<Scalar>::value;
+
+	/*
+	** The components of consecutive elements are `stride` bytes apart.
+	*/
+	template <class SerializedType>
+	static void flip(
+		uint8_t* buf, size_t count, size_t stride,
+		const io_state<SerializedType>& is, bool swapped
+	)
+	{
+		if (
+			swapped || sizeof(Scalar) == 1 ||
+			!((is_int && is.flip_integers()) ||
+			(is_float && is.flip_floats()))
+		) { return; }
+
+		/*
+		** If the element consists of only this component, or the
+		** components are stored in a column, then the components of
+		** consecutive elements are contiguous.
+		*/
+		if (Size * sizeof(Scalar) == stride) {
+			bswap_n((Scalar*)buf, Size * count);
+			return;
+		}
+		for (auto i = size_t{0}; i != count; ++i) {
+			bswap_n((Scalar*)(buf + i * stride), Size);
+		}
+	}
+
+	template <class SerializedType>
+	static void make_view(
+		uint8_t* buf, size_t count, size_t stride,
+		io_state<SerializedType>& is
+	)
+	{
+		assert(stride % sizeof(Scalar) == 0);
+		::new (&get_component<Index>(is.batch()))
+		typename view::type{view::make((Scalar*)buf, count,
+			stride / sizeof(Scalar))};
+	}
+
+	template <class SerializedType>
+	static void apply(
+		uint8_t* buf, size_t count, size_t stride, bool swapped,
+		io_state<SerializedType>& is, error_state&
+	)
+	{
+		flip(buf, count, stride, is, swapped);
+		make_view(buf, count, stride, is);
+	}
+};
+
+/*
+** As above, but for a component with a narrow scalar type, which is widened
+** into the scratch space of `is`. The columns of the view are contiguous.
+*/
+template <size_t Index, size_t MatrixIndex, class Scalar, size_t Size>
+struct process_narrow_batch_component
+{
+	using view = batch_view<float, Size>;
+	using codec = narrow_codec<Scalar>;
+
+	template <class SerializedType>
+	static float* widen(
+		uint8_t* buf, size_t count, size_t stride, bool swapped,
+		io_state<SerializedType>& is
+	)
+	{
+		auto flip = !swapped && is.flip_floats();
+		auto p = is.widened(Size * count);
+
+		if (codec::size(Size) == stride && scale_size<Scalar>::value == 0) {
+			codec::widen(buf, Size * count, flip, p);
+			return p;
+		}
+		for (auto i = size_t{0}; i != count; ++i) {
+			codec::widen(buf + i * stride, Size, flip, p + i * Size);
+		}
+		return p;
+	}
+
+	template <class SerializedType>
+	static void make_view(float* p, size_t count, io_state<SerializedType>& is)
+	{
+		::new (&get_component<Index>(is.batch()))
+		typename view::type{view::make(p, count, Size)};
+	}
+
+	template <class SerializedType>
+	static void apply(
+		uint8_t* buf, size_t count, size_t stride, bool swapped,
+		io_state<SerializedType>& is, error_state&
+	)
+	{ make_view(widen(buf, count, stride, swapped, is), count, is); }
+};
+
+template <
+	size_t Index, size_t MatrixIndex, class T,
+	bool Narrow = is_narrow<typename scalar_type<T>::type>::value
+>
+struct process_batch_impl : process_batch_component<Index, MatrixIndex, T, 1> {};
+
+template <size_t Index, size_t MatrixIndex, class Scalar>
+struct process_batch_impl<Index, MatrixIndex, Scalar, true> :
+process_narrow_batch_component<Index, MatrixIndex, Scalar, 1> {};
+
+template <size_t Index, size_t MatrixIndex, class Scalar, size_t Size>
+struct process_batch_impl<Index, MatrixIndex, vector<Scalar, Size>, false> :
+process_batch_component<Index, MatrixIndex, Scalar, Size> {};
+
+template <size_t Index, size_t MatrixIndex, class Scalar, size_t Size>
+struct process_batch_impl<Index, MatrixIndex, vector<Scalar, Size>, true> :
+process_narrow_batch_component<Index, MatrixIndex, Scalar, Size> {};
+
+template <
+	size_t Index,
+	size_t MatrixIndex,
+	class Scalar,
+	size_t Rows,
+	size_t Cols,
+	storage_order Order
+>
+struct process_batch_impl<
+	Index, MatrixIndex, matrix<Scalar, Rows, Cols, Order>, false
+>
+{
+	using base = process_batch_component<
+		Index, MatrixIndex, Scalar, Rows * Cols
+	>;
+	using helper = process_component<
+		Index, MatrixIndex, matrix<Scalar, Rows, Cols, Order>
+	>;
+
+	template <class SerializedType>
+	static void apply(
+		uint8_t* buf, size_t count, size_t stride, bool swapped,
+		io_state<SerializedType>& is, error_state&
+	)
+	{
+		base::flip(buf, count, stride, is, swapped);
+
+		if (is.transpose_matrix(MatrixIndex)) {
+			for (auto i = size_t{0}; i != count; ++i) {
+				helper::transpose_matrix((Scalar*)(buf + i * stride), is);
+			}
+		}
+		base::make_view(buf, count, stride, is);
+	}
+};
+
+template <
+	size_t Index,
+	size_t MatrixIndex,
+	class Scalar,
+	size_t Rows,
+	size_t Cols,
+	storage_order Order
+>
+struct process_batch_impl<
+	Index, MatrixIndex, matrix<Scalar, Rows, Cols, Order>, true
+>
+{
+	using base = process_narrow_batch_component<
+		Index, MatrixIndex, Scalar, Rows * Cols
+	>;
+	using helper = process_component<
+		Index, MatrixIndex, matrix<Scalar, Rows, Cols, Order>
+	>;
+
+	template <class SerializedType>
+	static void apply(
+		uint8_t* buf, size_t count, size_t stride, bool swapped,
+		io_state<SerializedType>& is, error_state&
+	)
+	{
+		auto p = base::widen(buf, count, stride, swapped, is);
+
+		if (is.transpose_matrix(MatrixIndex)) {
+			for (auto i = size_t{0}; i != count; ++i) {
+				helper::transpose_matrix(p + i * Rows * Cols, is);
+			}
+		}
+		base::make_view(p, count, is);
+	}
+};
+
+/*
+** Iterates over the components of the element type, keeping track of the
+** index of the current matrix and the offset of the current component within
+** the element.
+*/
+template <size_t Index, size_t MatrixIndex, class... Ts>
+struct process_batch_element;
+
+template <size_t Index, size_t MatrixIndex, class T, class... Ts>
+struct process_batch_element<Index, MatrixIndex, T, Ts...>
+{
+	using helper = process_batch_impl<Index, MatrixIndex, T>;
+	using next = process_batch_element<
+		Index + 1, MatrixIndex + is_matrix<T>::value, Ts...
+	>;
+
+	template <class SerializedType>
+	static CC_ALWAYS_INLINE void
+	apply(
+		uint8_t* buf, size_t count, bool swapped,
+		io_state<SerializedType>& is, error_state& es
+	)
+	{
+		// Narrow components are widened into contiguous columns.
+		static constexpr auto is_narrow_component =
+			is_narrow<typename scalar_type<T>::type>::value;
+		static_assert(is_narrow_component ||
+			element_size<SerializedType>::value %
+			(is_narrow_component ? 1 : scalar_info<T>::uniform_size) == 0,
+			"The size of the element must be a multiple of the size of "
+			"each scalar in order for the stride of the batch view to "
+			"be representable.");
+
+		helper::apply(buf, count, is.element_size(), swapped, is, es);
+		next::apply(buf + element_size<T>::value, count, swapped, is,
+			es);
+	}
+};
+
+template <size_t Index, size_t MatrixIndex>
+struct process_batch_element<Index, MatrixIndex>
+{
+	template <class SerializedType>
+	static CC_ALWAYS_INLINE void
+	apply(uint8_t*, size_t, bool, io_state<SerializedType>&, error_state&) {}
+};
+
+template <class InputType>
+struct process_batch
+{
+	using helper = process_batch_element<0, 0, InputType>;
+};
+
+template <class... Ts>
+struct process_batch<std::tuple<Ts...>>
+{
+	using helper = process_batch_element<0, 0, Ts...>;
+};
+
+/*
+** Reverses the byte order of every scalar in the batch using a single pass, if
+** this is possible. Returns true if this was done.
+*/
+template <class SerializedType>
+bool swap_batch(uint8_t* buf, size_t count, const io_state<SerializedType>& is)
+{
+	using info = scalar_info<SerializedType>;
+	if (info::uniform_size <= 1) { return false; }
+
+	auto ints = info::has_int && is.flip_integers();
+	auto floats = info::has_float && is.flip_floats();
+	if ((info::has_int && !ints) || (info::has_float && !floats)) {
+		return false;
+	}
+
+	bswap_n(buf, count * is.element_size() / info::uniform_size,
+		info::uniform_size);
+	return true;
+}
+
+/*
+** Copies a component to the destination provided by the caller, converting its
+** coefficients from the scalar type used by the file, and then converts the
+** copy to the requested storage order, in the case of a matrix.
+*/
+template <size_t Index, size_t MatrixIndex, class T>
+struct convert_component
+{
+	using scalar = typename value_scalar<T>::type;
+	static constexpr auto count = size_t{1};
+
+	static CC_ALWAYS_INLINE scalar* data(scalar& s) { return &s; }
+
+	template <class SerializedType>
+	static CC_ALWAYS_INLINE void
+	transpose(scalar*, io_state<SerializedType>&) {}
+};
+
+template <size_t Index, size_t MatrixIndex, class Scalar, size_t Size>
+struct convert_component<Index, MatrixIndex, vector<Scalar, Size>>
+{
+	using scalar = typename value_scalar<Scalar>::type;
+	static constexpr auto count = Size;
+
+	static CC_ALWAYS_INLINE scalar*
+	data(eigen_type<vector<Scalar, Size>>& v) { return v.data(); }
+
+	template <class SerializedType>
+	static CC_ALWAYS_INLINE void
+	transpose(scalar*, io_state<SerializedType>&) {}
+};
+
+template <
+	size_t Index,
+	size_t MatrixIndex,
+	class Scalar,
+	size_t Rows,
+	size_t Cols,
+	storage_order Order
+>
+struct convert_component<Index, MatrixIndex, matrix<Scalar, Rows, Cols, Order>>
+{
+	using scalar = typename value_scalar<Scalar>::type;
+	static constexpr auto count = Rows * Cols;
+
+	static CC_ALWAYS_INLINE scalar*
+	data(eigen_type<matrix<Scalar, Rows, Cols, Order>>& m)
+	{ return m.data(); }
+
+	// See `process_component::transpose_matrix`.
+	template <class SerializedType>
+	static CC_ALWAYS_INLINE void
+	transpose(scalar* p, io_state<SerializedType>& is)
+	{
+		static constexpr auto col_major = Order == storage_order::column_major;
+		static constexpr auto rows = col_major ? Rows : Cols;
+		static constexpr auto cols = col_major ? Cols : Rows;
+		if (is.transpose_matrix(MatrixIndex)) {
+			transpose_in_place(p, rows, cols,
+				is.template transposed<scalar>());
+		}
+	}
+};
+
+template <size_t Index, size_t MatrixIndex, class... Ts>
+struct convert_element;
+
+template <size_t Index, size_t MatrixIndex, class T, class... Ts>
+struct convert_element<Index, MatrixIndex, T, Ts...>
+{
+	using helper = convert_component<Index, MatrixIndex, T>;
+	using next = convert_element<
+		Index + 1, MatrixIndex + is_matrix<T>::value, Ts...
+	>;
+
+	template <class SerializedType, class Destination>
+	static CC_ALWAYS_INLINE void
+	apply(uint8_t* buf, io_state<SerializedType>& is, Destination& dst)
+	{
+		auto code = is.file_scalar(Index);
+		auto size = scalar_size(code);
+		auto scale = scale_prefix_size(code);
+
+		// The byte order is reversed in place, as done by `scan`.
+		if (scale != 0 && is.flip_floats()) {
+			bswap_n((uint32_t*)buf, 1);
+		}
+		if (
+			size > 1 && (is_floating_point(code) ?
+			is.flip_floats() : is.flip_integers())
+		) {
+			bswap_n(buf + scale, helper::count, size);
+		}
+
+		auto p = helper::data(get_component<Index>(dst));
+		convert_n(buf, code, helper::count, p);
+		helper::transpose(p, is);
+		next::apply(buf + scale + helper::count * size, is, dst);
+	}
+};
+
+template <size_t Index, size_t MatrixIndex>
+struct convert_element<Index, MatrixIndex>
+{
+	template <class SerializedType, class Destination>
+	static CC_ALWAYS_INLINE void
+	apply(uint8_t*, io_state<SerializedType>&, Destination&) {}
+};
+
+template <class InputType>
+struct convert
+{
+	using helper = convert_element<0, 0, InputType>;
+};
+
+template <class... Ts>
+struct convert<std::tuple<Ts...>>
+{
+	using helper = convert_element<0, 0, Ts...>;
+};
+
+}
+
+/*
+** Processes the element at the start of the buffer, and constructs the
+** corresponding view in `is.element()`. If the element type has dynamic
+** extents, then the size of the element is only known once its extents have
+** been read. If the element does not fit in the buffer, then the result has the
+** `incomplete` and `req_constr_update` flags set, and nothing is consumed; the
+** caller should grow the buffer to satisfy `bs.required_constraints()` and try
+** again.
+*/
+template <class SerializedType>
+operation_status
+scan(
+	uint8_t* buf, size_t n,
+	io_state<SerializedType>& is,
+	buffer_state& bs, error_state& es
+) noexcept
+{
+	if (is.converted()) {
+		return detail::conversion_failure(bs, es);
+	}
+	using dynamic_type = std::integral_constant<
+		bool, is_dynamic<SerializedType>::value
+	>;
+	return detail::scan_element(buf, n, is, bs, es, dynamic_type{});
+}
+
+/*
+** Processes the element at the start of the buffer, and copies it to `dst`.
+** Components whose scalar types in the file differ from those of the element
+** type are converted, as allowed by the conversion policy that was set before
+** the header was read; refer to `convert.hpp`. This is the only way to read the
+** elements of an archive for which `is.converted()` is true, since converted
+** components cannot be exposed in place. Only element types of fixed size are
+** supported.
+*/
+template <class SerializedType>
+operation_status
+scan(
+	uint8_t* buf, size_t n,
+	io_state<SerializedType>& is,
+	buffer_state& bs, error_state& es,
+	eigen_type<SerializedType>& dst
+) noexcept
+{
+	static_assert(!is_dynamic<SerializedType>::value,
+		"Converting scans require elements of fixed size.");
+
+	(void)n;
+	assert(n >= is.element_size());
+	bs.consumed(is.element_size());
+	if (!is.reserve_transposed(transpose_size<SerializedType>::value)) {
+		return detail::scratch_failure(bs, es);
+	}
+
+	using helper = typename detail::convert<SerializedType>::helper;
+	helper::apply(buf, is, dst);
+	return operation_status::success;
+}
+
+/*
+** Processes `count` consecutive elements at once, so that they can be consumed
+** as a minibatch. Afterwards, `is.batch()` contains a view of each component
+** of the element type, with one column per element. For example, if the
+** element type is `std::tuple<float, vector<float, 784>>`, then
+** `std::get<1>(is.batch())` is a 784 by `count` matrix. Matrix components are
+** flattened, and their coefficients are stored in the order given by the
+** storage order of the input type.
+**
+** The views refer to the data in the buffer, which is modified in place, except
+** for those of components with narrow scalar types, which refer to the scratch
+** space of `is` into which the components were widened.
+*/
+template <class SerializedType>
+operation_status
+scan_n(
+	uint8_t* buf, size_t n, size_t count,
+	io_state<SerializedType>& is,
+	buffer_state& bs, error_state& es
+) noexcept
+{
+	static_assert(!is_dynamic<SerializedType>::value,
+		"Batched scans require elements of fixed size.");
+
+	if (is.converted()) {
+		return detail::conversion_failure(bs, es);
+	}
+	(void)n;
+	assert(count > 0);
+	assert(n >= count * is.element_size());
+	bs.consumed(count * is.element_size());
+
+	using helper = typename detail::process_batch<SerializedType>::helper;
+	is.batch_size(count);
+	if (
+		!is.reset_widened(count * widened_size<SerializedType>::value) ||
+		!is.reserve_transposed(transpose_size<SerializedType>::value)
+	) {
+		return detail::scratch_failure(bs, es);
+	}
+	auto swapped = detail::swap_batch(buf, count, is);
+	helper::apply(buf, count, swapped, is, es);
+	return operation_status::success;
+}
+
 }}
 
 #endif
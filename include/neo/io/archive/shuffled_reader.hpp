@@ -0,0 +1,319 @@
+/*
+** File Name: shuffled_reader.hpp
+** Author:    Aditya Ramesh
+** Date:      07/27/2014
+** Contact:   _@adityaramesh.com
+**
+** The `shuffled_reader` class visits the records of an archive in a different
+** random order during each epoch, while keeping the reads nearly sequential.
+** It performs a two-level shuffle:
+**
+**   1. The records are divided into blocks of `block_size` consecutive
+**   records, and the order of the blocks is permuted.
+**   2. A background thread reads the blocks in the permuted order into a pair
+**   of windows, each of which holds up to `window_size` records. Every block is
+**   read using a single sequential read.
+**   3. Once a window has been filled, the order of its records is permuted, and
+**   they are scanned one at a time in that order, while the other window is
+**   being filled.
+**
+** Larger blocks make the IO more sequential, and larger windows mix records
+** from more blocks; a window that holds the entire archive gives a uniformly
+** random permutation. The permutations depend only on the seed and the epoch
+** number, so runs are reproducible.
+**
+** Usage: call `read_header` to initialize the `io_state`, construct the reader
+** (which begins epoch zero), and call `next()` until it returns false. Then call
+** `begin_epoch` to start the next epoch. The handle must not be used by other
+** threads while the reader is alive.
+*/
+
+#ifndef Z1D84F6B2_5A39_4E07_9C1B_E7302A85DF46
+#define Z1D84F6B2_5A39_4E07_9C1B_E7302A85DF46
+
+#include <algorithm>
+#include <cassert>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <numeric>
+#include <random>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include <ccbase/format.hpp>
+#include <neo/core/operation_status.hpp>
+#include <neo/core/file/buffer.hpp>
+#include <neo/core/file/handle.hpp>
+#include <neo/core/file/io.hpp>
+#include <neo/core/file/strategy.hpp>
+#include <neo/io/archive/definitions.hpp>
+#include <neo/io/archive/scan.hpp>
+
+namespace neo {
+namespace archive {
+
+template <class SerializedType, io_mode IOMode>
+class shuffled_reader
+{
+	static_assert(!!(IOMode & io_mode::input), "Input IO mode required.");
+	static_assert(!is_dynamic<SerializedType>::value,
+		"Shuffled reading requires elements of fixed size.");
+
+	static constexpr auto elem_size = element_size<SerializedType>::value;
+
+	struct window
+	{
+		file::buffer<IOMode> buf;
+		// The index of each record in the window.
+		std::vector<offset_type> ids;
+		bool full;
+
+		// The producer fills `ids` without allocating.
+		explicit window(size_t n, size_t records)
+		: buf{buffer_constraints{n}}, ids{}, full{}
+		{ ids.reserve(records); }
+	};
+
+	const file::handle<IOMode>& m_handle;
+	const file::strategy<IOMode>& m_strat;
+	io_state<SerializedType>& m_is;
+	buffer_state m_bs{make_buffer_state<SerializedType>()};
+	error_state m_es{};
+
+	offset_type m_count;
+	size_t m_block;
+	size_t m_blocks_per_window;
+	uint64_t m_seed;
+	std::mt19937_64 m_rng{};
+	// The order in which the blocks are read during the current epoch.
+	std::vector<offset_type> m_blocks{};
+	std::vector<window> m_windows{};
+
+	// Index into `m_blocks` of the next block to be read by the producer.
+	size_t m_next_block{};
+	size_t m_tail{};
+	size_t m_filled{};
+	bool m_eof{};
+	bool m_stop{};
+	std::exception_ptr m_error{};
+
+	std::mutex m_mutex{};
+	std::condition_variable m_producer_cv{};
+	std::condition_variable m_consumer_cv{};
+	std::thread m_thread{};
+
+	// Index of the window currently held by the consumer.
+	size_t m_head{};
+	bool m_holding{};
+	std::vector<uint32_t> m_order{};
+	size_t m_pos{};
+	offset_type m_index{};
+public:
+	/*
+	** Creates a reader for the archive opened using `h`, whose header has
+	** already been read into `is`. The block and window sizes are given
+	** in records; the window size is rounded down to a multiple of the
+	** block size. Throws `std::invalid_argument` if the block size is zero,
+	** if the window cannot hold at least one block, or if the archive is
+	** `converted` (whose records the reader cannot scan in place).
+	*/
+	explicit shuffled_reader(
+		const file::handle<IOMode>& h,
+		const file::strategy<IOMode>& s,
+		io_state<SerializedType>& is,
+		size_t block_size = 256,
+		size_t window_size = 64 * 1024,
+		uint64_t seed = 0
+	) : m_handle(h), m_strat(s), m_is(is), m_count{is.element_count()},
+	m_block{block_size},
+	m_blocks_per_window{blocks_per_window(block_size, window_size)},
+	m_seed{seed}
+	{
+		assert(!is.compressed() && "Use `decompress_blocks` instead.");
+		assert(!is.columnar() && "Use `read_columns` instead.");
+		if (is.converted()) {
+			throw std::invalid_argument{"Converted archives cannot "
+				"be shuffled."};
+		}
+
+		m_blocks.resize((m_count + m_block - 1) / m_block);
+		m_windows.reserve(2);
+		for (auto i = 0; i != 2; ++i) {
+			m_windows.emplace_back(std::max(size_t{1},
+				m_blocks_per_window * m_block * elem_size),
+				m_blocks_per_window * m_block);
+		}
+		begin_epoch(0);
+	}
+
+	shuffled_reader(const shuffled_reader&) = delete;
+	shuffled_reader& operator=(const shuffled_reader&) = delete;
+
+	~shuffled_reader() { stop(); }
+
+	size_t block_size() const noexcept { return m_block; }
+	size_t window_size() const noexcept
+	{ return m_blocks_per_window * m_block; }
+
+	error_state& errors() noexcept { return m_es; }
+
+	/*
+	** Returns the current record, and its index in the archive.
+	*/
+	const typename io_state<SerializedType>::value_type&
+	element() const noexcept { return m_is.element(); }
+
+	offset_type index() const noexcept { return m_index; }
+
+	/*
+	** Discards the rest of the current epoch, and starts the given one.
+	*/
+	void begin_epoch(uint64_t epoch)
+	{
+		stop();
+
+		std::seed_seq seq{
+			(uint32_t)m_seed, (uint32_t)(m_seed >> 32),
+			(uint32_t)epoch, (uint32_t)(epoch >> 32)
+		};
+		m_rng.seed(seq);
+		std::iota(m_blocks.begin(), m_blocks.end(), offset_type{0});
+		std::shuffle(m_blocks.begin(), m_blocks.end(), m_rng);
+
+		for (auto& w : m_windows) { w.full = false; }
+		m_next_block = m_tail = m_filled = m_head = m_pos = 0;
+		m_eof = m_stop = m_holding = false;
+		m_error = nullptr;
+		m_thread = std::thread{[this] { produce(); }};
+	}
+
+	/*
+	** Scans the next record of the epoch. Returns false once every record
+	** has been visited. If a record cannot be scanned, then an exception is
+	** returned, and the details are recorded in `errors()`.
+	*/
+	cc::expected<bool> next()
+	{
+		for (;;) {
+			if (m_holding && m_pos != m_order.size()) {
+				auto& w = m_windows[m_head];
+				auto k = m_order[m_pos++];
+				auto s = scan(w.buf.data() + k * elem_size, elem_size,
+					m_is, m_bs, m_es);
+				m_index = w.ids[k];
+				if (!(s & operation_status::success)) {
+					return std::runtime_error{cc::format(
+						"Failed to scan record $.", m_index)};
+				}
+				return true;
+			}
+
+			std::unique_lock<std::mutex> l{m_mutex};
+			if (m_holding) {
+				m_windows[m_head].full = false;
+				--m_filled;
+				m_head = (m_head + 1) % m_windows.size();
+				m_holding = false;
+				m_producer_cv.notify_one();
+			}
+
+			m_consumer_cv.wait(l, [&] {
+				return m_windows[m_head].full || m_error ||
+					(m_eof && m_filled == 0);
+			});
+			if (m_error) { return m_error; }
+			if (!m_windows[m_head].full) { return false; }
+			l.unlock();
+
+			auto n = m_windows[m_head].ids.size();
+			m_order.resize(n);
+			std::iota(m_order.begin(), m_order.end(), uint32_t{0});
+			std::shuffle(m_order.begin(), m_order.end(), m_rng);
+			m_pos = 0;
+			m_holding = true;
+		}
+	}
+private:
+	static size_t blocks_per_window(size_t block_size, size_t window_size)
+	{
+		if (block_size == 0) {
+			throw std::invalid_argument{"Block size must be positive."};
+		}
+		if (window_size < block_size || window_size > UINT32_MAX) {
+			throw std::invalid_argument{cc::format(
+				"Window size $ must be at least the block size $, "
+				"and at most $.", window_size, block_size,
+				UINT32_MAX)};
+		}
+		return window_size / block_size;
+	}
+
+	void stop()
+	{
+		if (!m_thread.joinable()) { return; }
+		{
+			std::lock_guard<std::mutex> l{m_mutex};
+			m_stop = true;
+		}
+		m_producer_cv.notify_one();
+		m_thread.join();
+	}
+
+	void produce()
+	{
+		auto hdr = m_is.header_size();
+
+		for (;;) {
+			std::unique_lock<std::mutex> l{m_mutex};
+			m_producer_cv.wait(l, [&] {
+				return m_stop || m_filled != m_windows.size();
+			});
+			if (m_stop) { return; }
+			if (m_next_block == m_blocks.size()) {
+				m_eof = true;
+				m_consumer_cv.notify_one();
+				return;
+			}
+
+			auto& w = m_windows[m_tail];
+			auto first = m_next_block;
+			auto last = std::min(first + m_blocks_per_window,
+				m_blocks.size());
+			m_next_block = last;
+			l.unlock();
+
+			w.ids.clear();
+			auto p = w.buf.data();
+			auto r = cc::expected<void>{true};
+			for (auto i = first; i != last; ++i) {
+				auto id = m_blocks[i] * m_block;
+				auto n = (size_t)std::min<offset_type>(m_block,
+					m_count - id);
+				r = file::read(m_handle, (off_t)(hdr + id * elem_size),
+					n * elem_size, p, m_strat);
+				if (!r) { break; }
+
+				for (auto j = offset_type{0}; j != n; ++j) {
+					w.ids.push_back(id + j);
+				}
+				p += n * elem_size;
+			}
+
+			l.lock();
+			if (!r) {
+				m_error = r.exception();
+				m_consumer_cv.notify_one();
+				return;
+			}
+			w.full = true;
+			++m_filled;
+			m_tail = (m_tail + 1) % m_windows.size();
+			m_consumer_cv.notify_one();
+		}
+	}
+};
+
+}}
+
+#endif
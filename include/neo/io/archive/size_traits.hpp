@@ -61,7 +61,11 @@ struct header_size<std::tuple<Ts...>>
 };
 
 /*
-** Measures the size of a single element of the given type.
+** Measures the size of a single element of the given type. Components with
+** dynamic extents contribute nothing to the size, so for such types, this is
+** the size of the smallest possible element: the extents that prefix each
+** record, along with the components whose sizes are fixed. The scale that
+** precedes a component with a scaled scalar type is counted in either case.
 */
 
 template <class... Ts>
@@ -70,13 +74,14 @@ struct element_size;
 template <class Scalar>
 struct element_size<Scalar>
 {
-	static constexpr auto value = sizeof(Scalar);
+	static constexpr auto value = scale_size<Scalar>::value + sizeof(Scalar);
 };
 
 template <class Scalar, size_t Size>
 struct element_size<vector<Scalar, Size>>
 {
-	static constexpr auto value = Size * sizeof(Scalar);
+	static constexpr auto value = scale_size<Scalar>::value +
+	(Size == dynamic ? size_t{0} : Size * sizeof(Scalar));
 };
 
 template <
@@ -87,7 +92,9 @@ template <
 >
 struct element_size<matrix<Scalar, Rows, Cols, Order>>
 {
-	static constexpr auto value = Rows * Cols * sizeof(Scalar);
+	static constexpr auto value = scale_size<Scalar>::value +
+	(Rows == dynamic || Cols == dynamic ?
+	size_t{0} : Rows * Cols * sizeof(Scalar));
 };
 
 template <class T, class... Ts>
@@ -97,11 +104,139 @@ struct element_size<T, Ts...>
 	element_size<T>::value + element_size<Ts...>::value;
 };
 
+/*
+** Measures the size of the extents stored at the start of each record of the
+** given type.
+*/
+
+template <class T>
+struct extents_size
+{
+	static constexpr auto value = 4 * dynamic_extents<T>::value;
+};
+
 template <class... Ts>
 struct element_size<std::tuple<Ts...>>
 {
 	static constexpr auto value =
-	element_size<Ts...>::value;
+	extents_size<std::tuple<Ts...>>::value + element_size<Ts...>::value;
+};
+
+/*
+** Counts the coefficients of a component of fixed size.
+*/
+
+template <class Scalar>
+struct coefficient_count
+{
+	static constexpr auto value = size_t{1};
+};
+
+template <class Scalar, size_t Size>
+struct coefficient_count<vector<Scalar, Size>>
+{
+	static constexpr auto value = Size;
+};
+
+template <
+	class Scalar,
+	size_t Rows,
+	size_t Cols,
+	storage_order Order
+>
+struct coefficient_count<matrix<Scalar, Rows, Cols, Order>>
+{
+	static constexpr auto value = Rows * Cols;
+};
+
+/*
+** Counts the coefficients of the components of an element that have narrow
+** scalar types, which must be widened when the element is scanned. Components
+** with dynamic extents contribute nothing to the count.
+*/
+
+template <class... Ts>
+struct widened_size;
+
+template <class Scalar>
+struct widened_size<Scalar>
+{
+	static constexpr auto value = size_t{is_narrow<Scalar>::value};
+};
+
+template <class Scalar, size_t Size>
+struct widened_size<vector<Scalar, Size>>
+{
+	static constexpr auto value =
+	!is_narrow<Scalar>::value || Size == dynamic ? size_t{0} : Size;
+};
+
+template <
+	class Scalar,
+	size_t Rows,
+	size_t Cols,
+	storage_order Order
+>
+struct widened_size<matrix<Scalar, Rows, Cols, Order>>
+{
+	static constexpr auto value =
+	!is_narrow<Scalar>::value || Rows == dynamic || Cols == dynamic ?
+	size_t{0} : Rows * Cols;
+};
+
+template <class T, class... Ts>
+struct widened_size<T, Ts...>
+{
+	static constexpr auto value =
+	widened_size<T>::value + widened_size<Ts...>::value;
+};
+
+template <class... Ts>
+struct widened_size<std::tuple<Ts...>>
+{
+	static constexpr auto value = widened_size<Ts...>::value;
+};
+
+/*
+** Measures the number of bytes of scratch space needed to transpose the largest
+** rectangular matrix of an element in place, after its coefficients have been
+** widened. Components with dynamic extents contribute nothing to the count.
+*/
+
+template <class... Ts>
+struct transpose_size;
+
+template <class T>
+struct transpose_size<T>
+{
+	static constexpr auto value = size_t{0};
+};
+
+template <
+	class Scalar,
+	size_t Rows,
+	size_t Cols,
+	storage_order Order
+>
+struct transpose_size<matrix<Scalar, Rows, Cols, Order>>
+{
+	static constexpr auto value =
+	Rows == Cols || Rows == dynamic || Cols == dynamic ? size_t{0} :
+	Rows * Cols * sizeof(typename value_scalar<Scalar>::type);
+};
+
+template <class T, class... Ts>
+struct transpose_size<T, Ts...>
+{
+	static constexpr auto value =
+	transpose_size<T>::value > transpose_size<Ts...>::value ?
+	transpose_size<T>::value : transpose_size<Ts...>::value;
+};
+
+template <class... Ts>
+struct transpose_size<std::tuple<Ts...>>
+{
+	static constexpr auto value = transpose_size<Ts...>::value;
 };
 
 /*
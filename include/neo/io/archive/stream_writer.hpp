@@ -0,0 +1,396 @@
+/*
+** File Name: stream_writer.hpp
+** Author:    Aditya Ramesh
+** Date:      07/27/2014
+** Contact:   _@adityaramesh.com
+**
+** The `stream_writer` class writes an archive whose record count is not known
+** in advance. The header is written with the `unfinalized_count_flag` bit of the
+** record count set, and records are appended to a staging buffer, which is
+** written to the file using a single large write whenever it fills up. After
+** each such flush, the record count in the header is updated to the number of
+** records flushed so far, with the flag still set. Calling `finalize()` flushes
+** the remaining records, writes the final count, and truncates the file to the
+** end of the last record, which discards any preallocated space.
+**
+** If the writer does not reach `finalize()` (e.g. because the process crashed),
+** then `read_header` reports a warning, clears `io_state::finalized`, and sets
+** the element count to the number of records in the last completed flush. The
+** records written after that can be recovered using `recover_element_count`.
+**
+** If a checksum block size is given, then the writer also computes the
+** checksums of the data as it is flushed, and `finalize()` appends the checksum
+** section described in `checksum.hpp`. Likewise, if `index` is set, then the
+** writer records the offset of each record, and `finalize()` writes the index
+** section described in `index.hpp` before the checksum section. The index is
+** held in memory until then, which costs eight bytes per record.
+*/
+
+#ifndef Z3A7D1C94_E68B_4F05_A2C7_5B90F14D8E61
+#define Z3A7D1C94_E68B_4F05_A2C7_5B90F14D8E61
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <vector>
+#include <ccbase/format.hpp>
+#include <neo/core/operation_status.hpp>
+#include <neo/core/file/buffer.hpp>
+#include <neo/core/file/handle.hpp>
+#include <neo/core/file/io.hpp>
+#include <neo/core/file/strategy.hpp>
+#include <neo/core/file/system.hpp>
+#include <neo/io/archive/checksum.hpp>
+#include <neo/io/archive/definitions.hpp>
+#include <neo/io/archive/format.hpp>
+#include <neo/io/archive/index.hpp>
+#include <neo/io/archive/scan.hpp>
+#include <neo/io/archive/write_header.hpp>
+
+namespace neo {
+namespace archive {
+
+template <class SerializedType, io_mode IOMode>
+class stream_writer
+{
+	static_assert(!!(IOMode & io_mode::output), "Output IO mode required.");
+
+	static constexpr auto hdr_size = header_size<SerializedType>::value;
+	static constexpr auto elem_count_size = size_t{8};
+
+	const file::handle<IOMode>& m_handle;
+	const file::strategy<IOMode>& m_strat;
+	file::buffer<IOMode> m_buf;
+	// Holds the record count while it is being written to the header.
+	file::buffer<IOMode> m_count_buf{
+		buffer_constraints{size_t{elem_count_size}}};
+
+	io_state<SerializedType> m_is{};
+	buffer_state m_bs{make_buffer_state<SerializedType>()};
+	error_state m_es{};
+	// Empty if checksums are disabled.
+	checksum_table m_checksums;
+	record_index m_index{};
+	bool m_indexed;
+	// The record count that is currently stored in the header.
+	uint64_t m_header_count{unfinalized_count_flag};
+
+	// The offset in the file at which the staging buffer will be written.
+	off_t m_off{};
+	// The number of bytes in the staging buffer.
+	size_t m_pos{};
+	offset_type m_count{};
+	offset_type m_flushed{};
+public:
+	/*
+	** Creates a writer whose staging buffer holds `buffer_size` bytes. The
+	** buffer is enlarged if a record with dynamic extents does not fit in
+	** it. If `checksum_block` is nonzero, then checksums are computed for
+	** blocks of that many bytes. If `index` is set, then an index is
+	** written when the archive is finalized. The handle and strategy must
+	** outlive the writer. Throws if the staging buffer cannot be allocated.
+	*/
+	explicit stream_writer(
+		const file::handle<IOMode>& h,
+		const file::strategy<IOMode>& s,
+		size_t buffer_size = 1024 * 1024,
+		uint32_t checksum_block = 0,
+		bool index = false
+	) : m_handle(h), m_strat(s),
+	m_buf{buffer_constraints{std::max<size_t>({buffer_size, hdr_size,
+		element_size<SerializedType>::value})}}, m_indexed{index}
+	{
+		if (checksum_block != 0) {
+			m_checksums = checksum_table{checksum_block};
+		}
+		write_header(m_buf.data(), m_buf.size(), m_is, m_bs, m_es);
+		m_pos = m_bs.consumed();
+	}
+
+	stream_writer(const stream_writer&) = delete;
+	stream_writer& operator=(const stream_writer&) = delete;
+
+	error_state& errors() noexcept { return m_es; }
+
+	/*
+	** Returns the number of records appended so far, and the number of
+	** those that have been written to the file.
+	*/
+	offset_type record_count() const noexcept { return m_count; }
+	offset_type flushed_count() const noexcept { return m_flushed; }
+
+	/*
+	** Appends `t` to the archive, flushing the staging buffer first if
+	** the record does not fit in it.
+	*/
+	template <class T>
+	cc::expected<void> push_back(const T& t) noexcept
+	{
+		if (
+			!is_dynamic<SerializedType>::value &&
+			m_buf.size() - m_pos < m_is.element_size()
+		) {
+			auto r = flush();
+			if (!r) { return r; }
+		}
+
+		auto st = format(t, m_buf.data() + m_pos, m_buf.size() - m_pos,
+			m_is, m_bs, m_es);
+		if (!!(st & operation_status::req_constr_update)) {
+			auto r = flush();
+			if (!r) { return r; }
+
+			r = reserve(*min_size(m_bs.required_constraints()));
+			if (!r) { return r; }
+			st = format(t, m_buf.data(), m_buf.size(), m_is, m_bs,
+				m_es);
+		}
+		if (!(st & operation_status::success)) {
+			return std::runtime_error{cc::format(
+				"Failed to format record $.", m_count)};
+		}
+
+		if (m_indexed) {
+			try {
+				m_index.push_back((offset_type)m_off + m_pos);
+			}
+			catch (const std::bad_alloc&) {
+				return std::runtime_error{cc::format(
+					"Failed to index record $.", m_count)};
+			}
+		}
+		m_pos += m_bs.consumed();
+		++m_count;
+		return true;
+	}
+
+	/*
+	** Writes the contents of the staging buffer to the file, and then
+	** updates the record count in the header.
+	*/
+	cc::expected<void> flush() noexcept
+	{
+		if (m_pos == 0) { return true; }
+		auto r = file::write(m_handle, m_off, m_pos, m_buf, m_strat);
+		if (!r) { return r; }
+		if (has_checksums()) {
+			m_checksums.update(m_buf.data(), m_pos);
+		}
+
+		m_off += (off_t)m_pos;
+		m_pos = 0;
+		m_flushed = m_count;
+		return write_count(unfinalized_count_flag | m_flushed);
+	}
+
+	/*
+	** Flushes the remaining records, writes the final record count to the
+	** header, and appends the index and checksum sections, if any. If
+	** `truncate` is set, then the file is also truncated to the end of the
+	** archive, which is required for these sections to be found.
+	*/
+	cc::expected<void> finalize(bool truncate = true) noexcept
+	{
+		assert((truncate || !(has_checksums() || has_index())) &&
+			"The index and checksum sections must be at the end of "
+			"the file.");
+
+		auto r = flush();
+		if (!r) { return r; }
+		r = write_count(m_count);
+		if (!r) { return r; }
+
+		if (has_index()) {
+			try {
+				m_index.push_back((offset_type)m_off);
+			}
+			catch (const std::bad_alloc&) {
+				return std::runtime_error{"Failed to index the end "
+					"of the data."};
+			}
+
+			// The sections are staged in the (now empty) buffer.
+			auto n = index_size(m_index);
+			r = reserve(n);
+			if (!r) { return r; }
+			write_index(m_buf.data(), n, m_index, m_is, m_bs, m_es);
+			r = file::write(m_handle, m_off, n, m_buf, m_strat);
+			if (!r) { return r; }
+			if (has_checksums()) {
+				m_checksums.update(m_buf.data(), n);
+			}
+			m_off += (off_t)n;
+		}
+
+		if (has_checksums()) {
+			auto n = checksum_size(m_checksums);
+			r = reserve(n);
+			if (!r) { return r; }
+			write_checksums(m_buf.data(), n, m_checksums, m_is, m_bs,
+				m_es);
+			r = file::write(m_handle, m_off, n, m_buf, m_strat);
+			if (!r) { return r; }
+			m_off += (off_t)n;
+		}
+
+		if (!truncate) { return true; }
+		return file::safe_truncate(m_handle.descriptor(), m_off);
+	}
+
+	bool has_checksums() const noexcept
+	{ return m_checksums.block_size() != 0; }
+
+	const checksum_table& checksums() const noexcept
+	{ return m_checksums; }
+
+	bool has_index() const noexcept { return m_indexed; }
+
+	/*
+	** Returns the offsets of the records appended so far. After
+	** `finalize()`, this also includes the offset of the end of the data.
+	*/
+	const record_index& index() const noexcept { return m_index; }
+private:
+	/*
+	** Enlarges the staging buffer, which must be empty, so that it holds
+	** at least `n` bytes.
+	*/
+	cc::expected<void> reserve(size_t n) noexcept
+	{
+		assert(m_pos == 0);
+		if (n <= m_buf.size()) { return true; }
+		try {
+			m_buf = file::buffer<IOMode>{buffer_constraints{n}};
+		}
+		catch (const std::exception&) {
+			return std::runtime_error{cc::format("Failed to allocate "
+				"a staging buffer of $ bytes.", n)};
+		}
+		return true;
+	}
+
+	cc::expected<void> write_count(uint64_t n) noexcept
+	{
+		std::memcpy(m_count_buf.data(), &n, elem_count_size);
+		auto r = file::write(m_handle, (off_t)(hdr_size - elem_count_size),
+			elem_count_size, m_count_buf, m_strat);
+		if (!r) { return r; }
+
+		if (has_checksums()) {
+			m_checksums.patch(hdr_size - elem_count_size,
+				(const uint8_t*)&m_header_count, m_count_buf.data(),
+				elem_count_size);
+		}
+		m_header_count = n;
+		return true;
+	}
+};
+
+namespace detail {
+
+template <class SerializedType, io_mode IOMode>
+cc::expected<offset_type>
+count_records(
+	const file::handle<IOMode>&,
+	const file::strategy<IOMode>&,
+	const io_state<SerializedType>& is,
+	off_t fs,
+	std::false_type
+) noexcept
+{
+	return (offset_type)(fs - (off_t)is.header_size()) / is.element_size();
+}
+
+/*
+** Counts the records with dynamic extents by reading the extents at the start
+** of each one. The file is read in chunks, so that each read usually covers the
+** extents of many records.
+*/
+template <class SerializedType, io_mode IOMode>
+cc::expected<offset_type>
+count_records(
+	const file::handle<IOMode>& h,
+	const file::strategy<IOMode>& s,
+	const io_state<SerializedType>& is,
+	off_t fs,
+	std::true_type
+) noexcept
+{
+	using helper = typename process_dynamic<SerializedType>::helper;
+	static constexpr auto extents = dynamic_extents<SerializedType>::value;
+	static constexpr auto prefix = extents_size<SerializedType>::value;
+	static constexpr auto chunk_size = size_t{64 * 1024};
+
+	auto buf = std::vector<uint8_t>(chunk_size);
+	auto base = off_t{0};
+	auto len = size_t{0};
+	auto off = (off_t)is.header_size();
+	auto n = offset_type{0};
+
+	while (off + (off_t)prefix <= fs) {
+		if (off + (off_t)prefix > base + (off_t)len) {
+			base = off;
+			len = (size_t)std::min<off_t>(chunk_size, fs - off);
+			auto r = file::read(h, base, len, buf.data(), s);
+			if (!r) { return r.exception(); }
+		}
+
+		auto ext = std::array<uint32_t, extents>{};
+		std::memcpy(ext.data(), buf.data() + (off - base), prefix);
+		if (is.flip_integers()) {
+			bswap_n(ext.data(), extents);
+		}
+
+		auto p = (const uint32_t*)ext.data();
+		off += (off_t)(prefix + helper::size(p));
+		if (off > fs) { break; }
+		++n;
+	}
+	return n;
+}
+
+}
+
+/*
+** Counts the complete records of an archive that was not finalized, whose
+** header has already been read into `is`, and updates the element count of
+** `is`. A record that was only partially written is not counted. If the file
+** was preallocated, then the space after the last record is zero-filled, and
+** cannot be told apart from records of zeros; in this case, the count stored
+** in `is` by `read_header` should be used instead.
+*/
+template <
+	class SerializedType,
+	io_mode IOMode,
+	typename std::enable_if<!!(IOMode & io_mode::input), int>::type = 0
+>
+cc::expected<offset_type>
+recover_element_count(
+	const file::handle<IOMode>& h,
+	const file::strategy<IOMode>& s,
+	io_state<SerializedType>& is
+) noexcept
+{
+	assert(!is.compressed() && !is.columnar());
+
+	auto st = file::safe_stat(h.descriptor());
+	if (!st) { return st.exception(); }
+	auto fs = st->st_size;
+	if (fs < (off_t)is.header_size()) {
+		return std::runtime_error{"Archive is too small to contain "
+			"a header."};
+	}
+
+	auto r = detail::count_records(h, s, is, fs,
+		std::integral_constant<bool, is_dynamic<SerializedType>::value>{});
+	if (!r) { return r; }
+	is.element_count(*r);
+	return r;
+}
+
+}}
+
+#endif
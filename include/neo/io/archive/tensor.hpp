@@ -10,11 +10,70 @@
 
 #include <cstdint>
 #include <limits>
+#include <tuple>
+#include <type_traits>
 #include <neo/io/archive/storage_order.hpp>
 
 namespace neo {
 namespace archive {
 
+/*
+** Scalar types that are only used for storage. When a component with one of
+** these scalar types is read, its coefficients are widened to `float`; when it
+** is written, `float` or `double` input is narrowed using round-to-nearest.
+** Refer to `convert.hpp`.
+*/
+
+// IEEE 754 half precision.
+struct float16 { uint16_t bits; };
+
+// The upper half of an IEEE 754 single precision float.
+struct bfloat16 { uint16_t bits; };
+
+/*
+** An 8-bit integer that is multiplied by a scale. Each component with this
+** scalar type is stored as the scale (a `float`), followed by the coefficients.
+*/
+struct scaled_int8 { int8_t bits; };
+
+template <class Scalar>
+struct is_narrow
+{
+	static constexpr auto value = false;
+};
+
+template <> struct is_narrow<float16>     { static constexpr auto value = true; };
+template <> struct is_narrow<bfloat16>    { static constexpr auto value = true; };
+template <> struct is_narrow<scaled_int8> { static constexpr auto value = true; };
+
+/*
+** Returns the scalar type used to expose a component that is stored using the
+** given scalar type.
+*/
+template <class Scalar>
+struct value_scalar
+{
+	using type = typename std::conditional<
+		is_narrow<Scalar>::value, float, Scalar
+	>::type;
+};
+
+/*
+** The size of the scale that precedes the coefficients of each component with
+** the given scalar type.
+*/
+template <class Scalar>
+struct scale_size
+{
+	static constexpr auto value = std::size_t{0};
+};
+
+template <>
+struct scale_size<scaled_int8>
+{
+	static constexpr auto value = std::size_t{4};
+};
+
 /*
 ** The scalar code is used to encode the type of the scalar in the header.
 */
@@ -32,9 +91,64 @@ template <> struct scalar_code<uint32_t> { static constexpr uint8_t value = 6; }
 template <> struct scalar_code<uint64_t> { static constexpr uint8_t value = 7; };
 template <> struct scalar_code<float>    { static constexpr uint8_t value = 8; };
 template <> struct scalar_code<double>   { static constexpr uint8_t value = 9; };
+template <> struct scalar_code<float16>     { static constexpr uint8_t value = 10; };
+template <> struct scalar_code<bfloat16>    { static constexpr uint8_t value = 11; };
+template <> struct scalar_code<scaled_int8> { static constexpr uint8_t value = 12; };
+
+/*
+** Returns the size of the scalar with the given code, or zero if the code is
+** invalid.
+*/
+std::size_t scalar_size(uint8_t code) noexcept
+{
+	switch (code) {
+	case scalar_code<int8_t>::value:      return 1;
+	case scalar_code<int16_t>::value:     return 2;
+	case scalar_code<int32_t>::value:     return 4;
+	case scalar_code<int64_t>::value:     return 8;
+	case scalar_code<uint8_t>::value:     return 1;
+	case scalar_code<uint16_t>::value:    return 2;
+	case scalar_code<uint32_t>::value:    return 4;
+	case scalar_code<uint64_t>::value:    return 8;
+	case scalar_code<float>::value:       return 4;
+	case scalar_code<double>::value:      return 8;
+	case scalar_code<float16>::value:     return 2;
+	case scalar_code<bfloat16>::value:    return 2;
+	case scalar_code<scaled_int8>::value: return 1;
+	default:                              return 0;
+	}
+}
+
+bool is_floating_point(uint8_t code) noexcept
+{
+	return code == scalar_code<float>::value ||
+		code == scalar_code<double>::value ||
+		code == scalar_code<float16>::value ||
+		code == scalar_code<bfloat16>::value;
+}
+
+/*
+** Returns the size of the scale that precedes the coefficients of each
+** component with the scalar type of the given code.
+*/
+std::size_t scale_prefix_size(uint8_t code) noexcept
+{
+	return code == scalar_code<scaled_int8>::value ?
+		archive::scale_size<scaled_int8>::value : 0;
+}
 
 static constexpr auto dynamic = std::numeric_limits<std::size_t>::max();
 
+/*
+** The value used in the header in place of an extent that is `dynamic`. The
+** actual extents are then stored at the start of each record; refer to
+** `notes/archive_format.md`.
+*/
+static constexpr uint32_t dynamic_extent_code = 0xFFFFFFFF;
+
+constexpr uint32_t extent_code(std::size_t n)
+{ return n == dynamic ? dynamic_extent_code : (uint32_t)n; }
+
 template <class Scalar, std::size_t Size = dynamic>
 struct vector {};
 
@@ -63,6 +177,60 @@ struct is_matrix<matrix<Scalar, Rows, Cols, Order>>
 	static constexpr auto value = true;
 };
 
+/*
+** Returns the scalar type of a component.
+*/
+
+template <class T>
+struct scalar_type
+{
+	using type = T;
+};
+
+template <class Scalar, std::size_t Size>
+struct scalar_type<vector<Scalar, Size>>
+{
+	using type = Scalar;
+};
+
+template <
+	class Scalar,
+	std::size_t Rows,
+	std::size_t Cols,
+	storage_order Order
+>
+struct scalar_type<matrix<Scalar, Rows, Cols, Order>>
+{
+	using type = Scalar;
+};
+
+/*
+** Determines whether any component of the given type has a narrow scalar type.
+*/
+
+template <class T>
+struct has_narrow
+{
+	static constexpr auto value =
+	is_narrow<typename scalar_type<T>::type>::value;
+};
+
+template <class... Ts>
+struct has_narrow<std::tuple<Ts...>>;
+
+template <>
+struct has_narrow<std::tuple<>>
+{
+	static constexpr auto value = false;
+};
+
+template <class T, class... Ts>
+struct has_narrow<std::tuple<T, Ts...>>
+{
+	static constexpr auto value = has_narrow<T>::value ||
+		has_narrow<std::tuple<Ts...>>::value;
+};
+
 template <class T>
 struct count_matrices
 {
@@ -82,6 +250,57 @@ struct count_matrices<std::tuple<T>>
 	static constexpr auto value = is_matrix<T>::value;
 };
 
+/*
+** Counts the number of extents of the given type that are `dynamic`, and hence
+** must be stored with each record.
+*/
+
+template <class T>
+struct dynamic_extents
+{
+	static constexpr auto value = size_t{0};
+};
+
+template <class Scalar, std::size_t Size>
+struct dynamic_extents<vector<Scalar, Size>>
+{
+	static constexpr auto value = size_t{Size == dynamic};
+};
+
+template <
+	class Scalar,
+	std::size_t Rows,
+	std::size_t Cols,
+	storage_order Order
+>
+struct dynamic_extents<matrix<Scalar, Rows, Cols, Order>>
+{
+	static constexpr auto value =
+		size_t{Rows == dynamic} + size_t{Cols == dynamic};
+};
+
+template <class... Ts>
+struct dynamic_extents<std::tuple<Ts...>>;
+
+template <>
+struct dynamic_extents<std::tuple<>>
+{
+	static constexpr auto value = size_t{0};
+};
+
+template <class T, class... Ts>
+struct dynamic_extents<std::tuple<T, Ts...>>
+{
+	static constexpr auto value = dynamic_extents<T>::value +
+		dynamic_extents<std::tuple<Ts...>>::value;
+};
+
+template <class T>
+struct is_dynamic
+{
+	static constexpr auto value = dynamic_extents<T>::value != 0;
+};
+
 }}
 
 #endif
@@ -0,0 +1,215 @@
+/*
+** File Name: transpose.hpp
+** Author:    Aditya Ramesh
+** Date:      07/26/2014
+** Contact:   _@adityaramesh.com
+**
+** This file defines the cache-blocked transpose kernels used to convert
+** matrices between storage orders. A matrix with `rows` rows and `cols` columns
+** is stored in row-major order; after transposition, the same coefficients are
+** stored in column-major order (equivalently, the transpose is stored in
+** row-major order). The matrix is processed in tiles whose rows span a cache
+** line, and tiles of 4-byte scalars are further divided into 4 by 4 blocks
+** that are transposed using SSE shuffles.
+**
+** Square matrices are transposed in place by swapping pairs of tiles across the
+** diagonal, without using any extra memory. Rectangular matrices can either be
+** transposed into a caller-provided destination, or in place through a scratch
+** buffer of the same size. The scratch buffer is either provided by the caller
+** (as done by `scan`, which must not allocate), or is a per-thread buffer that
+** is only reallocated when it needs to grow. (In-place cycle-following avoids
+** the scratch buffer, but takes quadratic time in the worst case.)
+*/
+
+#ifndef Z6B2D9F14_3A7E_4C58_B1F0_8E45D2A7C913
+#define Z6B2D9F14_3A7E_4C58_B1F0_8E45D2A7C913
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <ccbase/platform.hpp>
+
+#if defined(__SSE__)
+	#include <xmmintrin.h>
+#endif
+
+namespace neo {
+namespace archive {
+namespace detail {
+
+/*
+** The number of coefficients along each side of a tile.
+*/
+template <class Scalar>
+struct transpose_tile
+{
+	static constexpr auto value =
+		sizeof(Scalar) >= 16 ? size_t{4} : size_t{64 / sizeof(Scalar)};
+};
+
+/*
+** Transposes the 4 by 4 block of 4-byte scalars at `src`, whose rows are
+** `ss` scalars apart, to `dst`, whose rows are `ds` scalars apart. Returns
+** false if SSE is not available, in which case nothing is done.
+*/
+template <class Scalar>
+CC_ALWAYS_INLINE bool
+transpose_block(const Scalar* src, size_t ss, Scalar* dst, size_t ds)
+{
+	#if defined(__SSE__)
+		if (sizeof(Scalar) == 4) {
+			auto r0 = _mm_loadu_ps((const float*)(src));
+			auto r1 = _mm_loadu_ps((const float*)(src + ss));
+			auto r2 = _mm_loadu_ps((const float*)(src + 2 * ss));
+			auto r3 = _mm_loadu_ps((const float*)(src + 3 * ss));
+			_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+			_mm_storeu_ps((float*)(dst), r0);
+			_mm_storeu_ps((float*)(dst + ds), r1);
+			_mm_storeu_ps((float*)(dst + 2 * ds), r2);
+			_mm_storeu_ps((float*)(dst + 3 * ds), r3);
+			return true;
+		}
+	#endif
+	(void)src; (void)ss; (void)dst; (void)ds;
+	return false;
+}
+
+/*
+** Copies the transpose of the `m` by `n` tile at `src` (row stride `ss`) to
+** `dst` (row stride `ds`).
+*/
+template <class Scalar>
+CC_ALWAYS_INLINE void
+transpose_tile_to(
+	const Scalar* src, size_t ss, Scalar* dst, size_t ds,
+	size_t m, size_t n
+)
+{
+	auto i = size_t{0};
+	if (sizeof(Scalar) == 4) {
+		for (; i + 4 <= m; i += 4) {
+			auto j = size_t{0};
+			for (; j + 4 <= n; j += 4) {
+				if (!transpose_block(src + i * ss + j, ss,
+					dst + j * ds + i, ds)) { break; }
+			}
+			for (; j != n; ++j) {
+				for (auto k = i; k != i + 4; ++k) {
+					dst[j * ds + k] = src[k * ss + j];
+				}
+			}
+		}
+	}
+	for (; i < m; ++i) {
+		for (auto j = size_t{0}; j != n; ++j) {
+			dst[j * ds + i] = src[i * ss + j];
+		}
+	}
+}
+
+/*
+** Swaps the `t` by `t` tile at `a` with the transpose of the tile at `b`, where
+** both tiles belong to a square matrix with `n` columns.
+*/
+template <class Scalar>
+CC_ALWAYS_INLINE void
+swap_tiles(Scalar* a, Scalar* b, size_t n, size_t t)
+{
+	static constexpr auto tile = transpose_tile<Scalar>::value;
+	Scalar ta[tile * tile];
+	Scalar tb[tile * tile];
+
+	transpose_tile_to(a, n, ta, t, t, t);
+	transpose_tile_to(b, n, tb, t, t, t);
+	for (auto i = size_t{0}; i != t; ++i) {
+		std::copy_n(tb + i * t, t, a + i * n);
+		std::copy_n(ta + i * t, t, b + i * n);
+	}
+}
+
+}
+
+/*
+** Writes the transpose of the row-major `rows` by `cols` matrix at `src` to
+** `dst`, which must not overlap `src`.
+*/
+template <class Scalar>
+void transpose(const Scalar* src, Scalar* dst, size_t rows, size_t cols)
+{
+	static constexpr auto tile = detail::transpose_tile<Scalar>::value;
+
+	for (auto i = size_t{0}; i < rows; i += tile) {
+		auto m = std::min(tile, rows - i);
+		for (auto j = size_t{0}; j < cols; j += tile) {
+			auto n = std::min(tile, cols - j);
+			detail::transpose_tile_to(src + i * cols + j, cols,
+				dst + j * rows + i, rows, m, n);
+		}
+	}
+}
+
+/*
+** Transposes the row-major `rows` by `cols` matrix at `p` in place. If the
+** matrix is not square, then `tmp` must have space for `rows * cols` scalars;
+** otherwise, it is not used.
+*/
+template <class Scalar>
+void transpose_in_place(Scalar* p, size_t rows, size_t cols, Scalar* tmp)
+{
+	static constexpr auto tile = detail::transpose_tile<Scalar>::value;
+
+	if (rows == 1 || cols == 1) { return; }
+
+	if (rows != cols) {
+		assert(tmp != nullptr);
+		transpose(p, tmp, rows, cols);
+		std::copy_n(tmp, rows * cols, p);
+		return;
+	}
+
+	auto n = rows;
+	for (auto i = size_t{0}; i < n; i += tile) {
+		auto m = std::min(tile, n - i);
+
+		// Transpose the tile on the diagonal.
+		for (auto r = i; r != i + m; ++r) {
+			for (auto c = r + 1; c != i + m; ++c) {
+				std::swap(p[r * n + c], p[c * n + r]);
+			}
+		}
+
+		for (auto j = i + m; j < n; j += tile) {
+			auto k = std::min(tile, n - j);
+			if (k == tile && m == tile) {
+				detail::swap_tiles(p + i * n + j, p + j * n + i, n,
+					tile);
+				continue;
+			}
+			for (auto r = i; r != i + m; ++r) {
+				for (auto c = j; c != j + k; ++c) {
+					std::swap(p[r * n + c], p[c * n + r]);
+				}
+			}
+		}
+	}
+}
+
+/*
+** Transposes the row-major `rows` by `cols` matrix at `p` in place, using a
+** per-thread scratch buffer if the matrix is not square.
+*/
+template <class Scalar>
+void transpose_in_place(Scalar* p, size_t rows, size_t cols)
+{
+	static thread_local std::vector<Scalar> tmp;
+	if (rows != cols && tmp.size() < rows * cols) {
+		tmp.resize(rows * cols);
+	}
+	transpose_in_place(p, rows, cols, tmp.data());
+}
+
+}}
+
+#endif
@@ -9,6 +9,7 @@
 #define Z1214CF91_7CA1_4E99_A64E_9BDBF9939CEF
 
 #include <cassert>
+#include <cstring>
 #include <type_traits>
 #include <neo/core/operation_status.hpp>
 #include <neo/io/archive/definitions.hpp>
@@ -41,7 +42,7 @@ struct write_header<vector<Scalar, Size>>
 	{
 		buf[0] = scalar_code<Scalar>::value;
 		buf[1] = 1;
-		*(uint32_t*)(buf + 2) = Size;
+		*(uint32_t*)(buf + 2) = extent_code(Size);
 		return buf + 6;
 	}
 };
@@ -59,8 +60,8 @@ struct write_header<matrix<Scalar, Rows, Cols, Order>>
 		buf[0] = scalar_code<Scalar>::value;
 		buf[1] = 2;
 		buf[2] = static_cast<uint8_t>(Order);
-		*(uint32_t*)(buf + 3) = Rows;
-		*(uint32_t*)(buf + 7) = Cols;
+		*(uint32_t*)(buf + 3) = extent_code(Rows);
+		*(uint32_t*)(buf + 7) = extent_code(Cols);
 		return buf + 11;
 	}
 };
@@ -98,19 +99,28 @@ write_header(
 ) noexcept
 {
 	(void)n;
-	assert(n >= is.element_size());
+	assert(n >= is.header_size());
 	detail::write_header<SerializedType>::apply(buf);
+	assert(!(is.compressed() && is.columnar()) &&
+		"Columnar archives cannot be block-compressed.");
+	if (is.compressed()) {
+		buf[0] = compressed_version;
+	}
+	else if (is.columnar()) {
+		buf[0] = columnar_version;
+	}
 
 	static constexpr auto elem_count_size = 8;
 
-	if (is.element_count()) {
-		*reinterpret_cast<uint64_t*>(buf + is.header_size() - elem_count_size) =
-			is.element_count();
-		bs.consumed(is.header_size());
-	}
-	else {
-		bs.consumed(is.header_size() - elem_count_size);
-	}
+	/*
+	** If the record count is not known yet, then the archive is marked as
+	** unfinalized, and the count must be patched afterwards.
+	*/
+	auto count = is.has_element_count() ?
+		uint64_t{is.element_count()} : unfinalized_count_flag;
+	std::memcpy(buf + is.header_size() - elem_count_size, &count,
+		elem_count_size);
+	bs.consumed(is.header_size());
 	return operation_status::success;
 }
 
@@ -5,7 +5,14 @@
 ** Contact:   _@adityaramesh.com
 */
 
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <thread>
 #include <typeinfo>
+#include <vector>
 #include <ccbase/format.hpp>
 #include <ccbase/unit_test.hpp>
 #include <neo/core/file.hpp>
@@ -250,4 +257,1860 @@ module("test column-major deserialization")
 	}
 }
 
+module("test mapped view")
+{
+	namespace archive = neo::archive;
+	using archive::storage_order;
+
+	constexpr auto path = "data/archive/test.dsa";
+
+	using n1 = double;
+	using n2 = archive::vector<double, 37>;
+	using n3 = archive::matrix<double, 13, 37, storage_order::row_major>;
+	using n4 = archive::matrix<int16_t, 38, 53, storage_order::column_major>;
+	using n5 = archive::vector<int8_t, 4>;
+	using n6 = int32_t;
+	using input_type = std::tuple<n1, n2, n3, n4, n5, n6>;
+
+	auto v = archive::open_mapped_view<input_type>(path).move();
+	require(v.size() == 3);
+	require(v.end() - v.begin() == 3);
+
+	auto check = [&](const archive::mapped_view<input_type>::value_type& t) {
+		require(std::get<0>(t) == 1.0);
+		require(std::get<5>(t) == -1);
+
+		auto& a2 = std::get<1>(t);
+		auto& a3 = std::get<2>(t);
+		auto& a4 = std::get<3>(t);
+		auto& a5 = std::get<4>(t);
+
+		for (auto i = 0; i != a2.size(); ++i) {
+			require(a2(i) == i);
+		}
+		for (auto i = 0; i != a3.rows(); ++i) {
+			for (auto j = 0; j != a3.cols(); ++j) {
+				require(a3(i, j) == a3.cols() * i + j);
+			}
+		}
+		for (auto j = 0; j != a4.cols(); ++j) {
+			for (auto i = 0; i != a4.rows(); ++i) {
+				require(a4(i, j) == a4.cols() * i + j);
+			}
+		}
+		for (auto i = 0; i != a5.size(); ++i) {
+			require(a5(i) == i);
+		}
+	};
+
+	// The views must point into the mapping.
+	auto t = v[2];
+	require((const uint8_t*)std::get<1>(t).data() ==
+		v.data() + 2 * v.element_size() + sizeof(n1));
+	for (auto r : v) { check(r); }
+
+	auto pool = std::vector<std::thread>{};
+	for (auto k = 0; k != 4; ++k) {
+		pool.emplace_back([&] {
+			for (auto i = v.size(); i-- > 0;) { check(v[i]); }
+		});
+	}
+	for (auto& th : pool) { th.join(); }
+
+	// The matrices must be stored in the requested order.
+	using m4 = archive::matrix<int16_t, 38, 53, storage_order::row_major>;
+	using other_type = std::tuple<n1, n2, n3, m4, n5, n6>;
+	require(!archive::open_mapped_view<other_type>(path));
+}
+
+module("test batched deserialization")
+{
+	namespace archive = neo::archive;
+	using namespace neo;
+	using archive::storage_order;
+
+	using n1 = float;
+	using n2 = archive::vector<float, 5>;
+	using n3 = archive::matrix<float, 3, 4, storage_order::row_major>;
+	using n4 = int32_t;
+	using m3 = archive::matrix<float, 3, 4, storage_order::column_major>;
+	using output_type = std::tuple<n1, n2, n3, n4>;
+	using input_type = std::tuple<n1, n2, m3, n4>;
+
+	constexpr auto count = 4;
+	auto os = archive::io_state<output_type>{};
+	auto es = archive::error_state{};
+	auto bs = archive::make_buffer_state<output_type>();
+	os.element_count(count);
+
+	auto hdr = os.header_size();
+	auto elem = os.element_size();
+	auto buf = std::vector<uint8_t>(hdr + count * elem);
+	archive::write_header(buf.data(), buf.size(), os, bs, es);
+
+	auto a2 = archive::eigen_type<n2>{};
+	auto a3 = archive::eigen_type<n3>{};
+	for (auto k = 0; k != count; ++k) {
+		for (auto i = 0; i != a2.size(); ++i) {
+			a2(i) = 10 * k + i;
+		}
+		for (auto i = 0; i != a3.rows(); ++i) {
+			for (auto j = 0; j != a3.cols(); ++j) {
+				a3(i, j) = 100 * k + a3.cols() * i + j;
+			}
+		}
+		auto t = std::make_tuple(float(k), a2, a3, -k);
+		archive::format(t, buf.data() + hdr + k * elem, elem, os, bs, es);
+	}
+
+	auto is = archive::io_state<input_type>{};
+	bs = archive::make_buffer_state<input_type>();
+	auto s = archive::read_header(buf.data(), buf.size(), is, bs, es);
+	require(!!(s & operation_status::success));
+
+	s = archive::scan_n(buf.data() + hdr, count * elem, count, is, bs, es);
+	require(!!(s & operation_status::success));
+	require(bs.consumed() == count * elem);
+	require(is.batch_size() == count);
+
+	auto& b = is.batch();
+	require(std::get<0>(b).rows() == 1 && std::get<0>(b).cols() == count);
+	require(std::get<1>(b).rows() == 5 && std::get<1>(b).cols() == count);
+	require(std::get<2>(b).rows() == 12);
+
+	for (auto k = 0; k != count; ++k) {
+		require(std::get<0>(b)(0, k) == k);
+		require(std::get<3>(b)(0, k) == -k);
+
+		for (auto i = 0; i != 5; ++i) {
+			require(std::get<1>(b)(i, k) == 10 * k + i);
+		}
+
+		/*
+		** The matrix was written in row-major order, and read in
+		** column-major order, so it should have been transposed.
+		*/
+		auto c = Eigen::Map<Eigen::Matrix<float, 3, 4>>{
+			&std::get<2>(b)(0, k)};
+		for (auto i = 0; i != c.rows(); ++i) {
+			for (auto j = 0; j != c.cols(); ++j) {
+				require(c(i, j) == 100 * k + c.cols() * i + j);
+			}
+		}
+	}
+}
+
+module("test dynamic extents")
+{
+	namespace archive = neo::archive;
+	using namespace neo;
+	using archive::storage_order;
+	using archive::dynamic;
+
+	using n1 = int32_t;
+	using n2 = archive::vector<float, dynamic>;
+	using n3 = archive::matrix<int16_t, dynamic, 3, storage_order::row_major>;
+	using m3 = archive::matrix<int16_t, dynamic, 3, storage_order::column_major>;
+	using output_type = std::tuple<n1, n2, n3>;
+	using input_type = std::tuple<n1, n2, m3>;
+
+	static_assert(archive::is_dynamic<output_type>::value, "");
+	static_assert(archive::dynamic_extents<output_type>::value == 2, "");
+	require(archive::element_size<output_type>::value == 2 * 4 + 4);
+
+	constexpr auto count = 3;
+	auto os = archive::io_state<output_type>{};
+	auto es = archive::error_state{};
+	auto bs = archive::make_buffer_state<output_type>();
+	os.element_count(count);
+
+	auto hdr = os.header_size();
+	auto buf = std::vector<uint8_t>(hdr);
+	archive::write_header(buf.data(), buf.size(), os, bs, es);
+
+	// Records of different lengths are written back to back.
+	auto sizes = std::vector<size_t>{};
+	for (auto k = 0; k != count; ++k) {
+		auto a2 = archive::eigen_type<n2>(5 * k + 1);
+		auto a3 = archive::eigen_type<n3>(2 * k + 1, 3);
+		for (auto i = 0; i != a2.size(); ++i) {
+			a2(i) = 10 * k + i;
+		}
+		for (auto i = 0; i != a3.rows(); ++i) {
+			for (auto j = 0; j != a3.cols(); ++j) {
+				a3(i, j) = 100 * k + a3.cols() * i + j;
+			}
+		}
+		auto t = std::make_tuple(int32_t(-k), a2, a3);
+		auto expected = size_t(8 + 4 + 4 * a2.size() + 2 * a3.size());
+
+		auto off = buf.size();
+		buf.resize(off + 8);
+		auto s = archive::format(t, buf.data() + off, 8, os, bs, es);
+		require(!!(s & operation_status::req_constr_update));
+		require(bs.consumed() == 0);
+		require(*min_size(bs.required_constraints()) == expected);
+
+		buf.resize(off + expected);
+		s = archive::format(t, buf.data() + off, expected, os, bs, es);
+		require(!!(s & operation_status::success));
+		require(bs.consumed() == expected);
+		sizes.push_back(expected);
+	}
+
+	auto is = archive::io_state<input_type>{};
+	bs = archive::make_buffer_state<input_type>();
+	auto s = archive::read_header(buf.data(), buf.size(), is, bs, es);
+	require(!!(s & operation_status::success));
+	require(is.element_count() == count);
+
+	auto off = hdr;
+	for (auto k = 0; k != count; ++k) {
+		// The buffer first ends in the middle of the record.
+		auto n = sizes[k] - 1;
+		s = archive::scan(buf.data() + off, n, is, bs, es);
+		require(!!(s & operation_status::incomplete));
+		require(!!(s & operation_status::req_constr_update));
+		require(bs.consumed() == 0);
+		require(*min_size(bs.required_constraints()) == sizes[k]);
+
+		s = archive::scan(buf.data() + off, buf.size() - off, is, bs, es);
+		require(!!(s & operation_status::success));
+		require(bs.consumed() == sizes[k]);
+		require(is.element_size() == sizes[k]);
+		off += bs.consumed();
+
+		auto& t = is.element();
+		require(std::get<0>(t) == -k);
+		auto& a2 = std::get<1>(t);
+		auto& a3 = std::get<2>(t);
+		require(a2.size() == 5 * k + 1);
+		require(a3.rows() == 2 * k + 1 && a3.cols() == 3);
+
+		for (auto i = 0; i != a2.size(); ++i) {
+			require(a2(i) == 10 * k + i);
+		}
+		// Written in row-major order and read in column-major order.
+		for (auto i = 0; i != a3.rows(); ++i) {
+			for (auto j = 0; j != a3.cols(); ++j) {
+				require(a3(i, j) == 100 * k + a3.cols() * i + j);
+			}
+		}
+	}
+	require(off == buf.size());
+
+	/*
+	** Once the reader bounds the element size by the size of the file, a
+	** corrupt extent is rejected rather than causing the buffer to grow.
+	*/
+	is.max_element_size(buf.size() - hdr);
+	auto bad = std::vector<uint8_t>(buf.begin() + hdr, buf.end());
+	auto big = std::numeric_limits<uint32_t>::max();
+	std::memcpy(bad.data() + 4, &big, 4);
+	s = archive::scan(bad.data(), sizes[0], is, bs, es);
+	require(!(s & operation_status::success));
+	require(!(s & operation_status::req_constr_update));
+
+	auto ds = archive::dynamic_io_state{};
+	s = archive::read_header(buf.data(), buf.size(), ds, bs, es);
+	require(!!(s & operation_status::success));
+	ds.max_element_size(buf.size() - hdr);
+	s = archive::scan(bad.data(), sizes[0], ds, bs, es);
+	require(!(s & operation_status::success));
+	require(!(s & operation_status::req_constr_update));
+}
+
+module("test record index")
+{
+	namespace file = neo::file;
+	namespace archive = neo::archive;
+	using namespace neo;
+	using file::open_mode;
+	using archive::dynamic;
+
+	constexpr auto path = "data/archive/index.dsa";
+	using input_type = std::tuple<int32_t, archive::vector<float, dynamic>>;
+
+	constexpr auto count = 5;
+	auto is = archive::io_state<input_type>{};
+	auto es = archive::error_state{};
+	auto bs = archive::make_buffer_state<input_type>();
+	is.element_count(count);
+
+	auto buf = std::vector<uint8_t>(is.header_size());
+	archive::write_header(buf.data(), buf.size(), is, bs, es);
+
+	auto idx = archive::record_index{};
+	for (auto k = 0; k != count; ++k) {
+		auto a = archive::eigen_type<archive::vector<float>>(3 * k + 2);
+		for (auto i = 0; i != a.size(); ++i) {
+			a(i) = 10 * k + i;
+		}
+		auto t = std::make_tuple(int32_t(k), a);
+		auto off = buf.size();
+		buf.resize(off + 8 + 4 * a.size());
+		archive::format(t, buf.data() + off, buf.size() - off, is, bs, es);
+		idx.push_back(off);
+	}
+	idx.push_back(buf.size());
+	require(idx.record_count() == count);
+
+	auto off = buf.size();
+	buf.resize(off + archive::index_size(idx));
+	auto s = archive::write_index(buf.data() + off, buf.size() - off, idx,
+		is, bs, es);
+	require(!!(s & operation_status::success));
+	require(bs.consumed() == 8 * (count + 1) + archive::trailer_size);
+
+	using mode = io_mode;
+	auto so = file::strategy<mode::output>(off_t{0}, off_t{4096},
+		blksize_t{4096});
+	so.infer_defaults(access_mode::sequential).preallocate(false);
+	auto ho = file::open<open_mode::create_or_replace>(path, so).move();
+	auto w = file::buffer<mode::output>{buffer_constraints{buf.size()}};
+	std::copy(buf.begin(), buf.end(), w.data());
+	file::write(ho, 0, buf.size(), w, so).get();
+
+	for (auto m : {io_method::buffer, io_method::mmap}) {
+		auto si = file::strategy<mode::input>{path};
+		si.infer_defaults(access_mode::random).read_method(m);
+		auto hi = file::open<open_mode::read>(path, si).move();
+
+		auto ri = archive::io_state<input_type>{};
+		auto hdr = std::vector<uint8_t>(ri.header_size());
+		file::read(hi, 0, hdr.size(), hdr.data(), si).get();
+		s = archive::read_header(hdr.data(), hdr.size(), ri, bs, es);
+		require(!!(s & operation_status::success));
+
+		auto r = archive::read_index(hi, si, ri).move();
+		require(r.mapped() == (m == io_method::mmap && hi.mapped()));
+		require(r.record_count() == count);
+		for (auto k = 0; k != count; ++k) {
+			auto e = archive::seek(r, k);
+			require(e.offset == (off_t)idx.offset(k));
+			require(e.size == size_t(8 + 4 * (3 * k + 2)));
+		}
+
+		archive::offset_type ids[] = {3, 0, 4, 3};
+		auto b = file::buffer<mode::input>{buffer_constraints{buf.size()}};
+		auto n = archive::read_records(hi, r, ids, 4, b, si).get();
+		require(n == 2 * archive::seek(r, 3).size +
+			archive::seek(r, 0).size + archive::seek(r, 4).size);
+
+		auto p = b.data();
+		for (auto k : ids) {
+			s = archive::scan(p, n, ri, bs, es);
+			require(!!(s & operation_status::success));
+			p += bs.consumed();
+			n -= bs.consumed();
+
+			auto& t = ri.element();
+			require(std::get<0>(t) == (int32_t)k);
+			require(std::get<1>(t).size() == long(3 * k + 2));
+			for (auto i = 0; i != std::get<1>(t).size(); ++i) {
+				require(std::get<1>(t)(i) == 10 * k + i);
+			}
+		}
+		require(n == 0);
+	}
+
+	// The stream writer should emit the same index when asked to.
+	{
+		auto ho = file::open<open_mode::create_or_replace>(path, so).move();
+		archive::stream_writer<input_type, mode::output> w{ho, so, 64, 0,
+			true};
+		for (auto k = 0; k != count; ++k) {
+			auto a = archive::eigen_type<archive::vector<float>>(
+				3 * k + 2);
+			for (auto i = 0; i != a.size(); ++i) {
+				a(i) = 10 * k + i;
+			}
+			w.push_back(std::make_tuple(int32_t(k), a)).get();
+		}
+		w.finalize().get();
+		require(w.index().entries() == idx.entries());
+	}
+
+	auto si = file::strategy<mode::input>{path};
+	si.infer_defaults(access_mode::random);
+	auto hi = file::open<open_mode::read>(path, si).move();
+	require((size_t)*si.current_file_size() == buf.size());
+
+	auto ri = archive::io_state<input_type>{};
+	auto hdr = std::vector<uint8_t>(ri.header_size());
+	file::read(hi, 0, hdr.size(), hdr.data(), si).get();
+	s = archive::read_header(hdr.data(), hdr.size(), ri, bs, es);
+	require(!!(s & operation_status::success));
+	require(ri.element_count() == count);
+
+	auto r = archive::read_index(hi, si, ri).move();
+	require(r.record_count() == count);
+	for (auto k = 0; k != count + 1; ++k) {
+		require(r.offset(k) == idx.offset(k));
+	}
+	::unlink(path);
+}
+
+module("test parallel writer")
+{
+	namespace file = neo::file;
+	namespace archive = neo::archive;
+	using namespace neo;
+	using file::open_mode;
+	using mode = io_mode;
+
+	constexpr auto path = "data/archive/parallel.dsa";
+	using input_type = std::tuple<int32_t, archive::vector<float, 3>>;
+	using writer = archive::parallel_writer<input_type, mode::output>;
+
+	constexpr auto threads = 4;
+	constexpr auto block = 37;
+	constexpr auto count = 1000;
+
+	auto write = [&](io_method m) {
+		auto so = file::strategy<mode::output>(off_t{0},
+			off_t{64 * 1024}, blksize_t{4096});
+		so.infer_defaults(access_mode::sequential).write_method(m).
+			preallocate(m == io_method::mmap);
+		auto ho = file::open<open_mode::create_or_replace>(path, so).move();
+
+		writer w{ho, so, block};
+		require(w.mapped() == (m == io_method::mmap));
+
+		/*
+		** Each thread writes every `threads`th block, so the layout of
+		** the archive does not depend on how the threads are scheduled.
+		** The threads only record whether they succeeded; the results
+		** are checked on the main thread.
+		*/
+		auto ok = std::vector<char>(threads, 1);
+		auto work = [&](int t) {
+			auto r = writer::reservation{};
+			for (auto first = t * block; first < count;
+				first += threads * block)
+			{
+				auto n = std::min(block, count - first);
+				w.reserve(r, first, n);
+				for (auto i = first; i != first + n; ++i) {
+					auto v = archive::eigen_type<
+						archive::vector<float, 3>>{};
+					v << i, 2 * i, 3 * i;
+					r.push_back(std::make_tuple(int32_t(i), v));
+				}
+				if (!r.full() || !r.flush()) { ok[t] = 0; }
+			}
+		};
+
+		auto pool = std::vector<std::thread>{};
+		for (auto t = 1; t != threads; ++t) {
+			pool.emplace_back(work, t);
+		}
+		work(0);
+		for (auto& t : pool) { t.join(); }
+
+		for (auto t = 0; t != threads; ++t) { require(ok[t]); }
+		require(w.record_count() == count);
+		w.finalize().get();
+	};
+
+	for (auto m : {io_method::buffer, io_method::mmap}) {
+		write(m);
+
+		auto si = file::strategy<mode::input>{path};
+		si.infer_defaults(access_mode::sequential);
+		auto hi = file::open<open_mode::read>(path, si).move();
+
+		auto is = archive::io_state<input_type>{};
+		auto bs = archive::make_buffer_state<input_type>();
+		auto es = archive::error_state{};
+		require(*si.current_file_size() ==
+			off_t(is.header_size() + count * is.element_size()));
+
+		auto buf = std::vector<uint8_t>(*si.current_file_size());
+		file::read(hi, 0, buf.size(), buf.data(), si).get();
+		auto s = archive::read_header(buf.data(), buf.size(), is, bs, es);
+		require(!!(s & operation_status::success));
+		require(is.element_count() == count);
+
+		auto p = buf.data() + bs.consumed();
+		for (auto i = 0; i != count; ++i) {
+			s = archive::scan(p, is.element_size(), is, bs, es);
+			require(!!(s & operation_status::success));
+			p += bs.consumed();
+
+			auto& t = is.element();
+			require(std::get<0>(t) == i);
+			require(std::get<1>(t)(2) == 3 * i);
+		}
+	}
+	::unlink(path);
+}
+
+module("test stream writer")
+{
+	namespace file = neo::file;
+	namespace archive = neo::archive;
+	using namespace neo;
+	using file::open_mode;
+	using archive::dynamic;
+	using mode = io_mode;
+
+	constexpr auto path = "data/archive/stream.dsa";
+	using input_type = std::tuple<int32_t, archive::vector<float, dynamic>>;
+	using writer = archive::stream_writer<input_type, mode::output>;
+
+	constexpr auto count = 200;
+	auto record = [] (int i) {
+		auto v = archive::eigen_type<archive::vector<float, dynamic>>(
+			i % 50 + 1);
+		for (auto j = 0; j != v.size(); ++j) { v(j) = i + j; }
+		return std::make_tuple(int32_t(i), v);
+	};
+
+	/*
+	** Writes the records using a staging buffer that is smaller than
+	** most of them, so that it is flushed and enlarged many times.
+	*/
+	auto write = [&] (bool finalize) {
+		auto so = file::strategy<mode::output>(off_t{0},
+			off_t{64 * 1024}, blksize_t{4096});
+		so.infer_defaults(access_mode::sequential).preallocate(false);
+		auto ho = file::open<open_mode::create_or_replace>(path, so).move();
+
+		writer w{ho, so, 64};
+		for (auto i = 0; i != count; ++i) {
+			w.push_back(record(i)).get();
+		}
+		require(w.record_count() == count);
+		require(w.flushed_count() < count);
+
+		if (finalize) {
+			w.finalize().get();
+			require(w.flushed_count() == count);
+		}
+		else {
+			w.flush().get();
+		}
+	};
+
+	auto check = [&] (bool finalized, archive::offset_type n) {
+		auto si = file::strategy<mode::input>{path};
+		si.infer_defaults(access_mode::sequential);
+		auto hi = file::open<open_mode::read>(path, si).move();
+		auto buf = std::vector<uint8_t>(*si.current_file_size());
+		file::read(hi, 0, buf.size(), buf.data(), si).get();
+
+		auto is = archive::io_state<input_type>{};
+		auto bs = archive::make_buffer_state<input_type>();
+		auto es = archive::error_state{};
+		auto s = archive::read_header(buf.data(), buf.size(), is, bs, es);
+		require(!!(s & operation_status::success));
+		require(is.finalized() == finalized);
+		require(es.record_count() == (finalized ? 0 : 1));
+		require(is.element_count() == n);
+
+		if (!finalized) {
+			require(archive::recover_element_count(hi, si, is).get() ==
+				count);
+			require(is.element_count() == count);
+		}
+
+		auto p = buf.data() + is.header_size();
+		for (auto i = 0; i != count; ++i) {
+			auto m = buf.data() + buf.size() - p;
+			s = archive::scan(p, m, is, bs, es);
+			require(!!(s & operation_status::success));
+			p += bs.consumed();
+
+			auto& t = is.element();
+			require(std::get<0>(t) == i);
+			require(std::get<1>(t).size() == i % 50 + 1);
+			require(std::get<1>(t)(i % 50) == i + i % 50);
+		}
+		return (size_t)(p - buf.data());
+	};
+
+	write(true);
+	auto size = check(true, count);
+	require(*file::strategy<mode::input>{path}.current_file_size() ==
+		(off_t)size);
+
+	/*
+	** Simulate a crash after the last records were written, but before the
+	** record count in the header was updated, and before the next record
+	** was complete.
+	*/
+	write(false);
+	{
+		auto fd = file::safe_open(path, O_WRONLY).get();
+		auto hdr = archive::io_state<input_type>{}.header_size();
+		auto n = archive::unfinalized_count_flag | 150;
+		file::full_write(fd, (uint8_t*)&n, 8, hdr - 8).get();
+		auto tail = std::array<uint8_t, 12>{{10}};
+		file::full_write(fd, tail.data(), tail.size(), size).get();
+		file::safe_close(fd).get();
+	}
+	check(false, 150);
+	::unlink(path);
+}
+
+module("test crc32c")
+{
+	namespace archive = neo::archive;
+
+	auto s = std::string{"123456789"};
+	require(archive::crc32c((const uint8_t*)s.data(), s.size()) ==
+		0xE3069283);
+	require(archive::crc32c(nullptr, 0) == 0);
+
+	// The lengths cover both the interleaved lanes and the remainder.
+	auto buf = std::vector<uint8_t>(3 * 3 * 4096 + 29);
+	auto x = uint32_t{1};
+	for (auto& b : buf) {
+		x = 1664525 * x + 1013904223;
+		b = uint8_t(x >> 24);
+	}
+
+	for (auto n : {size_t{1}, size_t{7}, size_t{4096}, size_t{3 * 4096},
+		size_t{3 * 4096 + 5}, buf.size()})
+	{
+		auto c = archive::crc32c(buf.data(), n);
+		require(c == ~archive::detail::crc32c_update_generic(~0u,
+			buf.data(), n));
+
+		for (auto k : {size_t{0}, std::min<size_t>(3, n), n / 2, n}) {
+			auto c1 = archive::crc32c(buf.data(), k);
+			auto c2 = archive::crc32c(buf.data() + k, n - k);
+			require(archive::crc32c(buf.data() + k, n - k, c1) == c);
+			require(archive::crc32c_combine(c1, c2, n - k) == c);
+		}
+	}
+}
+
+module("test checksums")
+{
+	namespace file = neo::file;
+	namespace archive = neo::archive;
+	using namespace neo;
+	using file::open_mode;
+	using mode = io_mode;
+
+	constexpr auto path = "data/archive/checksum.dsa";
+	using input_type = std::tuple<int32_t, archive::vector<double, 5>>;
+	using writer = archive::stream_writer<input_type, mode::output>;
+
+	constexpr auto count = 500;
+	constexpr auto block = 1000;
+	{
+		auto so = file::strategy<mode::output>(off_t{0},
+			off_t{64 * 1024}, blksize_t{4096});
+		so.infer_defaults(access_mode::sequential).preallocate(false);
+		auto ho = file::open<open_mode::create_or_replace>(path, so).move();
+
+		writer w{ho, so, 4096, block};
+		require(w.has_checksums());
+		for (auto i = 0; i != count; ++i) {
+			auto v = archive::eigen_type<archive::vector<double, 5>>{};
+			v << i, i + 1, i + 2, i + 3, i + 4;
+			w.push_back(std::make_tuple(int32_t(i), v)).get();
+		}
+		w.finalize().get();
+	}
+
+	auto is = archive::io_state<input_type>{};
+	auto data = is.header_size() + count * is.element_size();
+	auto blocks = (data + block - 1) / block;
+
+	auto verify = [&] (size_t bad) {
+		auto si = file::strategy<mode::input>{path};
+		si.infer_defaults(access_mode::sequential);
+		auto hi = file::open<open_mode::read>(path, si).move();
+		require(*si.current_file_size() == off_t(data + 4 * blocks +
+			archive::checksum_trailer_size));
+
+		auto buf = std::vector<uint8_t>(data);
+		file::read(hi, 0, buf.size(), buf.data(), si).get();
+		auto bs = archive::make_buffer_state<input_type>();
+		auto es = archive::error_state{};
+		auto s = archive::read_header(buf.data(), buf.size(), is, bs, es);
+		require(!!(s & operation_status::success));
+		require(is.finalized() && is.element_count() == count);
+
+		auto t = archive::read_checksums(hi, si, is).move();
+		require(t.block_size() == block);
+		require(t.size() == data);
+		require(t.block_count() == blocks);
+
+		auto ces = archive::checksum_error_state{};
+		require(archive::verify_archive(hi, si, t, ces, 3,
+			4 * block).get() == bad);
+		require(ces.record_count() == bad);
+
+		// Inline verification of part of the data read above.
+		auto ies = archive::checksum_error_state{};
+		archive::verify_checksums(buf.data() + 1500, 4000, 1500, t, ies);
+		return std::make_pair(std::move(ces), std::move(ies));
+	};
+
+	auto r = verify(0);
+	require(r.second.record_count() == 0);
+
+	/*
+	** Corrupt a byte in the third block, and another in the last block,
+	** which is incomplete.
+	*/
+	{
+		auto fd = file::safe_open(path, O_WRONLY).get();
+		auto x = uint8_t{0xAB};
+		file::full_write(fd, &x, 1, 2 * block + 17).get();
+		file::full_write(fd, &x, 1, data - 1).get();
+		file::safe_close(fd).get();
+	}
+
+	r = verify(2);
+	auto& ces = r.first;
+	require(ces.record(0).context().element() == 2);
+	require(ces.record(0).context().offset() == 2 * block);
+	require(ces.record(1).context().element() == blocks - 1);
+	require(ces.record(1).context().offset() ==
+		off_t((blocks - 1) * block));
+
+	// Only blocks 2 through 4 lie entirely within [1500, 5500).
+	require(r.second.record_count() == 1);
+	require(r.second.record(0).context().element() == 2);
+	::unlink(path);
+}
+
+module("test shuffled reader")
+{
+	namespace file = neo::file;
+	namespace archive = neo::archive;
+	using namespace neo;
+	using file::open_mode;
+	using mode = io_mode;
+
+	constexpr auto path = "data/archive/shuffled.dsa";
+	using input_type = std::tuple<int32_t, archive::vector<float, 3>>;
+
+	constexpr auto count = 1000;
+	constexpr auto block = 8;
+	constexpr auto window = 4 * block;
+
+	{
+		auto so = file::strategy<mode::output>(off_t{0},
+			off_t{64 * 1024}, blksize_t{4096});
+		so.infer_defaults(access_mode::sequential).preallocate(false);
+		auto ho = file::open<open_mode::create_or_replace>(path, so).move();
+
+		archive::parallel_writer<input_type, mode::output> w{ho, so};
+		auto r = w.reserve(0, count);
+		for (auto i = 0; i != count; ++i) {
+			auto v = archive::eigen_type<archive::vector<float, 3>>{};
+			v << i, 2 * i, 3 * i;
+			r.push_back(std::make_tuple(int32_t(i), v));
+		}
+		r.flush().get();
+		w.finalize().get();
+	}
+
+	auto si = file::strategy<mode::input>{path};
+	si.infer_defaults(access_mode::sequential);
+	auto hi = file::open<open_mode::read>(path, si).move();
+
+	auto is = archive::io_state<input_type>{};
+	auto bs = archive::make_buffer_state<input_type>();
+	auto es = archive::error_state{};
+	auto hdr = std::vector<uint8_t>(is.header_size());
+	file::read(hi, 0, hdr.size(), hdr.data(), si).get();
+	archive::read_header(hdr.data(), hdr.size(), is, bs, es);
+
+	using reader = archive::shuffled_reader<input_type, mode::input>;
+	auto read_epoch = [&](reader& r) {
+		auto ids = std::vector<archive::offset_type>{};
+		while (r.next().get()) {
+			auto& t = r.element();
+			require(std::get<0>(t) == (int32_t)r.index());
+			require(std::get<1>(t)(2) == 3 * r.index());
+			ids.push_back(r.index());
+		}
+		return ids;
+	};
+
+	reader r1{hi, si, is, block, window, 42};
+	auto e0 = read_epoch(r1);
+	r1.begin_epoch(1);
+	auto e1 = read_epoch(r1);
+	require(e0 != e1);
+
+	for (const auto& e : {e0, e1}) {
+		auto sorted = e;
+		std::sort(sorted.begin(), sorted.end());
+		require(sorted.size() == count);
+		for (auto i = 0; i != count; ++i) {
+			require(sorted[i] == (archive::offset_type)i);
+		}
+
+		// Each window only holds records from four blocks.
+		for (auto i = size_t{0}; i < e.size(); i += window) {
+			auto blocks = std::vector<archive::offset_type>{};
+			for (auto j = i; j != std::min(i + window, e.size()); ++j) {
+				blocks.push_back(e[j] / block);
+			}
+			std::sort(blocks.begin(), blocks.end());
+			auto n = std::unique(blocks.begin(), blocks.end()) -
+				blocks.begin();
+			require(n <= 4);
+		}
+	}
+
+	// The permutations only depend on the seed and the epoch.
+	reader r2{hi, si, is, block, window, 42};
+	r2.begin_epoch(1);
+	require(read_epoch(r2) == e1);
+
+	// The last block has fewer records than the others.
+	reader r3{hi, si, is, 48, 96, 7};
+	auto e3 = read_epoch(r3);
+	std::sort(e3.begin(), e3.end());
+	require(e3.size() == count);
+	require(std::unique(e3.begin(), e3.end()) == e3.end());
+
+	// A window that cannot hold a single block is rejected.
+	auto thrown = false;
+	try { reader r4{hi, si, is, 64, 32}; }
+	catch (const std::invalid_argument&) { thrown = true; }
+	require(thrown);
+	::unlink(path);
+}
+
+module("test lz codec")
+{
+	namespace archive = neo::archive;
+
+	auto check = [&] (const std::vector<uint8_t>& a, size_t width) {
+		auto b = std::vector<uint8_t>(a.size());
+		auto c = std::vector<uint8_t>(a.size());
+		archive::shuffle(a.data(), a.size(), width, b.data());
+		archive::unshuffle(b.data(), b.size(), width, c.data());
+		require(c == a);
+
+		auto z = std::vector<uint8_t>(archive::lz_bound(a.size()));
+		auto n = archive::lz_compress(a.data(), a.size(), z.data(),
+			z.size());
+		require(n != 0);
+		auto d = std::vector<uint8_t>(a.size());
+		auto m = archive::lz_decompress(z.data(), n, d.data(), d.size());
+		require(m == a.size());
+		require(d == a);
+		return n;
+	};
+
+	// Incompressible data, short inputs, and long runs.
+	auto x = uint32_t{1};
+	auto a = std::vector<uint8_t>(100000);
+	for (auto& c : a) {
+		x = x * 1664525 + 1013904223;
+		c = x >> 24;
+	}
+	check(a, 4);
+	check(std::vector<uint8_t>{}, 4);
+	check(std::vector<uint8_t>(7, 1), 2);
+	require(check(std::vector<uint8_t>(100000, 7), 1) < 1000);
+
+	// Smoothly varying floats compress well once shuffled.
+	auto f = std::vector<float>(25000);
+	for (auto i = size_t{0}; i != f.size(); ++i) {
+		f[i] = 1000 + (i % 1000) * 0.5f;
+	}
+	auto p = (const uint8_t*)f.data();
+	auto n = check(std::vector<uint8_t>(p, p + 4 * f.size()), 4);
+	require(n < 2 * f.size());
+
+	// Truncated or corrupt streams are rejected.
+	auto z = std::vector<uint8_t>(archive::lz_bound(a.size()));
+	auto m = archive::lz_compress(p, 4 * f.size(), z.data(), z.size());
+	auto d = std::vector<uint8_t>(4 * f.size());
+	require(archive::lz_decompress(z.data(), m, d.data(), d.size() - 1) ==
+		~size_t{0});
+	require(archive::lz_decompress(z.data(), m - 1, d.data(), d.size()) !=
+		d.size());
+}
+
+module("test block compression")
+{
+	namespace archive = neo::archive;
+	using namespace neo;
+
+	using input_type = std::tuple<float, archive::vector<float, 15>>;
+	constexpr auto count = 10;
+	constexpr auto per_block = 4;
+	constexpr auto blocks = (count + per_block - 1) / per_block;
+
+	auto os = archive::io_state<input_type>{};
+	auto es = archive::error_state{};
+	auto bs = archive::make_buffer_state<input_type>();
+	os.element_count(count).compressed(true);
+
+	auto fmt = archive::default_block_format<input_type>(per_block);
+	require(fmt.method == archive::codec::lz);
+	require(fmt.shuffle_width == 4);
+
+	auto buf = std::vector<uint8_t>(os.header_size() +
+		archive::block_format_size);
+	archive::write_header(buf.data(), buf.size(), os, bs, es);
+	auto s = archive::write_block_format(buf.data() + os.header_size(),
+		archive::block_format_size, fmt, os, bs, es);
+	require(!!(s & operation_status::success));
+
+	auto elem = os.element_size();
+	auto raw = std::vector<uint8_t>(per_block * elem);
+	auto idx = archive::record_index{};
+	auto v = archive::eigen_type<archive::vector<float, 15>>{};
+
+	for (auto b = 0; b != blocks; ++b) {
+		auto k0 = b * per_block;
+		auto k1 = std::min(k0 + per_block, count);
+		for (auto k = k0; k != k1; ++k) {
+			v.setConstant(float(k));
+			archive::format(std::make_tuple(float(-k), v),
+				raw.data() + (k - k0) * elem, elem, os, bs, es);
+		}
+
+		auto n = (k1 - k0) * elem;
+		auto off = buf.size();
+		buf.resize(off + archive::max_frame_size(n));
+		s = archive::compress_block(raw.data(), n, buf.data() + off,
+			buf.size() - off, fmt, os, bs, es);
+		require(!!(s & operation_status::success));
+		require(bs.consumed() < n);
+		buf.resize(off + bs.consumed());
+		idx.push_back(off);
+	}
+	idx.push_back(buf.size());
+
+	// Compressed archives are only accepted if the caller asks for them.
+	auto ps = archive::io_state<input_type>{};
+	auto pes = archive::error_state{};
+	bs = archive::make_buffer_state<input_type>();
+	s = archive::read_header(buf.data(), buf.size(), ps, bs, pes);
+	require(!!(s & operation_status::fatal_error));
+	require(pes.record_count() == 1);
+
+	auto is = archive::io_state<input_type>{};
+	is.compressed(true);
+	s = archive::read_header(buf.data(), buf.size(), is, bs, es);
+	require(!!(s & operation_status::success));
+	require(is.compressed());
+
+	auto f = archive::block_format{};
+	s = archive::read_block_format(buf.data() + is.header_size(),
+		archive::block_format_size, f, is, bs, es);
+	require(!!(s & operation_status::success));
+	require(f.records_per_block == per_block);
+
+	const uint8_t* src[blocks];
+	uint8_t* dst[blocks];
+	size_t n[blocks];
+	size_t cap[blocks];
+	auto out = std::vector<std::vector<uint8_t>>(blocks);
+	for (auto b = 0; b != blocks; ++b) {
+		auto e = archive::seek(idx, b);
+		src[b] = buf.data() + e.offset;
+		n[b] = e.size;
+		out[b].resize(archive::block_size(src[b], is));
+		dst[b] = out[b].data();
+		cap[b] = out[b].size();
+	}
+
+	s = archive::decompress_blocks(src, n, dst, cap, blocks, f, is, es, 3);
+	require(!!(s & operation_status::success));
+
+	for (auto b = 0; b != blocks; ++b) {
+		auto k0 = b * per_block;
+		auto m = out[b].size() / elem;
+		require(m == size_t(std::min(per_block, count - k0)));
+
+		s = archive::scan_n(dst[b], out[b].size(), m, is, bs, es);
+		require(!!(s & operation_status::success));
+		for (auto k = size_t{0}; k != m; ++k) {
+			require(std::get<0>(is.batch())(0, k) == -float(k0 + k));
+			require((std::get<1>(is.batch()).col(k).array() ==
+				float(k0 + k)).all());
+		}
+	}
+
+	// A truncated block is reported, and the others are unaffected.
+	n[1] = archive::frame_header_size + 1;
+	s = archive::decompress_blocks(src, n, dst, cap, blocks, f, is, es);
+	require(!!(s & operation_status::recoverable_error));
+	require(es.record_count(severity::error) == 1);
+
+	/*
+	** A block whose frame header claims more bytes than the destination
+	** can hold is skipped, rather than decompressed past its end.
+	*/
+	auto bad = std::vector<uint8_t>(src[0], src[0] + n[0]);
+	auto big = uint32_t(cap[0] + 1);
+	std::memcpy(bad.data(), &big, 4);
+	auto bes = archive::error_state{};
+	s = archive::decompress_block(bad.data(), bad.size(), dst[0], cap[0],
+		f, is, bs, bes);
+	require(!!(s & operation_status::recoverable_error));
+	require(bes.record_count(severity::error) == 1);
+	require(bs.consumed() == bad.size());
+}
+
+module("test columnar layout")
+{
+	namespace file = neo::file;
+	namespace archive = neo::archive;
+	using namespace neo;
+	using file::open_mode;
+	using mode = io_mode;
+	using archive::storage_order;
+
+	constexpr auto path = "data/archive/columnar.dsa";
+	using n1 = archive::matrix<float, 4, 6, storage_order::row_major>;
+	using n2 = archive::vector<int16_t, 3>;
+	using n3 = int32_t;
+	using input_type = std::tuple<n1, n2, n3>;
+
+	constexpr auto count = 100;
+	constexpr auto per_group = 32;
+
+	auto os = archive::io_state<input_type>{};
+	auto es = archive::error_state{};
+	auto bs = archive::make_buffer_state<input_type>();
+	os.element_count(count).columnar(true);
+
+	auto buf = std::vector<uint8_t>(os.header_size() +
+		archive::column_format_size);
+	archive::write_header(buf.data(), buf.size(), os, bs, es);
+	auto s = archive::write_column_format(buf.data() + os.header_size(),
+		archive::column_format_size, archive::column_format{per_group},
+		os, bs, es);
+	require(!!(s & operation_status::success));
+
+	auto elem = os.element_size();
+	auto raw = std::vector<uint8_t>(per_group * elem);
+	auto a1 = archive::eigen_type<n1>{};
+	auto a2 = archive::eigen_type<n2>{};
+
+	for (auto k0 = 0; k0 < count; k0 += per_group) {
+		auto k1 = std::min(k0 + per_group, count);
+		for (auto k = k0; k != k1; ++k) {
+			for (auto i = 0; i != a1.rows(); ++i) {
+				for (auto j = 0; j != a1.cols(); ++j) {
+					a1(i, j) = 100 * k + a1.cols() * i + j;
+				}
+			}
+			a2 << k, -k, 2 * k;
+			archive::format(std::make_tuple(a1, a2, n3(-k)),
+				raw.data() + (k - k0) * elem, elem, os, bs, es);
+		}
+
+		auto off = buf.size();
+		buf.resize(off + (k1 - k0) * elem);
+		s = archive::write_row_group(raw.data(), k1 - k0,
+			buf.data() + off, buf.size() - off, os, bs, es);
+		require(!!(s & operation_status::success));
+	}
+
+	auto so = file::strategy<mode::output>(off_t{0}, off_t{64 * 1024},
+		blksize_t{4096});
+	so.infer_defaults(access_mode::sequential).preallocate(false);
+	auto ho = file::open<open_mode::create_or_replace>(path, so).move();
+	auto w = file::buffer<mode::output>{buffer_constraints{buf.size()}};
+	std::copy(buf.begin(), buf.end(), w.data());
+	file::write(ho, 0, buf.size(), w, so).get();
+
+	auto si = file::strategy<mode::input>{path};
+	si.infer_defaults(access_mode::random).read_method(io_method::buffer);
+	auto hi = file::open<open_mode::read>(path, si).move();
+
+	auto is = archive::io_state<input_type>{};
+	is.columnar(true);
+	bs = archive::make_buffer_state<input_type>();
+	s = archive::read_header(buf.data(), buf.size(), is, bs, es);
+	require(!!(s & operation_status::success));
+	require(is.columnar() && !is.compressed());
+
+	auto f = archive::column_format{};
+	s = archive::read_column_format(buf.data() + is.header_size(),
+		archive::column_format_size, f, is, bs, es);
+	require(!!(s & operation_status::success));
+	require(f.rows_per_group == per_group);
+	require(archive::row_group_count(f, is) == 4);
+	require(archive::row_group_size(f, is, 3) == 4);
+
+	auto b = file::buffer<mode::input>{buffer_constraints{per_group * elem}};
+	for (auto g = size_t{0}; g != archive::row_group_count(f, is); ++g) {
+		auto k0 = g * per_group;
+		auto rows = archive::row_group_size(f, is, g);
+
+		// Only the labels are read.
+		auto n = archive::read_columns<2>(hi, si, f, is, g, b).get();
+		require(n == rows * sizeof(n3));
+		s = archive::scan_columns<2>(b.data(), n, rows, is, bs, es);
+		require(!!(s & operation_status::success));
+		for (auto k = size_t{0}; k != rows; ++k) {
+			require(std::get<2>(is.batch())(0, k) == -int(k0 + k));
+		}
+
+		// The columns are placed in the order in which they are listed.
+		n = archive::read_columns<1, 0>(hi, si, f, is, g, b).get();
+		require(n == rows * (elem - sizeof(n3)));
+		s = archive::scan_columns<1, 0>(b.data(), n, rows, is, bs, es);
+		require(!!(s & operation_status::success));
+
+		auto& c1 = std::get<0>(is.batch());
+		auto& c2 = std::get<1>(is.batch());
+		require(c1.rows() == 24 && c2.rows() == 3);
+		for (auto k = size_t{0}; k != rows; ++k) {
+			auto x = int(k0 + k);
+			require(c2(0, k) == x && c2(1, k) == -x && c2(2, k) == 2 * x);
+			for (auto i = 0; i != 24; ++i) {
+				require(c1(i, k) == 100 * x + i);
+			}
+		}
+	}
+	::unlink(path);
+}
+
+/*
+** Reverses the byte order of the `n` scalars of `size` bytes each starting at
+** `p`, one byte at a time, so that the result does not depend on the kernels
+** being tested.
+*/
+uint8_t* reverse_scalars(uint8_t* p, size_t n, size_t size)
+{
+	for (auto i = size_t{0}; i != n; ++i, p += size) {
+		std::reverse(p, p + size);
+	}
+	return p;
+}
+
+module("test foreign byte order")
+{
+	namespace file = neo::file;
+	namespace archive = neo::archive;
+	using namespace neo;
+	using file::open_mode;
+	using archive::storage_order;
+
+	using n1 = int32_t;
+	using n2 = archive::vector<int16_t, 6>;
+	using n3 = archive::matrix<float, 3, 4, storage_order::row_major>;
+	using output_type = std::tuple<n1, n2, n3>;
+	using input_type = output_type;
+
+	constexpr auto count = 5;
+	auto os = archive::io_state<output_type>{};
+	auto es = archive::error_state{};
+	auto bs = archive::make_buffer_state<output_type>();
+	os.element_count(count);
+
+	auto hdr = os.header_size();
+	auto elem = os.element_size();
+	auto buf = std::vector<uint8_t>(hdr + count * elem);
+	archive::write_header(buf.data(), buf.size(), os, bs, es);
+
+	auto a2 = archive::eigen_type<n2>{};
+	auto a3 = archive::eigen_type<n3>{};
+	for (auto k = 0; k != count; ++k) {
+		for (auto i = 0; i != a2.size(); ++i) {
+			a2(i) = 1000 * k + i;
+		}
+		for (auto i = 0; i != a3.rows(); ++i) {
+			for (auto j = 0; j != a3.cols(); ++j) {
+				a3(i, j) = 100 * k + a3.cols() * i + j + 0.5f;
+			}
+		}
+		auto t = std::make_tuple(int32_t(-70000 * k), a2, a3);
+		archive::format(t, buf.data() + hdr + k * elem, elem, os, bs, es);
+	}
+
+	/*
+	** Convert the archive to the opposite byte order. The header consists
+	** of three bytes, followed by the descriptions of the components
+	** (2 + 6 + 11 bytes), and the record count.
+	*/
+	buf[1] = buf[1] == 0 ? 0x3 : 0x0;
+	reverse_scalars(&buf[7], 1, 4);
+	reverse_scalars(&buf[14], 2, 4);
+	reverse_scalars(&buf[22], 1, 8);
+	for (auto k = 0; k != count; ++k) {
+		auto p = buf.data() + hdr + k * elem;
+		p = reverse_scalars(p, 1, 4);
+		p = reverse_scalars(p, 6, 2);
+		p = reverse_scalars(p, 12, 4);
+	}
+
+	constexpr auto path = "data/archive/foreign.dsa";
+	{
+		auto fd = file::safe_open(path, O_WRONLY | O_CREAT | O_TRUNC).get();
+		file::full_write(fd, buf.data(), buf.size(), 0).get();
+		file::safe_close(fd).get();
+	}
+
+	auto strat = file::strategy<io_mode::input>{path};
+	strat.infer_defaults(access_mode::sequential);
+	auto h = file::open<open_mode::read>(path, strat).move();
+	auto fs = strat.current_file_size().get();
+	auto in = file::buffer<io_mode::input>{buffer_constraints{(size_t)fs}};
+	file::read(h, 0, fs, in, strat).get();
+	::unlink(path);
+
+	auto is = archive::io_state<input_type>{};
+	bs = archive::make_buffer_state<input_type>();
+	auto s = archive::read_header(in.data(), fs, is, bs, es);
+	require(!!(s & operation_status::success));
+	require(is.flip_integers() && is.flip_floats());
+	require(is.element_count() == count);
+
+	auto check = [&] (int k, int32_t x, const archive::eigen_type<n2>& v,
+		const archive::eigen_type<n3>& m)
+	{
+		require(x == -70000 * k);
+		for (auto i = 0; i != v.size(); ++i) {
+			require(v(i) == 1000 * k + i);
+		}
+		for (auto i = 0; i != m.rows(); ++i) {
+			for (auto j = 0; j != m.cols(); ++j) {
+				require(m(i, j) == 100 * k + m.cols() * i + j + 0.5f);
+			}
+		}
+	};
+
+	/*
+	** The first record is decoded using `scan`, and the remaining ones
+	** using `scan_n`.
+	*/
+	s = archive::scan(in.data() + hdr, elem, is, bs, es);
+	require(!!(s & operation_status::success));
+	check(0, std::get<0>(is.element()), std::get<1>(is.element()),
+		std::get<2>(is.element()));
+
+	s = archive::scan_n(in.data() + hdr + elem, (count - 1) * elem,
+		count - 1, is, bs, es);
+	require(!!(s & operation_status::success));
+	auto& b = is.batch();
+	for (auto k = 1; k != count; ++k) {
+		check(k, std::get<0>(b)(0, k - 1),
+			std::get<1>(b).col(k - 1),
+			Eigen::Map<archive::eigen_type<n3>>{
+				&std::get<2>(b)(0, k - 1)});
+	}
+}
+
+module("test dynamic io state")
+{
+	namespace archive = neo::archive;
+	using namespace neo;
+	using archive::storage_order;
+	using archive::dynamic;
+
+	using n1 = double;
+	using n2 = archive::vector<uint16_t, 3>;
+	using n3 = archive::matrix<float, 2, 3, storage_order::row_major>;
+	using output_type = std::tuple<n1, n2, n3>;
+
+	constexpr auto count = 4;
+	auto os = archive::io_state<output_type>{};
+	auto es = archive::error_state{};
+	auto bs = archive::make_buffer_state<output_type>();
+	os.element_count(count);
+
+	auto hdr = os.header_size();
+	auto elem = os.element_size();
+	auto buf = std::vector<uint8_t>(hdr + count * elem);
+	archive::write_header(buf.data(), buf.size(), os, bs, es);
+
+	auto a2 = archive::eigen_type<n2>{};
+	auto a3 = archive::eigen_type<n3>{};
+	for (auto k = 0; k != count; ++k) {
+		for (auto i = 0; i != a2.size(); ++i) {
+			a2(i) = 1000 * k + i;
+		}
+		for (auto i = 0; i != a3.rows(); ++i) {
+			for (auto j = 0; j != a3.cols(); ++j) {
+				a3(i, j) = 100 * k + a3.cols() * i + j + 0.5f;
+			}
+		}
+		auto t = std::make_tuple(k + 0.25, a2, a3);
+		archive::format(t, buf.data() + hdr + k * elem, elem, os, bs, es);
+	}
+
+	/*
+	** Convert the archive to the opposite byte order, as in the previous
+	** test, so that both the header and the records must be decoded.
+	*/
+	buf[1] = buf[1] == 0 ? 0x3 : 0x0;
+	reverse_scalars(&buf[7], 1, 4);
+	reverse_scalars(&buf[14], 2, 4);
+	reverse_scalars(&buf[22], 1, 8);
+	for (auto k = 0; k != count; ++k) {
+		auto p = buf.data() + hdr + k * elem;
+		p = reverse_scalars(p, 1, 8);
+		p = reverse_scalars(p, 3, 2);
+		p = reverse_scalars(p, 6, 4);
+	}
+
+	// The header is parsed in stages if the buffer is too small.
+	auto is = archive::dynamic_io_state{};
+	auto s = archive::read_header(buf.data(), 5, is, bs, es);
+	require(!!(s & operation_status::incomplete));
+	require(!!(s & operation_status::req_constr_update));
+	require(bs.consumed() == 0);
+
+	s = archive::read_header(buf.data(), buf.size(), is, bs, es);
+	require(!!(s & operation_status::success));
+	require(bs.consumed() == hdr);
+	require(is.header_size() == hdr);
+	require(is.element_size() == elem);
+	require(is.element_count() == count);
+	require(is.flip_integers() && is.flip_floats());
+	require(!is.is_dynamic());
+	require(is.component_count() == 3);
+	require(is.schema(0).scalar == archive::scalar_code<double>::value);
+	require(is.schema(0).dims == 0);
+	require(is.schema(1).scalar == archive::scalar_code<uint16_t>::value);
+	require(is.schema(1).dims == 1 && is.schema(1).rows == 3);
+	require(is.schema(2).dims == 2);
+	require(is.schema(2).order == storage_order::row_major);
+	require(is.schema(2).rows == 2 && is.schema(2).cols == 3);
+
+	for (auto k = 0; k != count; ++k) {
+		s = archive::scan(buf.data() + hdr + k * elem, elem, is, bs, es);
+		require(!!(s & operation_status::success));
+		require(bs.consumed() == elem);
+		require(is.component(0).value<double>() == k + 0.25);
+
+		auto v = is.component(1).map<uint16_t>();
+		require(v.rows() == 3 && v.cols() == 1);
+		for (auto i = 0; i != v.rows(); ++i) {
+			require(v(i, 0) == 1000 * k + i);
+		}
+		auto m = is.component(2).map<float>();
+		require(m.rows() == 2 && m.cols() == 3);
+		for (auto i = 0; i != m.rows(); ++i) {
+			for (auto j = 0; j != m.cols(); ++j) {
+				require(m(i, j) == 100 * k + m.cols() * i + j + 0.5f);
+			}
+		}
+	}
+
+	/*
+	** Elements with dynamic extents are decoded one at a time, and the
+	** views take on the extents of each element.
+	*/
+	using d1 = int32_t;
+	using d2 = archive::matrix<int16_t, dynamic, 2, storage_order::column_major>;
+	using dynamic_type = std::tuple<d1, d2>;
+
+	auto ds = archive::io_state<dynamic_type>{};
+	bs = archive::make_buffer_state<dynamic_type>();
+	ds.element_count(2);
+	hdr = ds.header_size();
+	buf.assign(hdr, 0);
+	archive::write_header(buf.data(), buf.size(), ds, bs, es);
+
+	auto sizes = std::vector<size_t>{};
+	for (auto k = 0; k != 2; ++k) {
+		auto a = archive::eigen_type<d2>(k + 2, 2);
+		for (auto i = 0; i != a.rows(); ++i) {
+			for (auto j = 0; j != a.cols(); ++j) {
+				a(i, j) = 10 * i + j;
+			}
+		}
+		auto n = size_t{4 + 4 + 2 * (size_t)a.size()};
+		auto off = buf.size();
+		buf.resize(off + n);
+		archive::format(std::make_tuple(int32_t(-k), a),
+			buf.data() + off, n, ds, bs, es);
+		sizes.push_back(n);
+	}
+
+	is = archive::dynamic_io_state{};
+	s = archive::read_header(buf.data(), buf.size(), is, bs, es);
+	require(!!(s & operation_status::success));
+	require(is.is_dynamic() && is.dynamic_extents() == 1);
+	require(is.min_element_size() == 8);
+	require(is.schema(1).rows == archive::dynamic_extent_code);
+
+	auto off = hdr;
+	for (auto k = 0; k != 2; ++k) {
+		s = archive::scan(buf.data() + off, sizes[k] - 1, is, bs, es);
+		require(!!(s & operation_status::incomplete));
+		require(*min_size(bs.required_constraints()) == sizes[k]);
+
+		s = archive::scan(buf.data() + off, sizes[k], is, bs, es);
+		require(!!(s & operation_status::success));
+		require(is.element_size() == sizes[k]);
+		require(is.component(0).value<int32_t>() == -k);
+
+		auto m = is.component(1).map<int16_t>();
+		require(m.rows() == k + 2 && m.cols() == 2);
+		for (auto i = 0; i != m.rows(); ++i) {
+			for (auto j = 0; j != m.cols(); ++j) {
+				require(m(i, j) == 10 * i + j);
+			}
+		}
+		off += sizes[k];
+	}
+}
+
+module("test narrow scalars")
+{
+	namespace archive = neo::archive;
+	using namespace neo;
+	using archive::storage_order;
+	using archive::dynamic;
+	using archive::float16;
+	using archive::bfloat16;
+	using archive::scaled_int8;
+
+	/*
+	** Every half is widened, and the results of the vectorized loop are
+	** compared to those of the scalar conversion.
+	*/
+	auto h = std::vector<float16>(65536);
+	for (auto i = size_t{0}; i != h.size(); ++i) {
+		h[i].bits = uint16_t(i);
+	}
+	auto f = std::vector<float>(h.size());
+	archive::widen_n(h.data(), h.size(), f.data());
+	for (auto i = size_t{0}; i != h.size(); ++i) {
+		auto x = archive::detail::half_to_float(h[i].bits);
+		require(std::isnan(x) ? std::isnan(f[i]) : f[i] == x);
+	}
+
+	// Narrowing the widened values recovers the original halves.
+	auto g = std::vector<float16>(h.size());
+	archive::narrow_n(f.data(), f.size(), g.data());
+	for (auto i = size_t{0}; i != h.size(); ++i) {
+		require(std::isnan(f[i]) || g[i].bits == h[i].bits);
+		require(archive::detail::float_to_half(f[i]) == g[i].bits ||
+			std::isnan(f[i]));
+	}
+
+	/*
+	** Values that lie between two halves, including the ties, which
+	** round to even. The number of values is not a multiple of eight, so
+	** that the scalar loop is also exercised.
+	*/
+	auto u = std::vector<float>{};
+	for (auto i = 0; i != 1000; ++i) {
+		u.push_back(std::ldexp(1.f + i / 4096.f, i % 40 - 30));
+		u.push_back(-u.back() * 1.5f);
+	}
+	u.push_back(1.f + std::ldexp(1.f, -11));
+	u.push_back(1.f + 3 * std::ldexp(1.f, -11));
+	u.push_back(65519.f);
+	u.push_back(65520.f);
+	u.push_back(std::ldexp(1.f, -25));
+	u.push_back(std::ldexp(1.5f, -25));
+
+	auto uh = std::vector<float16>(u.size());
+	auto ub = std::vector<bfloat16>(u.size());
+	archive::narrow_n(u.data(), u.size(), uh.data());
+	archive::narrow_n(u.data(), u.size(), ub.data());
+	for (auto i = size_t{0}; i != u.size(); ++i) {
+		require(uh[i].bits == archive::detail::float_to_half(u[i]));
+		require(ub[i].bits == archive::detail::float_to_bfloat(u[i]));
+	}
+
+	auto n = u.size();
+	require(archive::detail::half_to_float(uh[n - 6].bits) == 1.f);
+	require(archive::detail::half_to_float(uh[n - 5].bits) ==
+		1.f + std::ldexp(1.f, -9));
+	require(archive::detail::half_to_float(uh[n - 4].bits) == 65504.f);
+	require(std::isinf(archive::detail::half_to_float(uh[n - 3].bits)));
+	require(uh[n - 2].bits == 0);
+	require(uh[n - 1].bits == 1);
+
+	auto bf = std::vector<float>(ub.size());
+	archive::widen_n(ub.data(), ub.size(), bf.data());
+	for (auto i = size_t{0}; i != u.size(); ++i) {
+		require(std::abs(bf[i] - u[i]) <= std::abs(u[i]) / 256);
+	}
+	require(archive::detail::float_to_bfloat(1.f + std::ldexp(1.f, -8)) ==
+		archive::detail::float_to_bfloat(1.f));
+
+	/*
+	** Each scaled integer is within half of the scale of the original
+	** value, and the value with the largest magnitude is exact.
+	*/
+	auto si = std::vector<scaled_int8>(u.size());
+	auto sd = std::vector<double>(u.begin(), u.end());
+	auto scale = archive::narrow_n(sd.data(), sd.size(), si.data());
+	auto sf = std::vector<float>(si.size());
+	archive::widen_n(si.data(), si.size(), scale, sf.data());
+	for (auto i = size_t{0}; i != u.size(); ++i) {
+		require(std::abs(sf[i] - u[i]) <= scale * 0.5001f);
+		require(si[i].bits >= -127);
+	}
+	require(scale == archive::narrow_n(u.data(), u.size(), si.data()));
+
+	/*
+	** NaNs are quantized to zero, and do not affect the scale, both in
+	** the vectorized loop and in the scalar tail.
+	*/
+	auto nan = std::numeric_limits<float>::quiet_NaN();
+	auto un = u;
+	un[3] = un[un.size() - 1] = nan;
+	auto sn = std::vector<scaled_int8>(un.size());
+	require(archive::narrow_n(un.data(), un.size(), sn.data()) == scale);
+	require(sn[3].bits == 0 && sn[sn.size() - 1].bits == 0);
+
+	/*
+	** Round trip through an archive. The matrix is read in the opposite
+	** storage order, so that the widened coefficients are transposed.
+	*/
+	using n1 = float16;
+	using n2 = archive::vector<bfloat16, 21>;
+	using n3 = archive::matrix<float16, 3, 5, storage_order::row_major>;
+	using n4 = archive::vector<scaled_int8, 19>;
+	using m3 = archive::matrix<float16, 3, 5, storage_order::column_major>;
+	using output_type = std::tuple<n1, n2, n3, n4>;
+	using input_type = std::tuple<n1, n2, m3, n4>;
+
+	// The scaled vector is preceded by its scale.
+	require(archive::element_size<output_type>::value ==
+		2 + 2 * 21 + 2 * 15 + 4 + 19);
+	require(archive::widened_size<output_type>::value == 1 + 21 + 15 + 19);
+	require((std::is_same<
+		archive::eigen_type<n2>, Eigen::Matrix<float, 21, 1>>::value));
+
+	constexpr auto count = 6;
+	auto os = archive::io_state<output_type>{};
+	auto es = archive::error_state{};
+	auto bs = archive::make_buffer_state<output_type>();
+	os.element_count(count);
+
+	auto hdr = os.header_size();
+	auto elem = os.element_size();
+	auto buf = std::vector<uint8_t>(hdr + count * elem);
+	archive::write_header(buf.data(), buf.size(), os, bs, es);
+
+	auto a2 = Eigen::Matrix<double, 21, 1>{};
+	auto a3 = archive::eigen_type<n3>{};
+	auto a4 = archive::eigen_type<n4>{};
+	for (auto k = 0; k != count; ++k) {
+		for (auto i = 0; i != a2.size(); ++i) {
+			a2(i) = 4 * k + i;
+		}
+		for (auto i = 0; i != a3.rows(); ++i) {
+			for (auto j = 0; j != a3.cols(); ++j) {
+				a3(i, j) = 0.25f * (a3.cols() * i + j) + k;
+			}
+		}
+		for (auto i = 0; i != a4.size(); ++i) {
+			a4(i) = (i - 9) * (k + 1);
+		}
+		auto t = std::make_tuple(0.5 * k, a2, a3, a4);
+		auto s = archive::format(t, buf.data() + hdr + k * elem, elem,
+			os, bs, es);
+		require(!!(s & operation_status::success));
+	}
+
+	auto is = archive::io_state<input_type>{};
+	bs = archive::make_buffer_state<input_type>();
+	auto s = archive::read_header(buf.data(), buf.size(), is, bs, es);
+	require(!!(s & operation_status::success));
+	require(is.transpose_matrix(0));
+
+	auto check = [&] (int k, float x, const Eigen::Matrix<float, 21, 1>& v,
+		const archive::eigen_type<m3>& m, const Eigen::VectorXf& w)
+	{
+		require(x == 0.5f * k);
+		for (auto i = 0; i != v.size(); ++i) {
+			require(v(i) == 4 * k + i);
+		}
+		for (auto i = 0; i != m.rows(); ++i) {
+			for (auto j = 0; j != m.cols(); ++j) {
+				require(m(i, j) == 0.25f * (m.cols() * i + j) + k);
+			}
+		}
+		// The scale is 9 * (k + 1) / 127.
+		for (auto i = 0; i != w.size(); ++i) {
+			require(std::abs(w(i) - (i - 9) * (k + 1)) <=
+				(k + 1) * 9.0001f / 254);
+		}
+	};
+
+	s = archive::scan(buf.data() + hdr, elem, is, bs, es);
+	require(!!(s & operation_status::success));
+	check(0, std::get<0>(is.element()), std::get<1>(is.element()),
+		std::get<2>(is.element()), std::get<3>(is.element()));
+
+	s = archive::scan_n(buf.data() + hdr + elem, (count - 1) * elem,
+		count - 1, is, bs, es);
+	require(!!(s & operation_status::success));
+	auto& b = is.batch();
+	for (auto k = 1; k != count; ++k) {
+		check(k, std::get<0>(b)(0, k - 1), std::get<1>(b).col(k - 1),
+			Eigen::Map<archive::eigen_type<m3>>{
+				&std::get<2>(b)(0, k - 1)},
+			std::get<3>(b).col(k - 1));
+	}
+
+	// Components with dynamic extents, read using both interfaces.
+	using d1 = archive::vector<float16, dynamic>;
+	using d2 = archive::matrix<scaled_int8, dynamic, 2>;
+	using dynamic_type = std::tuple<d1, d2>;
+
+	auto ds = archive::io_state<dynamic_type>{};
+	bs = archive::make_buffer_state<dynamic_type>();
+	ds.element_count(1);
+	buf.assign(256, 0);
+	archive::write_header(buf.data(), buf.size(), ds, bs, es);
+	hdr = bs.consumed();
+
+	auto v1 = Eigen::VectorXf{11};
+	auto v2 = Eigen::MatrixXd{4, 2};
+	for (auto i = 0; i != v1.size(); ++i) { v1(i) = i - 0.5f; }
+	v2 << 1, -2, 3, -4, 5, -6, 7, -127;
+	s = archive::format(std::make_tuple(v1, v2), buf.data() + hdr,
+		buf.size() - hdr, ds, bs, es);
+	require(!!(s & operation_status::success));
+	require(bs.consumed() == 8 + 2 * 11 + 4 + 8);
+
+	auto copy = buf;
+	auto dr = archive::io_state<dynamic_type>{};
+	s = archive::read_header(buf.data(), buf.size(), dr, bs, es);
+	require(!!(s & operation_status::success));
+	s = archive::scan(buf.data() + hdr, buf.size() - hdr, dr, bs, es);
+	require(!!(s & operation_status::success));
+	require(std::get<0>(dr.element()) == v1);
+	require(std::get<1>(dr.element()) == v2.cast<float>());
+
+	auto dis = archive::dynamic_io_state{};
+	s = archive::read_header(copy.data(), copy.size(), dis, bs, es);
+	require(!!(s & operation_status::success));
+	s = archive::scan(copy.data() + hdr, copy.size() - hdr, dis, bs, es);
+	require(!!(s & operation_status::success));
+	auto& c = dis.component(1);
+	require(c.scalar == archive::scalar_code<scaled_int8>::value);
+	require(c.scale == 1.f && c.rows == 4 && c.cols == 2);
+	require(dis.element_size() == 8 + 2 * 11 + 4 + 8);
+}
+
+module("test scalar conversion")
+{
+	namespace archive = neo::archive;
+	using namespace neo;
+	using archive::storage_order;
+	using archive::float16;
+	using archive::scaled_int8;
+	using archive::conversion_policy;
+	using archive::scalar_code;
+
+	require(archive::is_lossless_conversion(
+		scalar_code<int16_t>::value, scalar_code<float>::value));
+	require(archive::is_lossless_conversion(
+		scalar_code<uint32_t>::value, scalar_code<int64_t>::value));
+	require(archive::is_lossless_conversion(
+		scalar_code<float16>::value, scalar_code<double>::value));
+	require(!archive::is_lossless_conversion(
+		scalar_code<int32_t>::value, scalar_code<float>::value));
+	require(!archive::is_lossless_conversion(
+		scalar_code<int8_t>::value, scalar_code<uint64_t>::value));
+	require(!archive::is_lossless_conversion(
+		scalar_code<double>::value, scalar_code<float>::value));
+	require(archive::is_lossless_conversion(
+		scalar_code<archive::bfloat16>::value, scalar_code<float>::value));
+	require(!archive::is_lossless_conversion(
+		scalar_code<archive::bfloat16>::value,
+		scalar_code<float16>::value));
+	require(!archive::is_lossless_conversion(
+		scalar_code<float16>::value,
+		scalar_code<archive::bfloat16>::value));
+	require(!archive::is_conversion_allowed(scalar_code<float>::value,
+		scalar_code<int32_t>::value, conversion_policy::lossy));
+	require(archive::is_conversion_allowed(scalar_code<int64_t>::value,
+		scalar_code<float>::value, conversion_policy::lossy));
+
+	using w1 = int16_t;
+	using w2 = archive::vector<uint8_t, 10>;
+	using w3 = archive::matrix<float, 3, 4, storage_order::row_major>;
+	using w4 = archive::vector<float16, 9>;
+	using w5 = archive::vector<scaled_int8, 5>;
+	using w6 = archive::vector<double, 5>;
+	using r2 = archive::vector<float, 10>;
+	using r3 = archive::matrix<double, 3, 4, storage_order::column_major>;
+	using r4 = archive::vector<double, 9>;
+	using r5 = archive::vector<float, 5>;
+	using output_type = std::tuple<w1, w2, w3, w4, w5, w6>;
+	using input_type = std::tuple<float, r2, r3, r4, r5, r5>;
+
+	constexpr auto count = 3;
+	auto os = archive::io_state<output_type>{};
+	auto es = archive::error_state{};
+	auto bs = archive::make_buffer_state<output_type>();
+	os.element_count(count);
+
+	auto hdr = os.header_size();
+	auto elem = os.element_size();
+	auto buf = std::vector<uint8_t>(hdr + count * elem);
+	archive::write_header(buf.data(), buf.size(), os, bs, es);
+
+	auto a2 = archive::eigen_type<w2>{};
+	auto a3 = archive::eigen_type<w3>{};
+	auto a4 = archive::eigen_type<w4>{};
+	auto a5 = archive::eigen_type<w5>{};
+	auto a6 = archive::eigen_type<w6>{};
+	for (auto k = 0; k != count; ++k) {
+		for (auto i = 0; i != a2.size(); ++i) { a2(i) = 25 * i + k; }
+		for (auto i = 0; i != a3.rows(); ++i) {
+			for (auto j = 0; j != a3.cols(); ++j) {
+				a3(i, j) = 0.5f * (a3.cols() * i + j) - k;
+			}
+		}
+		for (auto i = 0; i != a4.size(); ++i) { a4(i) = 0.25f * i + k; }
+		for (auto i = 0; i != a5.size(); ++i) { a5(i) = 127 * (i - 2); }
+		for (auto i = 0; i != a6.size(); ++i) { a6(i) = 1 + i * 1e-3 + k; }
+		auto t = std::make_tuple(int16_t(-300 * k), a2, a3, a4, a5, a6);
+		auto s = archive::format(t, buf.data() + hdr + k * elem, elem,
+			os, bs, es);
+		require(!!(s & operation_status::success));
+	}
+
+	/*
+	** The conversions from `double` to `float` are not lossless, and
+	** conversions are rejected by default.
+	*/
+	for (auto p : {conversion_policy::none, conversion_policy::lossless}) {
+		auto is = archive::io_state<input_type>{};
+		auto bs = archive::make_buffer_state<input_type>();
+		auto es = archive::error_state{};
+		is.conversion(p);
+		auto s = archive::read_header(buf.data(), buf.size(), is, bs,
+			es);
+		require(!(s & operation_status::success));
+	}
+
+	auto is = archive::io_state<input_type>{};
+	auto ibs = archive::make_buffer_state<input_type>();
+	is.conversion(conversion_policy::lossy);
+	auto s = archive::read_header(buf.data(), buf.size(), is, ibs, es);
+	require(!!(s & operation_status::success));
+	require(is.converted() && is.element_size() == elem);
+	require(is.transpose_matrix(0));
+
+	// Converted elements cannot be scanned in place.
+	auto ces = archive::error_state{};
+	s = archive::scan(buf.data() + hdr, elem, is, ibs, ces);
+	require(!!(s & operation_status::fatal_error));
+	require(ibs.consumed() == 0);
+	require(ces.record_count() == 1);
+
+	auto dst = archive::eigen_type<input_type>{};
+	for (auto k = 0; k != count; ++k) {
+		s = archive::scan(buf.data() + hdr + k * elem, elem, is, ibs,
+			es, dst);
+		require(!!(s & operation_status::success));
+		require(ibs.consumed() == elem);
+
+		require(std::get<0>(dst) == -300 * k);
+		auto& v2 = std::get<1>(dst);
+		for (auto i = 0; i != v2.size(); ++i) {
+			require(v2(i) == 25 * i + k);
+		}
+		auto& m3 = std::get<2>(dst);
+		for (auto i = 0; i != m3.rows(); ++i) {
+			for (auto j = 0; j != m3.cols(); ++j) {
+				require(m3(i, j) == 0.5 * (m3.cols() * i + j) - k);
+			}
+		}
+		auto& v4 = std::get<3>(dst);
+		for (auto i = 0; i != v4.size(); ++i) {
+			require(v4(i) == 0.25 * i + k);
+		}
+		// The scale is 2.
+		auto& v5 = std::get<4>(dst);
+		for (auto i = 0; i != v5.size(); ++i) {
+			require(std::abs(v5(i) - 127 * (i - 2)) <= 1);
+		}
+		auto& v6 = std::get<5>(dst);
+		for (auto i = 0; i != v6.size(); ++i) {
+			require(v6(i) == float(1 + i * 1e-3 + k));
+		}
+	}
+}
+
+module("test bswap kernels")
+{
+	namespace archive = neo::archive;
+
+	/*
+	** The lengths are chosen so that both the vectorized loops and the
+	** scalar loop for the remainder are exercised.
+	*/
+	auto v8 = std::vector<uint64_t>(67);
+	auto v4 = std::vector<uint32_t>(67);
+	auto v2 = std::vector<uint16_t>(67);
+	for (auto i = size_t{0}; i != v8.size(); ++i) {
+		v8[i] = 0x0102030405060708ull * (i + 1);
+		v4[i] = 0x01020304u * (i + 1);
+		v2[i] = uint16_t(0x0102u * (i + 1));
+	}
+
+	auto w8 = v8;
+	auto w4 = v4;
+	auto w2 = v2;
+	archive::bswap_n(w8.data() + 1, w8.size() - 1);
+	archive::bswap_n(w4.data() + 1, w4.size() - 1);
+	archive::bswap_n((uint8_t*)(w2.data() + 1), w2.size() - 1, 2);
+
+	require(w8[0] == v8[0] && w4[0] == v4[0] && w2[0] == v2[0]);
+	for (auto i = size_t{1}; i != v8.size(); ++i) {
+		require(w8[i] == __builtin_bswap64(v8[i]));
+		require(w4[i] == __builtin_bswap32(v4[i]));
+		require(w2[i] == __builtin_bswap16(v2[i]));
+	}
+}
+
+template <class Scalar>
+bool check_transpose(size_t rows, size_t cols)
+{
+	namespace archive = neo::archive;
+	auto a = std::vector<Scalar>(rows * cols);
+	auto b = std::vector<Scalar>(rows * cols);
+	for (auto i = size_t{0}; i != a.size(); ++i) {
+		a[i] = Scalar(i % 1000);
+	}
+
+	archive::transpose(a.data(), b.data(), rows, cols);
+	auto c = a;
+	archive::transpose_in_place(c.data(), rows, cols);
+
+	for (auto i = size_t{0}; i != rows; ++i) {
+		for (auto j = size_t{0}; j != cols; ++j) {
+			auto x = a[i * cols + j];
+			if (b[j * rows + i] != x || c[j * rows + i] != x) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+module("test transpose")
+{
+	/*
+	** The sizes are chosen so that both full and partial tiles, and both
+	** full and partial 4 by 4 blocks, are exercised.
+	*/
+	require(check_transpose<float>(37, 37));
+	require(check_transpose<float>(64, 64));
+	require(check_transpose<float>(13, 37));
+	require(check_transpose<int32_t>(50, 19));
+	require(check_transpose<double>(40, 40));
+	require(check_transpose<double>(9, 70));
+	require(check_transpose<int16_t>(38, 53));
+	require(check_transpose<int8_t>(130, 130));
+	require(check_transpose<float>(1, 20));
+}
+
 suite("Tests the archive IO facilities.")
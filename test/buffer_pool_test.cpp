@@ -0,0 +1,91 @@
+/*
+** File Name: buffer_pool_test.cpp
+** Author:    Aditya Ramesh
+** Date:      07/24/2014
+** Contact:   _@adityaramesh.com
+*/
+
+#include <thread>
+#include <vector>
+#include <ccbase/unit_test.hpp>
+#include <neo/core/file/buffer_pool.hpp>
+
+module("test size classes")
+{
+	namespace file = neo::file;
+	using file::detail::size_class;
+	using file::detail::class_size;
+
+	require(class_size(size_class(1)) == 4096);
+	require(class_size(size_class(4096)) == 4096);
+	require(class_size(size_class(4097)) == 5120);
+	require(class_size(size_class(8192)) == 8192);
+	require(class_size(size_class(15000)) == 16384);
+	require(class_size(size_class(40000)) == 40960);
+
+	for (auto n = size_t{1}; n < (size_t{1} << 24); n = 3 * n / 2 + 1) {
+		auto c = class_size(size_class(n));
+		require(c >= n);
+		require(n <= 4096 || c - n <= c / 4);
+	}
+}
+
+module("test reuse")
+{
+	namespace file = neo::file;
+	using neo::io_mode::input;
+
+	auto p = file::buffer_pool{};
+	auto bc = neo::buffer_constraints{100000};
+	bc.align_to(512);
+
+	{
+		auto b = p.allocate<input>(bc);
+		require(b.size() == 100000);
+		require(b.pooled_memory());
+		require((uintptr_t)b.data() % 4096 == 0);
+	}
+	require(p.fresh_allocations() == 1);
+
+	for (auto i = 0; i != 100; ++i) {
+		auto b1 = p.allocate<input>(bc);
+		auto b2 = p.allocate<input>(bc);
+		require(b1.data() != b2.data());
+	}
+	require(p.fresh_allocations() == 2);
+}
+
+module("test outlive pool")
+{
+	namespace file = neo::file;
+	using neo::io_mode::input;
+
+	auto b = file::buffer<input>{neo::buffer_constraints{1}};
+	{
+		auto p = file::buffer_pool{};
+		b = p.allocate<input>(neo::buffer_constraints{8192});
+	}
+	b.data()[8191] = 1;
+}
+
+module("test threads")
+{
+	namespace file = neo::file;
+	using neo::io_mode::input;
+
+	auto p = file::buffer_pool{};
+	auto ts = std::vector<std::thread>{};
+
+	for (auto i = 0; i != 4; ++i) {
+		ts.emplace_back([&] {
+			for (auto j = 0; j != 1000; ++j) {
+				auto b = p.allocate<input>(neo::buffer_constraints{65536});
+				b.data()[j] = (uint8_t)j;
+			}
+		});
+	}
+	for (auto& t : ts) { t.join(); }
+	require(p.fresh_allocations() <= 4);
+}
+
+suite("Tests the buffer pool.")
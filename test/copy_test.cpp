@@ -0,0 +1,101 @@
+/*
+** File Name: copy_test.cpp
+** Author:    Aditya Ramesh
+** Date:      07/25/2014
+** Contact:   _@adityaramesh.com
+*/
+
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <ccbase/format.hpp>
+#include <ccbase/unit_test.hpp>
+#include <neo/core/file/copy.hpp>
+
+static std::string contents(const char* path)
+{
+	auto is = std::ifstream{path};
+	return std::string{std::istreambuf_iterator<char>{is},
+		std::istreambuf_iterator<char>{}};
+}
+
+module("test copy path")
+{
+	namespace file = neo::file;
+	using file::replace_policy;
+
+	auto src = "data/text/moby_dick.txt";
+	auto dst = "data/copy.tmp";
+	std::remove(dst);
+
+	auto r = file::copy(src, dst).move();
+	require(r.bytes == contents(src).size());
+	require(r.method != file::copy_method::none);
+	require(contents(dst) == contents(src));
+
+	require(!file::copy(src, dst, replace_policy::fail_if_exists));
+	require(!!file::copy(src, dst, replace_policy::overwrite));
+
+	// Only `truncate` discards the bytes past the end of the copy.
+	{
+		std::ofstream os{dst, std::ios::app};
+		os << "tail";
+	}
+	require(!!file::copy(src, dst, replace_policy::overwrite));
+	require(contents(dst) == contents(src) + "tail");
+	require(!!file::copy(src, dst, replace_policy::truncate));
+	require(contents(dst) == contents(src));
+	std::remove(dst);
+}
+
+module("test copy range")
+{
+	using namespace neo;
+	namespace file = neo::file;
+	using file::open_mode;
+	using file::replace_policy;
+
+	auto src = "data/text/moby_dick.txt";
+	auto dst = "data/copy.tmp";
+	auto text = contents(src);
+
+	auto s1 = file::strategy<io_mode::input>{src};
+	s1.infer_defaults(access_mode::sequential);
+	auto h1 = file::open<open_mode::read>(src, s1).move();
+
+	auto s2 = file::strategy<io_mode::output>{"data"};
+	s2.infer_defaults(access_mode::sequential);
+	auto h2 = file::open<open_mode::create_or_replace>(dst, s2).move();
+
+	/*
+	** Copy two unaligned ranges, so that reflinks cannot be used, and
+	** check that progress is reported.
+	*/
+	auto calls = 0;
+	auto last = size_t{0};
+	auto r1 = file::copy(h1, 1001, h2, 0, 5000, replace_policy::overwrite,
+		buffer_constraints{1000}, [&] (size_t done, size_t len) {
+			require(done <= len);
+			last = done;
+			++calls;
+		}).move();
+	require(r1.bytes == 5000 && last == 5000 && calls > 0);
+
+	auto r2 = file::copy(h1, 17, h2, 5000, 100,
+		replace_policy::fail_if_exists).move();
+	require(r2.bytes == 100);
+	require(!file::copy(h1, 0, h2, 10, 100,
+		replace_policy::fail_if_exists));
+
+	// Ranges extending past the end of the source are shortened.
+	auto r3 = file::copy(h1, text.size() - 10, h2, 5100, 1000,
+		replace_policy::truncate).move();
+	require(r3.bytes == 10);
+
+	require(contents(dst) == text.substr(1001, 5000) + text.substr(17, 100) +
+		text.substr(text.size() - 10));
+	std::remove(dst);
+}
+
+suite("Tests the copy function.")
@@ -32,4 +32,51 @@ module("test open")
 	auto h2 = file::open<modify>(path, s2).move();
 }
 
+module("test map options")
+{
+	namespace file = neo::file;
+
+	using neo::access_mode::sequential;
+	using neo::io_mode::input;
+	using neo::io_method::mmap;
+	using neo::io_method::paging;
+	using neo::map_option::populate;
+	using neo::map_option::will_need;
+	using neo::map_option::huge_pages;
+	using neo::map_option::none;
+	using file::open_mode::read;
+
+	/*
+	** Returns the number of faults taken by the process while touching
+	** each page of a mapping created with the given options.
+	*/
+	auto path = "data/text/moby_dick.txt";
+	auto scan = [&] (neo::map_option opts) {
+		auto s = file::strategy<input>{path}.infer_defaults(sequential);
+		s.read_method(mmap | paging).map_options(opts);
+
+		auto h = file::open<read>(path, s).move();
+		require(h.mapped());
+		h.reset_faults();
+		auto sum = 0u;
+		for (auto i = size_t{0}; i < h.map_size(); i += 4096) {
+			sum += ((volatile uint8_t*)h.map())[i];
+		}
+		require(sum > 0);
+		return h.faults();
+	};
+
+	/*
+	** The first scan also brings the file into the page cache. When the
+	** pages are prefaulted, scanning the file takes fewer faults than
+	** when each page is faulted in on first access.
+	*/
+	scan(none);
+	auto lazy = scan(none);
+	auto eager = scan(populate | will_need | huge_pages);
+	require(lazy.major == 0 && eager.major == 0);
+	require(lazy.minor > 0);
+	require(eager.minor < lazy.minor);
+}
+
 suite("Tests the handle class.")
@@ -5,7 +5,10 @@
 ** Contact:   _@adityaramesh.com
 */
 
+#include <algorithm>
 #include <cstring>
+#include <thread>
+#include <vector>
 #include <ccbase/format.hpp>
 #include <ccbase/unit_test.hpp>
 #include <neo/core/file.hpp>
@@ -33,4 +36,164 @@ module("test read")
 	require(std::memcmp(b.data(), str2, 64) == 0);
 }
 
+module("test uring read")
+{
+	using namespace neo;
+	namespace file = neo::file;
+	using file::open_mode;
+	constexpr auto path = "data/text/moby_dick.txt";
+
+	auto s = file::strategy<io_mode::input>{path};
+	s.infer_defaults(access_mode::sequential);
+	s.read_method(io_method::uring | io_method::paging).queue_depth(8);
+
+	auto h = file::open<open_mode::read>(path, s).move();
+	auto b = file::allocate_ibuffer(h, s);
+	file::register_buffer(h, b).get();
+
+	file::read(h, 0, 64, b, s).get();
+	require(std::memcmp(b.data(), str1, 64) == 0);
+
+	auto fs = s.current_file_size().get();
+	file::enqueue_read(h, 0, 64, b.data(), 0).get();
+	file::enqueue_read(h, fs - 64, 64, b.data() + 64, 1).get();
+	file::submit(h).get();
+
+	file::completion c[2];
+	auto n = size_t{0};
+	while (n != 2) {
+		n += file::reap(h, c + n, 2 - n).get();
+	}
+	require(c[0].result == 64 && c[1].result == 64);
+	require(std::memcmp(b.data(), str1, 64) == 0);
+	require(std::memcmp(b.data() + 64, str2, 64) == 0);
+
+	// A read past the end of the file completes as a short transfer.
+	file::enqueue_read(h, fs - 10, 64, b.data(), 2).get();
+	file::submit(h).get();
+	while (file::reap(h, c, 1).get() == 0) {}
+	require(c[0].tag == 2 && c[0].result == 10);
+	require(std::memcmp(b.data(), str2 + 54, 10) == 0);
+
+	/*
+	** Synchronous reads may be issued concurrently on the same handle.
+	** The threads only record whether their reads succeeded.
+	*/
+	constexpr auto threads = 4;
+	auto ok = std::vector<char>(threads, 1);
+	auto work = [&] (int t) {
+		uint8_t buf[64];
+		for (auto i = 0; i != 200; ++i) {
+			auto last = (i + t) % 2 == 1;
+			auto r = file::read(h, last ? fs - 64 : 0, 64, buf, s);
+			if (!r || std::memcmp(buf, last ? str2 : str1, 64) != 0) {
+				ok[t] = 0;
+			}
+		}
+	};
+	auto pool = std::vector<std::thread>{};
+	for (auto t = 1; t != threads; ++t) { pool.emplace_back(work, t); }
+	work(0);
+	for (auto& t : pool) { t.join(); }
+	for (auto t = 0; t != threads; ++t) { require(ok[t]); }
+}
+
+module("test read_batch")
+{
+	using namespace neo;
+	namespace file = neo::file;
+	using file::open_mode;
+	constexpr auto path = "data/text/moby_dick.txt";
+
+	auto s = file::strategy<io_mode::input>{path};
+	s.infer_defaults(access_mode::sequential);
+
+	auto h = file::open<open_mode::read>(path, s).move();
+	auto b = file::buffer<io_mode::input>{buffer_constraints{192}};
+	auto fs = s.current_file_size().get();
+
+	/*
+	** The first and last extents are listed out of order, and the first
+	** two are separated by a small gap, so they should be coalesced.
+	*/
+	file::extent e[3] = {{fs - 64, 64}, {0, 64}, {80, 64}};
+	auto calls = file::read_batch(h, e, 3, b, s, 4096).get();
+	require(calls == 2);
+	require(std::memcmp(b.data(), str2, 64) == 0);
+	require(std::memcmp(b.data() + 64, str1, 64) == 0);
+}
+
+module("test unaligned direct io")
+{
+	using namespace neo;
+	namespace file = neo::file;
+	using file::open_mode;
+	constexpr auto src = "data/text/moby_dick.txt";
+	constexpr auto path = "data/text/direct_test.tmp";
+
+	auto si = file::strategy<io_mode::input>{src};
+	si.infer_defaults(access_mode::sequential);
+	si.read_method(io_method::buffer | io_method::direct);
+
+	/*
+	** Both the offsets and the destination are unaligned, and the last
+	** read ends in the middle of the final block of the file.
+	*/
+	auto hi = file::open<open_mode::read>(src, si).move();
+	auto fs = si.current_file_size().get();
+	auto b = std::vector<uint8_t>(1024 + 1);
+	file::read(hi, 0, 64, b.data() + 1, si).get();
+	require(std::memcmp(b.data() + 1, str1, 64) == 0);
+	file::read(hi, fs - 64, 64, b.data() + 1, si).get();
+	require(std::memcmp(b.data() + 1, str2, 64) == 0);
+
+	file::extent e[2] = {{fs - 64, 64}, {0, 64}};
+	uint8_t* dst[2] = {b.data() + 1, b.data() + 129};
+	auto calls = file::read_batch(hi, e, dst, 2, si).get();
+	require(calls == 2);
+	require(std::memcmp(b.data() + 1, str2, 64) == 0);
+	require(std::memcmp(b.data() + 129, str1, 64) == 0);
+
+	using mode = io_mode;
+	auto so = file::strategy<mode::input | mode::output>(off_t{0},
+		off_t{4096}, blksize_t{4096});
+	so.infer_defaults(access_mode::random);
+	so.read_method(io_method::buffer | io_method::direct);
+	so.write_method(io_method::buffer | io_method::direct).preallocate(false);
+
+	auto ho = file::open<open_mode::create_or_replace>(path, so).move();
+	auto w = file::buffer<mode::input | mode::output>{buffer_constraints{256}};
+	std::fill_n(w.data(), 256, 'a');
+	file::write(ho, 0, 256, w, so).get();
+	std::copy_n(str1, 64, w.data());
+	file::write(ho, 100, 64, w, so).get();
+	require(file::safe_stat(path).get().st_size == 256);
+
+	file::read(ho, 90, 84, b.data() + 1, so).get();
+	require(std::count(b.data() + 1, b.data() + 11, 'a') == 10);
+	require(std::memcmp(b.data() + 11, str1, 64) == 0);
+	require(std::count(b.data() + 75, b.data() + 85, 'a') == 10);
+
+	file::write(ho, 250, 64, w, so).get();
+	require(file::safe_stat(path).get().st_size == 314);
+
+	/*
+	** The two adjacent extents are coalesced into one run, and the last
+	** extent extends the file.
+	*/
+	auto z = std::vector<uint8_t>(64, 'z');
+	file::extent we[3] = {{300, 20}, {5, 10}, {15, 5}};
+	const uint8_t* ws[3] = {z.data(), z.data() + 1, z.data() + 2};
+	calls = file::write_batch(ho, we, ws, 3, so).get();
+	require(calls == 2);
+	require(file::safe_stat(path).get().st_size == 320);
+
+	file::read(ho, 0, 320, b.data() + 1, so).get();
+	require(std::count(b.data() + 1, b.data() + 6, 'a') == 5);
+	require(std::count(b.data() + 6, b.data() + 21, 'z') == 15);
+	require(b[21] == 'a');
+	require(std::count(b.data() + 301, b.data() + 321, 'z') == 20);
+	::unlink(path);
+}
+
 suite("Tests the file IO functionality.")
@@ -0,0 +1,53 @@
+/*
+** File Name: prefetching_reader_test.cpp
+** Author:    Aditya Ramesh
+** Date:      07/22/2014
+** Contact:   _@adityaramesh.com
+*/
+
+#include <ccbase/format.hpp>
+#include <ccbase/unit_test.hpp>
+#include <neo/core/file.hpp>
+
+module("test carry over")
+{
+	using namespace neo;
+	namespace file = neo::file;
+	using file::open_mode;
+
+	constexpr auto path = "data/text/moby_dick.txt";
+	constexpr auto record_size = 37;
+
+	auto s = file::strategy<io_mode::input>{path};
+	s.infer_defaults(access_mode::sequential);
+	auto fs = s.current_file_size().get();
+
+	auto h1 = file::open<open_mode::read>(path, s).move();
+	auto h2 = file::open<open_mode::read>(path, s).move();
+	auto b = file::buffer<io_mode::input>{buffer_constraints{record_size}};
+
+	/*
+	** Pretend that the file consists of fixed-size records, none of which
+	** is aligned to the window boundaries.
+	*/
+	auto bs = buffer_state{};
+	bs.required_constraints().at_least(record_size);
+	bs.preferred_constraints().at_least(record_size);
+
+	file::prefetching_reader<io_mode::input> r{h1, s, bs, 0, fs, 3};
+	auto c = size_t{0};
+	auto off = off_t{0};
+
+	while (auto n = r.next(c).get()) {
+		require(r.offset() == off);
+		for (c = 0; c + record_size <= n; c += record_size) {
+			file::read(h2, off, record_size, b, s).get();
+			require(std::equal(b.data(), b.data() + record_size,
+				r.data() + c));
+			off += record_size;
+		}
+	}
+	require(off == fs - fs % record_size);
+}
+
+suite("Tests the prefetching_reader class.")
@@ -0,0 +1,96 @@
+/*
+** File Name: profile_test.cpp
+** Author:    Aditya Ramesh
+** Date:      07/24/2014
+** Contact:   _@adityaramesh.com
+*/
+
+#include <cstdio>
+#include <fstream>
+#include <ccbase/unit_test.hpp>
+#include <neo/core/file/calibrate.hpp>
+
+module("test save and load")
+{
+	namespace file = neo::file;
+	using neo::access_mode;
+	using neo::io_method;
+
+	auto p = file::profile{};
+	p.insert({1, access_mode::sequential, io_method::mmap | io_method::paging,
+		1024, io_method::buffer | io_method::paging, 4096});
+	p.insert({1, access_mode::random, io_method::buffer | io_method::direct,
+		4096, io_method::buffer | io_method::direct, 4096});
+	p.insert({1, access_mode::sequential, io_method::buffer | io_method::paging,
+		65536, io_method::buffer | io_method::paging, 4096});
+	require(p.entries().size() == 2);
+
+	auto path = "data/profile.tmp";
+	p.save(path).get();
+	auto q = file::profile::load(path).move();
+	std::remove(path);
+
+	require(q.entries().size() == 2);
+	auto e = q.lookup(1, access_mode::sequential);
+	require(!!e);
+	require(e->read_method == (io_method::buffer | io_method::paging));
+	require(e->read_size == 65536);
+	require(!q.lookup(2, access_mode::random));
+
+	// Entries with invalid or conflicting methods are rejected.
+	for (auto line : {"1 random 3 4096 9 4096", "1 random 9 4096 10 4096",
+		"1 random 24 4096 9 4096", "1 random 9 4096 1024 4096"})
+	{
+		std::ofstream os{path};
+		os << line << '\n';
+		os.close();
+		require(!file::profile::load(path));
+		std::remove(path);
+	}
+}
+
+module("test infer defaults")
+{
+	namespace file = neo::file;
+	using neo::access_mode;
+	using neo::io_method;
+	using neo::io_mode;
+
+	auto path = "data/text/moby_dick.txt";
+	auto s = file::strategy<io_mode::input>{path};
+	require(!!s.device());
+
+	auto p = file::profile{};
+	p.insert({*s.device(), access_mode::sequential,
+		io_method::mmap | io_method::paging, 1024 * 1024,
+		io_method::buffer | io_method::paging, 4096});
+
+	s.infer_defaults(access_mode::sequential, p);
+	require(*s.read_method() == (io_method::mmap | io_method::paging));
+	require(*min_size(s.preferred_constraints(io_mode::input)) >= 1024 * 1024);
+
+	s.infer_defaults(access_mode::random, p);
+	require(!!(*s.read_method() & io_method::direct));
+}
+
+module("test calibrate")
+{
+	namespace file = neo::file;
+	using neo::access_mode;
+	using neo::io_mode;
+
+	auto o = file::calibration_options{};
+	o.file_size = 4 * 1024 * 1024;
+	o.max_requests = 64;
+	o.trials = 1;
+
+	auto path = "data/calibrate.tmp";
+	for (auto m : {access_mode::sequential, access_mode::random}) {
+		auto e = file::calibrate(path, m, o).move();
+		require(e.mode == m);
+		require(e.read_size > 0 && e.write_size > 0);
+		require(e.device == *file::strategy<io_mode::input>{"data"}.device());
+	}
+}
+
+suite("Tests the IO profile and calibration.")
@@ -0,0 +1,56 @@
+/*
+** File Name: window_reader_test.cpp
+** Author:    Aditya Ramesh
+** Date:      07/25/2014
+** Contact:   _@adityaramesh.com
+*/
+
+#include <ccbase/format.hpp>
+#include <ccbase/unit_test.hpp>
+#include <neo/core/file.hpp>
+
+module("test straddling records")
+{
+	using namespace neo;
+	namespace file = neo::file;
+	using file::open_mode;
+
+	constexpr auto path = "data/text/moby_dick.txt";
+	constexpr auto record_size = 37;
+
+	auto s = file::strategy<io_mode::input>{path};
+	s.infer_defaults(access_mode::sequential);
+	s.read_method(io_method::mmap | io_method::paging)
+		.map_options(map_option::sequential)
+		.map_window(3 * ::getpagesize());
+	auto fs = s.current_file_size().get();
+
+	auto h = file::open<open_mode::read>(path, s).move();
+	require(!h.mapped());
+	auto b = file::buffer<io_mode::input>{buffer_constraints{record_size}};
+
+	/*
+	** Pretend that the file consists of fixed-size records, none of which
+	** is aligned to the window boundaries.
+	*/
+	auto bs = buffer_state{};
+	bs.required_constraints().at_least(record_size);
+
+	file::window_reader<io_mode::input> r{h, s, bs, 0, fs};
+	auto c = size_t{0};
+	auto off = off_t{0};
+
+	while (auto n = r.next(c).get()) {
+		require(r.offset() == off);
+		require(n <= r.window_size());
+		for (c = 0; c + record_size <= n; c += record_size) {
+			file::read(h, off, record_size, b, s).get();
+			require(std::equal(b.data(), b.data() + record_size,
+				r.data() + c));
+			off += record_size;
+		}
+	}
+	require(off == fs - fs % record_size);
+}
+
+suite("Tests the window_reader class.")